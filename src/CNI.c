@@ -107,7 +107,132 @@ static void display_failure(const Circuit* c, Comb* comb, int comb_len, SecretDe
   printf("])\n\n");
 }
 
-int compute_CNI(ParsedFile * pf, int cores, int t, int k) {
+static void ignore_failure(const Circuit* c, Comb* comb, int comb_len, SecretDep* secret_deps,
+                           void* data_void) {
+  (void) c; (void) comb; (void) comb_len; (void) secret_deps; (void) data_void;
+}
+
+static void print_progress(const Circuit* c, int size) {
+  printf("Checking CNI ==> %" PRIu64 " tuples of size %d to check...\n",
+         n_choose_k(size, c->deps->length), size);
+}
+
+// Checks whether the faulted circuit |c| has a failure of size at most
+// |t| using |cores| threads. If |print| is true, the progress and the
+// failure (if any) are printed.
+static int check_CNI_scenario(const Circuit* c, const DimRedData* dim_red_data,
+                              int cores, int t, bool print,
+                              struct callback_data* data) {
+  bool has_random = true;
+  int has_failure = 0;
+  for (int size = 0; size <= t; size++) {
+    if (print) print_progress(c, size);
+    has_failure = find_first_failure(c,
+                                    cores,
+                                    -1,    // t_in
+                                    NULL,  // prefix
+                                    size,  // comb_len
+                                    t,     // max_len
+                                    dim_red_data,  // dim_red_data
+                                    has_random, // has_random
+                                    NULL,  // first_comb
+                                    false, // include_outputs
+                                    0,     // shares_to_ignore
+                                    false, // PINI
+                                    NULL,  // incompr_tuples
+                                    print ? display_failure : ignore_failure,
+                                    (void*)data);
+    if (has_failure) break;
+  }
+  return has_failure;
+}
+
+static void print_scenario_header(char ** names, Comb* faults, int faults_count) {
+  printf("################ Cheking CNI with faults on ");
+  for(int j=0; j<faults_count; j++){
+    printf("%s, ", names[faults[j]]);
+  }
+  printf("...\n");
+}
+
+// A faulted circuit that remains to be verified.
+struct scenario {
+  Comb* faults; // Indices (in |names|) of the faulted variables
+  int faults_count;
+  Circuit* circuit;
+  DimRedData* dim_red_data;
+  int has_failure;
+};
+
+// Parameters shared by all the scenarios.
+struct scenario_params {
+  int t;
+  struct callback_data* data;
+};
+
+// Checks whether |scenario| has a failure using |cores| threads,
+// without printing anything.
+static void check_CNI_scenario_quiet(const void* params_void, void* scenario_void,
+                                     int cores) {
+  const struct scenario_params* params = (const struct scenario_params*) params_void;
+  struct scenario* scenario = (struct scenario*) scenario_void;
+  scenario->has_failure = check_CNI_scenario(scenario->circuit, scenario->dim_red_data,
+                                             cores, params->t, false, params->data);
+}
+
+// Verifies the scenarios of |batch| and empties it. Returns 1 as soon
+// as a scenario has a failure (after printing it), and 0 otherwise.
+static int flush_scenario_batch(ScenarioBatch* batch, FaultInjector* fi,
+                                char ** names) {
+  const struct scenario_params* params = (const struct scenario_params*) batch->params;
+  if (batch->parallel_scenarios) {
+    verify_scenario_batch(batch);
+  }
+
+  int has_failure = 0;
+  for (int i = 0; i < batch->length; i++) {
+    struct scenario* scenario = scenario_batch_get(batch, i);
+    Circuit* c = scenario->circuit;
+
+    if (!has_failure) {
+      if (batch->parallel_scenarios) {
+        // Printing what a sequential verification would have printed.
+        // The verification of the first scenario with a failure is done
+        // again, to print the failure that has the lowest rank.
+        print_scenario_header(names, scenario->faults, scenario->faults_count);
+        if (scenario->has_failure) {
+          has_failure = check_CNI_scenario(c, scenario->dim_red_data, batch->cores,
+                                           params->t, true, params->data);
+        } else {
+          for (int size = 0; size <= params->t; size++) print_progress(c, size);
+        }
+      } else {
+        has_failure = check_CNI_scenario(c, scenario->dim_red_data, batch->cores,
+                                         params->t, true, params->data);
+      }
+
+      if (has_failure) {
+        print_circuit(c);
+        printf("Gadget is not (%d,%d)-CNI with faults on ", params->data->ni_order, params->data->faults);
+        for(int j=0; j<scenario->faults_count; j++){
+          printf("%s, ", names[scenario->faults[j]]);
+        }
+        printf("\n");
+        printf("------\n");
+      }
+      printf("################\n\n");
+    }
+
+    free(scenario->faults);
+    free_dim_red_data(scenario->dim_red_data);
+    free_faulted_circuit(fi, c);
+  }
+  batch->length = 0;
+
+  return has_failure;
+}
+
+int compute_CNI(ParsedFile * pf, int cores, int t, int k, bool parallel_scenarios) {
 
   // int length = 1;
   // char ** names = malloc(sizeof(*names));
@@ -124,21 +249,27 @@ int compute_CNI(ParsedFile * pf, int cores, int t, int k) {
 
   int has_failure = 0;
 
-  bool has_random = true;
+  // The fault-free circuit is built once, and each faulted circuit is
+  // derived from it.
+  FaultInjector * fi = make_fault_injector(pf, pf->glitch, pf->transition);
+
   struct callback_data data = { .ni_order = t, .faults = k };
 
-  for(int i=1; i<=k; i++){
+  struct scenario_params params = { .t = t, .data = &data };
+  ScenarioBatch batch;
+  init_scenario_batch(&batch, sizeof(struct scenario), cores, parallel_scenarios,
+                      check_CNI_scenario_quiet, &params);
+
+  for(int i=1; i<=k && !has_failure; i++){
 
     fv->length = i;
 
     Comb * comb = first_comb(i, 0);
     do{
 
-      printf("################ Cheking CNI with faults on ");
-      for(int j=0; j<i; j++){
-        printf("%s, ", names[comb[j]]);
+      if (!batch.parallel_scenarios) {
+        print_scenario_header(names, comb, i);
       }
-      printf("...\n");
 
       FaultedVar ** v = malloc(i * sizeof(*v));
 
@@ -151,62 +282,36 @@ int compute_CNI(ParsedFile * pf, int cores, int t, int k) {
 
       fv->vars = v;
 
-      Circuit * c = gen_circuit(pf, pf->glitch, pf->transition, fv);
-      //print_circuit(c);
-      DimRedData* dim_red_data = remove_elementary_wires(c, false);
-      
-      int has_failure = 0;
-      for (int size = 0; size <= t; size++) {
-        printf("Checking CNI ==> %" PRIu64 " tuples of size %d to check...\n",
-              n_choose_k(size, c->deps->length), size);
-        has_failure = find_first_failure(c,
-                                        cores,
-                                        -1,    // t_in
-                                        NULL,  // prefix
-                                        size,  // comb_len
-                                        t,     // max_len
-                                        dim_red_data,  // dim_red_data
-                                        has_random, // has_random
-                                        NULL,  // first_comb
-                                        false, // include_outputs
-                                        0,     // shares_to_ignore
-                                        false, // PINI
-                                        NULL,  // incompr_tuples
-                                        display_failure,
-                                        (void*)&data);
-        if (has_failure) break;
-      }
-
-      if (has_failure) {
-        print_circuit(c);
-        printf("Gadget is not (%d,%d)-CNI with faults on ", data.ni_order, data.faults);
-        for(int j=0; j<i; j++){
-          printf("%s, ", names[comb[j]]);
-        }
-        printf("\n");
-      }
+      struct scenario* scenario = scenario_batch_add(&batch);
+      scenario->faults = malloc(i * sizeof(*scenario->faults));
+      memcpy(scenario->faults, comb, i * sizeof(*comb));
+      scenario->faults_count = i;
+      scenario->circuit = inject_faults(fi, fv);
+      //print_circuit(scenario->circuit);
+      scenario->dim_red_data = remove_elementary_wires(scenario->circuit, false);
 
       for(int j=0; j<i; j++){
         free(v[j]);
       }
       free(v);
 
-      free_dim_red_data(dim_red_data);
-      free_circuit(c);
-      
-      if(has_failure){
-        printf("------\n");
-        printf("################\n\n");
-        return has_failure;
+      if (batch.length == batch.max_length) {
+        has_failure = flush_scenario_batch(&batch, fi, names);
       }
 
-      printf("################\n\n");
-
-
-    }while(incr_comb_in_place(comb, i, length));
+    }while(!has_failure && incr_comb_in_place(comb, i, length));
 
     free(comb);
   }
+  if (!has_failure) {
+    has_failure = flush_scenario_batch(&batch, fi, names);
+  }
+  free_scenario_batch(&batch);
+  free_fault_injector(fi);
+
+  if (has_failure) {
+    return has_failure;
+  }
 
   for(int i=0; i<length; i++){
     free(names[i]);
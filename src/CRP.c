@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <gmp.h>
@@ -14,20 +15,22 @@
 #include "verification_rules.h"
 #include "dimensions.h"
 #include "constructive.h"
+#include "coeff_store.h"
+#include "proba_eval.h"
+#include "sweep.h"
+#include "correction.h"
 
 
 
-struct callback_data {
-  uint64_t* coeffs;
-  bool dimension_reduction;
-  Circuit* init_circuit;
-  int* new_to_old_mapping;
-};
 
+static void get_faulty_scenarios_filename(ParsedFile * pf, int k, bool set, char **name){
+  *name = malloc(strlen(pf->filename) + 50);
+  sprintf(*name, "%s_faulty_scenarios_k%d_f%d_CRP", pf->filename, k, set ? 1 : 0);
+}
 
 FaultsCombs * read_faulty_scenarios(ParsedFile * pf, int k, bool set){
-  char *name = malloc(strlen(pf->filename) + 50);
-  sprintf(name, "%s_faulty_scenarios_k%d_f%d_CRP", pf->filename, k, set ? 1 : 0);
+  char *name;
+  get_faulty_scenarios_filename(pf, k, set, &name);
   FILE * f = fopen(name, "r");
   
   if(!f){
@@ -88,53 +91,120 @@ static int generate_names(ParsedFile * pf, char *** names_ptr){
   return length;
 }
 
-static void update_coeffs(const Circuit* c, Comb* comb, int comb_len, SecretDep* secret_deps,
-                          void* data_void) {
-  struct callback_data* data = (struct callback_data*) data_void;
-  (void) secret_deps;
-  uint64_t* coeffs = data->coeffs;
+static void get_filename(ParsedFile * pf, int coeff_max, int k, char **name, bool set){
+  *name = malloc(strlen(pf->filename) + 50);
+  sprintf(*name, "%s_k%d_c%d_f%d.CRP_coeffs", pf->filename, k, coeff_max, set ? 1 : 0);
+}
+
+
+// A faulted circuit whose coefficients remain to be computed.
+struct scenario {
+  uint64_t key; // Key of the scenario in the coefficient file
+  Circuit* circuit;
+  DimRedData* dim_red_data;
+  uint64_t* coeffs;
+};
 
-  /* printf("[ "); */
-  /* for (int i = 0; i < comb_len; i++) printf("%d ", comb[i]); */
-  /* printf("]\n"); */
+// Parameters shared by all the scenarios.
+struct scenario_params {
+  int coeffs_len;
+  int coeff_max;
+};
 
-  update_coeff_c_single(c, coeffs, comb, comb_len);
+// Computes the coefficients of |scenario| using |cores| threads.
+static void compute_scenario_coeffs(const void* params_void, void* scenario_void,
+                                    int cores) {
+  const struct scenario_params* params = (const struct scenario_params*) params_void;
+  struct scenario* scenario = (struct scenario*) scenario_void;
+  find_all_failures_monotone(scenario->circuit, cores, params->coeff_max,
+                             scenario->dim_red_data, NULL, scenario->coeffs);
 }
 
-static void get_filename(ParsedFile * pf, int coeff_max, int k, char **name, bool set){
-  *name = malloc(strlen(pf->filename) + 50);
-  sprintf(*name, "%s_k%d_c%d_f%d.CRP_coeffs", pf->filename, k, coeff_max, set ? 1 : 0);
+static void add_scenario(ScenarioBatch* batch, uint64_t key,
+                         Circuit* circuit, DimRedData* dim_red_data) {
+  const struct scenario_params* params = (const struct scenario_params*) batch->params;
+  struct scenario* scenario = scenario_batch_add(batch);
+  scenario->key = key;
+  scenario->circuit = circuit;
+  scenario->dim_red_data = dim_red_data;
+  scenario->coeffs = calloc(params->coeffs_len, sizeof(*scenario->coeffs));
 }
 
+// Computes the coefficients of the scenarios of |batch|, adds them to
+// |coeffs_file|, and empties |batch|.
+static void flush_scenario_batch(ScenarioBatch* batch, FaultInjector* fi,
+                                 CoeffStoreWriter* coeffs_file) {
+  verify_scenario_batch(batch);
+
+  for (int i = 0; i < batch->length; i++) {
+    struct scenario* scenario = scenario_batch_get(batch, i);
+    coeff_store_add(coeffs_file, scenario->key, scenario->coeffs);
+    free_dim_red_data(scenario->dim_red_data);
+    free_faulted_circuit(fi, scenario->circuit);
+    free(scenario->coeffs);
+  }
+  batch->length = 0;
+}
 
-void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool set) {
+
+void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool set,
+                        bool parallel_scenarios, bool gen_faulty_scenarios) {
 
   char ** names;
   int length = generate_names(pf, &names);
   // length = 2;
 
-  Circuit * c = gen_circuit(pf, pf->glitch, pf->transition, NULL);
+  // The fault-free circuit is built once, and each faulted circuit is
+  // derived from it.
+  FaultInjector * fi = make_fault_injector(pf, pf->glitch, pf->transition);
+  Circuit * c = fi->base;
   int total_wires = c->total_wires;
 
-  int coeff_max_main_loop = (coeff_max == -1) ? (c->length) :
-    (coeff_max > c->length ? c->length : coeff_max);
-
   if(coeff_max == -1){
     coeff_max = c->length;
   }
 
-  free_circuit(c);
+  // The scenarios that cannot be corrected are only computed if needed
+  // (they are the same for all values of coeff_max).
+  char * faulty_scenarios_filename;
+  get_faulty_scenarios_filename(pf, k, set, &faulty_scenarios_filename);
+  if(gen_faulty_scenarios || access(faulty_scenarios_filename, R_OK) != 0){
+    printf("Generating %s...\n", faulty_scenarios_filename);
+    FaultsCombs * uncorrected = find_uncorrected_faults_CRP(pf, k, set, cores);
+    write_faulty_scenarios_CRP(faulty_scenarios_filename, uncorrected);
+    free_faults_combs(uncorrected);
+  }
+  free(faulty_scenarios_filename);
 
   FaultsCombs * fc = read_faulty_scenarios(pf, k, set);
 
   Faults * fv = malloc(sizeof(*fv));
   fv->length = k;
 
+  CoeffStoreParams params = {
+    .gadget_hash = hash_gadget(pf),
+    .property    = COEFF_STORE_CRP,
+    .k           = k,
+    .t           = -1,
+    .coeff_max   = coeff_max,
+    .set         = set,
+    .names_count = length,
+    .input_combs = 0,
+    .coeffs_len  = total_wires+1
+  };
   char * filename;
   get_filename(pf, coeff_max, k, &filename, set);
-  FILE * coeffs_file = fopen(filename, "wb");
+  CoeffStoreWriter * coeffs_file = coeff_store_create(filename, &params);
   free(filename);
 
+  struct scenario_params batch_params = {
+    .coeffs_len = total_wires+1,
+    .coeff_max = coeff_max,
+  };
+  ScenarioBatch batch;
+  init_scenario_batch(&batch, sizeof(struct scenario), cores, parallel_scenarios,
+                      compute_scenario_coeffs, &batch_params);
+
   int cpt_ignored = 0;
   for(int i=1; i<=k; i++){
 
@@ -166,48 +236,14 @@ void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool s
         goto skip;
       }
 
-      uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-      Circuit * circuit = gen_circuit(pf, pf->glitch, pf->transition, fv);
+      Circuit * circuit = inject_faults(fi, fv);
       // print_circuit(c);
-      DimRedData* dim_red_data = remove_elementary_wires(circuit, false);
-
-      struct callback_data data = {
-        .coeffs = coeffs,
-      };
-
-      // Computing coefficients
-      // printf("f(p) = [ "); fflush(stdout);
-      for (int size = 0; size <= coeff_max_main_loop; size++) {
-
-        find_all_failures(circuit,
-                          cores,
-                          -1,    // t_in
-                          NULL,  // prefix
-                          size,  // comb_len
-                          coeff_max,  // max_len
-                          dim_red_data,
-                          true, // has_random
-                          NULL,  // first_comb
-                          false,  // include_outputs
-                          0,     // shares_to_ignore
-                          false, // PINI
-                          NULL,
-                          update_coeffs,
-                          (void*)&data);
-
-        // A failure of size 0 is not possible. However, we still want to
-        // iterate in the loop with |size| = 0 to generate the tuples with
-        // only elementary shares (which, because of the dimension
-        // reduction, are never generated otherwise).
-        // if (size > 0) {
-        //   printf("%"PRIu64", ", coeffs[size]); fflush(stdout);
-        // }
+      add_scenario(&batch, fault_set_key(comb, i, length), circuit,
+                   remove_elementary_wires(circuit, false));
+      if (batch.length == batch.max_length) {
+        flush_scenario_batch(&batch, fi, coeffs_file);
       }
 
-      fwrite(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-      free_circuit(circuit);
-      free(coeffs);
-
       skip:;
 
       free(v);
@@ -216,6 +252,9 @@ void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool s
 
     free(comb);
   }
+  flush_scenario_batch(&batch, fi, coeffs_file);
+  free_scenario_batch(&batch);
+  free_fault_injector(fi);
 
   for(int i=0; i<length; i++){
     free(names[i]);
@@ -228,157 +267,122 @@ void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool s
   Circuit * circuit = gen_circuit(pf, pf->glitch, pf->transition, NULL);
   // print_circuit(c);
   DimRedData* dim_red_data = remove_elementary_wires(circuit, false);
-  struct callback_data data = {
-    .coeffs = coeffs,
-  };
 
   // Computing coefficients
   printf("################ Cheking CRP without faults\n");
-  for (int size = 0; size <= coeff_max_main_loop; size++) {
-
-    find_all_failures(circuit,
-                      cores,
-                      -1,    // t_in
-                      NULL,  // prefix
-                      size,  // comb_len
-                      coeff_max,  // max_len
-                      dim_red_data,
-                      true, // has_random
-                      NULL,  // first_comb
-                      false,  // include_outputs
-                      0,     // shares_to_ignore
-                      false, // PINI
-                      NULL,
-                      update_coeffs,
-                      (void*)&data);
-  }
-  fwrite(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
+  find_all_failures_monotone(circuit, cores, coeff_max, dim_red_data, NULL, coeffs);
+  coeff_store_add(coeffs_file, 0, coeffs);
   free_circuit(circuit);
   free(coeffs);
 
-  fclose(coeffs_file);
+  coeff_store_finish(coeffs_file);
 
   printf("Ignored %d combs\n", cpt_ignored);
   free_faults_combs(fc);
 }
 
-void compute_CRP_val(ParsedFile * pf, int coeff_max, int k, double pleak, double pfault, bool set){
+// The coefficients of a CRP coefficient file, aggregated by number of
+// faults (see ScenarioSums).
+typedef struct _crp_scenarios {
+  int coeff_max;
+  int length;      // Number of variables that can be faulted
+  ScenarioSums * sums;
+} CRPScenarios;
+
+static CRPScenarios load_CRP_scenarios(ParsedFile * pf, int coeff_max, int k, bool set){
   char ** names;
   int length = generate_names(pf, &names);
+  for(int i=0; i<length; i++){
+    free(names[i]);
+  }
+  free(names);
 
   Circuit * c = gen_circuit(pf, pf->glitch, pf->transition, NULL);
   int total_wires = c->total_wires;
   free_circuit(c);
 
 
+  CoeffStoreParams params = {
+    .gadget_hash = hash_gadget(pf),
+    .property    = COEFF_STORE_CRP,
+    .k           = k,
+    .t           = -1,
+    .coeff_max   = coeff_max,
+    .set         = set,
+    .names_count = length,
+    .coeffs_len  = total_wires+1
+  };
   char * filename;
   get_filename(pf, coeff_max, k, &filename, set);
-  FILE * coeffs_file = fopen(filename, "rb");
-  if(!coeffs_file){
-    free(filename);
-    fprintf(stderr, "file %s not found...", filename);
-    exit(EXIT_FAILURE);
-  }
+  CoeffStore * coeffs_file = coeff_store_open(filename, &params);
   free(filename);
 
+  CRPScenarios s = { .coeff_max = coeff_max, .length = length,
+                     .sums = make_scenario_sums(k, total_wires+1) };
   uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-  mpf_t epsilon, mu, epsilon_max, mu_max;
-  mpf_init(epsilon);
-  mpf_init(mu);
-  mpf_init(epsilon_max);
-  mpf_init(mu_max);
-
-  char * prop = malloc(4 *sizeof(*prop));
-  sprintf(prop, "CRP");
-  FaultsCombs * fc = read_faulty_scenarios(pf, k, set);
-  free(prop);
 
-  Faults * fv = malloc(sizeof(*fv));
-  fv->length = k;
-
-  int cpt = 0;
-  int cpt_ignored = 0;
+  // The scenarios that were ignored when computing the coefficients
+  // (see compute_CRP_coeffs) are not in the coefficient file.
   for(int i=1; i<=k; i++){
 
-    fv->length = i;
-
     Comb * comb = first_comb(i, 0);
     do{
 
-      FaultedVar ** v = malloc(i * sizeof(*v));
-
-      for(int j=0; j<i; j++){
-        v[j] = malloc(sizeof(*v[j]));
-        v[j]->set = set;
-        v[j]->name = names[comb[j]];
-      }
-
-      fv->vars = v;
-
-      if(ignore_faulty_scenario(fv, fc)){
-        compute_combined_intermediate_mu(i, length, pfault, mu);
-        compute_combined_intermediate_mu(i, length, pfault, mu_max);
-        cpt_ignored++;
-        goto skip;
+      if(!coeff_store_get(coeffs_file, fault_set_key(comb, i, length), coeffs)){
+        scenario_sums_add_ignored(s.sums, i);
+        continue;
       }
+      scenario_sums_add(s.sums, i, coeffs);
 
-      fread(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-      // get_failure_proba(coeffs, total_wires+1, pleak);
-      compute_combined_intermediate_leakage_proba(coeffs, i, length, total_wires+1, pleak, pfault, epsilon, -1);
-      compute_combined_intermediate_leakage_proba(coeffs, i, length, total_wires+1, pleak, pfault, epsilon_max, coeff_max);
-      cpt++;
-
-      skip:;
-      free(v);
     }while(incr_comb_in_place(comb, i, length));
+    free(comb);
   }
 
-  fread(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-  // get_failure_proba(coeffs, total_wires+1, pleak);
-  compute_combined_intermediate_leakage_proba(coeffs, 0, length, total_wires+1, pleak, pfault, epsilon, -1);
-  compute_combined_intermediate_leakage_proba(coeffs, 0, length, total_wires+1, pleak, pfault, epsilon_max, coeff_max);
-
-  fclose(coeffs_file);
-
-  // printf("Ignored %d combs\n", cpt_ignored);
-  free_faults_combs(fc);
-
-  compute_combined_mu_max(k, length, pfault, mu_max);
-
-  mpf_t tmp;
-  mpf_t gamma, gamma_max;
-
-  mpf_inits(gamma, gamma_max, NULL);
+  if(!coeff_store_get(coeffs_file, 0, coeffs)){
+    fprintf(stderr, "Coefficient file does not contain the scenario without faults. Exiting.\n");
+    exit(EXIT_FAILURE);
+  }
+  scenario_sums_add(s.sums, 0, coeffs);
 
-  mpf_set(gamma, mu);
-  mpf_add(gamma, gamma, epsilon);
+  coeff_store_close(coeffs_file);
+  free(coeffs);
 
-  mpf_set(gamma_max, mu_max);
-  mpf_add(gamma_max, gamma_max, epsilon_max);
+  return s;
+}
 
-  // compute 1 / (1-mu)
-  mpf_init_set_d(tmp, 1);
-  mpf_sub (tmp, tmp, mu);
-  mpf_ui_div(tmp, 1, tmp);
-  mpf_mul(epsilon, epsilon, tmp);
+static void eval_CRP_point(const void * data, double pleak, double pfault,
+                           CombinedProba * res, int * group){
+  (void)group;
+  const CRPScenarios * s = data;
+  ProbaEval * eval = make_proba_eval(s->sums->n, pleak, s->length, pfault);
+  proba_eval_scenarios(eval, s->sums, s->coeff_max, res);
+  free_proba_eval(eval);
+}
 
-  mpf_init_set_d(tmp, 1);
-  mpf_sub (tmp, tmp, mu_max);
-  mpf_ui_div(tmp, 1, tmp);
-  mpf_mul(epsilon_max, epsilon_max, tmp);
+void compute_CRP_val(ParsedFile * pf, int coeff_max, int k, double pleak, double pfault, bool set){
+  CRPScenarios s = load_CRP_scenarios(pf, coeff_max, k, set);
 
-  mpf_clear(tmp);
+  CombinedProba res;
+  init_combined_proba(&res);
+  eval_CRP_point(&s, pleak, pfault, &res, NULL);
 
   printf("\n\n");
   gmp_printf("pfault = %.2lf, pleak = %.2lf:\n\n", pfault, pleak);
-  gmp_printf("epsilon min = %.10Ff\n", epsilon);
-  gmp_printf("mu min = %.10Ff\n", mu);
-  gmp_printf("gamma min = %.10Ff\n\n", gamma);
+  gmp_printf("epsilon min = %.10Ff\n", res.epsilon);
+  gmp_printf("mu min = %.10Ff\n", res.mu);
+  gmp_printf("gamma min = %.10Ff\n\n", res.gamma);
 
-  gmp_printf("epsilon max = %.10Ff\n", epsilon_max);
-  gmp_printf("mu max = %.10Ff\n", mu_max);
-  gmp_printf("gamma max = %.10Ff\n", gamma_max);
+  gmp_printf("epsilon max = %.10Ff\n", res.epsilon_max);
+  gmp_printf("mu max = %.10Ff\n", res.mu_max);
+  gmp_printf("gamma max = %.10Ff\n", res.gamma_max);
 
-  mpf_clears(epsilon, epsilon_max, mu, mu_max, gamma,gamma_max, NULL);
-  
-}
\ No newline at end of file
+  clear_combined_proba(&res);
+  free_scenario_sums(s.sums);
+}
+
+void compute_CRP_sweep(ParsedFile * pf, int coeff_max, int k, const ProbaGrid * grid, bool set,
+                       int cores, const char * output){
+  CRPScenarios s = load_CRP_scenarios(pf, coeff_max, k, set);
+  sweep_proba_grid(grid, cores, eval_CRP_point, &s, NULL, output);
+  free_scenario_sums(s.sums);
+}
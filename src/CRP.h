@@ -3,7 +3,14 @@
 #include "circuit.h"
 #include "dimensions.h"
 #include "utils.h"
+#include "sweep.h"
 
-void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool set);
+void compute_CRP_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, bool set,
+                        bool parallel_scenarios, bool gen_faulty_scenarios);
 
-void compute_CRP_val(ParsedFile * pf, int coeff_max, int k, double pleak, double pfault, bool set);
\ No newline at end of file
+void compute_CRP_val(ParsedFile * pf, int coeff_max, int k, double pleak, double pfault, bool set);
+
+// Same as compute_CRP_val, for all the probabilities of |grid| (see
+// sweep.h).
+void compute_CRP_sweep(ParsedFile * pf, int coeff_max, int k, const ProbaGrid * grid, bool set,
+                       int cores, const char * output);
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <assert.h>
 #include <inttypes.h>
 #include <gmp.h>
@@ -14,14 +16,12 @@
 #include "verification_rules.h"
 #include "dimensions.h"
 #include "constructive.h"
+#include "coeff_store.h"
+#include "proba_eval.h"
+#include "sweep.h"
+#include "correction.h"
 
 
-struct callback_data {
-  uint64_t* coeffs;
-  int t;
-  int nb_duplications;
-};
-
 
 static int generate_names(ParsedFile * pf, char *** names_ptr){
 
@@ -48,16 +48,6 @@ static int generate_names(ParsedFile * pf, char *** names_ptr){
   return length;
 }
 
-static void update_coeffs(const Circuit* c, Comb* comb, int comb_len, SecretDep* secret_deps,
-                          void* data_void) {
-  (void) secret_deps;
-  struct callback_data* data = (struct callback_data*) data_void;
-  int t = data->t;
-  int nb_duplications = data->nb_duplications;
-
-  update_coeff_c_single(c, data->coeffs, &comb[t*nb_duplications], comb_len-(t*nb_duplications));
-}
-
 void construct_output_prefix(Circuit * c, StrMap * out, Comb * out_comb, Comb * out_comb_res, int t){
 
   char ** names = malloc(t*c->nb_duplications * sizeof(*names));
@@ -99,7 +89,132 @@ static void get_faulty_combs_filename(ParsedFile * pf, int k, bool set, char **n
   sprintf(*name, "%s_faulty_scenarios_k%d_f%d_CRPC", pf->filename, k, set ? 1 : 0);
 }
 
-void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t, bool set) {
+// A faulted circuit whose coefficients remain to be computed.
+struct scenario {
+  uint64_t key; // Key of the scenario in the coefficient file
+  Circuit* circuit;
+  uint64_t* coeffs;
+};
+
+// Parameters shared by all the scenarios.
+struct scenario_params {
+  int coeffs_len;
+  int coeff_max;
+  StrMap* out;
+  int t;
+  int nb_duplications;
+  Comb** out_comb_arr; // Combinations of output shares to consider
+  uint64_t out_comb_len;
+  bool opt_incompr; // If true, tuples that contain a known failure are
+                    // not verified (see subset_index.h)
+};
+
+// Computes the coefficients of |scenario| using |cores| threads.
+static void compute_scenario_coeffs(const void* params_void, void* scenario_void,
+                                    int cores) {
+  const struct scenario_params* params = (const struct scenario_params*) params_void;
+  struct scenario* scenario = (struct scenario*) scenario_void;
+  Circuit* circuit = scenario->circuit;
+  int t = params->t;
+  uint64_t out_comb_len = params->out_comb_len;
+
+  int prefix_len = t * params->nb_duplications;
+
+  uint64_t** coeffs_out_comb;
+  coeffs_out_comb = malloc(out_comb_len * sizeof(*coeffs_out_comb));
+  for (unsigned i = 0; i < out_comb_len; i++) {
+    coeffs_out_comb[i] = calloc(params->coeffs_len,  sizeof(*coeffs_out_comb[i]));
+  }
+
+  // The output prefixes, and one CoeffsData for each of them
+  Comb** out_combs = malloc(out_comb_len * sizeof(*out_combs));
+  CoeffsData* data = malloc(out_comb_len * sizeof(*data));
+  void** data_ptrs = malloc(out_comb_len * sizeof(*data_ptrs));
+  for (unsigned l = 0; l < out_comb_len; l++) {
+    out_combs[l] = malloc(prefix_len * sizeof(*out_combs[l]));
+    construct_output_prefix(circuit, params->out, params->out_comb_arr[l], out_combs[l], t);
+    data[l] = (CoeffsData) { .coeffs = coeffs_out_comb[l], .hist = make_weight_histogram(),
+                             .prefix_len = prefix_len };
+    data_ptrs[l] = &data[l];
+  }
+
+  // Failures depend on the faults: each scenario has its own index
+  // (whose tuples also contain outputs, hence |deps->length|).
+  SubsetIndex* incompr_tuples = params->opt_incompr ?
+    make_subset_index(circuit->deps->length) : NULL;
+
+  for (int size = 0; size <= params->coeff_max; size++) {
+
+    // All the output prefixes are verified at once
+    find_all_failures_prefixes(circuit,
+                               cores,
+                               (t == circuit->share_count) ? t-1 : t, // t_in
+                               out_combs,    // prefixes
+                               out_comb_len, // prefix_count
+                               prefix_len,   // prefix_len
+                               size+prefix_len, // comb_len
+                               size+prefix_len, // max_len
+                               NULL,  // dim_red_data
+                               true,  // has_random
+                               incompr_tuples,
+                               coeffs_failure_callback,
+                               data_ptrs,
+                               &coeffs_local_data_ops);
+    for (unsigned int l = 0; l < out_comb_len; l++) {
+      // When a single thread is used, failures go to |data[l].hist|.
+      weight_histogram_flush(data[l].hist, data[l].coeffs);
+    }
+  }
+  for (unsigned l = 0; l < out_comb_len; l++) {
+    free_weight_histogram(data[l].hist);
+    free(out_combs[l]);
+  }
+  free(out_combs);
+  free(data);
+  free(data_ptrs);
+
+  #define max(a,b) ((a) > (b) ? (a) : (b))
+  uint64_t * coeffs = scenario->coeffs;
+  for (int m = 0; m <= circuit->total_wires; m++) {
+    for (unsigned j = 0; j < out_comb_len; j++) {
+      coeffs[m] = max(coeffs[m], coeffs_out_comb[j][m]);
+    }
+    // printf("%"PRId64", ", coeffs[m]);
+  }
+  // printf("\n");
+  for (unsigned i = 0; i < out_comb_len; i++) {
+    free(coeffs_out_comb[i]);
+  }
+  free(coeffs_out_comb);
+  if (incompr_tuples) free_subset_index(incompr_tuples);
+}
+
+static void add_scenario(ScenarioBatch* batch, uint64_t key, Circuit* circuit) {
+  const struct scenario_params* params = (const struct scenario_params*) batch->params;
+  struct scenario* scenario = scenario_batch_add(batch);
+  scenario->key = key;
+  scenario->circuit = circuit;
+  scenario->coeffs = calloc(params->coeffs_len, sizeof(*scenario->coeffs));
+}
+
+// Computes the coefficients of the scenarios of |batch|, adds them to
+// |coeffs_file|, and empties |batch|.
+static void flush_scenario_batch(ScenarioBatch* batch, FaultInjector* fi,
+                                 CoeffStoreWriter* coeffs_file) {
+  verify_scenario_batch(batch);
+
+  for (int i = 0; i < batch->length; i++) {
+    struct scenario* scenario = scenario_batch_get(batch, i);
+    coeff_store_add(coeffs_file, scenario->key, scenario->coeffs);
+    free_faulted_circuit(fi, scenario->circuit);
+    free(scenario->coeffs);
+  }
+  batch->length = 0;
+}
+
+
+void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t, bool set,
+                         bool parallel_scenarios, bool gen_faulty_scenarios, bool opt_incompr) {
 
   if(pf->out->next_val > 1){
     fprintf(stderr, "Cannot verify CRPC for gadgets with more than 1 output.");
@@ -109,16 +224,27 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
   char ** names;
   int length = generate_names(pf, &names);
 
-  Circuit * c = gen_circuit(pf, pf->glitch, pf->transition, NULL);
+  // The fault-free circuit is built once, and each faulted circuit is
+  // derived from it.
+  FaultInjector * fi = make_fault_injector(pf, pf->glitch, pf->transition);
+  Circuit * c = fi->base;
   int total_wires = c->total_wires;
   if(coeff_max == -1){
     coeff_max = c->length;
   }
-  free_circuit(c);
 
   char * faulty_combs_filename;
   get_faulty_combs_filename(pf, k, set, &faulty_combs_filename);
 
+  // The scenarios that cannot be corrected are only computed if needed
+  // (they are the same for all values of t and coeff_max).
+  if(gen_faulty_scenarios || access(faulty_combs_filename, R_OK) != 0){
+    printf("Generating %s...\n", faulty_combs_filename);
+    CorrectionScenarios * uncorrected = find_uncorrected_faults_CRPC(pf, k, set, cores);
+    write_faulty_scenarios_CRPC(faulty_combs_filename, uncorrected);
+    free_correction_scenarios(uncorrected);
+  }
+
   FILE * faulty_combs_file = fopen(faulty_combs_filename, "r");
   if(!faulty_combs_file){
     fprintf(stderr, "You must execute the testing_correction.py first on your gadget to generate the %s file.\n", faulty_combs_filename);
@@ -132,26 +258,50 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
 
   uint64_t out_comb_len;
   Comb** out_comb_arr = gen_combinations(&out_comb_len, t, pf->shares - 1);
-  Comb * out_comb = malloc((t * pf->nb_duplications) * sizeof(*out_comb));
-
-  VarVector verif_prefix = { .length = t*pf->nb_duplications, 
-                             .max_size = t*pf->nb_duplications, 
-                             .content = NULL };
-
-  struct callback_data data = { .t = t, .coeffs = NULL, .nb_duplications = pf->nb_duplications };
 
+  // The scenarios of the i-th combination of faults on inputs have keys
+  // i * |group_size| + fault_set_key(internal faults) (the last
+  // combination being the one without faults on inputs).
+  uint64_t group_size = fault_set_count(k, length);
+  CoeffStoreParams params = {
+    .gadget_hash = hash_gadget(pf),
+    .property    = COEFF_STORE_CRPC,
+    .k           = k,
+    .t           = t,
+    .coeff_max   = coeff_max,
+    .set         = set,
+    .names_count = length,
+    .input_combs = nb_input_combs,
+    .coeffs_len  = total_wires+1
+  };
   char * filename;
   get_filename(pf, coeff_max, t, k, set, &filename);
-  FILE * coeffs_file = fopen(filename, "wb");
+  CoeffStoreWriter * coeffs_file = coeff_store_create(filename, &params);
   free(filename);
 
+  struct scenario_params batch_params = {
+    .coeffs_len = total_wires+1,
+    .coeff_max = coeff_max,
+    .out = pf->out,
+    .t = t,
+    .nb_duplications = pf->nb_duplications,
+    .out_comb_arr = out_comb_arr,
+    .out_comb_len = out_comb_len,
+    .opt_incompr = opt_incompr,
+  };
+  ScenarioBatch batch;
+  init_scenario_batch(&batch, sizeof(struct scenario), cores, parallel_scenarios,
+                      compute_scenario_coeffs, &batch_params);
+
   for(int i=0; i< nb_input_combs+1; i++){
     int size_input_comb;
     FaultedVar ** v_inps = NULL;
     if(i< nb_input_combs){
-      // Constructing input faults prefix
+      // Constructing input faults prefix (which is also stored as a
+      // label in the coefficient file, for compute_CRPC_val)
       fscanf(faulty_combs_file, " %d ,", &size_input_comb);
-      printf("%d, ", size_input_comb);
+      char * label = malloc(size_input_comb * 100 + 20);
+      int label_len = sprintf(label, "%d, ", size_input_comb);
       v_inps = malloc(size_input_comb * sizeof(*v_inps));
       for(int k=0; k<size_input_comb-1; k++){
         v_inps[k] = malloc(sizeof(*v_inps[k]));
@@ -160,7 +310,7 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
         v_inps[k]->set = set;
         v_inps[k]->fault_on_input = true;
         sscanf(v_inps[k]->name, "%*[a-zA-Z]%d_%d", &v_inps[k]->share, &v_inps[k]->duplicate);
-        printf("%s %d %d, ", v_inps[k]->name, v_inps[k]->share, v_inps[k]->duplicate);
+        label_len += sprintf(label + label_len, "%s %d %d, ", v_inps[k]->name, v_inps[k]->share, v_inps[k]->duplicate);
       }
       v_inps[size_input_comb-1] = malloc(sizeof(*v_inps[size_input_comb-1]));
       v_inps[size_input_comb-1]->name = malloc(60 * sizeof(*v_inps[size_input_comb-1]->name));
@@ -168,7 +318,10 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
       v_inps[size_input_comb-1]->set = set;
       v_inps[size_input_comb-1]->fault_on_input = true;
       sscanf(v_inps[size_input_comb-1]->name, "%*[a-zA-Z]%d_%d", &v_inps[size_input_comb-1]->share, &v_inps[size_input_comb-1]->duplicate);
-      printf("%s %d %d\n", v_inps[size_input_comb-1]->name, v_inps[size_input_comb-1]->share, v_inps[size_input_comb-1]->duplicate);
+      sprintf(label + label_len, "%s %d %d", v_inps[size_input_comb-1]->name, v_inps[size_input_comb-1]->share, v_inps[size_input_comb-1]->duplicate);
+      printf("%s\n", label);
+      coeff_store_add_label(coeffs_file, label);
+      free(label);
     }
     else{
       size_input_comb = 0;
@@ -222,56 +375,10 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
       }
       printf("...\n");
 
-      Circuit * circuit = gen_circuit(pf, pf->glitch, pf->transition, fv);
-      uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-      uint64_t** coeffs_out_comb;
-      coeffs_out_comb = malloc(out_comb_len * sizeof(*coeffs_out_comb));
-      for (unsigned i = 0; i < out_comb_len; i++) {
-        coeffs_out_comb[i] = calloc((total_wires + 1),  sizeof(*coeffs_out_comb[i]));
-      }
-
-      for (int size = 0; size <= coeff_max; size++) {
-
-        for (unsigned int l = 0; l < out_comb_len; l++) {
-          construct_output_prefix(circuit, pf->out, out_comb_arr[l], out_comb, t);
-          verif_prefix.content = out_comb;
-          data.coeffs = coeffs_out_comb[l];
-
-          find_all_failures(circuit,
-                        cores,
-                        (t == circuit->share_count) ? t-1 : t, // t_in
-                        &verif_prefix,  // prefix
-                        size+verif_prefix.length, // comb_len
-                        size+verif_prefix.length, // max_len
-                        NULL,  // dim_red_data
-                        true,  // has_random
-                        NULL,  // first_comb
-                        false, // include_outputs
-                        0,     // shares_to_ignore
-                        false, // PINI
-                        NULL, // incompr_tuples
-                        update_coeffs,
-                        (void*)&data);
-        }
-      }
-
-      #define max(a,b) ((a) > (b) ? (a) : (b))
-      for (int m = 0; m <= circuit->total_wires; m++) {
-        for (unsigned j = 0; j < out_comb_len; j++) {
-          coeffs[m] = max(coeffs[m], coeffs_out_comb[j][m]);
-        }
-        // printf("%"PRId64", ", coeffs[m]);
-      }
-      // printf("\n");
-      for (unsigned i = 0; i < out_comb_len; i++) {
-        free(coeffs_out_comb[i]);
+      add_scenario(&batch, i * group_size, inject_faults(fi, fv));
+      if (batch.length == batch.max_length) {
+        flush_scenario_batch(&batch, fi, coeffs_file);
       }
-      free(coeffs_out_comb);
-
-
-      fwrite(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-      free(coeffs);
-      free_circuit(circuit);
 
       for(int j=0; j<size_input_comb; j++){
         free(v[j]);
@@ -317,58 +424,11 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
         fv->length = f+size_input_comb;
         
 
-        Circuit * circuit = gen_circuit(pf, pf->glitch, pf->transition, fv);
-
-        uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-
-        uint64_t** coeffs_out_comb;
-        coeffs_out_comb = malloc(out_comb_len * sizeof(*coeffs_out_comb));
-        for (unsigned i = 0; i < out_comb_len; i++) {
-          coeffs_out_comb[i] = calloc((total_wires + 1),  sizeof(*coeffs_out_comb[i]));
-        }
-
-        for (int size = 0; size <= coeff_max; size++) {
-
-          for (unsigned int l = 0; l < out_comb_len; l++) {
-            construct_output_prefix(circuit, pf->out, out_comb_arr[l], out_comb, t);
-            verif_prefix.content = out_comb;
-            data.coeffs = coeffs_out_comb[l];
-
-            find_all_failures(circuit,
-                          cores,
-                          (t == circuit->share_count) ? t-1 : t, // t_in
-                          &verif_prefix,  // prefix
-                          size+verif_prefix.length, // comb_len
-                          size+verif_prefix.length, // max_len
-                          NULL,  // dim_red_data
-                          true,  // has_random
-                          NULL,  // first_comb
-                          false, // include_outputs
-                          0,     // shares_to_ignore
-                          false, // PINI
-                          NULL, // incompr_tuples
-                          update_coeffs,
-                          (void*)&data);
-          }
-        }
-
-        #define max(a,b) ((a) > (b) ? (a) : (b))
-        for (int m = 0; m <= circuit->total_wires; m++) {
-          for (unsigned j = 0; j < out_comb_len; j++) {
-            coeffs[m] = max(coeffs[m], coeffs_out_comb[j][m]);
-          }
-          // printf("%"PRId64", ", coeffs[m]);
-        }
-        // printf("\n");
-        for (unsigned i = 0; i < out_comb_len; i++) {
-          free(coeffs_out_comb[i]);
+        add_scenario(&batch, i * group_size + fault_set_key(comb, f, length),
+                     inject_faults(fi, fv));
+        if (batch.length == batch.max_length) {
+          flush_scenario_batch(&batch, fi, coeffs_file);
         }
-        free(coeffs_out_comb);
-
-
-        fwrite(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-        free(coeffs);
-        free_circuit(circuit);
 
         skip:;
         for(int j=0; j<f+size_input_comb; j++){
@@ -392,8 +452,12 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
     free_faults_combs(sfc);
   }
 
-  fclose(coeffs_file);
+  flush_scenario_batch(&batch, fi, coeffs_file);
+  free_scenario_batch(&batch);
+
+  coeff_store_finish(coeffs_file);
   fclose(faulty_combs_file);
+  free_fault_injector(fi);
   for(int i=0; i<length; i++){
     free(names[i]);
   }
@@ -402,14 +466,25 @@ void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t
     free(out_comb_arr[i]);
   }
   free(out_comb_arr);
-  free(out_comb);
 
 
 
 }
 
 
-void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak, double pfault, bool set){
+// The coefficients of a CRPC coefficient file, aggregated by number of
+// faults (see ScenarioSums) for each combination of faults on inputs.
+typedef struct _crpc_scenarios {
+  int coeff_max;
+  int length;            // Number of variables that can be faulted
+  int nb_input_combs;
+  ScenarioSums ** sums;  // One per combination of faults on inputs, plus
+                         // one (the last) for the scenarios without
+  char ** labels;        // Descriptions of the combinations of faults on
+                         // inputs (NULL for the last one)
+} CRPCScenarios;
+
+static CRPCScenarios load_CRPC_scenarios(ParsedFile * pf, int coeff_max, int k, int t, bool set){
   if(pf->out->next_val > 1){
     fprintf(stderr, "Cannot verify CRPC for gadgets with more than 1 output.");
     exit(EXIT_FAILURE);
@@ -417,6 +492,10 @@ void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak
 
   char ** names;
   int length = generate_names(pf, &names);
+  for(int i=0; i<length; i++){
+    free(names[i]);
+  }
+  free(names);
 
   Circuit * c = gen_circuit(pf, pf->glitch, pf->transition, NULL);
   int total_wires = c->total_wires;
@@ -425,208 +504,140 @@ void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak
   }
   free_circuit(c);
 
-  char * faulty_combs_filename;
-  get_faulty_combs_filename(pf, k, set, &faulty_combs_filename);
-
-  FILE * faulty_combs_file = fopen(faulty_combs_filename, "r");
-  if(!faulty_combs_file){
-    fprintf(stderr, "You must execute the testing_correction.py first on your gadget to generate the %s file.\n", faulty_combs_filename);
-    free(faulty_combs_filename);
-    exit(EXIT_FAILURE);
-  }
-  free(faulty_combs_filename);
-  int nb_input_combs;
-  fscanf(faulty_combs_file, " %d", &nb_input_combs);
-  printf("There are %d input combs to consider\n", nb_input_combs);
-
-  mpf_t * gamma, *gamma_max, *epsilon, *mu, *epsilon_max, *mu_max;
-  gamma = malloc((nb_input_combs+1) * sizeof(mpf_t));
-  gamma_max = malloc((nb_input_combs+1) * sizeof(mpf_t));
-  mu = malloc((nb_input_combs+1) * sizeof(mpf_t));
-  mu_max = malloc((nb_input_combs+1) * sizeof(mpf_t));
-  epsilon = malloc((nb_input_combs+1) * sizeof(mpf_t));
-  epsilon_max = malloc((nb_input_combs+1) * sizeof(mpf_t));
-
+  // The combinations of faults on inputs and the scenarios that were
+  // ignored are recorded in the coefficient file (see
+  // compute_CRPC_coeffs): the faulty scenarios file is not needed here.
+  CoeffStoreParams params = {
+    .gadget_hash = hash_gadget(pf),
+    .property    = COEFF_STORE_CRPC,
+    .k           = k,
+    .t           = t,
+    .coeff_max   = coeff_max,
+    .set         = set,
+    .names_count = length,
+    .coeffs_len  = total_wires+1
+  };
   char * filename;
   get_filename(pf, coeff_max, t, k, set, &filename);
-  FILE * coeffs_file = fopen(filename, "rb");
+  CoeffStore * coeffs_file = coeff_store_open(filename, &params);
   free(filename);
+  uint64_t group_size = fault_set_count(k, length);
 
-  for(int i=0; i< nb_input_combs+1; i++){
+  CRPCScenarios s = { .coeff_max = coeff_max, .length = length };
+  s.nb_input_combs = coeff_store_params(coeffs_file)->input_combs;
+  s.sums = malloc((s.nb_input_combs+1) * sizeof(*s.sums));
+  s.labels = malloc((s.nb_input_combs+1) * sizeof(*s.labels));
 
-    mpf_inits(epsilon[i], epsilon_max[i], mu[i], mu_max[i], gamma[i], gamma_max[i], NULL);
+  uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
 
-    // Constructing input faults prefix
-    int size_input_comb;
-    FaultedVar ** v_inps = NULL;
-    if(i < nb_input_combs){
-      fscanf(faulty_combs_file, " %d ,", &size_input_comb);
-      printf("%d, ", size_input_comb);
-      FaultedVar ** v_inps = malloc(size_input_comb * sizeof(*v_inps));
-      for(int k=0; k<size_input_comb-1; k++){
-        v_inps[k] = malloc(sizeof(*v_inps[k]));
-        v_inps[k]->name = malloc(60 * sizeof(*v_inps[k]->name));
-        fscanf(faulty_combs_file, " %[^,],", v_inps[k]->name);
-        v_inps[k]->set = set;
-        v_inps[k]->fault_on_input = true;
-        sscanf(v_inps[k]->name, "%*[a-zA-Z]%d_%d", &v_inps[k]->share, &v_inps[k]->duplicate);
-        printf("%s %d %d, ", v_inps[k]->name, v_inps[k]->share, v_inps[k]->duplicate);
-      }
-      v_inps[size_input_comb-1] = malloc(sizeof(*v_inps[size_input_comb-1]));
-      v_inps[size_input_comb-1]->name = malloc(60 * sizeof(*v_inps[size_input_comb-1]->name));
-      fscanf(faulty_combs_file, " %s", v_inps[size_input_comb-1]->name);
-      v_inps[size_input_comb-1]->set = set;
-      v_inps[size_input_comb-1]->fault_on_input = true;
-      sscanf(v_inps[size_input_comb-1]->name, "%*[a-zA-Z]%d_%d", &v_inps[size_input_comb-1]->share, &v_inps[size_input_comb-1]->duplicate);
-      printf("%s %d %d\n", v_inps[size_input_comb-1]->name, v_inps[size_input_comb-1]->share, v_inps[size_input_comb-1]->duplicate);
-    }
+  for(int i=0; i< s.nb_input_combs+1; i++){
+    s.sums[i] = make_scenario_sums(k, total_wires+1);
+    s.labels[i] = NULL;
 
-    // Reading faulty scenarios to ignore with the constructed input prefix
-    FaultsCombs * sfc = malloc(sizeof(*sfc));
-    int nb_faulty_combs;
-    int no_internal_faults_scenario_fails;
-    fscanf(faulty_combs_file, " %d %d", &nb_faulty_combs, &no_internal_faults_scenario_fails);
-    // printf("%d\n", nb_faulty_combs);
-    sfc->length = nb_faulty_combs;
-    sfc->fc = malloc(nb_faulty_combs * sizeof(*sfc->fc));
-    FaultsComb ** fc = sfc->fc;
-    for(int m=0; m<nb_faulty_combs; m++){
-      fc[m] = malloc(sizeof(*fc[m]));
-      fscanf(faulty_combs_file, " %d ,", &fc[m]->length);
-      fc[m]->names = malloc(fc[m]->length * sizeof(*fc[m]->names));
-      // printf("%d, ", fc[k]->length);
-      for(int j=0; j< fc[m]->length-1; j++){
-        fc[m]->names[j] = malloc(60 * sizeof(*fc[m]->names[j]));
-        fscanf(faulty_combs_file, " %[^,],", fc[m]->names[j]);
-        // printf("%s, ", fc[k]->names[j]);
-      }
-      fc[m]->names[fc[m]->length-1] = malloc(60 * sizeof(*fc[m]->names[fc[m]->length-1]));
-      fscanf(faulty_combs_file, " %s\n", fc[m]->names[fc[m]->length-1]);
-      // printf("%s\n", fc[k]->names[fc[k]->length-1]);
+    if(i < s.nb_input_combs){
+      const char * label = coeff_store_label(coeffs_file, i);
+      s.labels[i] = strdup(label ? label : "");
     }
 
-     // No internal faults
-    if(i < nb_input_combs){
-      if(!no_internal_faults_scenario_fails){
-        uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-        fread(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-
-        compute_combined_intermediate_leakage_proba(coeffs, 0, length, total_wires+1, pleak, pfault, epsilon[i], -1);
-        compute_combined_intermediate_leakage_proba(coeffs, 0, length, total_wires+1, pleak, pfault, epsilon_max[i], coeff_max);
-        free(coeffs);
+    // No internal faults
+    if(i < s.nb_input_combs){
+      if(coeff_store_get(coeffs_file, i * group_size, coeffs)){
+        scenario_sums_add(s.sums[i], 0, coeffs);
       }
       else{
-        compute_combined_intermediate_mu(0, length, pfault, mu[i]);
-        compute_combined_intermediate_mu(0, length, pfault, mu_max[i]);
+        scenario_sums_add_ignored(s.sums[i], 0);
       }
     }
-    
+
+    // The scenarios that were ignored when computing the coefficients
+    // are not in the coefficient file.
     for(int f=1; f<=k; f++){
-      Faults * fv = malloc(sizeof(*fv));
       Comb * comb = first_comb(f, 0);
       do{
 
-        FaultedVar ** v = malloc(f * sizeof(*v));
-        for(int j=0; j<f; j++){
-          v[j] = malloc(sizeof(*v[j]));
-          v[j]->set = set;
-          v[j]->name = names[comb[j]];
-          v[j]->fault_on_input = false;
+        if(!coeff_store_get(coeffs_file, i * group_size + fault_set_key(comb, f, length), coeffs)){
+          scenario_sums_add_ignored(s.sums[i], f);
+          continue;
         }
-        fv->vars = v;
-        fv->length = f;
+        scenario_sums_add(s.sums[i], f, coeffs);
 
-        if(ignore_faulty_scenario(fv, sfc)){
-          compute_combined_intermediate_mu(f, length, pfault, mu[i]);
-          compute_combined_intermediate_mu(f, length, pfault, mu_max[i]);
-          goto skip;
-        }
-        
-        uint64_t * coeffs = calloc(total_wires+1, sizeof(*coeffs));
-        fread(coeffs, sizeof(*coeffs), total_wires+1, coeffs_file);
-
-        compute_combined_intermediate_leakage_proba(coeffs, f, length, total_wires+1, pleak, pfault, epsilon[i], -1);
-        compute_combined_intermediate_leakage_proba(coeffs, f, length, total_wires+1, pleak, pfault, epsilon_max[i], coeff_max);
-        free(coeffs);
-
-        // gmp_printf("%.10Ff\n", epsilon[i]);
-
-        skip:;
-        for(int j=0; j<f; j++){
-          free(v[j]);
-        }
-        free(v);
       }while(incr_comb_in_place(comb, f, length));
       free(comb);
-      free(fv);
     }
+  }
 
-    if(v_inps){
-      for(int h=0; h<size_input_comb; h++){
-        free(v_inps[h]->name);
-        free(v_inps[h]);
-      }
-      free(v_inps);
-    }
-    
-    free_faults_combs(sfc);
-
-
-    compute_combined_mu_max(k, length, pfault, mu_max[i]);
-
-    mpf_set(gamma[i], mu[i]);
-    mpf_add(gamma[i], gamma[i], epsilon[i]);
-
-    mpf_t tmp, tmp2;
-    mpf_inits(tmp, tmp2, NULL);
-    mpf_neg(tmp, mu[i]);
-    mpf_add_ui(tmp, tmp, 1);
-    mpf_set_ui(tmp2, 1);
-    mpf_div(tmp, tmp2, tmp);
-    mpf_mul(epsilon[i], epsilon[i], tmp);
+  free(coeffs);
+  coeff_store_close(coeffs_file);
 
-    mpf_set(gamma_max[i], mu_max[i]);
-    mpf_add(gamma_max[i], gamma_max[i], epsilon_max[i]);
-    mpf_neg(tmp, mu_max[i]);
-    mpf_add_ui(tmp, tmp, 1);
-    mpf_set_ui(tmp2, 1);
-    mpf_div(tmp, tmp2, tmp);
-    mpf_mul(epsilon_max[i], epsilon_max[i], tmp);
+  return s;
+}
 
+static void free_CRPC_scenarios(CRPCScenarios * s){
+  for(int i=0; i< s->nb_input_combs+1; i++){
+    free_scenario_sums(s->sums[i]);
+    free(s->labels[i]);
   }
+  free(s->sums);
+  free(s->labels);
+}
 
+// Sets |res| to the probabilities of the combination of faults on
+// inputs (|group|) with the highest gamma.
+static void eval_CRPC_point(const void * data, double pleak, double pfault,
+                            CombinedProba * res, int * group){
+  const CRPCScenarios * s = data;
+  ProbaEval * eval = make_proba_eval(s->sums[0]->n, pleak, s->length, pfault);
+
+  CombinedProba current;
+  init_combined_proba(&current);
   int idx_max = 0;
-  for(int i=1; i<nb_input_combs+1; i++){
-    if(mpf_cmp(gamma[i], gamma[idx_max]) > 0){
+  proba_eval_scenarios(eval, s->sums[0], s->coeff_max, res);
+  for(int i=1; i<s->nb_input_combs+1; i++){
+    proba_eval_scenarios(eval, s->sums[i], s->coeff_max, &current);
+    if(mpf_cmp(current.gamma, res->gamma) > 0){
       idx_max = i;
+      CombinedProba tmp = *res;
+      *res = current;
+      current = tmp;
     }
   }
+  *group = idx_max;
+
+  clear_combined_proba(&current);
+  free_proba_eval(eval);
+}
+
+void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak, double pfault, bool set){
+  CRPCScenarios s = load_CRPC_scenarios(pf, coeff_max, k, t, set);
+
+  printf("There are %d input combs to consider\n", s.nb_input_combs);
+  for(int i=0; i<s.nb_input_combs; i++){
+    printf("%s\n", s.labels[i]);
+  }
+
+  CombinedProba res;
+  init_combined_proba(&res);
+  int idx_max;
+  eval_CRPC_point(&s, pleak, pfault, &res, &idx_max);
 
   printf("\n\n");
-  gmp_printf("pfault = %.10Ff, pleak = %.10Ff:\n\n", pfault, pleak);  
+  gmp_printf("pfault = %.10lf, pleak = %.10lf:\n\n", pfault, pleak);
 
-  gmp_printf("epsilon min = %.10Ff\n", epsilon[idx_max]);
-  gmp_printf("mu min = %.10Ff\n", mu[idx_max]);
-  gmp_printf("gamma min = %.10Ff\n\n", gamma[idx_max]);
+  gmp_printf("epsilon min = %.10Ff\n", res.epsilon);
+  gmp_printf("mu min = %.10Ff\n", res.mu);
+  gmp_printf("gamma min = %.10Ff\n\n", res.gamma);
 
-  gmp_printf("epsilon max = %.10Ff\n", epsilon_max[idx_max]);
-  gmp_printf("mu max = %.10Ff\n", mu_max[idx_max]);
-  gmp_printf("gamma max = %.10Ff\n", gamma_max[idx_max]);
+  gmp_printf("epsilon max = %.10Ff\n", res.epsilon_max);
+  gmp_printf("mu max = %.10Ff\n", res.mu_max);
+  gmp_printf("gamma max = %.10Ff\n", res.gamma_max);
 
-  fclose(coeffs_file);
-  fclose(faulty_combs_file);
-  for(int i=0; i<length; i++){
-    free(names[i]);
-  }
-  free(names);
+  clear_combined_proba(&res);
+  free_CRPC_scenarios(&s);
+}
 
-  for(int i=0; i<(nb_input_combs+1); i++){
-    mpf_clears(gamma[i], gamma_max[i], mu[i], mu_max[i], epsilon[i], epsilon_max[i], NULL);
-  }
-  free(gamma);
-  free(gamma_max);
-  free(epsilon);
-  free(epsilon_max);
-  free(mu);
-  free(mu_max);
-}
\ No newline at end of file
+void compute_CRPC_sweep(ParsedFile * pf, int coeff_max, int k, int t, const ProbaGrid * grid,
+                        bool set, int cores, const char * output){
+  CRPCScenarios s = load_CRPC_scenarios(pf, coeff_max, k, t, set);
+  sweep_proba_grid(grid, cores, eval_CRPC_point, &s, (const char * const *)s.labels, output);
+  free_CRPC_scenarios(&s);
+}
@@ -3,7 +3,14 @@
 #include "circuit.h"
 #include "dimensions.h"
 #include "utils.h"
+#include "sweep.h"
 
-void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t, bool set);
+void compute_CRPC_coeffs(ParsedFile * pf, int cores, int coeff_max, int k, int t, bool set,
+                         bool parallel_scenarios, bool gen_faulty_scenarios, bool opt_incompr);
 
-void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak, double pfault, bool set);
\ No newline at end of file
+void compute_CRPC_val(ParsedFile * pf, int coeff_max, int k, int t, double pleak, double pfault, bool set);
+
+// Same as compute_CRPC_val, for all the probabilities of |grid| (see
+// sweep.h).
+void compute_CRPC_sweep(ParsedFile * pf, int coeff_max, int k, int t, const ProbaGrid * grid,
+                        bool set, int cores, const char * output);
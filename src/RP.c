@@ -13,31 +13,11 @@
 #include "coeffs.h"
 #include "verification_rules.h"
 #include "dimensions.h"
+#include "symmetry.h"
 
 
-struct callback_data {
-  uint64_t* coeffs;
-  bool dimension_reduction;
-  Circuit* init_circuit;
-  int* new_to_old_mapping;
-};
-
-
-static void update_coeffs(const Circuit* c, Comb* comb, int comb_len, SecretDep* secret_deps,
-                          void* data_void) {
-  struct callback_data* data = (struct callback_data*) data_void;
-  (void) secret_deps;
-  uint64_t* coeffs = data->coeffs;
-
-  /* printf("[ "); */
-  /* for (int i = 0; i < comb_len; i++) printf("%d ", comb[i]); */
-  /* printf("]\n"); */
-
-  update_coeff_c_single(c, coeffs, comb, comb_len);
-}
-
-
-void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incompr) {
+void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incompr,
+                       bool symmetries) {
   // Initializing coefficients
   uint64_t coeffs[circuit->total_wires+1];
   for (int i = 0; i <= circuit->total_wires; i++) {
@@ -52,39 +32,64 @@ void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incom
     coeff_max = dim_red_data->old_circuit->length;
   }
 
-  Trie* incompr_tuples = opt_incompr ? make_trie(circuit->length) : NULL;
+  // Symmetries are only used by the depth-first enumeration (not with
+  // the incompressible tuples optimization).
+  CircuitSymmetries* sym = NULL;
+  if (symmetries && !opt_incompr) {
+    sym = find_circuit_symmetries(circuit, dim_red_data);
+    print_circuit_symmetries(circuit, sym);
+  } else if (symmetries) {
+    printf("Symmetries are not used with the incompressible tuples optimization (-i).\n");
+  }
+
+  SubsetIndex* incompr_tuples = opt_incompr ? make_subset_index(circuit->length) : NULL;
 
-  struct callback_data data = {
+  CoeffsData data = {
     .coeffs = coeffs,
+    .hist = make_weight_histogram()
   };
 
 
   // Computing coefficients
   printf("f(p) = [ "); fflush(stdout);
-  for (int size = 0; size <= coeff_max_main_loop; size++) {
-
-    find_all_failures(circuit,
-                      cores,
-                      -1,    // t_in
-                      NULL,  // prefix
-                      size,  // comb_len
-                      coeff_max,  // max_len
-                      dim_red_data,
-                      true, // has_random
-                      NULL,  // first_comb
-                      false,  // include_outputs
-                      0,     // shares_to_ignore
-                      false, // PINI
-                      incompr_tuples,
-                      update_coeffs,
-                      (void*)&data);
-
-    // A failure of size 0 is not possible. However, we still want to
-    // iterate in the loop with |size| = 0 to generate the tuples with
-    // only elementary shares (which, because of the dimension
-    // reduction, are never generated otherwise).
-    if (size > 0) {
-      printf("%"PRIu64", ", coeffs[size]); fflush(stdout);
+  if (!opt_incompr) {
+    // RP is monotone: all sizes are verified at once, and the
+    // subtrees of the tuples that leak by themselves are counted
+    // without being enumerated.
+    find_all_failures_monotone(circuit, cores, coeff_max, dim_red_data, sym, coeffs);
+    for (int size = 1; size <= coeff_max_main_loop; size++) {
+      printf("%"PRIu64", ", coeffs[size]);
+    }
+  } else {
+    // The incompressible tuples optimization (-i) works size by size.
+    for (int size = 0; size <= coeff_max_main_loop; size++) {
+
+      find_all_failures_local(circuit,
+                              cores,
+                              -1,    // t_in
+                              NULL,  // prefix
+                              size,  // comb_len
+                              coeff_max,  // max_len
+                              dim_red_data,
+                              true, // has_random
+                              NULL,  // first_comb
+                              false,  // include_outputs
+                              0,     // shares_to_ignore
+                              false, // PINI
+                              incompr_tuples,
+                              coeffs_failure_callback,
+                              (void*)&data,
+                              &coeffs_local_data_ops);
+      // When a single thread is used, failures go to |data.hist|.
+      weight_histogram_flush(data.hist, coeffs);
+
+      // A failure of size 0 is not possible. However, we still want to
+      // iterate in the loop with |size| = 0 to generate the tuples with
+      // only elementary shares (which, because of the dimension
+      // reduction, are never generated otherwise).
+      if (size > 0) {
+        printf("%"PRIu64", ", coeffs[size]); fflush(stdout);
+      }
     }
   }
 
@@ -108,4 +113,8 @@ void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incom
   printf("\n");
 
   get_failure_proba(coeffs, circuit->total_wires+1, 0.01, coeff_max_main_loop);
+
+  free_weight_histogram(data.hist);
+  if (incompr_tuples) free_subset_index(incompr_tuples);
+  free_circuit_symmetries(sym);
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <stdbool.h>
+
 #include "circuit.h"
 
-void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incompr);
+// If |symmetries| is true, the symmetries of the circuit (see
+// symmetry.h) are used to verify only one tuple per orbit of tuples.
+void compute_RP_coeffs(Circuit* circuit, int cores, int coeff_max, int opt_incompr,
+                       bool symmetries);
@@ -13,21 +13,6 @@
 #include "coeffs.h"
 #include "verification_rules.h"
 
-struct callback_data {
-  int t;
-  uint64_t* coeffs;
-};
-
-
-static void update_coeffs(const Circuit* c, Comb* comb, int comb_len, SecretDep* secret_deps,
-                          void* data_void) {
-  (void) secret_deps;
-  struct callback_data* data = (struct callback_data*) data_void;
-  int t = data->t;
-
-  update_coeff_c_single(c, data->coeffs, &comb[t], comb_len-t);
-}
-
 void compute_RPC_coeffs(Circuit* circuit, int cores, int coeff_max,
                         int opt_incompr, int t, int t_output) {
   // Initializing coefficients
@@ -40,7 +25,8 @@ void compute_RPC_coeffs(Circuit* circuit, int cores, int coeff_max,
     coeff_max = circuit->length;
   }
 
-  Trie* incompr_tuples = opt_incompr ? make_trie(circuit->length) : NULL;
+  // The tuples also contain outputs (see |out_comb_arr| below)
+  SubsetIndex* incompr_tuples = opt_incompr ? make_subset_index(circuit->deps->length) : NULL;
 
   // Generating combinations of |t| elements corresponding to the outputs
   uint64_t out_comb_len;
@@ -58,34 +44,39 @@ void compute_RPC_coeffs(Circuit* circuit, int cores, int coeff_max,
     coeffs_out_comb[i] = calloc(circuit->total_wires + 1, sizeof(*coeffs_out_comb[i]));
   }
 
-  VarVector verif_prefix = { .length = t_output, .max_size = t_output, .content = NULL };
-
-  struct callback_data data = { .t = t_output, .coeffs = NULL };
+  // One CoeffsData per output combination
+  CoeffsData data[out_comb_len];
+  void* data_ptrs[out_comb_len];
+  for (unsigned int i = 0; i < out_comb_len; i++) {
+    data[i] = (CoeffsData) { .coeffs = coeffs_out_comb[i], .hist = make_weight_histogram(),
+                             .prefix_len = t_output };
+    data_ptrs[i] = &data[i];
+  }
 
 
   // Computing coefficients
   printf("f(p) = [ "); fflush(stdout);
   for (int size = 0; size <= coeff_max; size++) {
 
+    // All the output combinations are verified at once
+    find_all_failures_prefixes(circuit,
+                               cores,
+                               t, // t_in
+                               out_comb_arr, // prefixes
+                               out_comb_len, // prefix_count
+                               t_output,     // prefix_len
+                               size+t_output, // comb_len
+                               size+t_output, // max_len
+                               NULL,  // dim_red_data
+                               true,  // has_random
+                               incompr_tuples, // incompr_tuples
+                               coeffs_failure_callback,
+                               data_ptrs,
+                               &coeffs_local_data_ops);
+
     for (unsigned int i = 0; i < out_comb_len; i++) {
-      verif_prefix.content = out_comb_arr[i];
-      data.coeffs = coeffs_out_comb[i];
-
-      find_all_failures(circuit,
-                        cores,
-                        t, // t_in
-                        &verif_prefix,  // prefix
-                        size+verif_prefix.length, // comb_len
-                        size+verif_prefix.length, // max_len
-                        NULL,  // dim_red_data
-                        true,  // has_random
-                        NULL,  // first_comb
-                        false, // include_outputs
-                        0,     // shares_to_ignore
-                        false, // PINI
-                        incompr_tuples, // incompr_tuples
-                        update_coeffs,
-                        (void*)&data);
+      // When a single thread is used, failures go to |data[i].hist|.
+      weight_histogram_flush(data[i].hist, data[i].coeffs);
 
 #define max(a,b) ((a) > (b) ? (a) : (b))
       coeffs[size] = max(coeffs[size], coeffs_out_comb[i][size]);
@@ -130,5 +121,8 @@ void compute_RPC_coeffs(Circuit* circuit, int cores, int coeff_max,
   }
   free(out_comb_arr);
   free(coeffs_out_comb);
-  if (incompr_tuples) free_trie(incompr_tuples);
+  for (unsigned i = 0; i < out_comb_len; i++) {
+    free_weight_histogram(data[i].hist);
+  }
+  if (incompr_tuples) free_subset_index(incompr_tuples);
 }
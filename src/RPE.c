@@ -13,6 +13,8 @@
 #include "combinations.h"
 #include "coeffs.h"
 #include "verification_rules.h"
+#include "hash_tuples.h"
+#include "scheduler.h"
 
 #define COEFFS_COUNT    4
 #define I1_or_I2        0
@@ -36,196 +38,50 @@ static double min_arr(double* arr, int len) {
 
 /*************************************************
 
-   HashTable implementation, used for RPE2
-
-
-  TODO: make this implementation more generic so that it can be used
-  by failures_from_incompr as well.
+   Hash tables of failures, used for RPE2
 
 **************************************************/
 
+// The failures are stored in hash tables of tuples (see
+// hash_tuples.h), where each tuple is associated with the number of
+// times it was added (that is, the number of output combinations for
+// which it is a failure).
 
-
-#define HASH_MASK 0x1ffffff // 500M -> times 8 (sizeof a pointer) = 4GB table
-#define HASH_SIZE (HASH_MASK+1)
-
-// Computes a hash for integer |x|.
-// Hash function for integers from https://stackoverflow.com/a/12996028/4990392
-static unsigned int hash_int(unsigned int x) {
-  x = ((x >> 16) ^ x) * 0x45d9f3b;
-  x = ((x >> 16) ^ x) * 0x45d9f3b;
-  x = (x >> 16) ^ x;
-  return x;
-}
-
-// Computes a hash for |comb| by summing the hashes of each of its elements.
-static unsigned int hash_comb(Comb* comb, int comb_len) {
-  unsigned int hash = 0;
-  for (int i = 0; i < comb_len; i++) {
-    hash += hash_int(comb[i]);
-  }
-  return hash & HASH_MASK;
-}
-
-typedef struct _hashnode {
-  Comb* comb;
-  int comb_len;
-  int count;
-  struct _hashnode* next;
-} HashNode;
-
-typedef struct _hashmap {
-  HashNode** content;
-  int count; // The number of elements that are in this hashmap
-  int collisions; // The number of collisions
-} HashMap;
-
-// Allocates and initializes an empty hash map.
-static HashMap* init_hash() {
-  HashMap* map    = malloc(sizeof(*map));
-  map->content    = calloc(HASH_SIZE, sizeof(*(map->content)));
-  map->count      = 0;
-  map->collisions = 0;
-  return map;
-}
-
-
-static HashNode* hash_contains_keyed(HashMap* map, Comb* comb, int comb_len, int hash) {
-  HashNode* node = map->content[hash];
-  while (node) {
-    if (comb_len == node->comb_len &&
-        memcmp(node->comb, comb, comb_len * sizeof(*comb)) == 0) {
-      return node;
-    }
-    node = node->next;
-  }
-  return NULL;
+// Increments the count of |comb| (whose hash is |hash|) in |map|,
+// adding |comb| to |map| if needed.
+static void add_to_hash(TupleHash* map, Comb* comb, int comb_len, unsigned int hash) {
+  int* count = tuple_hash_insert(map, comb, comb_len * sizeof(*comb), hash, NULL);
+  (*count)++;
 }
 
-// Adds |comb| to |map|.
-static Comb* add_to_hash_keyed(HashMap* map, Comb* comb, int comb_len, int hash,
-                               int realloc_comb) {
-  HashNode* node = hash_contains_keyed(map, comb, comb_len, hash);
-  if (node) {
-    node->count++;
-    return node->comb;
-  } else {
-    node = malloc(sizeof(*node));
-    Comb* comb_copy = comb;
-    if (realloc_comb) {
-      comb_copy = malloc(comb_len * sizeof(*comb_copy));
-      memcpy(comb_copy, comb, comb_len * sizeof(*comb_copy));
-    }
-    node->comb = comb_copy;
-    node->comb_len = comb_len;
-    node->count = 1;
-    node->next = map->content[hash];
-    map->content[hash] = node;
-    return comb_copy;
-  }
+static bool count_is_not_1(const void* key, int key_size, void* value, void* data) {
+  (void) key; (void) key_size; (void) data;
+  return *(int*)value != 1;
 }
 
-// Adds |comb| to |map|. If |realloc_comb| is true, then another comb
-// is malloced before adding it to the hash. Otherwise, |comb| is
-// directly added in the hash. This is useful because for RPE2, combs
-// can be put in at most 4 hashes: I1_or_I2, I1, I2 and
-// I1_and_I2. It's thus less time-consuming and less memory-consuming
-// to only malloc the comb once for I1_or_I2 and reuse it as is in the
-// other tables.
-static Comb* add_to_hash(HashMap* map, Comb* comb, int comb_len, int realloc_comb) {
-  unsigned int hash = hash_comb(comb, comb_len);
-  return add_to_hash_keyed(map, comb, comb_len, hash, realloc_comb);
+static bool count_is_target(const void* key, int key_size, void* value, void* data) {
+  (void) key; (void) key_size;
+  return *(int*)value == *(int*)data;
 }
 
-// Removes from |map| all element whose count is 1. If |free_comb| is
-// true, then each comb's ->comb member is freed, otherwise they
-// aren't.
-static void remove_count_1(HashMap* map, int free_comb) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* prev = NULL;
-    HashNode* node = map->content[i];
-    while (node) {
-      HashNode* next = node->next;
-      if (node->count == 1) {
-        if (free_comb) free(node->comb);
-        if (prev) {
-          prev->next = next;
-        } else {
-          map->content[i] = next;
-        }
-        free(node);
-      } else {
-        prev = node;
-      }
-      node = next;
-    }
-  }
+static bool len_is_not_n(const void* key, int key_size, void* value, void* data) {
+  (void) key; (void) value;
+  return key_size != *(int*)data * (int)sizeof(Comb);
 }
 
-// Removes from |map| all element whose count is |target|. If
-// |free_comb| is true, then each comb's ->comb member is freed,
-// otherwise they aren't.
-static void remove_count_diff(HashMap* map, int target, int free_comb) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* prev = NULL;
-    HashNode* node = map->content[i];
-    while (node) {
-      HashNode* next = node->next;
-      if (node->count != target) {
-        if (free_comb) free(node->comb);
-        if (prev) {
-          prev->next = next;
-        } else {
-          map->content[i] = next;
-        }
-        free(node);
-      } else {
-        prev = node;
-      }
-      node = next;
-    }
-  }
+// Removes from |map| all element whose count is 1.
+static void remove_count_1(TupleHash* map) {
+  tuple_hash_filter(map, count_is_not_1, NULL);
 }
 
-// Removes from |map| all elements whose length is |n|. If |free_comb|
-// is true, then each comb's ->comb member is freed, otherwise they
-// aren't.
-static void remove_len_n(HashMap* map, int n, int free_comb) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* prev = NULL;
-    HashNode* node = map->content[i];
-    while (node) {
-      HashNode* next = node->next;
-      if (node->comb_len == n) {
-        if (free_comb) free(node->comb);
-        if (prev) {
-          prev->next = next;
-        } else {
-          map->content[i] = next;
-        }
-        free(node);
-      } else {
-        prev = node;
-      }
-      node = next;
-    }
-  }
+// Removes from |map| all element whose count is not |target|.
+static void remove_count_diff(TupleHash* map, int target) {
+  tuple_hash_filter(map, count_is_target, &target);
 }
 
-// Empties |map| without freeing |map| itself or its ->content
-// member. If |free_comb| is true, then each comb's ->comb member is
-// freed, otherwise they aren't.
-static void empty_hash(HashMap* map, int free_comb) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* node = map->content[i];
-    while (node) {
-      HashNode* next = node->next;
-      if (free_comb) free(node->comb);
-      free(node);
-      node = next;
-    }
-    map->content[i] = NULL;
-  }
+// Removes from |map| all elements whose length is |n|.
+static void remove_len_n(TupleHash* map, int n) {
+  tuple_hash_filter(map, len_is_not_n, &n);
 }
 
 
@@ -237,7 +93,7 @@ static void empty_hash(HashMap* map, int free_comb) {
 
 struct callback_data_RPE1 {
   int t;
-  uint64_t** coeff_c;
+  WeightHistogram** hists; // Failures for each coefficient array (I1_or_I2, I1, ...)
 };
 
 static void update_coeffs_RPE(const Circuit* c, Comb* comb, int comb_len,
@@ -245,27 +101,27 @@ static void update_coeffs_RPE(const Circuit* c, Comb* comb, int comb_len,
                               void* data_void) {
   struct callback_data_RPE1* data = (struct callback_data_RPE1*) data_void;
   int t = data->t;
-  uint64_t** coeff_c = data->coeff_c;
+  WeightHistogram** hists = data->hists;
 
   int secret_count = c->secret_count;
   assert(secret_count <= 2);
   // I1_or_I2 can be updated without checking |secret_deps|, since at
   // least one has to be true, or |comb| would not be a failure and
   // this function would not be called.
-  update_coeff_c_single(c, coeff_c[I1_or_I2], &comb[t], comb_len-t);
+  weight_histogram_add(hists[I1_or_I2], c, &comb[t], comb_len-t);
 
   if (secret_count > 1) {
 
     if (secret_deps[0]) {
-      update_coeff_c_single(c, coeff_c[I1], &comb[t], comb_len-t);
+      weight_histogram_add(hists[I1], c, &comb[t], comb_len-t);
     }
 
     if (secret_deps[1]) {
-      update_coeff_c_single(c, coeff_c[I2], &comb[t], comb_len-t);
+      weight_histogram_add(hists[I2], c, &comb[t], comb_len-t);
     }
 
     if (secret_deps[0] && secret_deps[1]) {
-      update_coeff_c_single(c, coeff_c[I1_and_I2], &comb[t], comb_len-t);
+      weight_histogram_add(hists[I1_and_I2], c, &comb[t], comb_len-t);
     }
   }
 }
@@ -359,30 +215,41 @@ uint64_t** compute_RPE1(Circuit* circuit, DimRedData* dim_red_data,
     }
   }
 
-  struct callback_data_RPE1 data = { .t = t_output, .coeff_c = NULL };
-  VarVector verif_prefix = { .length = t_output, .max_size = t_output, .content = NULL };
+  // One callback_data_RPE1 (and thus one histogram per coefficient
+  // array) per output combination
+  WeightHistogram* hists[out_comb_len][coeffs_count];
+  struct callback_data_RPE1 data[out_comb_len];
+  void* data_ptrs[out_comb_len];
+  for (unsigned i = 0; i < out_comb_len; i++) {
+    for (int j = 0; j < coeffs_count; j++) {
+      hists[i][j] = make_weight_histogram();
+    }
+    data[i] = (struct callback_data_RPE1) { .t = t_output, .hists = hists[i] };
+    data_ptrs[i] = &data[i];
+  }
 
   for (int size = 0; size <= coeff_max_main_loop; size++) {
 
+    // All the output combinations are verified at once
+    find_all_failures_prefixes(circuit,
+                               cores,
+                               t, // t_in
+                               out_comb_arr, // prefixes
+                               out_comb_len, // prefix_count
+                               t_output,     // prefix_len
+                               size+t_output, // comb_len
+                               coeff_max+t_output, // max_len
+                               dim_red_data,  // dim_red_data
+                               true,  // has_random
+                               NULL,  // incompr_tuples
+                               update_coeffs_RPE,
+                               data_ptrs,
+                               NULL); // local_ops
+
     for (unsigned int i = 0; i < out_comb_len; i++) {
-      verif_prefix.content = out_comb_arr[i];
-      data.coeff_c = coeffs_out_comb[i];
-
-      find_all_failures(circuit,
-                        cores,
-                        t, // t_in
-                        &verif_prefix,  // prefix
-                        size+verif_prefix.length, // comb_len
-                        coeff_max+verif_prefix.length, // max_len
-                        dim_red_data,  // dim_red_data
-                        true,  // has_random
-                        NULL,  // first_comb
-                        false, // include_outputs
-                        0,     // shares_to_ignore
-                        false, // PINI
-                        NULL, // incompr_tuples
-                        update_coeffs_RPE,
-                        (void*)&data);
+      for (int j = 0; j < coeffs_count; j++) {
+        weight_histogram_flush(hists[i][j], coeffs_out_comb[i][j]);
+      }
     }
 
     for (int i = 0; i < coeffs_count; i++) {
@@ -433,6 +300,11 @@ uint64_t** compute_RPE1(Circuit* circuit, DimRedData* dim_red_data,
     free(coeffs_out_comb[i]);
   }
   free(coeffs_out_comb);
+  for (unsigned i = 0; i < out_comb_len; i++) {
+    for (int j = 0; j < coeffs_count; j++) {
+      free_weight_histogram(hists[i][j]);
+    }
+  }
 
   return coeffs;
 }
@@ -453,7 +325,7 @@ uint64_t** compute_RPE1(Circuit* circuit, DimRedData* dim_red_data,
 
 struct callback_data_RPE2 {
   int base_size;
-  HashMap** failures;
+  TupleHash** failures;
   int count;
   bool low_memory;
   // The variables below are used only if |low_memory| is true.
@@ -463,14 +335,34 @@ struct callback_data_RPE2 {
   uint64_t out_comb_len;
   Comb** out_comb_arr;
   uint64_t** coeffs;
+  WeightHistogram** hists; // Failures not yet added to |coeffs|
 };
 
+// Adds |failure| (whose hash is |hash|) to the maps |failures|
+// corresponding to the inputs it leaks.
+static void add_failure_to_maps(TupleHash** failures, int secret_count,
+                                Comb* failure, int failure_len, unsigned int hash,
+                                SecretDep* secret_deps) {
+  add_to_hash(failures[I1_or_I2], failure, failure_len, hash);
+  if (secret_count > 1) {
+    if (secret_deps[0]) {
+      add_to_hash(failures[I1], failure, failure_len, hash);
+    }
+    if (secret_deps[1]) {
+      add_to_hash(failures[I2], failure, failure_len, hash);
+    }
+    if (secret_deps[0] && secret_deps[1]) {
+      add_to_hash(failures[I1_and_I2], failure, failure_len, hash);
+    }
+  }
+}
+
 void save_failure_to_map(const Circuit* c, Comb* comb, int comb_len,
                          SecretDep* secret_deps,
                          void* data_void) {
   struct callback_data_RPE2* data = (struct callback_data_RPE2*) data_void;
   int base_size = data->base_size;
-  HashMap** failures = data->failures;
+  TupleHash** failures = data->failures;
   int count = data->count;
   int secret_count = c->secret_count;
 
@@ -479,56 +371,30 @@ void save_failure_to_map(const Circuit* c, Comb* comb, int comb_len,
   // when inserting in failures[I1_or_I2], we know that one of the 2
   // is a failure (and we don't care which one).
 
-  if (count == 0) {
-    Comb* comb_malloced = add_to_hash(failures[I1_or_I2], &comb[base_size],
-                                      comb_len-base_size, 1);
-    if (secret_count > 1) {
-      if (secret_deps[0]) {
-        add_to_hash(failures[I1], comb_malloced, comb_len-base_size, 0);
-      }
-      if (secret_deps[1]) {
-        add_to_hash(failures[I2], comb_malloced, comb_len-base_size, 0);
-      }
-      if (secret_deps[0] && secret_deps[1]) {
-        add_to_hash(failures[I1_and_I2], comb_malloced, comb_len-base_size, 0);
-      }
-    }
-  } else {
-    int hash = hash_comb(&comb[base_size], comb_len-base_size);
-    if (hash_contains_keyed(failures[I1_or_I2], &comb[base_size], comb_len-base_size, hash)) {
-      Comb* comb_malloced = add_to_hash_keyed(failures[I1_or_I2], &comb[base_size],
-                                              comb_len-base_size, hash, 1);
-      if (secret_count > 1) {
-        if (secret_deps[0]) {
-          add_to_hash_keyed(failures[I1], comb_malloced, comb_len-base_size, hash, 0);
-        }
-        if (secret_deps[1]) {
-          add_to_hash_keyed(failures[I2], comb_malloced, comb_len-base_size, hash, 0);
-        }
-        if (secret_deps[0] && secret_deps[1]) {
-          add_to_hash_keyed(failures[I1_and_I2], comb_malloced, comb_len-base_size, hash, 0);
-        }
-      }
-    } else {
-      // Not already in the hash, no need to add it; nothing to do
-    }
+  Comb* failure = &comb[base_size];
+  int failure_len = comb_len - base_size;
+  unsigned int hash = hash_comb(failure, failure_len);
+  // After the first output combination, only failures that were
+  // failures for all previous ones are of interest.
+  if (count == 0 ||
+      tuple_hash_find(failures[I1_or_I2], failure, failure_len * sizeof(*failure), hash)) {
+    add_failure_to_maps(failures, secret_count, failure, failure_len, hash, secret_deps);
   }
 }
 
-void update_coeffs_from_maps(Circuit* c, uint64_t** coeff_c, HashMap** maps,
+void update_coeffs_from_maps(Circuit* c, uint64_t** coeff_c, TupleHash** maps,
                               int comb_len, int coeffs_count) {
+  WeightHistogram* hist = make_weight_histogram();
   for (int i = 0; i < coeffs_count; i++) {
-    HashMap* map = maps[i];
-    for (int j = 0; j < HASH_SIZE; j++) {
-      HashNode* node = map->content[j];
-      while (node) {
-        if (node->comb_len == comb_len) {
-          update_coeff_c_single(c, coeff_c[i], node->comb, comb_len);
-        }
-        node = node->next;
+    TupleHashIter it = tuple_hash_iter(maps[i]);
+    while (tuple_hash_next(&it)) {
+      if (it.key_size == comb_len * (int)sizeof(Comb)) {
+        weight_histogram_add(hist, c, (Comb*)it.key, comb_len);
       }
     }
+    weight_histogram_flush(hist, coeff_c[i]);
   }
+  free_weight_histogram(hist);
 }
 
 
@@ -539,7 +405,7 @@ void check_failure_and_update_coeffs(const Circuit* c, Comb* comb, int comb_len,
   int base_size = data->base_size;
   int secret_count = c->secret_count;
 
-  uint64_t** coeffs = data->coeffs;
+  WeightHistogram** hists = data->hists;
   uint64_t out_comb_len = data->out_comb_len;
   Comb** out_comb_arr = data->out_comb_arr;
   SecretDep secret_deps_other[2];
@@ -566,20 +432,239 @@ void check_failure_and_update_coeffs(const Circuit* c, Comb* comb, int comb_len,
   if (! (secret_deps[0] || secret_deps[1])) {
     return;
   }
-  update_coeff_c_single(c, coeffs[I1_or_I2], &comb[base_size], comb_len-base_size);
+  weight_histogram_add(hists[I1_or_I2], c, &comb[base_size], comb_len-base_size);
   if (secret_count > 1) {
     if (secret_deps[0]) {
-      update_coeff_c_single(c, coeffs[I1], &comb[base_size], comb_len-base_size);
+      weight_histogram_add(hists[I1], c, &comb[base_size], comb_len-base_size);
     }
     if (secret_deps[1]) {
-      update_coeff_c_single(c, coeffs[I2], &comb[base_size], comb_len-base_size);
+      weight_histogram_add(hists[I2], c, &comb[base_size], comb_len-base_size);
     }
     if (secret_deps[0] && secret_deps[1]) {
-      update_coeff_c_single(c, coeffs[I1_and_I2], &comb[base_size], comb_len-base_size);
+      weight_histogram_add(hists[I1_and_I2], c, &comb[base_size], comb_len-base_size);
+    }
+  }
+}
+
+
+// With |low_memory|, each thread accumulates failures in its own
+// histograms, which are then added to the shared coefficients (see
+// LocalDataOps).
+static void* make_local_data_RPE2(void* data_void) {
+  struct callback_data_RPE2* data = (struct callback_data_RPE2*) data_void;
+  struct callback_data_RPE2* local_data = malloc(sizeof(*local_data));
+  *local_data = *data;
+  int coeffs_count = data->circuit->secret_count == 1 ? 1 : COEFFS_COUNT;
+  local_data->hists = malloc(coeffs_count * sizeof(*local_data->hists));
+  for (int i = 0; i < coeffs_count; i++) {
+    local_data->hists[i] = make_weight_histogram();
+  }
+  return local_data;
+}
+
+static void merge_local_data_RPE2(void* data_void, void* local_data_void) {
+  struct callback_data_RPE2* data = (struct callback_data_RPE2*) data_void;
+  struct callback_data_RPE2* local_data = (struct callback_data_RPE2*) local_data_void;
+  int coeffs_count = data->circuit->secret_count == 1 ? 1 : COEFFS_COUNT;
+  for (int i = 0; i < coeffs_count; i++) {
+    weight_histogram_flush(local_data->hists[i], data->coeffs[i]);
+    free_weight_histogram(local_data->hists[i]);
+  }
+  free(local_data->hists);
+  free(local_data);
+}
+
+static const LocalDataOps local_data_ops_RPE2 = {
+  .make  = make_local_data_RPE2,
+  .merge = merge_local_data_RPE2
+};
+
+
+// Multithreaded batches of RPE2 (without |low_memory|).
+//
+// The tuples of a batch are cut in chunks, and each (output
+// combination, chunk) pair is verified independently by a worker of
+// the WorkPool, which saves the failures in its own maps. Since a
+// failure is found at most once per output combination, the sum of
+// its counts in all the maps is the number of output combinations for
+// which it is a failure. To merge the maps in parallel as well, the
+// maps of each worker are split in partitions (according to the hash
+// of the failures): each partition is then merged, filtered and
+// counted independently.
+struct RPE2_worker_data {
+  int base_size;
+  int partitions;
+  int coeffs_count;
+  TupleHash** failures; // failures[p*coeffs_count+i]: map |i| of partition |p|
+} __attribute__((aligned(64)));
+
+struct RPE2_batch_job {
+  Circuit* circuit;
+  DimRedData* dim_red_data;
+  int t;
+  int size;                 // Size of the tuples (without the output shares)
+  int coeff_max;
+  int t_output;
+  uint64_t out_comb_len;
+  Comb** out_comb_arr;
+  uint64_t batch_start;     // Rank (starting at 0) of the first tuple of the batch
+  uint64_t batch_end;       // Rank of the tuple after the last one of the batch
+  uint64_t chunk_size;
+  int chunks;               // Number of chunks per output combination
+  int coeffs_count;
+  int workers;
+  struct RPE2_worker_data* worker_data; // One per worker (and |workers| partitions)
+  uint64_t** coeffs;        // coeffs[p][i*(total_wires+1)+j]: coefficients of partition |p|
+};
+
+static void save_failure_to_partition(const Circuit* c, Comb* comb, int comb_len,
+                                      SecretDep* secret_deps, void* data_void) {
+  struct RPE2_worker_data* data = (struct RPE2_worker_data*) data_void;
+  Comb* failure = &comb[data->base_size];
+  int failure_len = comb_len - data->base_size;
+  unsigned int hash = hash_comb(failure, failure_len);
+  int partition = hash_int(hash) % data->partitions;
+  add_failure_to_maps(&data->failures[partition * data->coeffs_count], c->secret_count,
+                      failure, failure_len, hash, secret_deps);
+}
+
+static void RPE2_verify_worker(void* job_void, int idx, int worker_id) {
+  struct RPE2_batch_job* job = (struct RPE2_batch_job*) job_void;
+  int out_idx = idx / job->chunks;
+  uint64_t start = job->batch_start + (idx % job->chunks) * job->chunk_size;
+  uint64_t count = min(job->chunk_size, job->batch_end - start);
+
+  VarVector verif_prefix = { .length = job->t_output, .max_size = job->t_output,
+                             .content = job->out_comb_arr[out_idx] };
+  // Note: ranks of combinations.c start at 1.
+  Comb* first_tuple = unrank(job->circuit->length, job->size, start+1);
+  _verify_tuples(job->circuit,
+                 job->t, // t_in
+                 &verif_prefix, // prefix
+                 job->size+job->t_output, // comb_len
+                 job->coeff_max+job->t_output, //max_len
+                 job->dim_red_data, // dim_red_data
+                 true,         // has_random
+                 first_tuple,  // first_tuple
+                 count,        // tuple_count
+                 false,        // include_outputs
+                 0,            // shares_to_ignore
+                 false,        // PINI
+                 0,            // stop_at_first_failure
+                 0,            // only_one_tuple
+                 NULL,         // secret_deps_out
+                 NULL,         // incompr_tuples
+                 save_failure_to_partition,
+                 &job->worker_data[worker_id]);
+  free(first_tuple);
+}
+
+static void RPE2_merge_worker(void* job_void, int partition, int worker_id) {
+  (void) worker_id;
+  struct RPE2_batch_job* job = (struct RPE2_batch_job*) job_void;
+  const Circuit* c = job->dim_red_data->old_circuit;
+  int coeffs_count = job->coeffs_count;
+  int target = job->out_comb_len;
+  WeightHistogram* hist = make_weight_histogram();
+  for (int i = 0; i < coeffs_count; i++) {
+    TupleHash* merged = job->worker_data[0].failures[partition * coeffs_count + i];
+    for (int w = 1; w < job->workers; w++) {
+      TupleHash* map = job->worker_data[w].failures[partition * coeffs_count + i];
+      TupleHashIter it = tuple_hash_iter(map);
+      while (tuple_hash_next(&it)) {
+        int* count = tuple_hash_insert(merged, it.key, it.key_size, it.hash, NULL);
+        *count += *(int*)it.value;
+      }
+      tuple_hash_clear(map);
+    }
+    remove_count_diff(merged, target);
+
+    // Same sizes as update_coeffs_from_maps in compute_RPE2
+    TupleHashIter it = tuple_hash_iter(merged);
+    while (tuple_hash_next(&it)) {
+      int comb_len = it.key_size / sizeof(Comb);
+      if (comb_len >= job->size && comb_len <= job->size + job->t_output) {
+        weight_histogram_add(hist, c, (Comb*)it.key, comb_len);
+      }
     }
+    weight_histogram_flush(hist, &job->coeffs[partition][i * (c->total_wires+1)]);
+    tuple_hash_clear(merged);
   }
+  free_weight_histogram(hist);
 }
 
+// Verifies all the tuples of size |size| with |cores| threads, by
+// batches of BATCH_SIZE tuples, and adds the failures (that are
+// failures for all the output combinations) to |coeffs|.
+static void compute_RPE2_batches_parallel(Circuit* circuit, DimRedData* dim_red_data,
+                                          int cores, int coeff_max, int t, int size,
+                                          int t_output, uint64_t out_comb_len,
+                                          Comb** out_comb_arr, int coeffs_count,
+                                          uint64_t** coeffs) {
+  WorkPool* pool = get_work_pool(cores);
+  int workers = work_pool_size(pool);
+  int coeffs_len = dim_red_data->old_circuit->total_wires+1;
+
+  struct RPE2_worker_data* worker_data = aligned_alloc(64, workers * sizeof(*worker_data));
+  uint64_t** partition_coeffs = malloc(workers * sizeof(*partition_coeffs));
+  for (int w = 0; w < workers; w++) {
+    worker_data[w].base_size    = t_output;
+    worker_data[w].partitions   = workers;
+    worker_data[w].coeffs_count = coeffs_count;
+    worker_data[w].failures     = malloc(workers * coeffs_count * sizeof(*worker_data[w].failures));
+    for (int i = 0; i < workers * coeffs_count; i++) {
+      worker_data[w].failures[i] = make_tuple_hash(sizeof(int));
+    }
+    partition_coeffs[w] = calloc(coeffs_count * coeffs_len, sizeof(*partition_coeffs[w]));
+  }
+
+  // About RPE2_CHUNKS_PER_CORE chunks per core and per batch
+  uint64_t total_combs = n_choose_k(size, circuit->length);
+  uint64_t batch_size  = min(BATCH_SIZE, total_combs);
+  uint64_t chunk_size  = batch_size * out_comb_len / ((uint64_t)workers * RPE2_CHUNKS_PER_CORE);
+  chunk_size = min(batch_size, max(chunk_size, PARALLEL_MIN_CHUNK_SIZE));
+
+  struct RPE2_batch_job job = {
+    .circuit       = circuit,
+    .dim_red_data  = dim_red_data,
+    .t             = t,
+    .size          = size,
+    .coeff_max     = coeff_max,
+    .t_output      = t_output,
+    .out_comb_len  = out_comb_len,
+    .out_comb_arr  = out_comb_arr,
+    .chunk_size    = chunk_size,
+    .coeffs_count  = coeffs_count,
+    .workers       = workers,
+    .worker_data   = worker_data,
+    .coeffs        = partition_coeffs
+  };
+
+  for (uint64_t current_comb_idx = 0; current_comb_idx < total_combs;
+       current_comb_idx += BATCH_SIZE) {
+    printf("  + current_comb_idx = %"PRIu64" / %"PRIu64"\n", current_comb_idx, total_combs);
+    job.batch_start = current_comb_idx;
+    job.batch_end   = min(current_comb_idx + BATCH_SIZE, total_combs);
+    job.chunks      = (job.batch_end - job.batch_start + chunk_size - 1) / chunk_size;
+    work_pool_for(pool, job.chunks * out_comb_len, RPE2_verify_worker, &job);
+    work_pool_for(pool, workers, RPE2_merge_worker, &job);
+  }
+
+  for (int w = 0; w < workers; w++) {
+    for (int i = 0; i < coeffs_count; i++) {
+      for (int j = 0; j < coeffs_len; j++) {
+        coeffs[i][j] += partition_coeffs[w][i * coeffs_len + j];
+      }
+    }
+    for (int i = 0; i < workers * coeffs_count; i++) {
+      free_tuple_hash(worker_data[w].failures[i]);
+    }
+    free(worker_data[w].failures);
+    free(partition_coeffs[w]);
+  }
+  free(worker_data);
+  free(partition_coeffs);
+}
 
 
 // RPE2:
@@ -601,9 +686,13 @@ void check_failure_and_update_coeffs(const Circuit* c, Comb* comb, int comb_len,
 // thus have to keep only 1 million tuples in the hashes, which should
 // not be too much.
 //
+// With several cores, the batches are verified in parallel (see
+// compute_RPE2_batches_parallel), and with |low_memory|, the
+// callbacks of the different threads update their own coefficients.
+//
 uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
                         int cores, int coeff_max, int t, int low_memory) {
-  (void) cores; // Due to the batching, multithreading cannot be used.
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
   int secret_count = circuit->secret_count;
   int coeffs_count = secret_count == 1 ? 1 : COEFFS_COUNT;
   int t_output = circuit->share_count - 1;
@@ -677,9 +766,14 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
     }
   }
 
-  HashMap* all_failures[coeffs_count];
+  TupleHash* all_failures[coeffs_count];
   for (int i = 0; i < coeffs_count; i++) {
-    all_failures[i] = init_hash();
+    all_failures[i] = make_tuple_hash(sizeof(int));
+  }
+
+  WeightHistogram* hists[coeffs_count];
+  for (int i = 0; i < coeffs_count; i++) {
+    hists[i] = make_weight_histogram();
   }
 
   struct callback_data_RPE2 data = {
@@ -691,7 +785,8 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
     .dim_red_data = dim_red_data,
     .out_comb_len = out_comb_len,
     .out_comb_arr = out_comb_arr,
-    .coeffs = coeffs
+    .coeffs = coeffs,
+    .hists = hists
   };
   VarVector verif_prefix = { .length = t_output, .max_size = t_output, .content = NULL };
 
@@ -706,21 +801,30 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
       verif_prefix.content = out_comb_arr[0];
       data.count = 0;
 
-      find_all_failures(circuit,
-                        cores,
-                        t, // t_in
-                        &verif_prefix, // prefix
-                        size+verif_prefix.length, // comb_len
-                        coeff_max+verif_prefix.length, //max_len
-                        dim_red_data, // dim_red_data
-                        true,         // has_random
-                        NULL,         // first_tuple
-                        NULL,         // include_outputs
-                        0,            // shares_to_ignore
-                        false,        // PINI
-                        NULL,         // incompr_tuples
-                        check_failure_and_update_coeffs,
-                        (void*)&data);
+      find_all_failures_local(circuit,
+                              cores,
+                              t, // t_in
+                              &verif_prefix, // prefix
+                              size+verif_prefix.length, // comb_len
+                              coeff_max+verif_prefix.length, //max_len
+                              dim_red_data, // dim_red_data
+                              true,         // has_random
+                              NULL,         // first_tuple
+                              NULL,         // include_outputs
+                              0,            // shares_to_ignore
+                              false,        // PINI
+                              NULL,         // incompr_tuples
+                              check_failure_and_update_coeffs,
+                              (void*)&data,
+                              &local_data_ops_RPE2);
+      // When a single thread is used, failures go to |data.hists|.
+      for (int i = 0; i < coeffs_count; i++) {
+        weight_histogram_flush(hists[i], coeffs[i]);
+      }
+    } else if (cores > 1) {
+      compute_RPE2_batches_parallel(circuit, dim_red_data, cores, coeff_max, t, size,
+                                    verif_prefix.length, out_comb_len, out_comb_arr,
+                                    coeffs_count, coeffs);
     } else {
 
       uint64_t total_combs = n_choose_k(size, circuit->length);
@@ -728,7 +832,8 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
       for (uint64_t current_comb_idx = 0; current_comb_idx < total_combs;
            current_comb_idx += BATCH_SIZE) {
         printf("  + current_comb_idx = %"PRIu64" / %"PRIu64"\n", current_comb_idx, total_combs);
-        Comb* current_comb = unrank(circuit->length, size, current_comb_idx);
+        // Note: ranks of combinations.c start at 1.
+        Comb* current_comb = unrank(circuit->length, size, current_comb_idx+1);
 
         for (unsigned int i = 0; i < out_comb_len; i++) {
           printf("    - i = %d / %"PRIu64"\n", i, out_comb_len);
@@ -756,13 +861,13 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
         }
 
         for (int i = 0; i < coeffs_count; i++) {
-          remove_count_diff(all_failures[i], out_comb_len, i == 0);
+          remove_count_diff(all_failures[i], out_comb_len);
         }
         for (int i = size; i <= size+verif_prefix.length; i++) {
           update_coeffs_from_maps(circuit, coeffs, all_failures, i, coeffs_count);
         }
         for (int i = 0; i < coeffs_count; i++) {
-          empty_hash(all_failures[i], i == 0);
+          tuple_hash_clear(all_failures[i]);
         }
 
         free(current_comb);
@@ -771,9 +876,8 @@ uint64_t** compute_RPE2(Circuit* circuit, DimRedData* dim_red_data,
   }
 
   for (int i = 0; i < coeffs_count; i++) {
-    empty_hash(all_failures[i], i == 0);
-    free(all_failures[i]->content);
-    free(all_failures[i]);
+    free_tuple_hash(all_failures[i]);
+    free_weight_histogram(hists[i]);
   }
 
   printf("REP2- I1_or_I2: [ ");
@@ -855,7 +959,7 @@ uint64_t** compute_RPE_copy(Circuit* circuit, DimRedData* dim_red_data,
     }
   }
 
-  HashMap* all_failures[1] = { init_hash() };
+  TupleHash* all_failures[1] = { make_tuple_hash(sizeof(int)) };
 
   struct callback_data_RPE2 data = {
     .base_size = t + t_output,
@@ -893,24 +997,25 @@ uint64_t** compute_RPE_copy(Circuit* circuit, DimRedData* dim_red_data,
                           (void*)&data);
 
         if (j == 1) {
-          remove_count_1(all_failures[0], 1);
+          remove_count_1(all_failures[0]);
         }
       }
 
-      remove_count_diff(all_failures[0], out_comb_len_2, 1);
+      remove_count_diff(all_failures[0], out_comb_len_2);
       update_coeffs_from_maps(circuit, &local_coeffs, all_failures, size, coeffs_count);
 
       // Removing failures of size |size| to keep the memory and the
       // collisions as low as possible.
-      remove_len_n(all_failures[0], size, 1);
+      remove_len_n(all_failures[0], size);
     }
 
     for (int c = 0; c < circuit->total_wires+1; c++) {
       coeffs[0][c] = max(coeffs[0][c], local_coeffs[c]);
     }
 
-    empty_hash(all_failures[0], 1);
+    tuple_hash_clear(all_failures[0]);
   }
+  free_tuple_hash(all_failures[0]);
 
   printf("REP%d%d- I1_or_I2: [ ", first_output ? 1 : 2, first_output ? 2 : 1);
   for (int i = 0; i < circuit->total_wires; i++)
@@ -132,39 +132,61 @@ void compute_SNI(Circuit* circuit, int cores, int t) {
     uint64_t out_comb_len;
     Comb** out_comb_arr = gen_combinations(&out_comb_len, out_size,
                                            circuit->output_count * circuit->share_count - 1);
-    VarVector verif_prefix = { .length = out_size, .max_size = out_size, .content = NULL };
     int share_count_for_failure = t - out_size;
 
     fprintf(stderr, "Checking SNI: out_size = %d ==> %" PRIu64 " tuples...\n", out_size,
            out_comb_len * n_choose_k(t-out_size, circuit->length));
 
     for (unsigned int j = 0; j < out_comb_len; j++) {
-      verif_prefix.content = out_comb_arr[j];
-      for (int k = 0; k < out_size; k++) verif_prefix.content[k] += circuit->length;
-
-      for (int comb_len = out_size; comb_len <= t; comb_len++) {
-        int has_failure = find_first_failure(circuit,
-                                             cores,
-                                             share_count_for_failure, // t_in
-                                             &verif_prefix,  // prefix
-                                             comb_len,     // comb_len
-                                             t,     // max_len
-                                             dim_red_data, // dim_red_data
-                                             has_random, // has_random
-                                             NULL,  // first_comb
-                                             false, // include_outputs
-                                             0,     // shares_to_ignore
-                                             false, // PINI
-                                             NULL,  // incompr_tuples
-                                             display_failure,
-                                             (void*)&data);
-
-        if (has_failure) {
-          goto end_fail;
-        }
+      for (int k = 0; k < out_size; k++) out_comb_arr[j][k] += circuit->length;
+    }
+
+    // Looking for the first output combination (and then the smallest
+    // |comb_len|) that has a failure. All the output combinations are
+    // verified at once for each |comb_len|: after a failure is found
+    // for the j-th combination, only the ones before it remain to be
+    // verified for the next values of |comb_len|.
+    int first_failing = out_comb_len;
+    int first_failing_comb_len = -1;
+    for (int comb_len = out_size; comb_len <= t && first_failing > 0; comb_len++) {
+      int failing = find_first_failing_prefix(circuit,
+                                              cores,
+                                              share_count_for_failure, // t_in
+                                              out_comb_arr,  // prefixes
+                                              first_failing, // prefix_count
+                                              out_size,      // prefix_len
+                                              comb_len,      // comb_len
+                                              t,             // max_len
+                                              dim_red_data,  // dim_red_data
+                                              has_random);   // has_random
+      if (failing != -1) {
+        first_failing = failing;
+        first_failing_comb_len = comb_len;
       }
     }
 
+    if (first_failing_comb_len != -1) {
+      // Verifying this combination again to display the failure
+      VarVector verif_prefix = { .length = out_size, .max_size = out_size,
+                                 .content = out_comb_arr[first_failing] };
+      find_first_failure(circuit,
+                         cores,
+                         share_count_for_failure, // t_in
+                         &verif_prefix,  // prefix
+                         first_failing_comb_len, // comb_len
+                         t,     // max_len
+                         dim_red_data, // dim_red_data
+                         has_random, // has_random
+                         NULL,  // first_comb
+                         false, // include_outputs
+                         0,     // shares_to_ignore
+                         false, // PINI
+                         NULL,  // incompr_tuples
+                         display_failure,
+                         (void*)&data);
+      goto end_fail;
+    }
+
     // Freeing combinations
     for (unsigned int i = 0; i < out_comb_len; i++) free(out_comb_arr[i]);
     free(out_comb_arr);
@@ -0,0 +1,415 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bitdep_kernels.h"
+
+// The functions in this file are written once, as "templates" taking
+// the number of words of each field as parameters. When those
+// parameters are constants, always_inline ensures that each
+// specialized version is compiled with its own fully unrolled loops.
+#define KERNEL_TEMPLATE static inline __attribute__((always_inline))
+
+#define Is_leaky(_v, _t_in, _comb_free_space) (hamming_weight(_v)+_comb_free_space > (_t_in))
+
+
+/***********************************************************
+                      Templates
+************************************************************/
+
+// The randoms, multiplications and correction outputs of a BitDep are
+// stored one after the other, and can thus be seen as a single row of
+// words (whose unused words are never read). The SIMD backend (see
+// the Makefile's SIMD option) XORs whole rows using vectors of
+// |vec_words| words. GCC's vector extensions are used rather than
+// intrinsics, so that the same code is compiled as SSE, AVX2 or
+// AVX-512 depending on the target of the function it is inlined in.
+_Static_assert(offsetof(BitDep, mults) ==
+               offsetof(BitDep, randoms) + RANDOMS_MAX_LEN * sizeof(uint64_t),
+               "BitDep.mults must directly follow BitDep.randoms");
+_Static_assert(offsetof(BitDep, correction_outputs) ==
+               offsetof(BitDep, mults) + BITMULT_MAX_LEN * sizeof(uint64_t),
+               "BitDep.correction_outputs must directly follow BitDep.mults");
+
+typedef uint64_t v4u64 __attribute__((vector_size(32), aligned(8), may_alias));
+typedef uint64_t v8u64 __attribute__((vector_size(64), aligned(8), may_alias));
+
+// Number of words of the row starting at BitDep.randoms that contain
+// all the words used by a circuit of the given shape.
+static int bit_row_len(int rand_len, int mult_len, int corr_len) {
+  if (corr_len) return RANDOMS_MAX_LEN + BITMULT_MAX_LEN + corr_len;
+  if (mult_len) return RANDOMS_MAX_LEN + mult_len;
+  return rand_len;
+}
+
+KERNEL_TEMPLATE void xor_bit_row_tpl(uint64_t* restrict dst, const uint64_t* restrict src,
+                                     int row_len, int vec_words) {
+  int j = 0;
+  if (vec_words == 8) {
+    for ( ; j + 8 <= row_len; j += 8) {
+      *(v8u64*)(dst+j) ^= *(const v8u64*)(src+j);
+    }
+  }
+  if (vec_words >= 4) {
+    for ( ; j + 4 <= row_len; j += 4) {
+      *(v4u64*)(dst+j) ^= *(const v4u64*)(src+j);
+    }
+  }
+  for ( ; j < row_len; j++) {
+    dst[j] ^= src[j];
+  }
+}
+
+// Copies the fields of |src| that are used by a circuit of the given
+// shape to |dst|. The other fields of |dst| are left untouched (they
+// are never read).
+KERNEL_TEMPLATE void copy_bit_dep_tpl(const Circuit* c, BitDep* dst, const BitDep* src,
+                                      int rand_len, int mult_len, int corr_len,
+                                      bool faults_on_inputs) {
+  dst->secrets[0] = src->secrets[0];
+  dst->secrets[1] = src->secrets[1];
+  if (faults_on_inputs) {
+    memcpy(dst->duplicate_secrets, src->duplicate_secrets,
+           c->secret_count * c->share_count * sizeof(*dst->duplicate_secrets));
+  }
+  for (int j = 0; j < rand_len; j++) dst->randoms[j] = src->randoms[j];
+  for (int j = 0; j < mult_len; j++) dst->mults[j] = src->mults[j];
+  for (int j = 0; j < corr_len; j++) dst->correction_outputs[j] = src->correction_outputs[j];
+  dst->out      = src->out;
+  dst->constant = src->constant;
+}
+
+KERNEL_TEMPLATE void gauss_step_tpl(const Circuit* c,
+                                    BitDep* real_dep,
+                                    BitDep** gauss_deps,
+                                    GaussRand* gauss_rands,
+                                    int idx,
+                                    int rand_len, int mult_len, int corr_len,
+                                    bool faults_on_inputs,
+                                    bool full_copy,
+                                    int row_len, // Only used if |vec_words| != 0
+                                    int vec_words) {
+  BitDep* dep_target = gauss_deps[idx];
+  if (dep_target != real_dep) {
+    if (full_copy) {
+      memcpy(dep_target, real_dep, sizeof(*dep_target));
+    } else {
+      copy_bit_dep_tpl(c, dep_target, real_dep, rand_len, mult_len, corr_len,
+                       faults_on_inputs);
+    }
+  }
+  for (int i = 0; i < idx; i++) {
+    if (!gauss_rands[i].is_set) continue;
+    int r_idx  = gauss_rands[i].idx;
+    uint64_t r_mask = gauss_rands[i].mask;
+    if (dep_target->randoms[r_idx] & r_mask) {
+      BitDep* src = gauss_deps[i];
+      for (int j = 0; j < c->secret_count; j++) {
+        dep_target->secrets[j] ^= src->secrets[j];
+      }
+      if (faults_on_inputs) {
+        for (int j = 0; j < c->secret_count*c->share_count; j++) {
+          dep_target->duplicate_secrets[j] ^= src->duplicate_secrets[j];
+        }
+      }
+      if (vec_words) {
+        xor_bit_row_tpl(dep_target->randoms, src->randoms, row_len, vec_words);
+      } else {
+        for (int j = 0; j < rand_len; j++) {
+          dep_target->randoms[j] ^= src->randoms[j];
+        }
+        for (int j = 0; j < mult_len; j++) {
+          dep_target->mults[j] ^= src->mults[j];
+        }
+        for (int j = 0; j < corr_len; j++) {
+          dep_target->correction_outputs[j] ^= src->correction_outputs[j];
+        }
+      }
+      dep_target->constant ^= src->constant;
+
+      dep_target->out ^= src->out;
+    }
+  }
+}
+
+KERNEL_TEMPLATE void set_gauss_rand_tpl(BitDep** deps, GaussRand* gauss_rands, int idx,
+                                        CorrectionOutputs* correction_outputs,
+                                        int rand_len, int corr_len) {
+  BitDep* dep = deps[idx];
+  for (int i = 0; i < rand_len; i++) {
+    if (dep->randoms[i]) {
+      if (corr_len == 0 || correction_outputs->length == 0) {
+        gauss_rands[idx].is_set = 1;
+        gauss_rands[idx].idx    = i;
+        gauss_rands[idx].mask   = 1ULL << (63-__builtin_ia32_lzcnt_u64(dep->randoms[i]));
+        return;
+      }
+      else {
+        bool corr = false;
+        for (int j = 0; j < corr_len; j++) {
+          uint64_t corr_out_elem = dep->correction_outputs[j];
+          while (corr_out_elem != 0) {
+            corr = true;
+            int corr_output_idx_in_elem = __builtin_ia32_lzcnt_u64(corr_out_elem);
+            corr_out_elem &= ~(1ULL << (63-corr_output_idx_in_elem));
+            int corr_out_idx = j * 64 + (63-corr_output_idx_in_elem);
+
+            uint64_t rdep = correction_outputs->total_deps[corr_out_idx]->randoms[i];
+
+            if (((rdep & dep->randoms[i]) ^ dep->randoms[i]) != 0) {
+              gauss_rands[idx].is_set = 1;
+              gauss_rands[idx].idx    = i;
+              gauss_rands[idx].mask   = 1ULL << (63-__builtin_ia32_lzcnt_u64((rdep & dep->randoms[i]) ^ dep->randoms[i]));
+              return;
+            }
+          }
+        }
+        if (!corr) {
+          gauss_rands[idx].is_set = 1;
+          gauss_rands[idx].idx    = i;
+          gauss_rands[idx].mask   = 1ULL << (63-__builtin_ia32_lzcnt_u64(dep->randoms[i]));
+          return;
+        }
+      }
+    }
+  }
+  gauss_rands[idx].mask = 0;
+  gauss_rands[idx].is_set = 0;
+}
+
+KERNEL_TEMPLATE int set_contained_shares_tpl(const Circuit* c, char* leaky_inputs,
+                                             Dependency* secret_deps,
+                                             BitDep** local_deps, GaussRand* gauss_rands,
+                                             int local_deps_len, int secret_count, int t_in,
+                                             int comb_free_space,
+                                             Dependency shares_to_ignore, bool PINI,
+                                             bool faults_on_inputs) {
+  for (int i = 0; i < local_deps_len; i++) {
+    if (gauss_rands[i].is_set) continue;
+
+    BitDep* bit_dep = local_deps[i];
+    for (int k = 0; k < c->secret_count; k++) {
+      secret_deps[k] |= bit_dep->secrets[k];
+    }
+    if (faults_on_inputs) {
+      for (int k = 0; k < c->secret_count; k++) {
+        for (int l = 0; l < c->share_count; l++) {
+          if (bit_dep->duplicate_secrets[k*c->share_count + l]) {
+            secret_deps[k] |= (1ULL << l);
+          }
+        }
+      }
+    }
+  }
+  int ret = 0;
+  if (PINI) {
+    secret_deps[0] |= secret_deps[1];
+  }
+  for (int k = 0; k < secret_count; k++) {
+    secret_deps[k] &= ~shares_to_ignore;
+    if (Is_leaky(secret_deps[k], t_in, comb_free_space)) {
+      ret = 1;
+    }
+    if (Is_leaky(secret_deps[k], t_in, 0)) {
+      leaky_inputs[k] = 1;
+    }
+  }
+  return ret;
+}
+
+
+/***********************************************************
+                   Generic kernels
+************************************************************/
+
+static void gauss_step_generic(const BitDepKernels* k, const Circuit* c,
+                               BitDep* real_dep, BitDep** gauss_deps,
+                               GaussRand* gauss_rands, int idx) {
+  gauss_step_tpl(c, real_dep, gauss_deps, gauss_rands, idx,
+                 k->bit_rand_len, k->bit_mult_len, k->bit_correction_outputs_len,
+                 c->faults_on_inputs,
+                 true, // full_copy
+                 0, 0); // no SIMD
+}
+
+static void set_gauss_rand_generic(const BitDepKernels* k, BitDep** deps,
+                                   GaussRand* gauss_rands, int idx,
+                                   CorrectionOutputs* correction_outputs) {
+  set_gauss_rand_tpl(deps, gauss_rands, idx, correction_outputs,
+                     k->bit_rand_len, k->bit_correction_outputs_len);
+}
+
+
+#ifdef SIMD_AVX2
+__attribute__((target("avx2")))
+static void gauss_step_avx2(const BitDepKernels* k, const Circuit* c,
+                            BitDep* real_dep, BitDep** gauss_deps,
+                            GaussRand* gauss_rands, int idx) {
+  gauss_step_tpl(c, real_dep, gauss_deps, gauss_rands, idx,
+                 k->bit_rand_len, k->bit_mult_len, k->bit_correction_outputs_len,
+                 c->faults_on_inputs,
+                 true, // full_copy
+                 k->bit_row_len, 4);
+}
+#endif
+
+#ifdef SIMD_AVX512
+__attribute__((target("avx512f")))
+static void gauss_step_avx512(const BitDepKernels* k, const Circuit* c,
+                              BitDep* real_dep, BitDep** gauss_deps,
+                              GaussRand* gauss_rands, int idx) {
+  gauss_step_tpl(c, real_dep, gauss_deps, gauss_rands, idx,
+                 k->bit_rand_len, k->bit_mult_len, k->bit_correction_outputs_len,
+                 c->faults_on_inputs,
+                 true, // full_copy
+                 k->bit_row_len, 8);
+}
+#endif
+
+
+/***********************************************************
+                  Specialized kernels
+************************************************************/
+
+// Shapes for which specialized kernels are generated. Gadgets with
+// larger shapes (more than 128 randoms, 128 multiplications or 64
+// correction outputs) use the generic kernels.
+#define KERNELS_MAX_RAND_LEN 2 // 1 to 2 words
+#define KERNELS_MAX_MULT_LEN 2 // 0 to 2 words
+#define KERNELS_MAX_CORR_LEN 1 // 0 to 1 word
+
+#define DEFINE_GAUSS_STEP(R, M, C, F)                                   \
+  static void gauss_step_r##R##_m##M##_c##C##_f##F(                     \
+      const BitDepKernels* k, const Circuit* c,                         \
+      BitDep* real_dep, BitDep** gauss_deps,                            \
+      GaussRand* gauss_rands, int idx) {                                \
+    (void) k;                                                           \
+    gauss_step_tpl(c, real_dep, gauss_deps, gauss_rands, idx,           \
+                   R, M, C, F, false, 0, 0);                            \
+  }
+
+#define DEFINE_GAUSS_STEPS_F(R, M, C) \
+  DEFINE_GAUSS_STEP(R, M, C, 0)       \
+  DEFINE_GAUSS_STEP(R, M, C, 1)
+#define DEFINE_GAUSS_STEPS_C(R, M)    \
+  DEFINE_GAUSS_STEPS_F(R, M, 0)       \
+  DEFINE_GAUSS_STEPS_F(R, M, 1)
+#define DEFINE_GAUSS_STEPS_M(R)       \
+  DEFINE_GAUSS_STEPS_C(R, 0)          \
+  DEFINE_GAUSS_STEPS_C(R, 1)          \
+  DEFINE_GAUSS_STEPS_C(R, 2)
+
+DEFINE_GAUSS_STEPS_M(1)
+DEFINE_GAUSS_STEPS_M(2)
+
+#define GAUSS_STEPS_F(R, M, C) \
+  { gauss_step_r##R##_m##M##_c##C##_f0, gauss_step_r##R##_m##M##_c##C##_f1 }
+#define GAUSS_STEPS_C(R, M) \
+  { GAUSS_STEPS_F(R, M, 0), GAUSS_STEPS_F(R, M, 1) }
+#define GAUSS_STEPS_M(R) \
+  { GAUSS_STEPS_C(R, 0), GAUSS_STEPS_C(R, 1), GAUSS_STEPS_C(R, 2) }
+
+typedef void (*gauss_step_fn)(const BitDepKernels*, const Circuit*,
+                              BitDep*, BitDep**, GaussRand*, int);
+
+// Indexed by [rand_len-1][mult_len][corr_len][faults_on_inputs]
+static const gauss_step_fn gauss_steps[KERNELS_MAX_RAND_LEN][KERNELS_MAX_MULT_LEN+1]
+                                      [KERNELS_MAX_CORR_LEN+1][2] = {
+  GAUSS_STEPS_M(1),
+  GAUSS_STEPS_M(2)
+};
+
+
+#define DEFINE_SET_GAUSS_RAND(R, C)                                     \
+  static void set_gauss_rand_r##R##_c##C(                               \
+      const BitDepKernels* k, BitDep** deps,                            \
+      GaussRand* gauss_rands, int idx,                                  \
+      CorrectionOutputs* correction_outputs) {                          \
+    (void) k;                                                           \
+    set_gauss_rand_tpl(deps, gauss_rands, idx, correction_outputs, R, C); \
+  }
+
+DEFINE_SET_GAUSS_RAND(1, 0)
+DEFINE_SET_GAUSS_RAND(1, 1)
+DEFINE_SET_GAUSS_RAND(2, 0)
+DEFINE_SET_GAUSS_RAND(2, 1)
+
+typedef void (*set_gauss_rand_fn)(const BitDepKernels*, BitDep**, GaussRand*, int,
+                                  CorrectionOutputs*);
+
+// Indexed by [rand_len-1][corr_len]
+static const set_gauss_rand_fn set_gauss_rands[KERNELS_MAX_RAND_LEN][KERNELS_MAX_CORR_LEN+1] = {
+  { set_gauss_rand_r1_c0, set_gauss_rand_r1_c1 },
+  { set_gauss_rand_r2_c0, set_gauss_rand_r2_c1 }
+};
+
+
+#define DEFINE_SET_CONTAINED_SHARES(F)                                  \
+  static int set_contained_shares_f##F(                                 \
+      const Circuit* c, char* leaky_inputs, Dependency* secret_deps,    \
+      BitDep** local_deps, GaussRand* gauss_rands,                      \
+      int local_deps_len, int secret_count, int t_in,                   \
+      int comb_free_space, Dependency shares_to_ignore, bool PINI) {    \
+    return set_contained_shares_tpl(c, leaky_inputs, secret_deps,       \
+                                    local_deps, gauss_rands,            \
+                                    local_deps_len, secret_count, t_in, \
+                                    comb_free_space, shares_to_ignore,  \
+                                    PINI, F);                           \
+  }
+
+DEFINE_SET_CONTAINED_SHARES(0)
+DEFINE_SET_CONTAINED_SHARES(1)
+
+
+/***********************************************************
+                     Selection
+************************************************************/
+
+void init_bitdep_kernels(BitDepKernels* k, const Circuit* c) {
+  int random_count       = c->random_count;
+  int mult_count         = c->deps->mult_deps->length;
+  int corr_outputs_count = c->deps->correction_outputs->length;
+
+  // Same computations as in _verify_tuples
+  k->bit_rand_len = 1 + random_count / 64;
+  k->bit_mult_len = (mult_count == 0) ? 0 : 1 + mult_count / 64;
+  k->bit_correction_outputs_len = (corr_outputs_count == 0) ? 0 : 1 + corr_outputs_count / 64;
+  k->bit_row_len = bit_row_len(k->bit_rand_len, k->bit_mult_len, k->bit_correction_outputs_len);
+
+  int faults = c->faults_on_inputs ? 1 : 0;
+
+  if (k->bit_rand_len <= KERNELS_MAX_RAND_LEN &&
+      k->bit_mult_len <= KERNELS_MAX_MULT_LEN &&
+      k->bit_correction_outputs_len <= KERNELS_MAX_CORR_LEN) {
+    k->gauss_step = gauss_steps[k->bit_rand_len-1][k->bit_mult_len]
+                               [k->bit_correction_outputs_len][faults];
+  } else {
+    // Wide rows: this is where the SIMD backend (if enabled at compile
+    // time and supported by the CPU) pays off. Narrower rows are
+    // better served by the unrolled scalar kernels above.
+    k->gauss_step = gauss_step_generic;
+#ifdef SIMD_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+      k->gauss_step = gauss_step_avx2;
+    }
+#endif
+#ifdef SIMD_AVX512
+    if (__builtin_cpu_supports("avx512f")) {
+      k->gauss_step = gauss_step_avx512;
+    }
+#endif
+  }
+
+  if (k->bit_rand_len <= KERNELS_MAX_RAND_LEN &&
+      k->bit_correction_outputs_len <= KERNELS_MAX_CORR_LEN) {
+    k->set_gauss_rand = set_gauss_rands[k->bit_rand_len-1][k->bit_correction_outputs_len];
+  } else {
+    k->set_gauss_rand = set_gauss_rand_generic;
+  }
+
+  // set_contained_shares does not depend on the number of words of
+  // the BitDeps, and thus always has a specialized version.
+  k->set_contained_shares = faults ? set_contained_shares_f1 : set_contained_shares_f0;
+}
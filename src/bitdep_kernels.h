@@ -0,0 +1,57 @@
+#pragma once
+
+// Specialized versions of the innermost functions of the verification
+// (gauss_step, set_gauss_rand and set_contained_shares).
+//
+// A BitDep is always allocated for the largest supported gadgets (see
+// circuit.h), but most gadgets only use 1 word of randoms, 0 to 2
+// words of multiplications and 0 or 1 word of correction outputs. The
+// generic functions loop over the actual number of words (which is
+// only known at runtime), and copy whole BitDeps. The specialized
+// versions know those numbers at compile time: the compiler fully
+// unrolls their loops, and only the words that are actually used are
+// copied.
+//
+// The kernels are selected once per call to _verify_tuples, based on
+// the shape of the circuit (see init_bitdep_kernels). Circuits whose
+// shape has no specialized version use the generic kernels, or, when
+// IronMask is compiled with SIMD=avx2 or SIMD=avx512 (see the
+// Makefile) and the CPU supports it, a SIMD version of gauss_step.
+
+#include <stdbool.h>
+
+#include "circuit.h"
+#include "verification_rules.h"
+
+typedef struct _bitdep_kernels BitDepKernels;
+
+struct _bitdep_kernels {
+  int bit_rand_len;               // Number of words of BitDep.randoms used
+  int bit_mult_len;               // Number of words of BitDep.mults used
+  int bit_correction_outputs_len; // Number of words of BitDep.correction_outputs used
+  int bit_row_len; // Number of words from BitDep.randoms to the last word used
+                   // (randoms, mults and correction_outputs are contiguous)
+
+  // Adds |real_dep| at index |idx| of |gauss_deps|, and performs a
+  // Gauss elimination on it (see gauss_step in verification_rules.c).
+  void (*gauss_step)(const BitDepKernels* k, const Circuit* c,
+                     BitDep* real_dep, BitDep** gauss_deps,
+                     GaussRand* gauss_rands, int idx);
+
+  // Sets |gauss_rands[idx]| to contain the first random that appears
+  // in |deps[idx]| (see set_gauss_rand in verification_rules.c).
+  void (*set_gauss_rand)(const BitDepKernels* k, BitDep** deps,
+                         GaussRand* gauss_rands, int idx,
+                         CorrectionOutputs* correction_outputs);
+
+  // Same as set_contained_shares in verification_rules.c.
+  int (*set_contained_shares)(const Circuit* c, char* leaky_inputs,
+                              Dependency* secret_deps,
+                              BitDep** local_deps, GaussRand* gauss_rands,
+                              int local_deps_len, int secret_count, int t_in,
+                              int comb_free_space,
+                              Dependency shares_to_ignore, bool PINI);
+};
+
+// Fills |k| with the kernels best suited for |c|.
+void init_bitdep_kernels(BitDepKernels* k, const Circuit* c);
@@ -273,13 +273,118 @@ void _update_contained_secrets(Dependency** contained_secrets, int idx, Dependen
 }
 
 
+// Returns true if the variables |dep1| and |dep2| have exactly the
+// same dependencies.
+static bool same_dep_arr(const DepArrVector* dep1, const DepArrVector* dep2, int deps_size) {
+  if (dep1->length != dep2->length) return false;
+  for (int j = 0; j < dep1->length; j++) {
+    if (memcmp(dep1->content[j], dep2->content[j], deps_size * sizeof(Dependency))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns an array of size |c->deps->length| where a cell at 1
+// indicates that the variable at this index in |c| can reuse the
+// contained secrets and the BitDeps of the same variable in |base|
+// (see compute_contained_secrets and compute_bit_deps). This is the
+// case when both variables have the same name and the same
+// dependencies, do not depend on correction outputs, and when the
+// operands of each multiplication they depend on are themselves
+// unchanged. Returns NULL if the layout of the dependencies of |c| and
+// |base| differ (eg, because of faults on inputs), in which case
+// nothing can be reused.
+bool* compute_reusable_deps(const Circuit* c, int ** temporary_mult_idx,
+                            const Circuit* base, int ** base_temporary_mult_idx) {
+  const DependencyList* deps = c->deps;
+  const DependencyList* base_deps = base->deps;
+  if (deps->length != base_deps->length ||
+      deps->deps_size != base_deps->deps_size ||
+      deps->first_rand_idx != base_deps->first_rand_idx ||
+      deps->first_mult_idx != base_deps->first_mult_idx ||
+      deps->first_correction_idx != base_deps->first_correction_idx ||
+      deps->mult_deps->length != base_deps->mult_deps->length ||
+      deps->correction_outputs->length != base_deps->correction_outputs->length ||
+      c->faults_on_inputs || base->faults_on_inputs) {
+    return NULL;
+  }
+
+  int deps_size = deps->deps_size;
+  int mult_count = deps->mult_deps->length;
+  int non_mult_deps_count = deps->first_mult_idx;
+
+  bool* same_deps = malloc(deps->length * sizeof(*same_deps));
+  for (int i = 0; i < deps->length; i++) {
+    same_deps[i] = strcmp(deps->names[i], base_deps->names[i]) == 0 &&
+      same_dep_arr(deps->deps[i], base_deps->deps[i], deps_size);
+  }
+
+  bool* same_mults = malloc(mult_count * sizeof(*same_mults));
+  for (int i = 0; i < mult_count; i++) {
+    int left  = temporary_mult_idx[i][0];
+    int right = temporary_mult_idx[i][1];
+    same_mults[i] = left  == base_temporary_mult_idx[i][0] &&
+                    right == base_temporary_mult_idx[i][1] &&
+                    same_deps[left] && same_deps[right];
+  }
+
+  bool* reusable = malloc(deps->length * sizeof(*reusable));
+  for (int i = 0; i < deps->length; i++) {
+    reusable[i] = same_deps[i];
+    DepArrVector* dep_arr = deps->deps[i];
+    for (int j = 0; j < dep_arr->length && reusable[i]; j++) {
+      Dependency* dep = dep_arr->content[j];
+      for (int k = 0; k < mult_count; k++) {
+        if (dep[non_mult_deps_count+k] && !same_mults[k]) {
+          reusable[i] = false;
+          break;
+        }
+      }
+      int start = deps->first_correction_idx;
+      for (int k = start; k < start + deps->correction_outputs->length; k++) {
+        if (dep[k]) {
+          reusable[i] = false;
+          break;
+        }
+      }
+    }
+  }
+
+  free(same_deps);
+  free(same_mults);
+  return reusable;
+}
+
+
 // Computes |c->deps->contained_secrets|, ie, which secret shares are
-// in each variable.
-void compute_contained_secrets(Circuit* c, int ** temporary_mult_idx) {
+// in each variable. If |reusable| is not NULL, the variables whose
+// cell is set in |reusable| share the contained secrets of |base|
+// instead of recomputing them (see compute_reusable_deps).
+void compute_contained_secrets(Circuit* c, int ** temporary_mult_idx,
+                               const Circuit* base, const bool* reusable) {
   int non_mult_deps_count = c->deps->first_mult_idx;
 
   Dependency** contained_secrets = malloc(c->deps->length * sizeof(*contained_secrets));
   for (int i = 0; i < c->deps->length; i++) {
+    if (reusable && reusable[i]) {
+      contained_secrets[i] = base->deps->contained_secrets[i];
+      // Multiplications are unchanged as well, but their contained
+      // secrets would normally have been computed here
+      DepArrVector* dep_arr = c->deps->deps[i];
+      for (int dep_idx = 0; dep_idx < dep_arr->length; dep_idx++) {
+        for (int k = 0; k < c->deps->mult_deps->length; k++) {
+          MultDependency* mult_dep = c->deps->mult_deps->deps[k];
+          if (dep_arr->content[dep_idx][non_mult_deps_count+k] && !mult_dep->contained_secrets) {
+            mult_dep->contained_secrets = calloc(c->secret_count, sizeof(*mult_dep->contained_secrets));
+            memcpy(mult_dep->contained_secrets,
+                   base->deps->mult_deps->deps[k]->contained_secrets,
+                   c->secret_count * sizeof(*mult_dep->contained_secrets));
+          }
+        }
+      }
+      continue;
+    }
     // Allocating arrays of size 2 instead of size |c->secret_count|
     // so that we can always access the 2nd element without undefined
     // behavior, which removes the need for some "if (secret_count ==
@@ -317,8 +422,12 @@ void compute_contained_secrets(Circuit* c, int ** temporary_mult_idx) {
 }
 
 
-// Creates the BitDeps corresponding to the DependencyList in |circuit|.
-void compute_bit_deps(Circuit* circuit, int ** temporary_mult_idx) {
+// Creates the BitDeps corresponding to the DependencyList in
+// |circuit|. If |reusable| is not NULL, the variables whose cell is set
+// in |reusable| share the BitDeps of |base| instead of recomputing them
+// (see compute_reusable_deps).
+void compute_bit_deps(Circuit* circuit, int ** temporary_mult_idx,
+                      const Circuit* base, const bool* reusable) {
   DependencyList* deps = circuit->deps;
   BitDepVector** bit_deps = malloc(deps->length * sizeof(*bit_deps));
 
@@ -337,6 +446,10 @@ void compute_bit_deps(Circuit* circuit, int ** temporary_mult_idx) {
   int bit_correction_outputs_len = (corr_outputs_count == 0) ? 0 : 1 + corr_outputs_count / 64;
 
   for (int i = 0; i < deps->length; i++) {
+    if (reusable && reusable[i]) {
+      bit_deps[i] = base->deps->bit_deps[i];
+      continue;
+    }
     DepArrVector* dep = deps->deps[i];
     bit_deps[i] = BitDepVector_make();
     for (int j = 0; j < dep->length; j++) {
@@ -704,7 +817,7 @@ void free_circuit(Circuit* c) {
     DepArrVector_free(c->deps->deps[i]);
     free(c->deps->names[i]);
     free(c->deps->contained_secrets[i]);
-    BitDepVector_deep_free(c->deps->bit_deps[i]);
+    if (c->deps->bit_deps[i]) BitDepVector_deep_free(c->deps->bit_deps[i]);
   }
   free(c->deps->deps);
   free(c->deps->deps_exprs);
@@ -142,8 +142,12 @@ BitDep * init_bit_dep();
 void set_bit_dep_zero(BitDep* bit_dep);
 void compute_total_wires(Circuit* c);
 void compute_rands_usage(Circuit* c);
-void compute_contained_secrets(Circuit* c, int ** temporary_mult_idx);
-void compute_bit_deps(Circuit* circuit, int ** temporary_mult_idx);
+bool* compute_reusable_deps(const Circuit* c, int ** temporary_mult_idx,
+                            const Circuit* base, int ** base_temporary_mult_idx);
+void compute_contained_secrets(Circuit* c, int ** temporary_mult_idx,
+                               const Circuit* base, const bool* reusable);
+void compute_bit_deps(Circuit* circuit, int ** temporary_mult_idx,
+                      const Circuit* base, const bool* reusable);
 void compute_total_correction_bit_deps(Circuit * circuit);
 void print_circuit(const Circuit* c);
 
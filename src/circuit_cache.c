@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "circuit_cache.h"
+#include "coeff_store.h"
+#include "config.h"
+
+#define CIRCUIT_CACHE_MAGIC "IMCIRCCH"
+#define CIRCUIT_CACHE_VERSION 1
+
+
+/***********************************************************
+                        File layout
+************************************************************/
+
+typedef struct _circuit_cache_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_count;
+  uint64_t gadget_hash; // See hash_gadget
+  uint64_t file_size;
+  uint64_t checksum;    // Checksum of the whole file, except this field
+} CircuitCacheFileHeader;
+
+// Each record is followed by its |length| variables (as int32_t),
+// padded to a multiple of 8 bytes.
+typedef struct _circuit_cache_record {
+  uint32_t kind;
+  uint32_t length;
+  uint64_t key;
+} CircuitCacheRecord;
+
+_Static_assert(sizeof(CircuitCacheFileHeader) == 40, "CircuitCacheFileHeader should not have padding");
+_Static_assert(sizeof(CircuitCacheRecord) == 16, "CircuitCacheRecord should not have padding");
+
+static size_t record_size(uint32_t length) {
+  return sizeof(CircuitCacheRecord) + (length * sizeof(int32_t) + 7) / 8 * 8;
+}
+
+static uint64_t file_checksum(const uint8_t* data, size_t size) {
+  uint64_t hash = hash_bytes(HASH_INIT, data, offsetof(CircuitCacheFileHeader, checksum));
+  return hash_bytes(hash, data + sizeof(CircuitCacheFileHeader),
+                    size - sizeof(CircuitCacheFileHeader));
+}
+
+
+/***********************************************************
+                           Cache
+************************************************************/
+
+// The cache of the gadget being verified (NULL |filename| if the cache
+// is not opened).
+static struct {
+  char* filename;
+  uint64_t gadget_hash;
+  const uint8_t* data; // The whole file (mmap-ed), or NULL if it is empty
+  size_t size;
+} cache = { NULL, 0, NULL, 0 };
+
+// Maps the file of the cache. Files that are not valid caches of the
+// current gadget are ignored (they will be overwritten by the next
+// circuit_cache_add).
+static void map_cache_file() {
+  cache.data = NULL;
+  cache.size = 0;
+  int fd = open(cache.filename, O_RDONLY);
+  if (fd == -1) return;
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(CircuitCacheFileHeader)) {
+    close(fd);
+    return;
+  }
+  size_t size = st.st_size;
+  const uint8_t* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return;
+
+  const CircuitCacheFileHeader* header = (const CircuitCacheFileHeader*) data;
+  bool valid = !memcmp(header->magic, CIRCUIT_CACHE_MAGIC, sizeof(header->magic)) &&
+    header->version == CIRCUIT_CACHE_VERSION &&
+    header->file_size == size &&
+    header->checksum == file_checksum(data, size);
+  // Checking that the records fit in the file
+  size_t offset = sizeof(*header);
+  for (uint32_t i = 0; valid && i < header->record_count; i++) {
+    const CircuitCacheRecord* record = (const CircuitCacheRecord*)(data + offset);
+    valid = offset + sizeof(*record) <= size && offset + record_size(record->length) <= size;
+    if (valid) offset += record_size(record->length);
+  }
+  valid = valid && offset == size;
+  if (valid && header->gadget_hash != cache.gadget_hash) {
+    printf("Circuit cache %s was computed for another version of the gadget "
+           "(or with other glitch/transition options): ignoring it.\n", cache.filename);
+    valid = false;
+  }
+  if (!valid) {
+    munmap((void*)data, size);
+    return;
+  }
+  cache.data = data;
+  cache.size = size;
+}
+
+void circuit_cache_open(const ParsedFile* pf) {
+  if (!CIRCUIT_CACHE) return;
+  circuit_cache_close();
+  cache.filename = malloc(strlen(pf->filename) + 20);
+  sprintf(cache.filename, "%s.circuit_cache", pf->filename);
+  cache.gadget_hash = hash_gadget(pf);
+  map_cache_file();
+}
+
+void circuit_cache_close() {
+  if (cache.data) munmap((void*)cache.data, cache.size);
+  free(cache.filename);
+  cache.filename = NULL;
+  cache.data = NULL;
+  cache.size = 0;
+}
+
+uint64_t hash_circuit_state(const Circuit* circuit) {
+  const DependencyList* deps = circuit->deps;
+  int32_t sizes[3] = { circuit->length, deps->length, deps->deps_size };
+  uint64_t hash = hash_bytes(HASH_INIT, sizes, sizeof(sizes));
+  for (int i = 0; i < deps->length; i++) {
+    hash = hash_bytes(hash, deps->names[i], strlen(deps->names[i]) + 1);
+  }
+  return hash;
+}
+
+// Returns the record (|kind|, |key|), or NULL if there is none.
+static const CircuitCacheRecord* find_record(uint32_t kind, uint64_t key) {
+  if (!cache.data) return NULL;
+  const CircuitCacheFileHeader* header = (const CircuitCacheFileHeader*) cache.data;
+  size_t offset = sizeof(*header);
+  for (uint32_t i = 0; i < header->record_count; i++) {
+    const CircuitCacheRecord* record = (const CircuitCacheRecord*)(cache.data + offset);
+    if (record->kind == kind && record->key == key) return record;
+    offset += record_size(record->length);
+  }
+  return NULL;
+}
+
+VarVector* circuit_cache_get(uint32_t kind, uint64_t key) {
+  const CircuitCacheRecord* record = find_record(kind, key);
+  if (!record) return NULL;
+  const int32_t* content = (const int32_t*)(record + 1);
+  VarVector* vars = VarVector_make_size(record->length + 1);
+  for (uint32_t i = 0; i < record->length; i++) {
+    VarVector_push(vars, content[i]);
+  }
+  return vars;
+}
+
+void circuit_cache_add(uint32_t kind, uint64_t key, const VarVector* vars) {
+  if (!cache.filename || find_record(kind, key)) return;
+
+  // The new file: the records of the current one, followed by the new
+  // record.
+  size_t old_records_size = cache.data ? cache.size - sizeof(CircuitCacheFileHeader) : 0;
+  size_t size = sizeof(CircuitCacheFileHeader) + old_records_size + record_size(vars->length);
+  uint8_t* data = calloc(size, 1);
+  CircuitCacheFileHeader* header = (CircuitCacheFileHeader*) data;
+  memcpy(header->magic, CIRCUIT_CACHE_MAGIC, sizeof(header->magic));
+  header->version = CIRCUIT_CACHE_VERSION;
+  header->record_count = 1;
+  if (cache.data) {
+    header->record_count += ((const CircuitCacheFileHeader*) cache.data)->record_count;
+    memcpy(data + sizeof(*header), cache.data + sizeof(*header), old_records_size);
+  }
+  header->gadget_hash = cache.gadget_hash;
+  header->file_size = size;
+
+  CircuitCacheRecord* record = (CircuitCacheRecord*)(data + sizeof(*header) + old_records_size);
+  record->kind = kind;
+  record->length = vars->length;
+  record->key = key;
+  int32_t* content = (int32_t*)(record + 1);
+  for (int i = 0; i < vars->length; i++) {
+    content[i] = vars->content[i];
+  }
+  header->checksum = file_checksum(data, size);
+
+  // Writing to a temporary file and renaming it, so that other runs on
+  // the same gadget never read a partially written cache.
+  char* tmp_filename = malloc(strlen(cache.filename) + 30);
+  sprintf(tmp_filename, "%s.%d.tmp", cache.filename, (int)getpid());
+  FILE* f = fopen(tmp_filename, "wb");
+  bool ok = f && fwrite(data, 1, size, f) == size;
+  if (f) ok = (fclose(f) == 0) && ok;
+  ok = ok && rename(tmp_filename, cache.filename) == 0;
+  if (!ok) {
+    // Not being able to write the cache (eg, read-only directory) only
+    // means that the next runs will have to recompute it.
+    fprintf(stderr, "Warning: failed to write circuit cache %s.\n", cache.filename);
+    remove(tmp_filename);
+  }
+  free(tmp_filename);
+  free(data);
+
+  if (ok) {
+    if (cache.data) munmap((void*)cache.data, cache.size);
+    map_cache_file();
+  }
+}
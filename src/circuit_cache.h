@@ -0,0 +1,60 @@
+#pragma once
+
+// Cache of the results of the costly preprocessing steps applied to
+// a gadget before its verification, so that the many runs on the
+// same gadget (for each t, k, probability...) only pay for them once.
+//
+// Parsing a gadget and building its Circuit takes a few milliseconds
+// even for the largest gadgets; the step that actually dominates the
+// startup of NI/SNI on multiplication gadgets is
+// advanced_dimension_reduction (several seconds at order 6, and
+// minutes beyond), whose result (the variables that it removes) is
+// cached here.
+//
+// The cache of a gadget is stored in a file next to it
+// (<gadget>.circuit_cache), which is made of:
+//
+//  - a header (CircuitCacheFileHeader in circuit_cache.c) containing
+//    the hash of the gadget file and of the glitch/transition options
+//    (see hash_gadget): a cache computed for another version of the
+//    gadget is ignored, and replaced by the next write;
+//
+//  - records, each containing the variables returned by a
+//    preprocessing step (|kind|) for a given state of the circuit
+//    (|key|, see hash_circuit_state).
+//
+// The file is mmap-ed when the cache is opened, and rewritten (to a
+// temporary file, which is then renamed, so that concurrent runs
+// never see a partial file) whenever a record is added.
+//
+// The cache is opened once by main (see circuit_cache_open), and
+// disabled if CIRCUIT_CACHE is 0 in config.h.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "circuit.h"
+#include "vectors.h"
+#include "utils.h"
+
+#define CIRCUIT_CACHE_ADVANCED_DIM_RED 0 // Variables removed by advanced_dimension_reduction
+
+// Opens the cache of the gadget of |pf| (whose glitch/transition
+// options must already be set).
+void circuit_cache_open(const ParsedFile* pf);
+
+// Returns a hash of the variables of |circuit| (their number and
+// names), which identifies the state of a circuit built from the
+// gadget of the cache, after some dimension reductions.
+uint64_t hash_circuit_state(const Circuit* circuit);
+
+// Returns the variables of the record (|kind|, |key|), or NULL if the
+// cache is not opened or does not contain this record. The result
+// must be freed with VarVector_free.
+VarVector* circuit_cache_get(uint32_t kind, uint64_t key);
+
+// Adds the record (|kind|, |key|) with the variables |vars| to the
+// cache (if it is opened).
+void circuit_cache_add(uint32_t kind, uint64_t key, const VarVector* vars);
+
+void circuit_cache_close();
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "coeff_store.h"
+#include "config.h"
+
+#define COEFF_STORE_MAGIC "IMCOEFFS"
+#define COEFF_STORE_VERSION 1
+
+#define COEFF_STORE_FLAG_VARINT 1 // Coefficients are zigzag-delta varints
+
+
+/***********************************************************
+                        File layout
+************************************************************/
+
+typedef struct _coeff_store_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  CoeffStoreParams params;
+  uint64_t scenario_count;
+  uint64_t index_offset;  // Offset of the index (array of CoeffStoreIndexEntry)
+  uint64_t labels_count;
+  uint64_t labels_offset; // Offset of the labels
+  uint64_t file_size;
+  uint64_t checksum;      // Checksum of all the fields above
+} CoeffStoreFileHeader;
+
+typedef struct _coeff_store_index_entry {
+  uint64_t key;
+  uint64_t offset;   // Offset of the coefficients in the file
+  uint64_t size;     // Size in bytes of the (encoded) coefficients
+  uint64_t checksum; // Checksum of the encoded coefficients
+} CoeffStoreIndexEntry;
+
+struct _coeff_store_writer {
+  FILE* file;
+  char* filename;
+  CoeffStoreFileHeader header;
+  CoeffStoreIndexEntry* index;
+  uint64_t index_max_size;
+  uint64_t offset; // Current offset in the file
+  uint8_t* buffer; // To encode coefficients
+  char** labels;
+  int labels_count;
+};
+
+struct _coeff_store {
+  const uint8_t* data; // The whole file (mmap-ed)
+  size_t size;
+  const CoeffStoreFileHeader* header;
+  const CoeffStoreIndexEntry* index;
+  const char** labels;
+  char* filename;
+};
+
+
+uint64_t hash_bytes(uint64_t hash, const void* bytes, size_t len) {
+  const uint8_t* b = (const uint8_t*) bytes;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= b[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+_Static_assert(sizeof(CoeffStoreParams) == 40, "CoeffStoreParams should not have padding");
+_Static_assert(sizeof(CoeffStoreFileHeader) == 104, "CoeffStoreFileHeader should not have padding");
+
+static uint64_t header_checksum(const CoeffStoreFileHeader* header) {
+  return hash_bytes(HASH_INIT, header, offsetof(CoeffStoreFileHeader, checksum));
+}
+
+uint64_t hash_gadget(const ParsedFile* pf) {
+  uint64_t hash = HASH_INIT;
+  FILE* f = fopen(pf->filename, "rb");
+  if (f) {
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+      hash = hash_bytes(hash, buf, len);
+    }
+    fclose(f);
+  }
+  uint8_t options[2] = { pf->glitch, pf->transition };
+  return hash_bytes(hash, options, sizeof(options));
+}
+
+uint64_t fault_set_count(int k, int names_count) {
+  uint64_t count = 0;
+  for (int i = 0; i <= k; i++) {
+    count += n_choose_k(i, names_count);
+  }
+  return count;
+}
+
+uint64_t fault_set_key(const Comb* comb, int comb_len, int names_count) {
+  if (comb_len == 0) return 0;
+  // Note: ranks of combinations.c start at 1.
+  return fault_set_count(comb_len-1, names_count)
+    + rank(names_count, comb_len, (Comb*)comb) - 1;
+}
+
+
+/***********************************************************
+                    Encoding of coefficients
+************************************************************/
+
+// Encodes |coeffs| in |out| (which must be large enough; 10 bytes per
+// coefficient are always enough). Returns the number of bytes written.
+static size_t encode_coeffs(const uint64_t* coeffs, int len, uint8_t* out, bool varint) {
+  if (!varint) {
+    memcpy(out, coeffs, len * sizeof(*coeffs));
+    return len * sizeof(*coeffs);
+  }
+  size_t size = 0;
+  uint64_t prev = 0;
+  for (int i = 0; i < len; i++) {
+    int64_t delta = (int64_t)(coeffs[i] - prev);
+    uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    prev = coeffs[i];
+    do {
+      uint8_t byte = zigzag & 0x7f;
+      zigzag >>= 7;
+      out[size++] = byte | (zigzag ? 0x80 : 0);
+    } while (zigzag);
+  }
+  return size;
+}
+
+// Decodes |size| bytes of |in| into |coeffs|. Returns false if |in| is
+// not a valid encoding of |len| coefficients.
+static bool decode_coeffs(const uint8_t* in, size_t size, uint64_t* coeffs, int len, bool varint) {
+  if (!varint) {
+    if (size != len * sizeof(*coeffs)) return false;
+    memcpy(coeffs, in, size);
+    return true;
+  }
+  size_t pos = 0;
+  uint64_t prev = 0;
+  for (int i = 0; i < len; i++) {
+    uint64_t zigzag = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+      if (pos == size || shift > 63) return false;
+      byte = in[pos++];
+      zigzag |= (uint64_t)(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    coeffs[i] = prev + (uint64_t)delta;
+    prev = coeffs[i];
+  }
+  return pos == size;
+}
+
+
+/***********************************************************
+                           Writer
+************************************************************/
+
+static void write_or_die(CoeffStoreWriter* w, const void* data, size_t size) {
+  if (fwrite(data, 1, size, w->file) != size) {
+    fprintf(stderr, "Failed to write coefficient file %s. Exiting.\n", w->filename);
+    exit(EXIT_FAILURE);
+  }
+  w->offset += size;
+}
+
+CoeffStoreWriter* coeff_store_create(const char* filename, const CoeffStoreParams* params) {
+  CoeffStoreWriter* w = malloc(sizeof(*w));
+  w->file = fopen(filename, "wb");
+  if (!w->file) {
+    fprintf(stderr, "Failed to open coefficient file %s. Exiting.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  w->filename = strdup(filename);
+  memset(&w->header, 0, sizeof(w->header));
+  memcpy(w->header.magic, COEFF_STORE_MAGIC, sizeof(w->header.magic));
+  w->header.version = COEFF_STORE_VERSION;
+  w->header.flags = COEFF_STORE_COMPRESS ? COEFF_STORE_FLAG_VARINT : 0;
+  w->header.params = *params;
+  w->index_max_size = 64;
+  w->index = malloc(w->index_max_size * sizeof(*w->index));
+  w->buffer = malloc(params->coeffs_len * 10);
+  w->labels = NULL;
+  w->labels_count = 0;
+  w->offset = 0;
+
+  // The header is written again with the right offsets by
+  // coeff_store_finish.
+  write_or_die(w, &w->header, sizeof(w->header));
+  return w;
+}
+
+void coeff_store_add(CoeffStoreWriter* w, uint64_t key, const uint64_t* coeffs) {
+  CoeffStoreFileHeader* header = &w->header;
+  if (header->scenario_count == w->index_max_size) {
+    w->index_max_size *= 2;
+    w->index = realloc(w->index, w->index_max_size * sizeof(*w->index));
+  }
+  size_t size = encode_coeffs(coeffs, header->params.coeffs_len, w->buffer,
+                              header->flags & COEFF_STORE_FLAG_VARINT);
+  CoeffStoreIndexEntry* entry = &w->index[header->scenario_count++];
+  entry->key = key;
+  entry->offset = w->offset;
+  entry->size = size;
+  entry->checksum = hash_bytes(HASH_INIT, w->buffer, size);
+  write_or_die(w, w->buffer, size);
+}
+
+void coeff_store_add_label(CoeffStoreWriter* w, const char* label) {
+  w->labels = realloc(w->labels, (w->labels_count+1) * sizeof(*w->labels));
+  w->labels[w->labels_count++] = strdup(label);
+}
+
+static int cmp_index_entries(const void* a, const void* b) {
+  uint64_t ka = ((const CoeffStoreIndexEntry*)a)->key;
+  uint64_t kb = ((const CoeffStoreIndexEntry*)b)->key;
+  return (ka > kb) - (ka < kb);
+}
+
+void coeff_store_finish(CoeffStoreWriter* w) {
+  CoeffStoreFileHeader* header = &w->header;
+
+  // Padding so that the index is aligned
+  uint8_t zeros[8] = { 0 };
+  write_or_die(w, zeros, (8 - w->offset % 8) % 8);
+
+  qsort(w->index, header->scenario_count, sizeof(*w->index), cmp_index_entries);
+  for (uint64_t i = 1; i < header->scenario_count; i++) {
+    if (w->index[i].key == w->index[i-1].key) {
+      fprintf(stderr, "Scenario %"PRIu64" added twice to coefficient file %s. Exiting.\n",
+              w->index[i].key, w->filename);
+      exit(EXIT_FAILURE);
+    }
+  }
+  header->index_offset = w->offset;
+  write_or_die(w, w->index, header->scenario_count * sizeof(*w->index));
+
+  header->labels_count = w->labels_count;
+  header->labels_offset = w->offset;
+  for (int i = 0; i < w->labels_count; i++) {
+    write_or_die(w, w->labels[i], strlen(w->labels[i]) + 1);
+    free(w->labels[i]);
+  }
+
+  header->file_size = w->offset;
+  header->checksum = header_checksum(header);
+  if (fseek(w->file, 0, SEEK_SET)) {
+    fprintf(stderr, "Failed to write coefficient file %s. Exiting.\n", w->filename);
+    exit(EXIT_FAILURE);
+  }
+  write_or_die(w, header, sizeof(*header));
+
+  fclose(w->file);
+  free(w->filename);
+  free(w->index);
+  free(w->buffer);
+  free(w->labels);
+  free(w);
+}
+
+
+/***********************************************************
+                           Reader
+************************************************************/
+
+static void corrupted(const char* filename, const char* reason) {
+  fprintf(stderr, "Coefficient file %s is invalid (%s). "
+          "Please recompute it. Exiting.\n", filename, reason);
+  exit(EXIT_FAILURE);
+}
+
+static void check_param(const char* filename, const char* name,
+                        int64_t actual, int64_t expected) {
+  if (actual != expected) {
+    fprintf(stderr, "Coefficient file %s was computed with %s = %"PRId64" instead of %"PRId64". "
+            "Please recompute it. Exiting.\n", filename, name, actual, expected);
+    exit(EXIT_FAILURE);
+  }
+}
+
+CoeffStore* coeff_store_open(const char* filename, const CoeffStoreParams* expected) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "file %s not found...", filename);
+    exit(EXIT_FAILURE);
+  }
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(CoeffStoreFileHeader)) {
+    corrupted(filename, "truncated header");
+  }
+  size_t size = st.st_size;
+  const uint8_t* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Failed to map coefficient file %s. Exiting.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  const CoeffStoreFileHeader* header = (const CoeffStoreFileHeader*) data;
+  if (memcmp(header->magic, COEFF_STORE_MAGIC, sizeof(header->magic))) {
+    corrupted(filename, "not a coefficient file, or a coefficient file from an older version of IronMask");
+  }
+  if (header->version != COEFF_STORE_VERSION) corrupted(filename, "unsupported version");
+  if (header->checksum != header_checksum(header)) corrupted(filename, "bad header checksum");
+  if (header->file_size != size) corrupted(filename, "truncated file");
+  if (header->index_offset % 8 ||
+      header->index_offset + header->scenario_count * sizeof(CoeffStoreIndexEntry) > size ||
+      header->labels_offset > size) {
+    corrupted(filename, "bad index");
+  }
+
+  const CoeffStoreParams* params = &header->params;
+  check_param(filename, "property", params->property, expected->property);
+  if (params->gadget_hash != expected->gadget_hash) {
+    fprintf(stderr, "Coefficient file %s was computed for another gadget (or with other "
+            "glitch/transition options). Please recompute it. Exiting.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  check_param(filename, "k", params->k, expected->k);
+  check_param(filename, "t", params->t, expected->t);
+  if (expected->coeff_max != -1) {
+    check_param(filename, "coeff_max", params->coeff_max, expected->coeff_max);
+  }
+  check_param(filename, "set", params->set, expected->set);
+  check_param(filename, "the number of faultable variables", params->names_count, expected->names_count);
+  check_param(filename, "the number of coefficients", params->coeffs_len, expected->coeffs_len);
+
+  CoeffStore* s = malloc(sizeof(*s));
+  s->data = data;
+  s->size = size;
+  s->header = header;
+  s->index = (const CoeffStoreIndexEntry*)(data + header->index_offset);
+  s->filename = strdup(filename);
+
+  for (uint64_t i = 0; i < header->scenario_count; i++) {
+    const CoeffStoreIndexEntry* entry = &s->index[i];
+    if (entry->offset < sizeof(*header) || entry->offset + entry->size > header->index_offset ||
+        (i > 0 && entry->key <= s->index[i-1].key)) {
+      corrupted(filename, "bad index");
+    }
+  }
+
+  s->labels = malloc(header->labels_count * sizeof(*s->labels));
+  const char* label = (const char*)(data + header->labels_offset);
+  for (uint64_t i = 0; i < header->labels_count; i++) {
+    const char* end = memchr(label, '\0', (const char*)data + size - label);
+    if (!end) corrupted(filename, "bad labels");
+    s->labels[i] = label;
+    label = end + 1;
+  }
+
+  return s;
+}
+
+bool coeff_store_get(const CoeffStore* s, uint64_t key, uint64_t* coeffs) {
+  // Binary search in the index
+  uint64_t lo = 0, hi = s->header->scenario_count;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (s->index[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == s->header->scenario_count || s->index[lo].key != key) return false;
+
+  const CoeffStoreIndexEntry* entry = &s->index[lo];
+  const uint8_t* encoded = s->data + entry->offset;
+  if (hash_bytes(HASH_INIT, encoded, entry->size) != entry->checksum ||
+      !decode_coeffs(encoded, entry->size, coeffs, s->header->params.coeffs_len,
+                     s->header->flags & COEFF_STORE_FLAG_VARINT)) {
+    corrupted(s->filename, "bad coefficients");
+  }
+  return true;
+}
+
+const CoeffStoreParams* coeff_store_params(const CoeffStore* s) {
+  return &s->header->params;
+}
+
+const char* coeff_store_label(const CoeffStore* s, int idx) {
+  if (idx < 0 || (uint64_t)idx >= s->header->labels_count) return NULL;
+  return s->labels[idx];
+}
+
+void coeff_store_close(CoeffStore* s) {
+  munmap((void*)s->data, s->size);
+  free(s->labels);
+  free(s->filename);
+  free(s);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+// Binary storage of the coefficients computed by CRP and CRPC (one
+// vector of coefficients per fault scenario).
+//
+// A coefficient file is made of:
+//
+//  - a header (CoeffStoreFileHeader in coeff_store.c), which contains
+//    the parameters the coefficients were computed with (see
+//    CoeffStoreParams), so that a file computed for another gadget or
+//    other parameters is rejected instead of being silently misread;
+//
+//  - the coefficient vectors, in the order in which they were added,
+//    each one encoded as varints of the zigzag-encoded differences
+//    between consecutive coefficients (when COEFF_STORE_COMPRESS is
+//    set in config.h; raw uint64_t otherwise);
+//
+//  - an index, sorted by key, giving the offset, size and checksum of
+//    each vector;
+//
+//  - optional labels (NUL-terminated strings), which CRPC uses to
+//    describe its combinations of faults on inputs.
+//
+// Each scenario is identified by a key (see fault_set_key), so that
+// readers can directly look up the scenarios they are interested in
+// (the file is mmap-ed), and scenarios that were not computed (because
+// they were ignored) are simply absent from the index.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "combinations.h"
+#include "utils.h"
+
+#define COEFF_STORE_CRP  0
+#define COEFF_STORE_CRPC 1
+
+// (the fields are ordered so that this structure has no padding, since
+// it is written as is in coefficient files)
+typedef struct _coeff_store_params {
+  uint64_t gadget_hash; // See hash_gadget
+  uint32_t property;    // COEFF_STORE_CRP or COEFF_STORE_CRPC
+  int32_t k;
+  int32_t t;            // -1 for CRP
+  int32_t coeff_max;
+  int32_t set;          // 1 if faults set wires to 1, 0 if they reset them
+  int32_t names_count;  // Number of variables that can be faulted
+  int32_t input_combs;  // Number of combinations of faults on inputs (CRPC only)
+  uint32_t coeffs_len;  // Number of coefficients of each scenario
+} CoeffStoreParams;
+
+typedef struct _coeff_store_writer CoeffStoreWriter;
+typedef struct _coeff_store CoeffStore;
+
+// FNV-1a hash of the |len| bytes of |bytes|, continuing from |hash|
+// (HASH_INIT to start a new hash).
+uint64_t hash_bytes(uint64_t hash, const void* bytes, size_t len);
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+// Returns a hash of the gadget file of |pf| and of the options that
+// impact the coefficients (glitches/transitions).
+uint64_t hash_gadget(const ParsedFile* pf);
+
+// Returns the key of the scenario where the variables |comb| (of
+// length |comb_len|, among |names_count| variables) are faulted. Keys
+// are the ranks of the fault sets when enumerating them by increasing
+// size and then in lexicographic order: the empty fault set has key 0.
+uint64_t fault_set_key(const Comb* comb, int comb_len, int names_count);
+
+// Returns the number of keys of fault sets of size at most |k|.
+uint64_t fault_set_count(int k, int names_count);
+
+CoeffStoreWriter* coeff_store_create(const char* filename, const CoeffStoreParams* params);
+// Adds the coefficients |coeffs| (of length |params->coeffs_len|) of the
+// scenario |key|. Keys don't need to be added in any specific order,
+// but should be unique.
+void coeff_store_add(CoeffStoreWriter* w, uint64_t key, const uint64_t* coeffs);
+// Adds a label; labels are numbered from 0 in the order they are added.
+void coeff_store_add_label(CoeffStoreWriter* w, const char* label);
+// Writes the index and the labels, and closes the file.
+void coeff_store_finish(CoeffStoreWriter* w);
+
+// Opens the coefficient file |filename|, and exits with an error
+// message if it is corrupted or if its parameters do not match
+// |expected|. A |coeff_max| of -1 in |expected| matches any coeff_max.
+CoeffStore* coeff_store_open(const char* filename, const CoeffStoreParams* expected);
+// Sets |coeffs| to the coefficients of the scenario |key|. Returns
+// false if the file does not contain this scenario.
+bool coeff_store_get(const CoeffStore* s, uint64_t key, uint64_t* coeffs);
+const CoeffStoreParams* coeff_store_params(const CoeffStore* s);
+// Returns the label |idx|, or NULL if there is no such label.
+const char* coeff_store_label(const CoeffStore* s, int idx);
+void coeff_store_close(CoeffStore* s);
@@ -4,12 +4,16 @@
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <gmp.h>
 
 #include "coeffs.h"
+#include "config.h"
+#include "proba_eval.h"
 #include "parser.h"
 #include "list_tuples.h"
 #include "combinations.h"
+#include "hash_tuples.h"
 
 
 #define table_coeff_size 65 // above 67, binomial coefficients will overflow 64-bit integers
@@ -117,6 +121,204 @@ void update_coeff_c_single(const Circuit* c, uint64_t* coeff_c, Comb* comb, int
   compute_tree2(uple, coeff_c, (int)nb_occ_tuple);
 }
 
+struct _weight_histogram {
+  TupleHash* counts; // Sorted weights (as int[]) -> number of failures (uint64_t)
+  // Consecutive failures often have the same signature (eg, when
+  // they are expanded from the same tuple after the dimension
+  // reduction): the last one is kept to skip the lookup in |counts|.
+  uint64_t* last_count; // Value of |last_signature| in |counts| (NULL if none)
+  int* last_signature;
+  int last_len;
+  int last_size;        // Number of elements that |last_signature| can hold
+};
+
+WeightHistogram* make_weight_histogram() {
+  WeightHistogram* hist = malloc(sizeof(*hist));
+  hist->counts         = make_tuple_hash(sizeof(uint64_t));
+  hist->last_count     = NULL;
+  hist->last_size      = 16;
+  hist->last_signature = malloc(hist->last_size * sizeof(*hist->last_signature));
+  hist->last_len       = 0;
+  return hist;
+}
+
+void free_weight_histogram(WeightHistogram* hist) {
+  if (!hist) return;
+  free_tuple_hash(hist->counts);
+  free(hist->last_signature);
+  free(hist);
+}
+
+void weight_histogram_add(WeightHistogram* hist, const Circuit* c,
+                          const Comb* comb, int comb_len) {
+  // Insertion sort: tuples are short. (|comb_len| can be 0 for RPC,
+  // when a failure only contains outputs.)
+  int signature[comb_len+1];
+  for (int i = 0; i < comb_len; i++) {
+    int w = c->weights[comb[i]];
+    int j = i;
+    while (j > 0 && signature[j-1] > w) {
+      signature[j] = signature[j-1];
+      j--;
+    }
+    signature[j] = w;
+  }
+
+  if (hist->last_count && comb_len == hist->last_len) {
+    int i = 0;
+    while (i < comb_len && signature[i] == hist->last_signature[i]) i++;
+    if (i == comb_len) {
+      (*hist->last_count)++;
+      return;
+    }
+  }
+
+  unsigned int hash = 0;
+  for (int i = 0; i < comb_len; i++) {
+    hash += hash_int(signature[i]);
+  }
+  uint64_t* count = tuple_hash_insert(hist->counts, signature,
+                                      comb_len * sizeof(*signature), hash, NULL);
+  (*count)++;
+
+  // |count| remains valid until the next insertion, which is when
+  // |last_count| is replaced.
+  if (comb_len > hist->last_size) {
+    hist->last_size = comb_len;
+    hist->last_signature = realloc(hist->last_signature,
+                                   hist->last_size * sizeof(*hist->last_signature));
+  }
+  memcpy(hist->last_signature, signature, comb_len * sizeof(*signature));
+  hist->last_len = comb_len;
+  hist->last_count = count;
+}
+
+void weight_histogram_flush(WeightHistogram* hist, uint64_t* coeff_c) {
+  TupleHashIter it = tuple_hash_iter(hist->counts);
+  while (tuple_hash_next(&it)) {
+    const int* signature = it.key;
+    uint64_t count = *(uint64_t*)it.value;
+    int len = it.key_size / sizeof(*signature);
+
+    uint64_t nb_occ_tuple = 0;
+    Array uple;
+    uple.length = len;
+    uint64_t content[len+1];
+    uple.content = content;
+    for (int i = 0; i < len; i++) {
+      nb_occ_tuple += signature[i];
+      uple.content[i] = signature[i];
+    }
+
+    // compute_tree2 only adds to coeffs[len..nb_occ_tuple+1]. The
+    // coefficients of a tuple only depend on the multiset of its
+    // weights, so expanding once and multiplying by |count| gives
+    // the same result (modulo 2^64) as |count| calls.
+    uint64_t tuple_coeffs[nb_occ_tuple+2];
+    memset(tuple_coeffs, 0, sizeof(tuple_coeffs));
+    compute_tree2(uple, tuple_coeffs, (int)nb_occ_tuple);
+    // Only the non-zero coefficients are added: |coeff_c| is usually
+    // sized for the circuit, while |tuple_coeffs| has one extra slot.
+    for (uint64_t k = len; k < nb_occ_tuple+2; k++) {
+      if (tuple_coeffs[k]) coeff_c[k] += count * tuple_coeffs[k];
+    }
+  }
+  tuple_hash_clear(hist->counts);
+  hist->last_count = NULL;
+}
+
+struct _subtree_sums {
+  int var_count;
+  int max_free;   // Maximal number of variables added to a tuple
+  int coeffs_len;
+  // |sums[(p * (max_free+1) + r) * coeffs_len + k]| is the number of
+  // ways to probe k wires with at least one wire on each of up to r
+  // variables among the variables p to |var_count|-1 and the extra
+  // variables.
+  uint64_t* sums;
+};
+
+// Multiplies the polynomials |g| (|g[j]| being the coefficients for j
+// added variables) by (1 + y * ((1+x)^|w| - 1)), ie, accounts for a
+// new variable of weight |w|.
+static void add_var_to_subtree_poly(uint64_t* g, int max_free, int coeffs_len, int w) {
+  for (int j = max_free; j > 0; j--) {
+    uint64_t* dst = &g[j * coeffs_len];
+    const uint64_t* src = &g[(j-1) * coeffs_len];
+    for (int k = coeffs_len-1; k >= 0; k--) {
+      if (!src[k]) continue;
+      for (int i = 1; i <= w && k+i < coeffs_len; i++) {
+        dst[k+i] += src[k] * table_coeff[w][i];
+      }
+    }
+  }
+}
+
+static void store_subtree_sums(SubtreeSums* sums, const uint64_t* g, int p) {
+  int coeffs_len = sums->coeffs_len;
+  uint64_t* dst = &sums->sums[(uint64_t)p * (sums->max_free+1) * coeffs_len];
+  memcpy(dst, g, coeffs_len * sizeof(*dst));
+  for (int r = 1; r <= sums->max_free; r++) {
+    for (int k = 0; k < coeffs_len; k++) {
+      dst[r * coeffs_len + k] = dst[(r-1) * coeffs_len + k] + g[r * coeffs_len + k];
+    }
+  }
+}
+
+SubtreeSums* make_subtree_sums(const int* var_weights, int var_count,
+                               const int* extra_weights, int extra_count,
+                               int max_free, int coeffs_len) {
+  SubtreeSums* sums = malloc(sizeof(*sums));
+  sums->var_count  = var_count;
+  sums->max_free   = max_free = max_free > 0 ? max_free : 0;
+  sums->coeffs_len = coeffs_len;
+  sums->sums = malloc((uint64_t)(var_count+1) * (max_free+1) * coeffs_len * sizeof(*sums->sums));
+
+  uint64_t* g = calloc((max_free+1) * coeffs_len, sizeof(*g));
+  g[0] = 1;
+  for (int i = 0; i < extra_count; i++) {
+    add_var_to_subtree_poly(g, max_free, coeffs_len, extra_weights[i]);
+  }
+  store_subtree_sums(sums, g, var_count);
+  for (int p = var_count-1; p >= 0; p--) {
+    add_var_to_subtree_poly(g, max_free, coeffs_len, var_weights[p]);
+    store_subtree_sums(sums, g, p);
+  }
+  free(g);
+  return sums;
+}
+
+void free_subtree_sums(SubtreeSums* sums) {
+  if (!sums) return;
+  free(sums->sums);
+  free(sums);
+}
+
+void subtree_sums_add(const SubtreeSums* sums, const Circuit* c,
+                      const Comb* comb, int comb_len,
+                      int first_var, int free_len, uint64_t* coeff_c) {
+  uint64_t nb_occ_tuple = 0;
+  uint64_t content[comb_len+1];
+  Array uple = { .length = comb_len, .content = content };
+  for (int i = 0; i < comb_len; i++) {
+    nb_occ_tuple += c->weights[comb[i]];
+    content[i] = c->weights[comb[i]];
+  }
+  uint64_t tuple_coeffs[nb_occ_tuple+2];
+  memset(tuple_coeffs, 0, sizeof(tuple_coeffs));
+  compute_tree2(uple, tuple_coeffs, (int)nb_occ_tuple);
+
+  int coeffs_len = sums->coeffs_len;
+  if (free_len > sums->max_free) free_len = sums->max_free;
+  const uint64_t* ext = &sums->sums[((uint64_t)first_var * (sums->max_free+1) + free_len) * coeffs_len];
+  for (int i = comb_len; i < (int)nb_occ_tuple+2 && i < coeffs_len; i++) {
+    if (!tuple_coeffs[i]) continue;
+    for (int k = 0; i+k < coeffs_len; k++) {
+      coeff_c[i+k] += tuple_coeffs[i] * ext[k];
+    }
+  }
+}
+
 void update_coeff_c(const Circuit* c, uint64_t* coeff_c, ListComb* combs, int comb_len) {
   ListCombElem* curr = combs->head;
   Array uple;
@@ -159,20 +361,6 @@ void initialize_table_coeffs() {
   }
 }
 
-// Computes n_choose_k using GMP floating point numbers
-void n_choose_k_gmp(int k, int n, mpf_t res) {
-
-  mpf_init_set_ui(res, 1);
-
-  for (int i = k; i > 0; i--) {
-    mpf_mul_ui(res, res, n);
-    mpf_div_ui(res, res, k);
-    n--;
-    k--;
-  }
-
-}
-
 // Computes p such that f(p) = p where f is the function defined by
 // |coeffs| as:
 //
@@ -189,199 +377,56 @@ void n_choose_k_gmp(int k, int n, mpf_t res) {
 // if |min_max| == -1, then replace unknown coefficients by 0
 double compute_leakage_proba(uint64_t* coeffs, int last_precise_coeff, int len,
                              int min_max, bool square_root) {
-  mpf_t coeffs_max[len];
-
-  for (int i = 0; i < last_precise_coeff+1; i++) {
-    mpf_init_set_ui(coeffs_max[i], coeffs[i]);
-  }
-
-  for (int i = last_precise_coeff+1; i < len; i++) {
-    if (min_max == 1) {
-      n_choose_k_gmp(i, len, coeffs_max[i]);
-    } else {
-      mpf_init(coeffs_max[i]);
-    }
-  }
+  // The coefficients are converted once, and f is then evaluated with
+  // Horner's scheme (see proba_eval.h).
+  ProbaPoly* poly = make_proba_poly(coeffs, last_precise_coeff, len, min_max);
 
   // Binary search to find leakage proba p
   double p_inf = 0, p_sup = 1, epsilon = 0.000000000001;
   while ( fabs(p_inf - p_sup) > epsilon ) {
     double p = (p_inf + p_sup) / 2;
 
-    mpf_t fp;
-    mpf_init(fp);
-
-    for (int i = 1; i < len; i++) {
-      mpf_t tmp;
-      mpf_init_set_d(tmp, p);
-      mpf_pow_ui(tmp, tmp, i);
-      mpf_mul(tmp, tmp, coeffs_max[i]);
-      mpf_add(fp, fp, tmp);
-
-      mpf_clear(tmp);
-    }
-
-    if (square_root) {
-      mpf_sqrt(fp, fp);
-    }
-
-    if (mpf_cmp_d(fp, p) == 0) break;
-    if (mpf_cmp_d(fp, p) == 1) { // f(p) > p
+    int cmp = proba_poly_cmp(poly, p, square_root);
+    if (cmp == 0) break;
+    if (cmp == 1) { // f(p) > p
       p_sup = p;
     } else { // f(p) < p
       p_inf = p;
     }
-
-    mpf_clear(fp);
   }
 
-  for (int i = 0; i < len; i++) {
-    mpf_clear(coeffs_max[i]);
-  }
+  free_proba_poly(poly);
 
   return (p_inf+p_sup)/2;
 }
 
 void get_failure_proba(uint64_t* coeffs, int len, double p, int coeff_max){
-  mpf_t coeffs_max[len];
+  // f(p) = (1-p) * \sum_{i=1}^{len-1} coeffs[i] p^i (1-p)^(len-1-i)
+  ProbaEval* e = make_proba_eval(len, p, 0, 0);
+  uint64_t* coeffs_no_0 = malloc(len * sizeof(*coeffs_no_0));
+  memcpy(coeffs_no_0, coeffs, len * sizeof(*coeffs_no_0));
+  coeffs_no_0[0] = 0;
 
-  for (int i = 0; i < len; i++) {
-    mpf_init_set_ui(coeffs_max[i], coeffs[i]);
-  }
-
-  if(coeff_max != -1){
-    for (int i = coeff_max+1; i < len; i++) {
-      n_choose_k_gmp(i, len-1, coeffs_max[i]);
-    }
-  }
+  ProbaSum sum;
+  proba_sum_init(&sum);
+  proba_eval_add_leakage(e, coeffs_no_0, NULL, 1, 0, coeff_max, NULL, &sum);
 
   mpf_t fp;
-  mpf_init(fp);
-
-  for (int i = 1; i < len; i++) {
-    mpf_t tmp, tmp2;
-
-    mpf_init_set_d(tmp, p);
-    mpf_pow_ui(tmp, tmp, i);
-    
-    mpf_init_set_d(tmp2, 1.0-p);
-    mpf_pow_ui(tmp2, tmp2, len-i);
-
-    mpf_mul(tmp, tmp, coeffs_max[i]);
-    mpf_mul(tmp, tmp, tmp2);
-
-    mpf_add(fp, fp, tmp);
-
-    mpf_clear(tmp);
-  }
+  mpf_init2(fp, PROBA_EVAL_GMP_PREC);
+  proba_sum_get(&sum, fp);
+  mpf_t one_minus_p;
+  mpf_init_set_d(one_minus_p, 1.0-p);
+  mpf_mul(fp, fp, one_minus_p);
 
   gmp_printf("f(%.2lf) = %.10Ff\n", p, fp);
 
-  mpf_clear(fp);
+  mpf_clears(fp, one_minus_p, NULL);
+  proba_sum_clear(&sum);
+  free(coeffs_no_0);
+  free_proba_eval(e);
 }
 
 
-void compute_combined_intermediate_leakage_proba(uint64_t* coeffs, int k, int total, int coeffs_size, double p, double f, mpf_t res, int c_max){
-  mpf_t coeffs_mpf[coeffs_size];
-
-  if(c_max == -1){
-    for (int i = 0; i < coeffs_size; i++) {
-      mpf_init_set_ui(coeffs_mpf[i], coeffs[i]);
-    }
-  }
-  else{
-    for (int i = 0; i <= c_max; i++) {
-      mpf_init_set_ui(coeffs_mpf[i], coeffs[i]);
-    }
-    for (int i = c_max+1; i < coeffs_size; i++) {
-      n_choose_k_gmp(i, coeffs_size-1, coeffs_mpf[i]);
-      // if(i == coeffs_size - 1){
-      //   gmp_printf("%d, %.2Ff\n", i, coeffs_mpf[i]);
-      // }
-    }
-  }
-
-  mpf_t fp_tmp;
-  mpf_init(fp_tmp);
-
-  for (int i = 0; i < coeffs_size; i++) {
-
-    mpf_t tmp, tmp2;
-
-    mpf_init_set_d(tmp, p);
-    mpf_pow_ui(tmp, tmp, i);
-
-    mpf_init_set_d(tmp2, 1.0-p);
-    mpf_pow_ui(tmp2, tmp2, coeffs_size-i-1);
-
-    mpf_mul(tmp, tmp, coeffs_mpf[i]);
-    mpf_mul(tmp, tmp, tmp2);
-    
-    mpf_add(fp_tmp, fp_tmp, tmp);
-
-    mpf_clear(tmp);
-    mpf_clear(tmp2);
-  }
-
-  mpf_t tmp, tmp2;
-
-  mpf_init_set_d(tmp, f);
-  mpf_pow_ui(tmp, tmp, k);
-
-  mpf_init_set_d(tmp2, 1.0-f);
-  mpf_pow_ui(tmp2, tmp2, total-k);
-
-  mpf_mul(fp_tmp, fp_tmp, tmp);
-  mpf_mul(fp_tmp, fp_tmp, tmp2);
-
-  mpf_clear(tmp);
-  mpf_clear(tmp2);
-
-  mpf_add(res, res, fp_tmp);
-}
-
-
-void compute_combined_intermediate_mu(int k, int total, double f, mpf_t res){
-
-  mpf_t tmp, tmp2;
-
-  mpf_init_set_d(tmp, f);
-  mpf_pow_ui(tmp, tmp, k);
-
-  mpf_init_set_d(tmp2, 1.0-f);
-  mpf_pow_ui(tmp2, tmp2, total-k);
-
-  mpf_mul(tmp, tmp, tmp2);
-  mpf_add(res, res, tmp);
-
-  mpf_clear(tmp);
-  mpf_clear(tmp2);
-}
-
-void compute_combined_mu_max(int k, int total, double f, mpf_t res){
-  mpf_t tmp, tmp2, cf;
-
-  for(int i=k+1; i<= total;i++){
-
-    mpf_init(cf);
-    n_choose_k_gmp(i, total, cf);
-
-    mpf_init_set_d(tmp, f);
-    mpf_pow_ui(tmp, tmp, i);
-
-    mpf_init_set_d(tmp2, 1.0-f);
-    mpf_pow_ui(tmp2, tmp2, total-i);
-
-    mpf_mul(tmp, tmp, tmp2);
-    mpf_mul(tmp, tmp, cf);
-    mpf_add(res, res, tmp);
-
-    mpf_clear(cf);
-    mpf_clear(tmp);
-    mpf_clear(tmp2);
-  }
-}
-
 void compute_combined_final_proba(mpf_t epsilon, mpf_t mu){
   mpf_t tmp;
 
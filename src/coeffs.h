@@ -10,6 +10,48 @@
 void update_coeff_c_single(const Circuit* c, uint64_t* coeff_c, Comb* comb, int comb_len);
 void update_coeff_c(const Circuit* c, uint64_t* coeff_c, ListComb* combs, int comb_len);
 
+// Failures accumulated by weight signature (the sorted weights of
+// their variables), so that update_coeff_c_single's expansion is done
+// once per distinct signature rather than once per failure: most
+// failures share a handful of signatures. A histogram is not
+// thread-safe; threads should each use their own (see LocalDataOps).
+typedef struct _weight_histogram WeightHistogram;
+
+WeightHistogram* make_weight_histogram();
+void free_weight_histogram(WeightHistogram* hist);
+
+// Records the failure |comb| (same as update_coeff_c_single, but
+// deferred until the next weight_histogram_flush).
+void weight_histogram_add(WeightHistogram* hist, const Circuit* c,
+                          const Comb* comb, int comb_len);
+
+// Adds the coefficients of the failures of |hist| to |coeff_c|, and
+// empties |hist|.
+void weight_histogram_flush(WeightHistogram* hist, uint64_t* coeff_c);
+
+// Coefficients of all the extensions of a tuple at once, for
+// properties whose failures remain failures when variables are added
+// to them (see find_all_failures_monotone). The variables that can
+// extend a tuple are the variables |first_var| to |var_count|-1 of a
+// sequence of |var_count| variables, plus a fixed set of |extra_count|
+// variables (the wires removed by the dimension reduction). Since
+// the coefficients of a tuple are the product of a polynomial per
+// variable, the sums over all the extensions are precomputed for
+// each |first_var| and number of added variables.
+typedef struct _subtree_sums SubtreeSums;
+
+SubtreeSums* make_subtree_sums(const int* var_weights, int var_count,
+                               const int* extra_weights, int extra_count,
+                               int max_free, int coeffs_len);
+void free_subtree_sums(SubtreeSums* sums);
+
+// Adds to |coeff_c| the coefficients of all the tuples made of |comb|
+// (whose variables are those of |c|) and of up to |free_len| of the
+// extension variables of |sums| starting from |first_var|.
+void subtree_sums_add(const SubtreeSums* sums, const Circuit* c,
+                      const Comb* comb, int comb_len,
+                      int first_var, int free_len, uint64_t* coeff_c);
+
 void initialize_table_coeffs();
 
 double compute_leakage_proba(uint64_t* coeffs, int last_precise_coeff, int len,
@@ -18,9 +60,4 @@ double compute_leakage_proba(uint64_t* coeffs, int last_precise_coeff, int len,
 void get_failure_proba(uint64_t* coeffs, int len, double p, int coeff_max);
 
 
-void compute_combined_intermediate_leakage_proba(uint64_t* coeffs, int k, int total, int coeffs_size, double p, double f, mpf_t res, int c_max);
-
-void compute_combined_intermediate_mu(int k, int total, double f, mpf_t res);
-void compute_combined_mu_max(int k, int total, double f, mpf_t res);
-
 void compute_combined_final_proba(mpf_t epsilon, mpf_t mu);
\ No newline at end of file
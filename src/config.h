@@ -5,6 +5,72 @@
 // as well though; TODO)
 #define BATCH_SIZE 1000000 // 1 million
 
+// Initial number of slots of the hash tables of tuples (see
+// hash_tuples.h), which are doubled whenever more than
+// TUPLE_HASH_MAX_LOAD_NUM/TUPLE_HASH_MAX_LOAD_DEN of them are used.
+#define TUPLE_HASH_INITIAL_CAPACITY 1024
+#define TUPLE_HASH_MAX_LOAD_NUM 7
+#define TUPLE_HASH_MAX_LOAD_DEN 8
+
+// Parameters of the work-stealing scheduler used when verifying
+// tuples on multiple cores (see scheduler.h). The tuples are split in
+// about PARALLEL_CHUNKS_PER_CORE chunks per core, but a chunk never
+// contains less than PARALLEL_MIN_CHUNK_SIZE tuples, since the
+// incremental Gaussian elimination of _verify_tuples has to start
+// from scratch at the beginning of each chunk.
+#define PARALLEL_CHUNKS_PER_CORE 64
+#define PARALLEL_MIN_CHUNK_SIZE 256
+
+// When RPE2 is verified by batches on multiple cores, each batch is
+// split in about RPE2_CHUNKS_PER_CORE chunks per core (all output
+// combinations included).
+#define RPE2_CHUNKS_PER_CORE 16
+
+// When looking for the first failure on multiple cores, each thread
+// checks every CANCEL_CHECK_PERIOD tuples whether another thread
+// already found a failure with a lower rank, in which case it stops.
+#define CANCEL_CHECK_PERIOD 64
+
+// When fault scenarios are verified in parallel (--parallel-scenarios
+// option of CNI/CRP/CRPC), the faulted circuits are built by batches of
+// SCENARIO_BATCH_PER_CORE circuits per core, which are then verified in
+// parallel, one circuit per core at a time.
+#define SCENARIO_BATCH_PER_CORE 16
+
+// If 1, the coefficients of the CRP/CRPC coefficient files are stored
+// as varints of the differences between consecutive coefficients,
+// which makes the files several times smaller. Set to 0 to store raw
+// uint64_t instead (see coeff_store.h). Files written with either
+// setting can be read by both.
+#define COEFF_STORE_COMPRESS 1
+
+// If 1, the results of the costly preprocessing steps of the gadgets
+// (currently, the variables removed by advanced_dimension_reduction)
+// are stored in a <gadget>.circuit_cache file next to the gadget, and
+// reused by the next runs on the same gadget (see circuit_cache.h).
+#define CIRCUIT_CACHE 1
+
+// When looking for the fault scenarios that cannot be corrected (see
+// correction.h), gadgets are evaluated on all the assignments of their
+// inputs and randoms if there are at most
+// CORRECTION_EXHAUSTIVE_MAX_VARS of them (2^(n-6) words per variable),
+// and otherwise on CORRECTION_SIMULATION_WORDS words of random
+// assignments (followed by an exact check of the outputs that look
+// correct). Scenarios are distributed to threads by groups of
+// CORRECTION_SCENARIOS_PER_TASK.
+#define CORRECTION_EXHAUSTIVE_MAX_VARS 16
+#define CORRECTION_SIMULATION_WORDS 4
+#define CORRECTION_SCENARIOS_PER_TASK 64
+
+// Leakage and fault probabilities (see proba_eval.h) are computed in
+// double-double arithmetic when its error bound is below
+// PROBA_EVAL_MAX_REL_ERROR, and with GMP floats of PROBA_EVAL_GMP_PREC
+// bits otherwise. Double-double sums are moved to their GMP part every
+// PROBA_SUM_FLUSH_PERIOD additions.
+#define PROBA_EVAL_MAX_REL_ERROR 0x1p-70
+#define PROBA_EVAL_GMP_PREC 256
+#define PROBA_SUM_FLUSH_PERIOD (1 << 16)
+
 #include <stdint.h>
 
 #define LARGE_CIRCUITS
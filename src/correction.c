@@ -0,0 +1,971 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "correction.h"
+#include "config.h"
+#include "combinations.h"
+#include "scheduler.h"
+
+
+/***********************************************************
+                      Circuit representation
+************************************************************/
+
+// Each value of the gadget is stored in a slot: the constants 0 and 1,
+// then the randoms, the duplicates of input shares, and finally one
+// slot per equation (variables that are assigned several times thus
+// have several slots).
+#define SLOT_ZERO 0
+#define SLOT_ONE  1
+
+// Kinds of faults of a slot
+#define FAULT_RAND  1 // Faulted random (also faulted in the reference circuit)
+#define FAULT_CONST 2 // Faulted variable
+#define FAULT_FRESH 4 // Not a kind of fault of a slot: passed to |evaluate| to
+                      // replace the duplicates of input shares faulted by the
+                      // environment by their fresh variables
+#define FAULT_ALL   (FAULT_RAND | FAULT_CONST | FAULT_FRESH)
+
+typedef struct _gate {
+  Operator op;
+  int left;
+  int right; // Unused if |op| is Asgn
+} Gate;
+
+typedef struct _correction_circuit {
+  int input_vars; // Number of input shares (a0, a1, ..., b0, b1, ...)
+  int nb_dup;     // Number of duplicates of each input share (at least 1)
+  int rand_count;
+  int eq_count;
+  int first_rand;
+  int first_dup;  // Slot of a0_0; the slot of the j-th duplicate of the
+                  // i-th input share is |first_dup + i * nb_dup + j|
+  int first_eq;
+  int slot_count;
+  Gate* gates;    // |gates[i]| computes slot |first_eq + i|
+  char** dup_names;
+
+  int out_count;   // Number of duplicates of output shares
+  int* out_slots;
+  int* out_groups; // Index of the (output, share) of each duplicate
+  int group_count;
+  int bound;       // Number of incorrect duplicates that can be corrected
+
+  // Faultable variables, in the same order as generate_names in
+  // CRP.c/CRPC.c, and the slots that are faulted when they are.
+  int names_count;
+  char** names;
+  int** name_slots;
+  int* name_slots_len;
+  bool* name_is_rand;
+  // Faultable variables in the order of test_correction.py (the
+  // assigned variables that are not outputs, then the randoms, and
+  // then the outputs, from the last one assigned to the first one):
+  // |file_order[r]| is the index in |names| of the |r|-th one, and
+  // |file_ranks| is the inverse permutation.
+  int* file_order;
+  int* file_ranks;
+} CorrectionCircuit;
+
+static CorrectionCircuit* make_correction_circuit(const ParsedFile* pf) {
+  CorrectionCircuit* cc = malloc(sizeof(*cc));
+  int shares = pf->shares;
+  cc->nb_dup = pf->nb_duplications > 1 ? pf->nb_duplications : 1;
+  cc->input_vars = pf->in->next_val * shares;
+  cc->rand_count = pf->randoms->next_val;
+  cc->eq_count = pf->eqs->size;
+  cc->first_rand = 2;
+  cc->first_dup = cc->first_rand + cc->rand_count;
+  cc->first_eq = cc->first_dup + cc->input_vars * cc->nb_dup;
+  cc->slot_count = cc->first_eq + cc->eq_count;
+
+  // Maps each name to the slot of its latest assignment (StrMap
+  // prepends new elements, and returns the first one it finds).
+  StrMap* slots = make_str_map("slots");
+  str_map_add_with_val(slots, strdup("0"), SLOT_ZERO);
+  str_map_add_with_val(slots, strdup("1"), SLOT_ONE);
+
+  cc->dup_names = malloc(cc->input_vars * cc->nb_dup * sizeof(*cc->dup_names));
+  int share_idx = 0;
+  for (StrMapElem* e = pf->in->head; e != NULL; e = e->next) {
+    for (int i = 0; i < shares; i++, share_idx++) {
+      for (int j = 0; j < cc->nb_dup; j++) {
+        int len = strlen(e->key) + 10;
+        char* name = malloc(len * sizeof(*name));
+        if (pf->nb_duplications <= 1) {
+          snprintf(name, len, "%s%d", e->key, i);
+        } else {
+          snprintf(name, len, "%s%d_%d", e->key, i, j);
+        }
+        int dup = share_idx * cc->nb_dup + j;
+        cc->dup_names[dup] = name;
+        str_map_add_with_val(slots, strdup(name), cc->first_dup + dup);
+      }
+    }
+  }
+
+  int rand_idx = 0;
+  for (StrMapElem* e = pf->randoms->head; e != NULL; e = e->next, rand_idx++) {
+    str_map_add_with_val(slots, strdup(e->key), cc->first_rand + rand_idx);
+  }
+
+  cc->gates = malloc(cc->eq_count * sizeof(*cc->gates));
+  int eq_idx = 0;
+  for (EqListElem* e = pf->eqs->head; e != NULL; e = e->next, eq_idx++) {
+    Gate* g = &cc->gates[eq_idx];
+    g->op = e->expr->op;
+    g->left = str_map_get(slots, e->expr->left);
+    g->right = g->op == Asgn ? -1 : str_map_get(slots, e->expr->right);
+    str_map_add_with_val(slots, strdup(e->dst), cc->first_eq + eq_idx);
+  }
+
+  cc->out_count = pf->out->next_val * shares * cc->nb_dup;
+  cc->group_count = pf->out->next_val * shares;
+  cc->bound = (cc->nb_dup - 1) / 2;
+  cc->out_slots = malloc(cc->out_count * sizeof(*cc->out_slots));
+  cc->out_groups = malloc(cc->out_count * sizeof(*cc->out_groups));
+  int out_idx = 0, group_idx = 0;
+  for (StrMapElem* e = pf->out->head; e != NULL; e = e->next) {
+    for (int i = 0; i < shares; i++, group_idx++) {
+      for (int j = 0; j < cc->nb_dup; j++, out_idx++) {
+        int len = strlen(e->key) + 10;
+        char name[len];
+        if (pf->nb_duplications <= 1) {
+          snprintf(name, len, "%s%d", e->key, i);
+        } else {
+          snprintf(name, len, "%s%d_%d", e->key, i, j);
+        }
+        cc->out_slots[out_idx] = str_map_get(slots, name);
+        cc->out_groups[out_idx] = group_idx;
+      }
+    }
+  }
+  free_str_map(slots);
+
+  cc->names_count = cc->rand_count + cc->eq_count;
+  cc->names = malloc(cc->names_count * sizeof(*cc->names));
+  cc->name_slots = malloc(cc->names_count * sizeof(*cc->name_slots));
+  cc->name_slots_len = calloc(cc->names_count, sizeof(*cc->name_slots_len));
+  cc->name_is_rand = malloc(cc->names_count * sizeof(*cc->name_is_rand));
+  int idx = 0;
+  for (StrMapElem* e = pf->randoms->head; e != NULL; e = e->next, idx++) {
+    cc->names[idx] = e->key;
+    cc->name_slots[idx] = malloc(sizeof(*cc->name_slots[idx]));
+    cc->name_slots[idx][cc->name_slots_len[idx]++] = cc->first_rand + idx;
+    cc->name_is_rand[idx] = true;
+  }
+  // Faulting a variable that is assigned several times faults all of
+  // its assignments.
+  for (EqListElem* e = pf->eqs->head; e != NULL; e = e->next, idx++) {
+    cc->names[idx] = e->dst;
+    cc->name_slots[idx] = malloc(cc->eq_count * sizeof(*cc->name_slots[idx]));
+    cc->name_is_rand[idx] = false;
+    eq_idx = 0;
+    for (EqListElem* e2 = pf->eqs->head; e2 != NULL; e2 = e2->next, eq_idx++) {
+      if (strcmp(e->dst, e2->dst) == 0) {
+        cc->name_slots[idx][cc->name_slots_len[idx]++] = cc->first_eq + eq_idx;
+      }
+    }
+  }
+
+  // test_correction.py considers as outputs the last assignments of
+  // the duplicates of the output shares (always named with their
+  // duplicate number).
+  bool* is_out_eq = calloc(cc->eq_count, sizeof(*is_out_eq));
+  char** eq_names = &cc->names[cc->rand_count];
+  for (StrMapElem* e = pf->out->head; e != NULL; e = e->next) {
+    for (int i = 0; i < shares; i++) {
+      for (int j = 0; j < pf->nb_duplications; j++) {
+        int len = strlen(e->key) + 24;
+        char name[len];
+        snprintf(name, len, "%s%d_%d", e->key, i, j);
+        for (int l = cc->eq_count - 1; l >= 0; l--) {
+          if (strcmp(eq_names[l], name) == 0) {
+            is_out_eq[l] = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+  cc->file_order = malloc(cc->names_count * sizeof(*cc->file_order));
+  cc->file_ranks = malloc(cc->names_count * sizeof(*cc->file_ranks));
+  int rank = 0;
+  for (int l = 0; l < cc->eq_count; l++) {
+    if (!is_out_eq[l]) cc->file_order[rank++] = cc->rand_count + l;
+  }
+  for (int l = 0; l < cc->rand_count; l++) {
+    cc->file_order[rank++] = l;
+  }
+  for (int l = cc->eq_count - 1; l >= 0; l--) {
+    if (is_out_eq[l]) cc->file_order[rank++] = cc->rand_count + l;
+  }
+  assert(rank == cc->names_count);
+  for (int r = 0; r < cc->names_count; r++) {
+    cc->file_ranks[cc->file_order[r]] = r;
+  }
+  free(is_out_eq);
+
+  return cc;
+}
+
+static void free_correction_circuit(CorrectionCircuit* cc) {
+  for (int i = 0; i < cc->input_vars * cc->nb_dup; i++) {
+    free(cc->dup_names[i]);
+  }
+  free(cc->dup_names);
+  for (int i = 0; i < cc->names_count; i++) {
+    free(cc->name_slots[i]);
+  }
+  free(cc->names);
+  free(cc->name_slots);
+  free(cc->name_slots_len);
+  free(cc->name_is_rand);
+  free(cc->file_order);
+  free(cc->file_ranks);
+  free(cc->gates);
+  free(cc->out_slots);
+  free(cc->out_groups);
+  free(cc);
+}
+
+
+/***********************************************************
+                       Bitsliced evaluation
+************************************************************/
+
+// The assignments of the variables on which the gadget is evaluated.
+// The variables are the input shares, the randoms, and then one fresh
+// variable per faulted duplicate of input share.
+typedef struct _correction_env {
+  int var_count;
+  int words;        // Number of 64-bit words of each value
+  bool exhaustive;  // True if the |words| words contain all the
+                    // assignments of the variables
+  uint64_t* columns;   // |var_count * words|: values of the variables
+  int* dup_vars;       // Variable of each duplicate of input share
+  int fresh_count;
+  int* fresh_dups;     // Faulted duplicates of input shares
+  uint64_t* base;      // |slot_count * words|: values of the slots
+                       // without faults
+} CorrectionEnv;
+
+static uint64_t splitmix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static void evaluate(const CorrectionCircuit* cc, const CorrectionEnv* env,
+                     const uint8_t* faults, int kinds, bool set,
+                     uint64_t* vals, uint8_t* tainted);
+
+static CorrectionEnv* make_correction_env(const CorrectionCircuit* cc, bool set,
+                                          const int* fresh_dups, int fresh_count) {
+  CorrectionEnv* env = malloc(sizeof(*env));
+  env->var_count = cc->input_vars + cc->rand_count + fresh_count;
+  env->exhaustive = env->var_count <= CORRECTION_EXHAUSTIVE_MAX_VARS;
+  env->words = !env->exhaustive ? CORRECTION_SIMULATION_WORDS :
+    env->var_count <= 6 ? 1 : 1 << (env->var_count - 6);
+
+  int words = env->words;
+  env->columns = malloc(env->var_count * words * sizeof(*env->columns));
+  static const uint64_t patterns[6] = {
+    0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL,
+    0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL
+  };
+  uint64_t seed = 0x1234567890abcdefULL;
+  for (int v = 0; v < env->var_count; v++) {
+    for (int w = 0; w < words; w++) {
+      uint64_t* col = &env->columns[v * words + w];
+      if (!env->exhaustive) {
+        *col = splitmix64(&seed);
+      } else if (v < 6) {
+        *col = patterns[v];
+      } else {
+        *col = ((w >> (v - 6)) & 1) ? ~0ULL : 0;
+      }
+    }
+  }
+
+  int dup_count = cc->input_vars * cc->nb_dup;
+  env->dup_vars = malloc(dup_count * sizeof(*env->dup_vars));
+  for (int d = 0; d < dup_count; d++) {
+    env->dup_vars[d] = d / cc->nb_dup;
+  }
+  env->fresh_count = fresh_count;
+  env->fresh_dups = malloc((fresh_count ? fresh_count : 1) * sizeof(*env->fresh_dups));
+  for (int i = 0; i < fresh_count; i++) {
+    env->fresh_dups[i] = fresh_dups[i];
+    env->dup_vars[fresh_dups[i]] = cc->input_vars + cc->rand_count + i;
+  }
+
+  uint8_t* no_faults = calloc(cc->slot_count, sizeof(*no_faults));
+  env->base = malloc(cc->slot_count * words * sizeof(*env->base));
+  evaluate(cc, env, no_faults, FAULT_RAND | FAULT_CONST, set, env->base, NULL);
+  free(no_faults);
+
+  return env;
+}
+
+static void free_correction_env(CorrectionEnv* env) {
+  free(env->columns);
+  free(env->dup_vars);
+  free(env->fresh_dups);
+  free(env->base);
+  free(env);
+}
+
+// Evaluates the slots of |cc| on the assignments of |env|, in |vals|
+// (|cc->slot_count * env->words| words). Only the faults of |faults|
+// whose kind is in |kinds| are applied. If |tainted| is not NULL, it
+// is set to indicate which slots depend on a faulted variable or on a
+// faulted duplicate of input share (faulted randoms don't taint slots,
+// since they are also faulted in the reference circuit).
+static void evaluate(const CorrectionCircuit* cc, const CorrectionEnv* env,
+                     const uint8_t* faults, int kinds, bool set,
+                     uint64_t* vals, uint8_t* tainted) {
+  int words = env->words;
+  uint64_t fault_val = set ? ~0ULL : 0;
+
+  memset(&vals[SLOT_ZERO * words], 0, words * sizeof(*vals));
+  memset(&vals[SLOT_ONE * words], 0xff, words * sizeof(*vals));
+
+  for (int r = 0; r < cc->rand_count; r++) {
+    int slot = cc->first_rand + r;
+    uint64_t* dst = &vals[slot * words];
+    if (faults[slot] & kinds) {
+      for (int w = 0; w < words; w++) dst[w] = fault_val;
+    } else {
+      memcpy(dst, &env->columns[(cc->input_vars + r) * words], words * sizeof(*dst));
+    }
+  }
+
+  for (int d = 0; d < cc->input_vars * cc->nb_dup; d++) {
+    int slot = cc->first_dup + d;
+    int var = (kinds & FAULT_FRESH) ? env->dup_vars[d] : d / cc->nb_dup;
+    memcpy(&vals[slot * words], &env->columns[var * words], words * sizeof(*vals));
+  }
+
+  if (tainted) {
+    memset(tainted, 0, cc->first_eq * sizeof(*tainted));
+    if (kinds & FAULT_FRESH) {
+      for (int i = 0; i < env->fresh_count; i++) {
+        tainted[cc->first_dup + env->fresh_dups[i]] = 1;
+      }
+    }
+  }
+
+  for (int i = 0; i < cc->eq_count; i++) {
+    const Gate* g = &cc->gates[i];
+    int slot = cc->first_eq + i;
+    uint64_t* dst = &vals[slot * words];
+    const uint64_t* left = &vals[g->left * words];
+    const uint64_t* right = g->op == Asgn ? NULL : &vals[g->right * words];
+    if (faults[slot] & kinds) {
+      for (int w = 0; w < words; w++) dst[w] = fault_val;
+    } else if (g->op == Asgn) {
+      memcpy(dst, left, words * sizeof(*dst));
+    } else if (g->op == Add) {
+      for (int w = 0; w < words; w++) dst[w] = left[w] ^ right[w];
+    } else {
+      for (int w = 0; w < words; w++) dst[w] = left[w] & right[w];
+    }
+    if (tainted) {
+      tainted[slot] = (faults[slot] & kinds) ? 1 :
+        tainted[g->left] | (g->op != Asgn ? tainted[g->right] : 0);
+    }
+  }
+}
+
+
+/***********************************************************
+                  Algebraic normal forms (exact check)
+************************************************************/
+
+// An ANF is a sorted array of distinct monomials, each monomial being a
+// bitset of |mono_words| words of the variables it contains (the
+// constant 1 is the empty monomial).
+typedef struct _anf {
+  int len;
+  uint64_t* terms;
+} Anf;
+
+static int cmp_monomials(const uint64_t* a, const uint64_t* b, int mono_words) {
+  for (int i = 0; i < mono_words; i++) {
+    if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// Sorts the |len| monomials of |terms| (bottom-up merge sort, using
+// |tmp|, of the same size as |terms|). Returns the sorted array (either
+// |terms| or |tmp|).
+static uint64_t* sort_monomials(uint64_t* terms, uint64_t* tmp, int len, int mono_words) {
+  for (int width = 1; width < len; width *= 2) {
+    for (int lo = 0; lo < len; lo += 2 * width) {
+      int mid = lo + width < len ? lo + width : len;
+      int hi = lo + 2 * width < len ? lo + 2 * width : len;
+      int i = lo, j = mid, out = lo;
+      while (i < mid || j < hi) {
+        int from = (j == hi || (i < mid && cmp_monomials(&terms[i * mono_words],
+                                                          &terms[j * mono_words],
+                                                          mono_words) <= 0)) ? i++ : j++;
+        memcpy(&tmp[out++ * mono_words], &terms[from * mono_words], mono_words * sizeof(*tmp));
+      }
+    }
+    uint64_t* swap = terms; terms = tmp; tmp = swap;
+  }
+  return terms;
+}
+
+static Anf anf_const(int val, int mono_words) {
+  Anf a = { .len = val, .terms = calloc(mono_words, sizeof(*a.terms)) };
+  return a;
+}
+
+static Anf anf_var(int var, int mono_words) {
+  Anf a = { .len = 1, .terms = calloc(mono_words, sizeof(*a.terms)) };
+  a.terms[var / 64] = 1ULL << (var % 64);
+  return a;
+}
+
+static Anf anf_copy(Anf a, int mono_words) {
+  Anf r = { .len = a.len, .terms = malloc((a.len ? a.len : 1) * mono_words * sizeof(*r.terms)) };
+  memcpy(r.terms, a.terms, a.len * mono_words * sizeof(*r.terms));
+  return r;
+}
+
+static Anf anf_add(Anf a, Anf b, int mono_words) {
+  Anf r = { .len = 0, .terms = malloc((a.len + b.len + 1) * mono_words * sizeof(*r.terms)) };
+  int i = 0, j = 0;
+  while (i < a.len || j < b.len) {
+    int cmp = i == a.len ? 1 : j == b.len ? -1 :
+      cmp_monomials(&a.terms[i * mono_words], &b.terms[j * mono_words], mono_words);
+    if (cmp == 0) {
+      i++; j++; // x + x = 0
+    } else {
+      const uint64_t* m = cmp < 0 ? &a.terms[i++ * mono_words] : &b.terms[j++ * mono_words];
+      memcpy(&r.terms[r.len++ * mono_words], m, mono_words * sizeof(*m));
+    }
+  }
+  return r;
+}
+
+static Anf anf_mul(Anf a, Anf b, int mono_words) {
+  int len = a.len * b.len;
+  uint64_t* prods = malloc((len + 1) * mono_words * sizeof(*prods));
+  uint64_t* tmp = malloc((len + 1) * mono_words * sizeof(*tmp));
+  for (int i = 0; i < a.len; i++) {
+    for (int j = 0; j < b.len; j++) {
+      uint64_t* m = &prods[(i * b.len + j) * mono_words];
+      for (int w = 0; w < mono_words; w++) {
+        m[w] = a.terms[i * mono_words + w] | b.terms[j * mono_words + w];
+      }
+    }
+  }
+  uint64_t* sorted = sort_monomials(prods, tmp, len, mono_words);
+
+  // Monomials that appear an even number of times cancel out
+  Anf r = { .len = 0, .terms = sorted == prods ? tmp : prods };
+  for (int i = 0; i < len; ) {
+    int j = i + 1;
+    while (j < len && !cmp_monomials(&sorted[i * mono_words], &sorted[j * mono_words], mono_words)) j++;
+    if ((j - i) % 2) {
+      memcpy(&r.terms[r.len++ * mono_words], &sorted[i * mono_words], mono_words * sizeof(*sorted));
+    }
+    i = j;
+  }
+  free(sorted);
+  return r;
+}
+
+// Returns the ANF of slot |target| with the faults |faults| of kinds
+// |kinds|. |anfs| and |needed| are scratch arrays of |cc->slot_count|
+// elements (|needed| must be all false, and is left so).
+static Anf anf_of_slot(const CorrectionCircuit* cc, const CorrectionEnv* env,
+                       const uint8_t* faults, int kinds, bool set, int target,
+                       Anf* anfs, bool* needed) {
+  int mono_words = (env->var_count + 63) / 64;
+
+  needed[target] = true;
+  for (int slot = target; slot >= cc->first_eq; slot--) {
+    if (!needed[slot] || (faults[slot] & kinds)) continue;
+    const Gate* g = &cc->gates[slot - cc->first_eq];
+    needed[g->left] = true;
+    if (g->op != Asgn) needed[g->right] = true;
+  }
+
+  for (int slot = 0; slot <= target; slot++) {
+    if (!needed[slot]) continue;
+    if (slot == SLOT_ZERO || slot == SLOT_ONE) {
+      anfs[slot] = anf_const(slot == SLOT_ONE, mono_words);
+    } else if (slot < cc->first_dup) {
+      anfs[slot] = (faults[slot] & kinds) ? anf_const(set, mono_words) :
+        anf_var(cc->input_vars + slot - cc->first_rand, mono_words);
+    } else if (slot < cc->first_eq) {
+      int d = slot - cc->first_dup;
+      anfs[slot] = anf_var((kinds & FAULT_FRESH) ? env->dup_vars[d] : d / cc->nb_dup, mono_words);
+    } else if (faults[slot] & kinds) {
+      anfs[slot] = anf_const(set, mono_words);
+    } else {
+      const Gate* g = &cc->gates[slot - cc->first_eq];
+      anfs[slot] = g->op == Asgn ? anf_copy(anfs[g->left], mono_words) :
+        g->op == Add ? anf_add(anfs[g->left], anfs[g->right], mono_words) :
+        anf_mul(anfs[g->left], anfs[g->right], mono_words);
+    }
+  }
+
+  for (int slot = 0; slot < target; slot++) {
+    if (needed[slot]) {
+      free(anfs[slot].terms);
+      needed[slot] = false;
+    }
+  }
+  needed[target] = false;
+  return anfs[target];
+}
+
+static bool anf_equal(Anf a, Anf b, int mono_words) {
+  return a.len == b.len &&
+    !memcmp(a.terms, b.terms, a.len * mono_words * sizeof(*a.terms));
+}
+
+
+/***********************************************************
+                        Scenario analysis
+************************************************************/
+
+typedef struct _correction_workspace {
+  uint8_t* faults;
+  uint64_t* ref;  // Values with only the faulted randoms
+  uint64_t* vals; // Values with all the faults
+  uint8_t* tainted;
+  int* wrong;     // Number of incorrect duplicates of each output share
+  Anf* anfs;
+  bool* needed;
+} CorrectionWorkspace;
+
+struct correction_analysis {
+  const CorrectionCircuit* cc;
+  const CorrectionEnv* env;
+  bool set;
+  int k;
+  Comb* combs;    // All the sets of faults to check, |k| elements each
+  int* comb_lens;
+  int comb_count;
+  bool* uncorrectable; // Result for each set of faults
+  CorrectionWorkspace* workspaces; // One per worker
+};
+
+static void init_correction_workspace(CorrectionWorkspace* ws, const CorrectionCircuit* cc,
+                                      const CorrectionEnv* env) {
+  ws->faults = calloc(cc->slot_count, sizeof(*ws->faults));
+  ws->ref = malloc(cc->slot_count * env->words * sizeof(*ws->ref));
+  ws->vals = malloc(cc->slot_count * env->words * sizeof(*ws->vals));
+  ws->tainted = malloc(cc->slot_count * sizeof(*ws->tainted));
+  ws->wrong = malloc(cc->group_count * sizeof(*ws->wrong));
+  ws->anfs = malloc(cc->slot_count * sizeof(*ws->anfs));
+  ws->needed = calloc(cc->slot_count, sizeof(*ws->needed));
+}
+
+static void free_correction_workspace(CorrectionWorkspace* ws) {
+  free(ws->faults);
+  free(ws->ref);
+  free(ws->vals);
+  free(ws->tainted);
+  free(ws->wrong);
+  free(ws->anfs);
+  free(ws->needed);
+}
+
+// Returns true if the faults on the variables |comb| (and on the
+// duplicates of input shares faulted by the environment) cannot be
+// corrected.
+static bool is_uncorrectable(const struct correction_analysis* a, CorrectionWorkspace* ws,
+                             const Comb* comb, int comb_len) {
+  const CorrectionCircuit* cc = a->cc;
+  const CorrectionEnv* env = a->env;
+  int words = env->words;
+
+  bool has_rand = false;
+  for (int i = 0; i < comb_len; i++) {
+    int name = comb[i];
+    for (int j = 0; j < cc->name_slots_len[name]; j++) {
+      ws->faults[cc->name_slots[name][j]] |= cc->name_is_rand[name] ? FAULT_RAND : FAULT_CONST;
+    }
+    has_rand |= cc->name_is_rand[name];
+  }
+
+  // The outputs are compared to those of the circuit where only the
+  // randoms are faulted.
+  const uint64_t* ref = env->base;
+  if (has_rand) {
+    evaluate(cc, env, ws->faults, FAULT_RAND, a->set, ws->ref, NULL);
+    ref = ws->ref;
+  }
+  evaluate(cc, env, ws->faults, FAULT_ALL, a->set, ws->vals,
+           env->exhaustive ? NULL : ws->tainted);
+
+  int mono_words = (env->var_count + 63) / 64;
+  memset(ws->wrong, 0, cc->group_count * sizeof(*ws->wrong));
+  bool uncorrectable = false;
+  for (int o = 0; o < cc->out_count && !uncorrectable; o++) {
+    int slot = cc->out_slots[o];
+    bool wrong = memcmp(&ref[slot * words], &ws->vals[slot * words], words * sizeof(*ref)) != 0;
+    if (!wrong && !env->exhaustive && ws->tainted[slot]) {
+      // Equal on the random assignments: checking exactly.
+      Anf ref_anf = anf_of_slot(cc, env, ws->faults, FAULT_RAND, a->set, slot,
+                                ws->anfs, ws->needed);
+      Anf anf = anf_of_slot(cc, env, ws->faults, FAULT_ALL, a->set, slot,
+                            ws->anfs, ws->needed);
+      wrong = !anf_equal(ref_anf, anf, mono_words);
+      free(ref_anf.terms);
+      free(anf.terms);
+    }
+    if (wrong && ++ws->wrong[cc->out_groups[o]] > cc->bound) {
+      uncorrectable = true;
+    }
+  }
+
+  for (int i = 0; i < comb_len; i++) {
+    int name = comb[i];
+    for (int j = 0; j < cc->name_slots_len[name]; j++) {
+      ws->faults[cc->name_slots[name][j]] = 0;
+    }
+  }
+  return uncorrectable;
+}
+
+static void correction_analysis_worker(void* data, int idx, int worker_id) {
+  struct correction_analysis* a = (struct correction_analysis*) data;
+  int end = (idx + 1) * CORRECTION_SCENARIOS_PER_TASK;
+  if (end > a->comb_count) end = a->comb_count;
+  for (int i = idx * CORRECTION_SCENARIOS_PER_TASK; i < end; i++) {
+    a->uncorrectable[i] = is_uncorrectable(a, &a->workspaces[worker_id],
+                                           &a->combs[i * a->k], a->comb_lens[i]);
+  }
+}
+
+// Sets |a->uncorrectable| for all the sets of faults of |a|, using
+// |cores| threads.
+static void run_correction_analysis(struct correction_analysis* a, int cores) {
+  int tasks = (a->comb_count + CORRECTION_SCENARIOS_PER_TASK - 1) / CORRECTION_SCENARIOS_PER_TASK;
+  a->workspaces = malloc(cores * sizeof(*a->workspaces));
+  for (int i = 0; i < cores; i++) {
+    init_correction_workspace(&a->workspaces[i], a->cc, a->env);
+  }
+
+  if (cores == 1) {
+    for (int i = 0; i < tasks; i++) {
+      correction_analysis_worker(a, i, 0);
+    }
+  } else {
+    work_pool_for(get_work_pool(cores), tasks, correction_analysis_worker, a);
+  }
+
+  for (int i = 0; i < cores; i++) {
+    free_correction_workspace(&a->workspaces[i]);
+  }
+  free(a->workspaces);
+}
+
+// Fills |a->combs| with all the sets of |min_size| to |k| faults, in
+// the order in which CRP/CRPC enumerate them.
+static void gen_fault_combs(struct correction_analysis* a, int min_size, int k) {
+  int names_count = a->cc->names_count;
+  a->k = k > 0 ? k : 1;
+  a->comb_count = 0;
+  for (int i = min_size; i <= k; i++) {
+    a->comb_count += n_choose_k(i, names_count);
+  }
+  a->combs = calloc(a->comb_count * a->k, sizeof(*a->combs));
+  a->comb_lens = malloc(a->comb_count * sizeof(*a->comb_lens));
+  a->uncorrectable = malloc(a->comb_count * sizeof(*a->uncorrectable));
+
+  int idx = 0;
+  for (int i = min_size; i <= k; i++) {
+    if (i == 0) {
+      a->comb_lens[idx++] = 0;
+      continue;
+    }
+    if (i > names_count) break;
+    Comb* comb = first_comb(i, 0);
+    do {
+      memcpy(&a->combs[idx * a->k], comb, i * sizeof(*comb));
+      a->comb_lens[idx++] = i;
+    } while (incr_comb_in_place(comb, i, names_count));
+    free(comb);
+  }
+  assert(idx == a->comb_count);
+}
+
+// A set of faults, as the ranks of its variables in the order of
+// test_correction.py (see CorrectionCircuit).
+struct ranked_comb {
+  int len;
+  int* ranks; // Sorted
+};
+
+// Orders sets of faults as test_correction.py enumerates them: by size,
+// and then lexicographically.
+static int cmp_ranked_combs(const void* a_void, const void* b_void) {
+  const struct ranked_comb* a = (const struct ranked_comb*) a_void;
+  const struct ranked_comb* b = (const struct ranked_comb*) b_void;
+  if (a->len != b->len) return a->len - b->len;
+  for (int i = 0; i < a->len; i++) {
+    if (a->ranks[i] != b->ranks[i]) return a->ranks[i] - b->ranks[i];
+  }
+  return 0;
+}
+
+// Returns the sets of faults of |a| (except the empty one) that cannot
+// be corrected, or NULL if there are none. They are in the order in
+// which test_correction.py writes them, so that the faulty scenarios
+// files are identical.
+static FaultsCombs* collect_uncorrectable(const struct correction_analysis* a) {
+  const CorrectionCircuit* cc = a->cc;
+  struct ranked_comb* ranked = malloc(a->comb_count * sizeof(*ranked));
+  int count = 0;
+  for (int i = 0; i < a->comb_count; i++) {
+    if (!a->uncorrectable[i] || a->comb_lens[i] == 0) continue;
+    struct ranked_comb* rc = &ranked[count++];
+    rc->len = a->comb_lens[i];
+    rc->ranks = malloc(rc->len * sizeof(*rc->ranks));
+    for (int j = 0; j < rc->len; j++) {
+      // Insertion sort: |rc->len| is at most |k|
+      int r = cc->file_ranks[a->combs[i * a->k + j]];
+      int l = j;
+      for (; l > 0 && rc->ranks[l-1] > r; l--) {
+        rc->ranks[l] = rc->ranks[l-1];
+      }
+      rc->ranks[l] = r;
+    }
+  }
+  if (count == 0) {
+    free(ranked);
+    return NULL;
+  }
+  qsort(ranked, count, sizeof(*ranked), cmp_ranked_combs);
+
+  FaultsCombs* fc = malloc(sizeof(*fc));
+  fc->length = count;
+  fc->fc = malloc(count * sizeof(*fc->fc));
+  for (int i = 0; i < count; i++) {
+    FaultsComb* f = malloc(sizeof(*f));
+    f->length = ranked[i].len;
+    f->names = malloc(f->length * sizeof(*f->names));
+    for (int j = 0; j < f->length; j++) {
+      f->names[j] = strdup(cc->names[cc->file_order[ranked[i].ranks[j]]]);
+    }
+    fc->fc[i] = f;
+    free(ranked[i].ranks);
+  }
+  free(ranked);
+  return fc;
+}
+
+static int resolve_cores(int cores) {
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
+  return cores < 1 ? 1 : cores;
+}
+
+FaultsCombs* find_uncorrected_faults_CRP(const ParsedFile* pf, int k, bool set, int cores) {
+  CorrectionCircuit* cc = make_correction_circuit(pf);
+  CorrectionEnv* env = make_correction_env(cc, set, NULL, 0);
+
+  struct correction_analysis a = { .cc = cc, .env = env, .set = set };
+  gen_fault_combs(&a, 1, k);
+  run_correction_analysis(&a, resolve_cores(cores));
+  FaultsCombs* fc = collect_uncorrectable(&a);
+
+  free(a.combs);
+  free(a.comb_lens);
+  free(a.uncorrectable);
+  free_correction_env(env);
+  free_correction_circuit(cc);
+  return fc;
+}
+
+
+/***********************************************************
+                  Combinations of faults on inputs
+************************************************************/
+
+typedef struct _input_comb {
+  int len;
+  int* dups; // Faulted duplicates of input shares
+} InputComb;
+
+// Returns (in |*count|) the combinations of faults on duplicates of
+// input shares such that at most |cc->bound| duplicates of each input
+// share are faulted, in the same order as test_correction.py: the
+// combinations of input shares i+1.. (call them |old|) are followed by
+// those of input share i alone (|new|), and then by each element of
+// |old| followed by each element of |new|.
+static InputComb* gen_input_combs(const CorrectionCircuit* cc, int* count) {
+  InputComb* combs = NULL;
+  int len = 0;
+
+  for (int share = cc->input_vars - 1; share >= 0; share--) {
+    InputComb* new = NULL;
+    int new_len = 0;
+    for (int size = 1; size <= cc->bound; size++) {
+      Comb* comb = first_comb(size, 0);
+      do {
+        new = realloc(new, (new_len + 1) * sizeof(*new));
+        new[new_len].len = size;
+        new[new_len].dups = malloc(size * sizeof(*new[new_len].dups));
+        for (int j = 0; j < size; j++) {
+          new[new_len].dups[j] = share * cc->nb_dup + comb[j];
+        }
+        new_len++;
+      } while (incr_comb_in_place(comb, size, cc->nb_dup));
+      free(comb);
+    }
+
+    int total = len + new_len + len * new_len;
+    combs = realloc(combs, (total ? total : 1) * sizeof(*combs));
+    int idx = len;
+    for (int i = 0; i < new_len; i++) {
+      combs[idx++] = new[i];
+    }
+    for (int i = 0; i < len; i++) {
+      for (int j = 0; j < new_len; j++, idx++) {
+        combs[idx].len = combs[i].len + new[j].len;
+        combs[idx].dups = malloc(combs[idx].len * sizeof(*combs[idx].dups));
+        memcpy(combs[idx].dups, combs[i].dups, combs[i].len * sizeof(*combs[i].dups));
+        memcpy(&combs[idx].dups[combs[i].len], new[j].dups, new[j].len * sizeof(*new[j].dups));
+      }
+    }
+    free(new);
+    len = total;
+  }
+
+  *count = len;
+  return combs;
+}
+
+CorrectionScenarios* find_uncorrected_faults_CRPC(const ParsedFile* pf, int k, bool set, int cores) {
+  cores = resolve_cores(cores);
+  CorrectionCircuit* cc = make_correction_circuit(pf);
+
+  int input_combs_count;
+  InputComb* input_combs = gen_input_combs(cc, &input_combs_count);
+  printf("%d combinations of faults on inputs to consider\n", input_combs_count);
+
+  CorrectionScenarios* cs = malloc(sizeof(*cs));
+  cs->input_combs_count = input_combs_count;
+  cs->input_combs = malloc((input_combs_count + 1) * sizeof(*cs->input_combs));
+  cs->uncorrected = malloc((input_combs_count + 1) * sizeof(*cs->uncorrected));
+  cs->no_internal_faults_fails = calloc(input_combs_count + 1, sizeof(*cs->no_internal_faults_fails));
+
+  // With faults on inputs, the empty set of internal faults is
+  // checked as well.
+  struct correction_analysis a = { .cc = cc, .set = set };
+  gen_fault_combs(&a, 0, k);
+
+  for (int i = 0; i <= input_combs_count; i++) {
+    CorrectionEnv* env;
+    if (i < input_combs_count) {
+      InputComb* ic = &input_combs[i];
+      FaultsComb* f = malloc(sizeof(*f));
+      f->length = ic->len;
+      f->names = malloc(ic->len * sizeof(*f->names));
+      for (int j = 0; j < ic->len; j++) {
+        f->names[j] = strdup(cc->dup_names[ic->dups[j]]);
+      }
+      cs->input_combs[i] = f;
+      env = make_correction_env(cc, set, ic->dups, ic->len);
+    } else {
+      cs->input_combs[i] = NULL;
+      env = make_correction_env(cc, set, NULL, 0);
+    }
+
+    a.env = env;
+    run_correction_analysis(&a, cores);
+    // a.combs[0] is the empty set of faults
+    cs->no_internal_faults_fails[i] = i < input_combs_count && a.uncorrectable[0];
+    cs->uncorrected[i] = collect_uncorrectable(&a);
+    free_correction_env(env);
+  }
+
+  for (int i = 0; i < input_combs_count; i++) {
+    free(input_combs[i].dups);
+  }
+  free(input_combs);
+  free(a.combs);
+  free(a.comb_lens);
+  free(a.uncorrectable);
+  free_correction_circuit(cc);
+  return cs;
+}
+
+void free_correction_scenarios(CorrectionScenarios* cs) {
+  for (int i = 0; i <= cs->input_combs_count; i++) {
+    if (cs->input_combs[i]) {
+      for (int j = 0; j < cs->input_combs[i]->length; j++) {
+        free(cs->input_combs[i]->names[j]);
+      }
+      free(cs->input_combs[i]->names);
+      free(cs->input_combs[i]);
+    }
+    free_faults_combs(cs->uncorrected[i]);
+  }
+  free(cs->input_combs);
+  free(cs->uncorrected);
+  free(cs->no_internal_faults_fails);
+  free(cs);
+}
+
+
+/***********************************************************
+                      Faulty scenarios files
+************************************************************/
+
+static void write_faults_comb(FILE* f, const FaultsComb* fc) {
+  fprintf(f, "%d, ", fc->length);
+  for (int i = 0; i < fc->length-1; i++) {
+    fprintf(f, "%s, ", fc->names[i]);
+  }
+  fprintf(f, "%s\n", fc->names[fc->length-1]);
+}
+
+static FILE* open_faulty_scenarios_file(const char* filename) {
+  FILE* f = fopen(filename, "w");
+  if (!f) {
+    fprintf(stderr, "Failed to open faulty scenarios file %s. Exiting.\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  return f;
+}
+
+void write_faulty_scenarios_CRP(const char* filename, const FaultsCombs* fc) {
+  FILE* f = open_faulty_scenarios_file(filename);
+  fprintf(f, "%d\n", fc ? fc->length : 0);
+  for (int i = 0; fc && i < fc->length; i++) {
+    write_faults_comb(f, fc->fc[i]);
+  }
+  fclose(f);
+}
+
+void write_faulty_scenarios_CRPC(const char* filename, const CorrectionScenarios* cs) {
+  FILE* f = open_faulty_scenarios_file(filename);
+  fprintf(f, "%d\n", cs->input_combs_count);
+  for (int i = 0; i <= cs->input_combs_count; i++) {
+    if (i < cs->input_combs_count) {
+      write_faults_comb(f, cs->input_combs[i]);
+    }
+    const FaultsCombs* fc = cs->uncorrected[i];
+    fprintf(f, "%d\n", fc ? fc->length : 0);
+    fprintf(f, " %d\n", cs->no_internal_faults_fails[i] ? 1 : 0);
+    for (int j = 0; fc && j < fc->length; j++) {
+      write_faults_comb(f, fc->fc[j]);
+    }
+  }
+  fclose(f);
+}
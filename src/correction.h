@@ -0,0 +1,54 @@
+#pragma once
+
+// Finds the fault scenarios that a gadget with duplications cannot
+// correct (this used to be done by test_correction.py, with Sage).
+//
+// A scenario is a set of faulted variables (randoms and variables
+// assigned by the gadget, plus, for CRPC, duplicates of input shares).
+// Faulted randoms and variables are replaced by 0 (reset) or 1 (set),
+// while faulted duplicates of input shares are replaced by a fresh
+// variable (their value is arbitrary). A scenario cannot be corrected
+// if, for some share of some output, more than (nb_duplications-1)/2
+// of its duplicates are not equal (as Boolean functions of the inputs
+// and randoms) to what they are when only the faulted randoms are
+// faulted.
+//
+// The outputs are evaluated bitsliced: on all the assignments of the
+// variables when there are at most CORRECTION_EXHAUSTIVE_MAX_VARS of
+// them (which is then an exact check), and otherwise on random
+// assignments, in which case the duplicates that are equal on all of
+// them are compared exactly through their algebraic normal forms.
+
+#include <stdbool.h>
+
+#include "utils.h"
+
+// The scenarios that cannot be corrected for CRPC. Index |i| <
+// |input_combs_count| corresponds to the faults on inputs
+// |input_combs[i]|, and index |input_combs_count| to the scenarios
+// without faults on inputs.
+typedef struct _correction_scenarios {
+  int input_combs_count;
+  FaultsComb** input_combs;
+  FaultsCombs** uncorrected; // Non-empty sets of internal faults that cannot
+                             // be corrected (NULL if there are none)
+  bool* no_internal_faults_fails; // True if the faults on inputs alone cannot
+                                  // be corrected (always false for the last index)
+} CorrectionScenarios;
+
+// Returns the sets of at most |k| faulted variables of |pf| (among its
+// randoms and assigned variables) that cannot be corrected, or NULL if
+// there are none. Uses |cores| threads.
+FaultsCombs* find_uncorrected_faults_CRP(const ParsedFile* pf, int k, bool set, int cores);
+
+// Same as find_uncorrected_faults_CRP, but for each combination of
+// faults on inputs that the duplications should be able to correct
+// (at most (nb_duplications-1)/2 duplicates of each input share).
+CorrectionScenarios* find_uncorrected_faults_CRPC(const ParsedFile* pf, int k, bool set, int cores);
+
+// Write |fc| (resp. |cs|) in the format of the faulty scenarios files
+// read by CRP (resp. CRPC).
+void write_faulty_scenarios_CRP(const char* filename, const FaultsCombs* fc);
+void write_faulty_scenarios_CRPC(const char* filename, const CorrectionScenarios* cs);
+
+void free_correction_scenarios(CorrectionScenarios* cs);
@@ -10,6 +10,8 @@
 #include "config.h"
 #include "circuit.h"
 #include "combinations.h"
+#include "hash_tuples.h"
+#include "circuit_cache.h"
 
 // -----------------------------------------------------------
 //
@@ -45,19 +47,6 @@
 
 
 
-// TODO: must be able to change size dynamically
-#define HASH_MASK 0x1ffffff
-#define HASH_SIZE (HASH_MASK+1)
-
-// Computes a hash for integer |x|.
-// Hash function for integers from https://stackoverflow.com/a/12996028/4990392
-static unsigned int hash_int(unsigned int x) {
-  x = ((x >> 16) ^ x) * 0x45d9f3b;
-  x = ((x >> 16) ^ x) * 0x45d9f3b;
-  x = (x >> 16) ^ x;
-  return x;
-}
-
 // Compute the hash for |dep|. This hash is based only on the randoms inside |dep|.
 static unsigned int hash_dep(Dependency* dep, int first_rand_idx, int non_mult_deps_count) {
   unsigned int hash = 0;
@@ -66,30 +55,30 @@ static unsigned int hash_dep(Dependency* dep, int first_rand_idx, int non_mult_d
       hash += hash_int(i);
     }
   }
-  return hash & HASH_MASK;
+  return hash;
 }
 
+// The linear combinations are stored in a hash table of tuples (see
+// hash_tuples.h) indexed by the bitmaps of their randoms. Each bitmap
+// is associated with the list of multiplications (and the length of
+// the combination) that were found with these randoms.
 typedef struct _multnode {
   int length;
-  uint64_t* mults;
-  struct _multnode* next;
+  int next; // Index of the next node in |mult_nodes| (-1 for the last one)
 } MultNode;
 
-typedef struct _hashnode {
-  uint64_t* rands;
-  MultNode* mult_node;
-  struct _hashnode* next;
-} HashNode;
-
 typedef struct _hashmap {
-  HashNode** content;
+  TupleHash* content; // Bitmaps of randoms -> index of their first MultNode
+  MultNode* mult_nodes;
+  uint64_t* mults;    // The |mults| bitmap of the i-th MultNode is at i*mults_len
+  int mult_nodes_count;
+  int mult_nodes_max_size;
   int deps_size; // size of the Dependency* in the hash
   int first_rand_idx;
   int non_mult_deps_count;
   int mult_count;
-  int mults_len; // Length of the |mults| array in MultNodes
-  int rands_len; // Length of the |rands| array in HashNodes
-  int count; // Number of elements in the hash
+  int mults_len; // Length of the |mults| bitmaps
+  int rands_len; // Length of the |rands| bitmaps
 } HashMap;
 
 // Allocates and initializes an empty hash map.
@@ -98,45 +87,43 @@ static HashMap* init_map(Circuit* circuit) {
   int first_rand_idx = circuit->deps->first_rand_idx;
   int non_mult_deps_count = circuit->secret_count + circuit->random_count;
   HashMap* map    = malloc(sizeof(*map));
-  map->content    = calloc(HASH_SIZE, sizeof(*(map->content)));
+  map->content    = make_tuple_hash(sizeof(int));
   map->deps_size  = deps_size;
   map->first_rand_idx = first_rand_idx;
   map->non_mult_deps_count = non_mult_deps_count;
   map->mults_len = circuit->deps->mult_deps->length / 64 + 1;
   map->rands_len = (non_mult_deps_count - circuit->secret_count) / 64 + 1;
-  map->count      = 0;
   map->mult_count = circuit->deps->mult_deps->length;
+  map->mult_nodes_count    = 0;
+  map->mult_nodes_max_size = 16;
+  map->mult_nodes = malloc(map->mult_nodes_max_size * sizeof(*map->mult_nodes));
+  map->mults      = malloc(map->mult_nodes_max_size * map->mults_len * sizeof(*map->mults));
   return map;
 }
 
 // Check if |map| contains |dep| at index |hash|. If it does, returns
-// its |length| field, and otherwise, return 0.
+// 1, and otherwise, returns 0. In both cases, |*first_node| is set to
+// the value associated with |rands| in |map->content| (the index of
+// its first MultNode), or to NULL if |map| does not contain |rands|.
 static int hash_contains_keyed(HashMap* map, int length, int hash,
                                uint64_t* rands, uint64_t* mults,
-                               HashNode** ret_node) {
-  int rands_len = map->rands_len;
+                               int** first_node) {
   int mults_len = map->mults_len;
-  HashNode* node = map->content[hash];
-  while (node) {
-    if (memcmp(node->rands, rands, rands_len * sizeof(*rands)) == 0) {
-      MultNode* mult_node = node->mult_node;
-      while (mult_node) {
-        if (mult_node->length <= length) {
-          int found = 1;
-          for (int i = 0; i < mults_len; i++) {
-            if ((mult_node->mults[i] & mults[i]) != mults[i]) {
-              found = 0;
-              break;
-            }
-          }
-          if (found) return 1;
+  int* node_idx = tuple_hash_find(map->content, rands, map->rands_len * sizeof(*rands), hash);
+  *first_node = node_idx;
+  if (!node_idx) return 0;
+  for (int idx = *node_idx; idx != -1; idx = map->mult_nodes[idx].next) {
+    if (map->mult_nodes[idx].length <= length) {
+      uint64_t* node_mults = &map->mults[idx * mults_len];
+      int found = 1;
+      for (int i = 0; i < mults_len; i++) {
+        if ((node_mults[i] & mults[i]) != mults[i]) {
+          found = 0;
+          break;
         }
-        mult_node = mult_node->next;
       }
-      *ret_node = node;
-      return 0;
+      if (found) return 1;
     }
-    node = node->next;
   }
   return 0;
 }
@@ -144,32 +131,29 @@ static int hash_contains_keyed(HashMap* map, int length, int hash,
 // Adds |dep| to |map|.
 static void add_to_hash_keyed(HashMap* map, int length, int hash,
                               uint64_t* rands, uint64_t* mults) {
-  HashNode* node = NULL;
-  if (hash_contains_keyed(map, length, hash, rands, mults, &node)) {
+  int* first_node;
+  if (hash_contains_keyed(map, length, hash, rands, mults, &first_node)) {
     return;
-  } else {
-    int rands_len = map->rands_len;
-    int mults_len = map->mults_len;
-    map->count++;
-
-    MultNode* mult_node = malloc(sizeof(*node));
-    mult_node->length = length;
-    mult_node->mults = malloc(mults_len * sizeof(*mult_node->mults));
-    memcpy(mult_node->mults, mults, mults_len * sizeof(*mult_node->mults));
-
-    if (node) {
-      mult_node->next = node->mult_node;
-      node->mult_node = mult_node;
-    } else {
-      node = malloc(sizeof(*node));
-      node->rands = malloc(rands_len * sizeof(*node->rands));
-      memcpy(node->rands, rands, rands_len * sizeof(*node->rands));
-      node->mult_node = mult_node;
-      mult_node->next = NULL;
-      node->next = map->content[hash];
-      map->content[hash] = node;
-    }
   }
+  int mults_len = map->mults_len;
+  if (map->mult_nodes_count == map->mult_nodes_max_size) {
+    map->mult_nodes_max_size *= 2;
+    map->mult_nodes = realloc(map->mult_nodes,
+                              map->mult_nodes_max_size * sizeof(*map->mult_nodes));
+    map->mults = realloc(map->mults,
+                         map->mult_nodes_max_size * mults_len * sizeof(*map->mults));
+  }
+  int idx = map->mult_nodes_count++;
+  map->mult_nodes[idx].length = length;
+  memcpy(&map->mults[idx * mults_len], mults, mults_len * sizeof(*mults));
+
+  if (!first_node) {
+    first_node = tuple_hash_insert(map->content, rands, map->rands_len * sizeof(*rands),
+                                   hash, NULL);
+    *first_node = -1;
+  }
+  map->mult_nodes[idx].next = *first_node;
+  *first_node = idx;
 }
 
 static void build_rands_bitmap(HashMap* map, Dependency* dep, uint64_t* rands) {
@@ -183,7 +167,7 @@ static void build_rands_bitmap(HashMap* map, Dependency* dep, uint64_t* rands) {
     for (int j = 0; j < 64; j++) {
       if (i*64+j >= rands_count) break;
       if (dep[first_rand_idx+i*64+j]) {
-        rands[i] |= 1 << j;
+        rands[i] |= 1ULL << j;
       }
     }
   }
@@ -199,7 +183,7 @@ static void build_mults_bitmap(HashMap* map, Dependency* dep, uint64_t* mults) {
     for (int j = 0; j < 64; j++) {
       if (i*64+j >= mult_count) break;
       if (dep[non_mult_deps_count+i*64+j]) {
-        mults[i] |= 1 << j;
+        mults[i] |= 1ULL << j;
       }
     }
   }
@@ -220,8 +204,8 @@ static int hash_contains(HashMap* map, Dependency* dep, int length) {
   uint64_t mults[map->mults_len];
   build_mults_bitmap(map, dep, mults);
 
-  HashNode* node;
-  if (hash_contains_keyed(map, length, hash, rands, mults, &node)) {
+  int* first_node;
+  if (hash_contains_keyed(map, length, hash, rands, mults, &first_node)) {
     return 1;
   } else {
     return 0;
@@ -249,23 +233,9 @@ static void add_to_hash(HashMap* map, Dependency* dep, int length) {
 
 // Frees |map| and its content.
 static void free_hash(HashMap* map) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* node = map->content[i];
-    while (node) {
-      MultNode* mult_node = node->mult_node;
-      while (mult_node) {
-        free(mult_node->mults);
-        MultNode* next_mult = mult_node->next;
-        free(mult_node);
-        mult_node = next_mult;
-      }
-      free(node->rands);
-      HashNode* next = node->next;
-      free(node);
-      node = next;
-    }
-  }
-  free(map->content);
+  free_tuple_hash(map->content);
+  free(map->mult_nodes);
+  free(map->mults);
   free(map);
 }
 
@@ -539,6 +509,44 @@ VarVector** extract_outputs_subcircuit(Circuit* circuit) {
   return subcircuits;
 }
 
+// Returns the variables that advanced_dimension_reduction removes from
+// |circuit|.
+static VarVector* compute_removable_wires(Circuit* circuit) {
+  // Step 1: extract the sub-circuit used for each output. They should
+  // be disjoint except for the inputs and randoms.
+  VarVector** subcircuits = extract_outputs_subcircuit(circuit);
+
+  // Step 2:
+  //  for each sub-circuit c':
+  //    while c' has a candidate p for removal:
+  //      compute subsets of c' with and without p
+  //      if without p produces the same subsets, remove p
+  //      update all subcircuit (decrement numbers under p) and |circuit|
+  VarVector* to_remove = VarVector_make();
+  for (int i = 0; i < circuit->share_count; i++) {
+    // TODO: Like Bordes-Karpman, we try to remove all candidates at
+    // once. It's obviously more efficient, but it would be
+    // interesting to see if any probes can be missed this way. On ISW
+    // (primary target of Border-Karpman), I guess that doing all
+    // probes at once is enough.
+    VarVector* remove_candidates = get_remove_candidates(circuit, subcircuits[i]);
+    if (remove_candidates->length &&
+        can_be_removed(circuit, subcircuits[i], remove_candidates)) {
+      for (int j = 0; j < remove_candidates->length; j++) {
+        VarVector_push(to_remove, remove_candidates->content[j]);
+      }
+    }
+    VarVector_free(remove_candidates);
+  }
+
+  for (int i = 0; i < circuit->share_count; i++) {
+    VarVector_free(subcircuits[i]);
+  }
+  free(subcircuits);
+
+  return to_remove;
+}
+
 void advanced_dimension_reduction(Circuit* circuit) {
 
   if (circuit->output_count == 2) {
@@ -576,37 +584,17 @@ void advanced_dimension_reduction(Circuit* circuit) {
   time_t start, end;
   time(&start);
 
-  // Step 1: extract the sub-circuit used for each output. They should
-  // be disjoint except for the inputs and randoms.
-  VarVector** subcircuits = extract_outputs_subcircuit(circuit);
-
-  // Step 2:
-  //  for each sub-circuit c':
-  //    while c' has a candidate p for removal:
-  //      compute subsets of c' with and without p
-  //      if without p produces the same subsets, remove p
-  //      update all subcircuit (decrement numbers under p) and |circuit|
-  VarVector* to_remove = VarVector_make();
-  for (int i = 0; i < circuit->share_count; i++) {
-    // TODO: Like Bordes-Karpman, we try to remove all candidates at
-    // once. It's obviously more efficient, but it would be
-    // interesting to see if any probes can be missed this way. On ISW
-    // (primary target of Border-Karpman), I guess that doing all
-    // probes at once is enough.
-    VarVector* remove_candidates = get_remove_candidates(circuit, subcircuits[i]);
-    if (remove_candidates->length &&
-        can_be_removed(circuit, subcircuits[i], remove_candidates)) {
-      for (int j = 0; j < remove_candidates->length; j++) {
-        VarVector_push(to_remove, remove_candidates->content[j]);
-      }
-    }
-    VarVector_free(remove_candidates);
-  }
-
-  for (int i = 0; i < circuit->share_count; i++) {
-    VarVector_free(subcircuits[i]);
+  // The variables to remove only depend on the gadget and on the
+  // variables of |circuit|: they are computed once, and then loaded
+  // from the cache of the gadget (see circuit_cache.h).
+  uint64_t cache_key = hash_circuit_state(circuit);
+  VarVector* to_remove = circuit_cache_get(CIRCUIT_CACHE_ADVANCED_DIM_RED, cache_key);
+  if (to_remove) {
+    printf("Variables to remove loaded from the circuit cache.\n");
+  } else {
+    to_remove = compute_removable_wires(circuit);
+    circuit_cache_add(CIRCUIT_CACHE_ADVANCED_DIM_RED, cache_key, to_remove);
   }
-  free(subcircuits);
 
   // Removing all variables from |to_remove| from |circuit|.
   DependencyList* deps = circuit->deps;
@@ -614,7 +602,10 @@ void advanced_dimension_reduction(Circuit* circuit) {
   DependencyList* new_deps = malloc(sizeof(*new_deps));
   new_deps->deps_size      = deps->deps_size;
   new_deps->first_rand_idx = deps->first_rand_idx;
+  new_deps->first_correction_idx = deps->first_correction_idx;
+  new_deps->first_mult_idx = deps->first_mult_idx;
   new_deps->mult_deps      = deps->mult_deps;
+  new_deps->correction_outputs = deps->correction_outputs;
   new_deps->length         = 0;
   new_deps->deps           = malloc(deps->length * sizeof(*new_deps->deps));
   new_deps->deps_exprs     = malloc(deps->length * sizeof(*new_deps->deps_exprs));
@@ -835,7 +826,10 @@ void remove_randoms(Circuit* circuit) {
   DependencyList* new_deps = malloc(sizeof(*new_deps));
   new_deps->deps_size      = deps->deps_size;
   new_deps->first_rand_idx = deps->first_rand_idx;
+  new_deps->first_correction_idx = deps->first_correction_idx;
+  new_deps->first_mult_idx = deps->first_mult_idx;
   new_deps->mult_deps      = deps->mult_deps;
+  new_deps->correction_outputs = deps->correction_outputs;
   new_deps->length         = 0;
   new_deps->deps           = malloc(deps->length * sizeof(*new_deps->deps));
   new_deps->deps_exprs     = malloc(deps->length * sizeof(*new_deps->deps_exprs));
@@ -3,23 +3,38 @@
 #include <string.h>
 
 #include "hash_tuples.h"
+#include "config.h"
+
+// Each entry of the arena is made of an EntryHeader, followed by the
+// key (padded to a multiple of 8 bytes), followed by the value (padded
+// as well). Entries are referred to by their offset in the arena
+// divided by 8 (which allows arenas of up to 32GB with 32-bit slots);
+// offset 0 is never used, so that an empty slot is simply a slot
+// whose |entry| is 0.
+typedef struct _entry_header {
+  uint32_t key_size;
+  uint32_t hash;
+} EntryHeader;
+
+typedef struct _slot {
+  uint32_t entry; // Offset (divided by 8) of the entry in the arena; 0 if empty
+  uint32_t hash;  // Hash of the entry (to avoid looking at the arena on most mismatches)
+} Slot;
+
+struct _tuple_hash {
+  int value_size;
+  int count;           // Number of entries
+  uint32_t capacity;   // Number of slots (a power of 2)
+  int shift;           // 32 - log2(capacity)
+  Slot* slots;
+  char* arena;
+  uint64_t arena_len;  // Used bytes of |arena|
+  uint64_t arena_size; // Allocated bytes of |arena|
+};
+
+#define PAD8(x) (((uint64_t)(x) + 7) & ~(uint64_t)7)
 
-// TODO: it would be nice to be able to resize the hash...
-#define HASH_MASK 0x1ffffff // 500M -> times 8 (sizeof a pointer) = 4GB table
-#define HASH_SIZE (HASH_MASK+1)
 
-
-HashMap init_hash() {
-  HashMap map;
-  map.content = calloc(HASH_SIZE, sizeof(*map.content));
-  return map;
-}
-
-// I don't remember where I borrowed this hash function from... I'm
-// thinking maybe StackOverflow, but I'm not sure. Anyways, if you
-// (the reader) plan on reusing this hash function, don't cite me as
-// the source for it, but have a look around the web, and you should
-// easily find the actual author.
 unsigned int hash_int(unsigned int x) {
   x = ((x >> 16) ^ x) * 0x45d9f3b;
   x = ((x >> 16) ^ x) * 0x45d9f3b;
@@ -27,131 +42,193 @@ unsigned int hash_int(unsigned int x) {
   return x;
 }
 
-unsigned int hash_comb(Comb* comb, int comb_len) {
+unsigned int hash_comb(const Comb* comb, int comb_len) {
   unsigned int hash = 0;
   for (int i = 0; i < comb_len; i++) {
     hash += hash_int(comb[i]);
   }
-  return hash & HASH_MASK;
+  return hash;
 }
 
 
-// Returns the generation of |comb| in |map| if it exists at index |key|; 0 otherwise.
-int _hash_contains(HashMap map, Comb* comb, int comb_len, unsigned int key) {
-  HashNode* curr = map.content[key];
-  Comb* sorted_comb;
-  int is_sorted = 0;
-  while (curr != NULL) {
-    if (curr->length != comb_len) {
-      goto next;
-    }
-    if (!is_sorted) {
-      if (is_sorted_comb(comb, comb_len)) {
-        sorted_comb = comb;
-      } else {
-        sorted_comb = alloca(comb_len * sizeof(*sorted_comb));
-        memcpy(sorted_comb, comb, comb_len * sizeof(*sorted_comb));
-        sort_comb(sorted_comb, comb_len);
-      }
-      is_sorted = 1;
-    }
-    if (!curr->sorted) {
-      if (!is_sorted_comb(curr->comb, curr->length)) {
-        sort_comb(curr->comb, curr->length);
-      }
-      curr->sorted = 1;
+static void alloc_slots(TupleHash* map, uint32_t capacity) {
+  map->capacity = capacity;
+  map->shift = 32 - __builtin_ctz(capacity);
+  map->slots = calloc(capacity, sizeof(*map->slots));
+}
+
+TupleHash* make_tuple_hash(int value_size) {
+  TupleHash* map = malloc(sizeof(*map));
+  map->value_size = value_size;
+  map->count      = 0;
+  alloc_slots(map, TUPLE_HASH_INITIAL_CAPACITY);
+  map->arena_size = 4096;
+  map->arena      = malloc(map->arena_size);
+  map->arena_len  = 8;
+  return map;
+}
+
+void free_tuple_hash(TupleHash* map) {
+  if (!map) return;
+  free(map->slots);
+  free(map->arena);
+  free(map);
+}
+
+void tuple_hash_clear(TupleHash* map) {
+  if (map->count) {
+    memset(map->slots, 0, map->capacity * sizeof(*map->slots));
+  }
+  map->count     = 0;
+  map->arena_len = 8;
+}
+
+int tuple_hash_count(const TupleHash* map) {
+  return map->count;
+}
+
+// The hashes given by the callers (sums of hash_int) are not
+// necessarily well distributed in their high or low bits: Fibonacci
+// hashing spreads them over the slots.
+static inline uint32_t ideal_slot(const TupleHash* map, uint32_t hash) {
+  return (hash * 2654435769u) >> map->shift;
+}
+
+static inline EntryHeader* get_entry(const TupleHash* map, uint32_t entry) {
+  return (EntryHeader*)(map->arena + (uint64_t)entry * 8);
+}
+
+static inline void* entry_value(EntryHeader* e) {
+  return (char*)(e+1) + PAD8(e->key_size);
+}
+
+// Puts the entry |entry| (whose hash is |hash|) in the table, moving
+// entries closer to their ideal slots forward (Robin Hood).
+static void place_entry(TupleHash* map, uint32_t entry, uint32_t hash) {
+  uint32_t mask = map->capacity - 1;
+  Slot curr = { .entry = entry, .hash = hash };
+  uint32_t pos  = ideal_slot(map, hash);
+  uint32_t dist = 0;
+  while (1) {
+    Slot* s = &map->slots[pos];
+    if (!s->entry) {
+      *s = curr;
+      return;
     }
-    for (int i = 0; i < comb_len; i++) {
-      if (curr->comb[i] != sorted_comb[i]) {
-        goto next;
-      }
+    uint32_t s_dist = (pos - ideal_slot(map, s->hash)) & mask;
+    if (s_dist < dist) {
+      Slot tmp = *s;
+      *s = curr;
+      curr = tmp;
+      dist = s_dist;
     }
-    return curr->generation;
+    pos = (pos + 1) & mask;
+    dist++;
+  }
+}
 
-  next:
-    curr = curr->next;
+// Recomputes all slots from the arena, with |capacity| slots.
+static void rebuild_slots(TupleHash* map, uint32_t capacity) {
+  if (capacity != map->capacity) {
+    free(map->slots);
+    alloc_slots(map, capacity);
+  } else {
+    memset(map->slots, 0, capacity * sizeof(*map->slots));
   }
-  return 0;
-}
-
-// Returns 1 if |map| contains |comb|, 0 otherwise
-int hash_contains(HashMap map, Comb* comb, int comb_len) {
-  unsigned int key = hash_comb(comb, comb_len);
-  return _hash_contains(map, comb, comb_len, key);
-}
-
-void add_to_hash(HashMap map, Comb* comb, int comb_len, int generation) {
-  unsigned int key = hash_comb(comb, comb_len);
-  if (_hash_contains(map, comb, comb_len, key)) return;
-  Comb* comb_copy = malloc(comb_len * sizeof(*comb_copy));
-  memcpy(comb_copy, comb, comb_len * sizeof(*comb_copy));
-  HashNode* node = malloc(sizeof(*node));
-  node->length = comb_len;
-  node->sorted = 0;
-  node->comb   = comb_copy;
-  node->generation = generation;
-  node->next = map.content[key];
-  map.content[key] = node;
-}
-
-// Adds |comb| to |map|, without copying it
-void add_to_hash_no_copy(HashMap map, Comb* comb, int comb_len, int generation) {
-  unsigned int key = hash_comb(comb, comb_len);
-  HashNode* node = malloc(sizeof(*node));
-  node->length = comb_len;
-  node->sorted = 0;
-  node->comb   = comb;
-  node->generation = generation;
-  node->next = map.content[key];
-  map.content[key] = node;
-}
-
-// Adds elements from |src| into |dst|, while freeing |src| (and its content).
-// Note: this is actually pretty expensive because hashes are very
-// large... There is a tradeoff to be found between number of
-// collisions and hash size...
-void merge_hashes(HashMap dst, HashMap src) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* node = src.content[i];
-    while (node) {
-      if (! _hash_contains(dst, node->comb, node->length, i)) {
-        HashNode* next = node->next;
-        node->next = dst.content[i];
-        dst.content[i] = node;
-        node = next;
-      } else {
-        HashNode* next = node->next;
-        free(node->comb);
-        free(node);
-        node = next;
+  uint64_t offset = 8;
+  while (offset < map->arena_len) {
+    EntryHeader* e = (EntryHeader*)(map->arena + offset);
+    place_entry(map, offset / 8, e->hash);
+    offset += sizeof(*e) + PAD8(e->key_size) + PAD8(map->value_size);
+  }
+}
+
+void* tuple_hash_find(const TupleHash* map, const void* key, int key_size,
+                      unsigned int hash) {
+  uint32_t mask = map->capacity - 1;
+  uint32_t pos  = ideal_slot(map, hash);
+  uint32_t dist = 0;
+  while (1) {
+    const Slot* s = &map->slots[pos];
+    if (!s->entry) return NULL;
+    // With Robin Hood hashing, an entry is never further from its
+    // ideal slot than the entries it was placed after.
+    if (((pos - ideal_slot(map, s->hash)) & mask) < dist) return NULL;
+    if (s->hash == hash) {
+      EntryHeader* e = get_entry(map, s->entry);
+      if (e->key_size == (uint32_t)key_size && memcmp(e+1, key, key_size) == 0) {
+        return entry_value(e);
       }
     }
-    src.content[i] = NULL;
+    pos = (pos + 1) & mask;
+    dist++;
   }
 }
 
+void* tuple_hash_insert(TupleHash* map, const void* key, int key_size,
+                        unsigned int hash, bool* inserted) {
+  void* value = tuple_hash_find(map, key, key_size, hash);
+  if (inserted) *inserted = value == NULL;
+  if (value) return value;
 
-int hash_size(HashMap map) {
-  int total = 0;
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* curr = map.content[i];
-    while (curr) {
-      total++;
-      curr = curr->next;
-    }
+  uint64_t entry_size = sizeof(EntryHeader) + PAD8(key_size) + PAD8(map->value_size);
+  if (map->arena_len + entry_size > map->arena_size) {
+    while (map->arena_len + entry_size > map->arena_size) map->arena_size *= 2;
+    map->arena = realloc(map->arena, map->arena_size);
+  }
+  uint64_t offset = map->arena_len;
+  EntryHeader* e = (EntryHeader*)(map->arena + offset);
+  e->key_size = key_size;
+  e->hash     = hash;
+  memcpy(e+1, key, key_size);
+  value = entry_value(e);
+  memset(value, 0, PAD8(map->value_size));
+  map->arena_len += entry_size;
+  map->count++;
+
+  if ((uint64_t)map->count * TUPLE_HASH_MAX_LOAD_DEN >
+      (uint64_t)map->capacity * TUPLE_HASH_MAX_LOAD_NUM) {
+    rebuild_slots(map, map->capacity * 2);
+  } else {
+    place_entry(map, offset / 8, hash);
   }
-  return total;
+  return value;
 }
 
-void free_hash(HashMap map) {
-  for (int i = 0; i < HASH_SIZE; i++) {
-    HashNode* node = map.content[i];
-    while (node) {
-      free(node->comb);
-      HashNode* next = node->next;
-      free(node);
-      node = next;
+void tuple_hash_filter(TupleHash* map,
+                       bool (*keep)(const void* key, int key_size, void* value, void* data),
+                       void* data) {
+  uint64_t read = 8, write = 8;
+  int count = 0;
+  while (read < map->arena_len) {
+    EntryHeader* e = (EntryHeader*)(map->arena + read);
+    uint64_t entry_size = sizeof(*e) + PAD8(e->key_size) + PAD8(map->value_size);
+    if (keep(e+1, e->key_size, entry_value(e), data)) {
+      if (write != read) memmove(map->arena + write, e, entry_size);
+      write += entry_size;
+      count++;
     }
+    read += entry_size;
   }
-  free(map.content);
+  if (count == map->count) return;
+  map->arena_len = write;
+  map->count = count;
+  rebuild_slots(map, map->capacity);
+}
+
+TupleHashIter tuple_hash_iter(const TupleHash* map) {
+  TupleHashIter it = { .map = map, .next = 8 };
+  return it;
+}
+
+bool tuple_hash_next(TupleHashIter* it) {
+  const TupleHash* map = it->map;
+  if (it->next >= map->arena_len) return false;
+  EntryHeader* e = (EntryHeader*)(map->arena + it->next);
+  it->key      = e+1;
+  it->key_size = e->key_size;
+  it->hash     = e->hash;
+  it->value    = entry_value(e);
+  it->next    += sizeof(*e) + PAD8(e->key_size) + PAD8(map->value_size);
+  return true;
 }
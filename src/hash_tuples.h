@@ -1,37 +1,90 @@
 #pragma once
 
-// This file offers a HashMap datastructure. This HashMap is
-// implemented as an array of linked lists.
+// This file offers a generic hash table of tuples (or of any
+// fixed-size binary keys), used by RPE, failures_from_incompr and
+// dimensions.
 //
-// In practice, we are using a few hashmaps in IronMask, but each of
-// them has it specificities, meaning that no two hashes are
-// similar. This hashmap defined in this file is not used anywhere
-// anymore, but other hashmaps are inspired by it.
+// Keys (and their associated values) are stored inline, one after
+// the other, in a single arena, and the table itself is an array of
+// slots that point into this arena, using open addressing with Robin
+// Hood hashing (linear probing where entries that are far from their
+// ideal slot take the place of entries that are closer to theirs,
+// which keeps probe sequences short even when the table is quite
+// full). The table grows as entries are added, and the arena can be
+// iterated in O(number of entries), regardless of the size of the
+// table.
 //
-// TODO: make this hashmap implem somewhat generic and base all hash
-// maps of IronMask on it.
+// Hashes are provided by the caller (see hash_comb), which allows
+// them to be computed incrementally (eg, failures_from_incompr
+// computes the hash of a tuple extended with one element from the
+// hash of the tuple).
+//
+// Entries cannot be removed individually; tuple_hash_filter should be
+// used instead to remove all entries that do not satisfy a
+// predicate. Pointers returned by the functions below are invalidated
+// by any later insertion, filtering or clearing.
 
-#include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "combinations.h"
 
-typedef struct _hashnode {
-  uint8_t length;
-  uint8_t sorted; // If true, then this element is sorted, otherwire it's not
-  int generation;
-  Comb* comb;
-  struct _hashnode* next;
-} HashNode;
-
-typedef struct _hashmap {
-  HashNode** content;
-} HashMap;
-
-HashMap init_hash();
-void add_to_hash(HashMap map, Comb* comb, int comb_len, int generation);
-void add_to_hash_no_copy(HashMap map, Comb* comb, int comb_len, int generation);
-int hash_contains(HashMap map, Comb* comb, int comb_len);
-void merge_hashes(HashMap dst, HashMap src);
-int hash_size(HashMap map);
-void free_hash();
+// Hash function for integers from https://stackoverflow.com/a/12996028/4990392
+unsigned int hash_int(unsigned int x);
+
+// Computes a hash for |comb| by summing the hashes of each of its
+// elements (the hash of |comb| extended with |x| is thus the hash of
+// |comb| plus hash_int(x)).
+unsigned int hash_comb(const Comb* comb, int comb_len);
+
+
+typedef struct _tuple_hash TupleHash;
+
+// Allocates an empty table whose entries carry |value_size| bytes of
+// data (which can be 0 to use the table as a set).
+TupleHash* make_tuple_hash(int value_size);
+void free_tuple_hash(TupleHash* map);
+
+// Removes all entries of |map| (but keeps its memory for future use).
+void tuple_hash_clear(TupleHash* map);
+
+// Returns the number of entries of |map|.
+int tuple_hash_count(const TupleHash* map);
+
+// Returns the value associated with the key |key| (of |key_size|
+// bytes, and whose hash is |hash|) in |map|, or NULL if |map| does
+// not contain |key|.
+void* tuple_hash_find(const TupleHash* map, const void* key, int key_size,
+                      unsigned int hash);
+
+// Returns the value associated with |key| in |map|, adding |key|
+// first (with a zeroed value) if |map| does not contain it. If
+// |inserted| is not NULL, it is set to true if |key| was added, and to
+// false if it was already in |map|.
+void* tuple_hash_insert(TupleHash* map, const void* key, int key_size,
+                        unsigned int hash, bool* inserted);
+
+// Removes from |map| all the entries for which |keep| returns false.
+void tuple_hash_filter(TupleHash* map,
+                       bool (*keep)(const void* key, int key_size, void* value, void* data),
+                       void* data);
+
+// Iterates through the entries of |map|, in insertion order:
+//
+//    TupleHashIter it = tuple_hash_iter(map);
+//    while (tuple_hash_next(&it)) {
+//      ... it.key, it.key_size, it.hash, it.value ...
+//    }
+//
+// |map| should not be modified during the iteration.
+typedef struct _tuple_hash_iter {
+  const TupleHash* map;
+  uint64_t next;   // Offset of the next entry in the arena
+  const void* key;
+  int key_size;
+  unsigned int hash;
+  void* value;
+} TupleHashIter;
+
+TupleHashIter tuple_hash_iter(const TupleHash* map);
+bool tuple_hash_next(TupleHashIter* it);
@@ -28,9 +28,18 @@
 #include "CNI.h"
 #include "CRP.h"
 #include "CRPC.h"
+#include "scheduler.h"
+#include "sweep.h"
+#include "circuit_cache.h"
 
 #define GLITCH_OPT 1000
 #define TRANSITION_OPT 1001
+#define PARALLEL_SCENARIOS_OPT 1002
+#define FAULTY_SCENARIOS_OPT 1003
+#define SWEEP_L_OPT 1004
+#define SWEEP_F_OPT 1005
+#define SWEEP_OUTPUT_OPT 1006
+#define SYMMETRIES_OPT 1007
 
 /***********************************************************
                             Main
@@ -45,18 +54,6 @@ int is_int(char* s) {
   return 1;
 }
 
-int is_double(char* s) {
-  if (!s || !*s) return 0;
-  int cpt=0;
-  while (*s) {
-    if(*s == ','){ cpt++; }
-    else if (*s < '0' || *s > '9'){ return 0; }
-    s++;
-  }
-  if(cpt > 1) return 0;
-  return 1;
-}
-
 void usage() {
   printf("Usage:\n"
          "    ironmask [OPTIONS] [NI|SNI|freeSNI|uniformSNI|IOS|PINI|RP|RPC|RPE|CNI|CRP|CRPC] FILE\n"
@@ -72,11 +69,32 @@ void usage() {
          "    -o[num], --t_output[num]            Sets the t_output parameter for RPC/RPE.\n"
          "    -j[num], --jobs[num]                Sets the number of core to use.\n"
          "                                        If [num] is -1, ironmask uses all cores.\n"
-         "    -i, --incompr-opt                   Enables incompressible tuples optimization.\n"
-         "                                        (this option may or may not work, you should probably\n"
-         "                                        not use it unless you know what you're doing)\n"
+         "    -i, --incompr-opt                   Enables incompressible tuples optimization (RP/RPC/CRPC):\n"
+         "                                        tuples containing a known failure are not verified.\n"
+         "                                        Usually faster on gadgets with costly eliminations\n"
+         "                                        (eg, multiplications), slower on linear ones.\n"
+         "    --symmetries                        For RP, detects the share permutations that leave\n"
+         "                                        the gadget unchanged, and only verifies one tuple\n"
+         "                                        per orbit of tuples under these permutations.\n"
          "    --glitch                            Takes glitches into account.\n"
          "    --transition                        Takes transitions into account\n"
+         "    --parallel-scenarios                For CNI/CRP/CRPC with -j, verifies several fault\n"
+         "                                        scenarios in parallel (each on a single core)\n"
+         "                                        instead of parallelizing each scenario.\n"
+         "    --faulty-scenarios                  For CRP/CRPC, recomputes the fault scenarios that\n"
+         "                                        cannot be corrected even if the corresponding\n"
+         "                                        _faulty_scenarios file already exists (otherwise,\n"
+         "                                        they are only computed when it does not).\n"
+         "    --sweep-l[list], --sweep-f[list]    For CRP/CRPC, evaluates the coefficients for all\n"
+         "                                        the leakage (--sweep-l) and fault (--sweep-f)\n"
+         "                                        probabilities of [list] (combined with -l/-f if only\n"
+         "                                        one of them is given), in parallel with -j. [list]\n"
+         "                                        is either a list of values separated by ':', or\n"
+         "                                        'lin:FROM:TO:COUNT' or 'log:FROM:TO:COUNT' for\n"
+         "                                        COUNT values evenly spaced on a linear/log scale.\n"
+         "    --sweep-output[file]                Writes the results of --sweep-l/--sweep-f to [file]\n"
+         "                                        (in JSON if it ends with .json, in CSV otherwise)\n"
+         "                                        instead of printing them as CSV.\n"
          "    -h, --help                          Prints this help information.\n\n");
 
   exit(EXIT_SUCCESS);
@@ -88,7 +106,11 @@ int main(int argc, char** argv) {
 
   int verbose = 0, coeff_max = -1, t = -1, t_output = -1, opt_incompr = 0, cores = 1, k = -1;
   double pleak = -1, pfault = -1;
-  bool glitch = false, transition = false;
+  bool glitch = false, transition = false, parallel_scenarios = false;
+  bool gen_faulty_scenarios = false;
+  bool symmetries = false;
+  ProbaGrid grid = { 0, NULL, 0, NULL };
+  char* sweep_output = NULL;
   bool set = true;
   char* property = NULL;
   char* filename = NULL;
@@ -108,6 +130,12 @@ int main(int argc, char** argv) {
       { "incompr-opt", no_argument,       0, 'i'            },
       { "glitch",      no_argument,       0, GLITCH_OPT     },
       { "transition",  no_argument,       0, TRANSITION_OPT },
+      { "parallel-scenarios", no_argument, 0, PARALLEL_SCENARIOS_OPT },
+      { "faulty-scenarios", no_argument, 0, FAULTY_SCENARIOS_OPT },
+      { "sweep-l",     required_argument, 0, SWEEP_L_OPT    },
+      { "sweep-f",     required_argument, 0, SWEEP_F_OPT    },
+      { "sweep-output", required_argument, 0, SWEEP_OUTPUT_OPT },
+      { "symmetries",  no_argument,       0, SYMMETRIES_OPT },
       { 0, 0, 0, 0}
     };
 
@@ -161,21 +189,17 @@ int main(int argc, char** argv) {
         }
         break;
       case 'l':
-        if (!is_double(optarg)) {
-          fprintf(stderr, "Option -l expects a float. Provided: '%s'. Exiting.\n",
+        if (!parse_proba(optarg, &pleak)) {
+          fprintf(stderr, "Option -l expects a probability. Provided: '%s'. Exiting.\n",
                   optarg);
           exit(EXIT_FAILURE);
-        } else {
-          sscanf(optarg, "%lf", &pleak);
         }
         break;
       case 'f':
-        if (!is_double(optarg)) {
-          fprintf(stderr, "Option -f expects a float. Provided: '%s'. Exiting.\n",
+        if (!parse_proba(optarg, &pfault)) {
+          fprintf(stderr, "Option -f expects a probability. Provided: '%s'. Exiting.\n",
                   optarg);
           exit(EXIT_FAILURE);
-        } else {
-          sscanf(optarg, "%lf", &pfault);
         }
         break;
       case 's':
@@ -210,6 +234,34 @@ int main(int argc, char** argv) {
       case TRANSITION_OPT:
         transition = true;
         break;
+      case PARALLEL_SCENARIOS_OPT:
+        parallel_scenarios = true;
+        break;
+      case FAULTY_SCENARIOS_OPT:
+        gen_faulty_scenarios = true;
+        break;
+      case SWEEP_L_OPT:
+        free(grid.pleak);
+        if (!parse_proba_list(optarg, &grid.pleak, &grid.pleak_count)) {
+          fprintf(stderr, "Option --sweep-l expects a list of probabilities. Provided: '%s'. Exiting.\n",
+                  optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case SWEEP_F_OPT:
+        free(grid.pfault);
+        if (!parse_proba_list(optarg, &grid.pfault, &grid.pfault_count)) {
+          fprintf(stderr, "Option --sweep-f expects a list of probabilities. Provided: '%s'. Exiting.\n",
+                  optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case SWEEP_OUTPUT_OPT:
+        sweep_output = optarg;
+        break;
+      case SYMMETRIES_OPT:
+        symmetries = true;
+        break;
       default:
         usage();
     }
@@ -288,9 +340,38 @@ int main(int argc, char** argv) {
     t_output = t;
   }
 
+  bool sweep = grid.pleak_count || grid.pfault_count;
+  if (sweep) {
+    if ((strcmp(property, "CRP") != 0) && (strcmp(property, "CRPC") != 0)) {
+      fprintf(stderr, "Options --sweep-l/--sweep-f are only available for CRP/CRPC.\n\n");
+      usage();
+    }
+    // A single probability given with -l/-f is used for the whole grid.
+    if (!grid.pleak_count && pleak != -1) {
+      grid.pleak = malloc(sizeof(*grid.pleak));
+      grid.pleak[0] = pleak;
+      grid.pleak_count = 1;
+    }
+    if (!grid.pfault_count && pfault != -1) {
+      grid.pfault = malloc(sizeof(*grid.pfault));
+      grid.pfault[0] = pfault;
+      grid.pfault_count = 1;
+    }
+    if (!grid.pleak_count || !grid.pfault_count) {
+      fprintf(stderr, "With --sweep-l (resp. --sweep-f), either --sweep-f or -f (resp. --sweep-l or -l) is mandatory.\n\n");
+      usage();
+    }
+    if ((uint64_t)grid.pleak_count * grid.pfault_count > 100000000) {
+      fprintf(stderr, "Too many probabilities to evaluate (%d x %d). Exiting.\n",
+              grid.pleak_count, grid.pfault_count);
+      exit(EXIT_FAILURE);
+    }
+  }
+
   ParsedFile * pf = parse_file(filename);
   pf->glitch = glitch;
   pf->transition = transition;
+  circuit_cache_open(pf);
 
   Circuit* circuit = gen_circuit(pf, glitch, transition, NULL);
 
@@ -336,25 +417,31 @@ int main(int argc, char** argv) {
   } else if (strcmp(property, "IOS") == 0) {
     compute_IOS(circuit, cores, t);
   } else if (strcmp(property, "RP") == 0) {
-    compute_RP_coeffs(circuit, cores, coeff_max, opt_incompr);
+    compute_RP_coeffs(circuit, cores, coeff_max, opt_incompr, symmetries);
   } else if (strcmp(property, "RPC") == 0) {
     compute_RPC_coeffs(circuit, cores, coeff_max, opt_incompr, t, t_output);
   } else if (strcmp(property, "RPE") == 0) {
     compute_RPE_coeffs(circuit, cores, coeff_max, t, t_output);
   } else if (strcmp(property, "CNI") == 0) {
-    compute_CNI(pf, cores, t, k);
+    compute_CNI(pf, cores, t, k, parallel_scenarios);
   } else if (strcmp(property, "CRP") == 0) {
-    if(pleak != -1 && pfault != -1){
+    if(sweep){
+      compute_CRP_sweep(pf, coeff_max, k, &grid, set, cores, sweep_output);
+    } else if(pleak != -1 && pfault != -1){
       compute_CRP_val(pf, coeff_max, k, pleak, pfault, set);
     } else{
-      compute_CRP_coeffs(pf, cores, coeff_max, k, set);
+      compute_CRP_coeffs(pf, cores, coeff_max, k, set, parallel_scenarios,
+                         gen_faulty_scenarios);
     }
   } else if (strcmp(property, "CRPC") == 0) {
-    if(pleak != -1 && pfault != -1){
+    if(sweep){
+      compute_CRPC_sweep(pf, coeff_max, k, t, &grid, set, cores, sweep_output);
+    } else if(pleak != -1 && pfault != -1){
       compute_CRPC_val(pf, coeff_max, k, t, pleak, pfault, set);
     }
     else{
-      compute_CRPC_coeffs(pf, cores, coeff_max, k, t, set);
+      compute_CRPC_coeffs(pf, cores, coeff_max, k, t, set, parallel_scenarios,
+                          gen_faulty_scenarios, opt_incompr);
     }
   } else {
     fprintf(stderr, "Property %s not implemented. Exiting.\n", property);
@@ -366,6 +453,9 @@ int main(int argc, char** argv) {
   printf("\nVerification completed in %" PRIu64 " min %" PRIu64 " sec.\n",
          diff_time / 60, diff_time % 60);
 
+  free_work_pool();
+  circuit_cache_close();
+  free_proba_grid(&grid);
   free_parsed_file(pf);
   free_circuit(circuit);
   return EXIT_SUCCESS;
@@ -344,11 +344,9 @@ bool is_var_constant(char * name){
 }
 
 bool are_dep_equal(Dependency * dep1, Dependency * dep2, int deps_size){
-  bool eq = true;
-  for(int i=0; i< deps_size; i++){
-    eq = eq && (dep1[i] == dep2[i]);
-  }
-  return eq;
+  // memcmp stops at the first difference (this is called for each pair
+  // of multiplications by update_same_dependencies_idx_last_mult).
+  return memcmp(dep1, dep2, deps_size * sizeof(*dep1)) == 0;
 }
 
 bool are_dep_equal_with_mult(Dependency * dep1, Dependency * dep2, int deps_size,
@@ -510,7 +508,14 @@ inline void add_elem_dep(char * name, int dep_idx, Dependency d,
 }
 
 
-Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv) {
+// Builds the circuit described by |pf| with the faults |fv|. If |fi|
+// is not NULL, the BitDeps and contained secrets of the variables that
+// are not impacted by the faults are taken from |fi->base| rather than
+// recomputed. If |temporary_mult_idx_out| is not NULL, it receives the
+// positions of the operands of each multiplication (which are
+// otherwise freed).
+static Circuit* _gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv,
+                             const FaultInjector * fi, int *** temporary_mult_idx_out) {
 
   StrMap* in = pf->in;
   StrMap* randoms = pf->randoms;
@@ -1025,9 +1030,12 @@ Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv)
 
   compute_total_wires(c);
   compute_rands_usage(c);
-  compute_contained_secrets(c, temporary_mult_idx);
-  compute_bit_deps(c, temporary_mult_idx);
+  bool* reusable = fi ? compute_reusable_deps(c, temporary_mult_idx,
+                                              fi->base, fi->base_mult_idx) : NULL;
+  compute_contained_secrets(c, temporary_mult_idx, fi ? fi->base : NULL, reusable);
+  compute_bit_deps(c, temporary_mult_idx, fi ? fi->base : NULL, reusable);
   compute_total_correction_bit_deps(c);
+  free(reusable);
 
 
   //print_circuit(c);
@@ -1041,10 +1049,14 @@ Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv)
   //print_eq_full_expr(eqs, "temp204");
   //printf("\n\n");
 
-  for(int i=0; i<mult_count; i++){
-    free(temporary_mult_idx[i]);
+  if (temporary_mult_idx_out) {
+    *temporary_mult_idx_out = temporary_mult_idx;
+  } else {
+    for(int i=0; i<mult_count; i++){
+      free(temporary_mult_idx[i]);
+    }
+    free(temporary_mult_idx);
   }
-  free(temporary_mult_idx);
   free(split);
   free(fault_idx);
   free_original_deps(orig_deps_struct);
@@ -1058,4 +1070,72 @@ Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv)
 
 
   return c;
-}
\ No newline at end of file
+}
+
+Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv) {
+  return _gen_circuit(pf, glitch, transition, fv, NULL, NULL);
+}
+
+
+/* ***************************************************** */
+/*              Incremental fault injection              */
+/* ***************************************************** */
+
+static int cmp_ptr(const void* a, const void* b) {
+  uintptr_t pa = (uintptr_t)*(void* const*)a;
+  uintptr_t pb = (uintptr_t)*(void* const*)b;
+  return (pa > pb) - (pa < pb);
+}
+
+FaultInjector* make_fault_injector(ParsedFile * pf, bool glitch, bool transition) {
+  FaultInjector* fi = malloc(sizeof(*fi));
+  fi->pf = pf;
+  fi->glitch = glitch;
+  fi->transition = transition;
+  fi->base = _gen_circuit(pf, glitch, transition, NULL, NULL, &fi->base_mult_idx);
+
+  // Sorting the pointers that faulted circuits can share with |base|,
+  // so that free_faulted_circuit can recognize them with a binary
+  // search.
+  int length = fi->base->deps->length;
+  fi->shared_count = 2 * length;
+  fi->shared = malloc(fi->shared_count * sizeof(*fi->shared));
+  for (int i = 0; i < length; i++) {
+    fi->shared[2*i]   = fi->base->deps->bit_deps[i];
+    fi->shared[2*i+1] = fi->base->deps->contained_secrets[i];
+  }
+  qsort(fi->shared, fi->shared_count, sizeof(*fi->shared), cmp_ptr);
+
+  return fi;
+}
+
+Circuit* inject_faults(FaultInjector* fi, Faults * fv) {
+  return _gen_circuit(fi->pf, fi->glitch, fi->transition, fv, fi, NULL);
+}
+
+// Returns true if |ptr| belongs to the base circuit of |fi|.
+static bool is_shared_with_base(const FaultInjector* fi, void* ptr) {
+  return bsearch(&ptr, fi->shared, fi->shared_count, sizeof(*fi->shared), cmp_ptr) != NULL;
+}
+
+void free_faulted_circuit(FaultInjector* fi, Circuit* c) {
+  for (int i = 0; i < c->deps->length; i++) {
+    if (is_shared_with_base(fi, c->deps->bit_deps[i])) {
+      c->deps->bit_deps[i] = NULL;
+    }
+    if (is_shared_with_base(fi, c->deps->contained_secrets[i])) {
+      c->deps->contained_secrets[i] = NULL;
+    }
+  }
+  free_circuit(c);
+}
+
+void free_fault_injector(FaultInjector* fi) {
+  for (int i = 0; i < fi->base->deps->mult_deps->length; i++) {
+    free(fi->base_mult_idx[i]);
+  }
+  free(fi->base_mult_idx);
+  free(fi->shared);
+  free_circuit(fi->base);
+  free(fi);
+}
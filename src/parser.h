@@ -9,3 +9,32 @@ void free_parsed_file(ParsedFile * parsed);
 
 Circuit* gen_circuit(ParsedFile * pf, bool glitch, bool transition, Faults * fv);
 
+
+// Incremental fault injection: the fault-free circuit is built once
+// (|base|), and each faulted circuit is then generated from it. The
+// equations still need to be replayed for each set of faults, but the
+// BitDeps and contained secrets of the variables that the faults do
+// not impact (see compute_reusable_deps in circuit.c) are shared with
+// |base| instead of being recomputed, so that the cost of the derived
+// computations only depends on the part of the circuit that the
+// faults reach.
+typedef struct _fault_injector {
+  ParsedFile * pf;
+  bool glitch;
+  bool transition;
+  Circuit* base;       // Fault-free circuit
+  int** base_mult_idx; // Positions of the operands of the mults of |base|
+  void** shared;       // Sorted pointers that faulted circuits may share with |base|
+  int shared_count;
+} FaultInjector;
+
+FaultInjector* make_fault_injector(ParsedFile * pf, bool glitch, bool transition);
+
+// Returns the circuit of |fi->pf| with the faults |fv|. This circuit
+// must be freed with free_faulted_circuit (and not free_circuit),
+// possibly after a call to remove_elementary_wires.
+Circuit* inject_faults(FaultInjector* fi, Faults * fv);
+
+void free_faulted_circuit(FaultInjector* fi, Circuit* c);
+void free_fault_injector(FaultInjector* fi);
+
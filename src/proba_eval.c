@@ -0,0 +1,577 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <math.h>
+#include <gmp.h>
+
+#include "proba_eval.h"
+#include "config.h"
+
+// Nonzero values whose binary exponent is outside of
+// [-DD_MAX_EXP,DD_MAX_EXP] are not represented as double-doubles
+// (they are only used through GMP): the products of two values in this
+// range (or of one of them and a 128-bit coefficient) never underflow
+// nor overflow.
+#define DD_MAX_EXP 450
+
+// 2^-106: the error bounds of the double-double operations below are
+// multiples of it.
+#define DD_EPS2 0x1p-106
+
+
+/***********************************************************
+                Double-double arithmetic
+************************************************************/
+
+// The algorithms (and their error bounds) are from Joldes, Muller and
+// Popescu, "Tight and rigorous error bounds for basic building blocks
+// of double-word arithmetic" (2017).
+
+static inline DoubleDouble fast_two_sum(double a, double b) {
+  // Requires |a| >= |b|
+  double s = a + b;
+  double e = b - (s - a);
+  return (DoubleDouble) { s, e };
+}
+
+static inline DoubleDouble two_sum(double a, double b) {
+  double s  = a + b;
+  double bb = s - a;
+  double e  = (a - (s - bb)) + (b - bb);
+  return (DoubleDouble) { s, e };
+}
+
+// Relative error at most 3 * 2^-106 (AccurateDWPlusDW).
+static inline DoubleDouble dd_add(DoubleDouble a, DoubleDouble b) {
+  DoubleDouble s = two_sum(a.hi, b.hi);
+  DoubleDouble t = two_sum(a.lo, b.lo);
+  DoubleDouble v = fast_two_sum(s.hi, s.lo + t.hi);
+  return fast_two_sum(v.hi, t.lo + v.lo);
+}
+
+// Relative error at most 4 * 2^-106 (DWTimesDW3).
+static inline DoubleDouble dd_mul(DoubleDouble a, DoubleDouble b) {
+  double ch  = a.hi * b.hi;
+  double cl1 = fma(a.hi, b.hi, -ch);
+  double tl  = fma(a.hi, b.lo, a.lo * b.lo);
+  double cl2 = fma(a.lo, b.hi, tl);
+  return fast_two_sum(ch, cl1 + cl2);
+}
+
+static inline DoubleDouble dd_from_u64(uint64_t x) {
+  // Both halves are exact
+  return two_sum((double)(x >> 32) * 4294967296.0, (double)(x & 0xffffffff));
+}
+
+// hi * 2^64 + lo, with a relative error of at most 3 * 2^-106.
+static inline DoubleDouble dd_from_u128(uint64_t hi, uint64_t lo) {
+  if (!hi) return dd_from_u64(lo);
+  DoubleDouble h = dd_from_u64(hi);
+  h.hi *= 0x1p64;
+  h.lo *= 0x1p64;
+  return dd_add(h, dd_from_u64(lo));
+}
+
+static void mpf_set_u128(mpf_t res, uint64_t hi, uint64_t lo) {
+  mpf_set_ui(res, hi);
+  mpf_mul_2exp(res, res, 64);
+  mpf_t t;
+  mpf_init2(t, PROBA_EVAL_GMP_PREC);
+  mpf_set_ui(t, lo);
+  mpf_add(res, res, t);
+  mpf_clear(t);
+}
+
+static DoubleDouble dd_from_mpf(const mpf_t x) {
+  mpf_t r;
+  mpf_init2(r, PROBA_EVAL_GMP_PREC);
+  double hi = mpf_get_d(x);
+  mpf_set_d(r, hi);
+  mpf_sub(r, x, r);
+  double lo = mpf_get_d(r);
+  mpf_clear(r);
+  return fast_two_sum(hi, lo);
+}
+
+static void mpf_add_dd(mpf_t res, DoubleDouble x) {
+  mpf_t t;
+  mpf_init2(t, PROBA_EVAL_GMP_PREC);
+  mpf_set_d(t, x.hi);
+  mpf_add(res, res, t);
+  mpf_set_d(t, x.lo);
+  mpf_add(res, res, t);
+  mpf_clear(t);
+}
+
+static bool dd_in_range(const mpf_t x) {
+  if (mpf_sgn(x) == 0) return true;
+  long exp;
+  mpf_get_d_2exp(&exp, x);
+  return exp >= -DD_MAX_EXP && exp <= DD_MAX_EXP;
+}
+
+
+/***********************************************************
+                      Sums of probabilities
+************************************************************/
+
+void proba_sum_init(ProbaSum* s) {
+  s->dd = (DoubleDouble) { 0, 0 };
+  s->adds = 0;
+  mpf_init2(s->gmp, PROBA_EVAL_GMP_PREC);
+}
+
+static void proba_sum_flush(ProbaSum* s) {
+  mpf_add_dd(s->gmp, s->dd);
+  s->dd = (DoubleDouble) { 0, 0 };
+  s->adds = 0;
+}
+
+static inline void proba_sum_add_dd(ProbaSum* s, DoubleDouble x) {
+  s->dd = dd_add(s->dd, x);
+  if (++s->adds == PROBA_SUM_FLUSH_PERIOD) {
+    proba_sum_flush(s);
+  }
+}
+
+void proba_sum_get(ProbaSum* s, mpf_t res) {
+  proba_sum_flush(s);
+  mpf_set(res, s->gmp);
+}
+
+void proba_sum_clear(ProbaSum* s) {
+  mpf_clear(s->gmp);
+}
+
+
+/***********************************************************
+                      Precomputed tables
+************************************************************/
+
+// A table of non-negative values, stored both as double-doubles (when
+// they are in range) and as GMP floats.
+typedef struct _proba_table {
+  int len;
+  DoubleDouble* dd;
+  bool* ok; // True if dd[i] can be used
+  mpf_t* gmp;
+} ProbaTable;
+
+static void init_proba_table(ProbaTable* t, int len) {
+  t->len = len;
+  t->dd  = malloc(len * sizeof(*t->dd));
+  t->ok  = malloc(len * sizeof(*t->ok));
+  t->gmp = malloc(len * sizeof(*t->gmp));
+  for (int i = 0; i < len; i++) {
+    mpf_init2(t->gmp[i], PROBA_EVAL_GMP_PREC);
+  }
+}
+
+// Computes the double-double versions of the entries of |t| from
+// their GMP versions.
+static void finish_proba_table(ProbaTable* t) {
+  for (int i = 0; i < t->len; i++) {
+    t->ok[i] = dd_in_range(t->gmp[i]);
+    t->dd[i] = t->ok[i] ? dd_from_mpf(t->gmp[i]) : (DoubleDouble) { 0, 0 };
+  }
+}
+
+static void clear_proba_table(ProbaTable* t) {
+  for (int i = 0; i < t->len; i++) {
+    mpf_clear(t->gmp[i]);
+  }
+  free(t->dd);
+  free(t->ok);
+  free(t->gmp);
+}
+
+// Sets |weights[i]| to x^i (1-x)^(len-1-i), and |tail[i]| to
+// \sum_{j=i}^{len-1} (len-1 choose j) weights[j] (|tail| has len+1
+// entries, the last one being 0).
+// Note that 1-x is computed as a double.
+static void fill_binomial_tables(ProbaTable* weights, ProbaTable* tail, double x, int len) {
+  mpf_t* x_pow   = malloc(len * sizeof(*x_pow));
+  mpf_t* one_pow = malloc(len * sizeof(*one_pow));
+  for (int i = 0; i < len; i++) {
+    mpf_init2(x_pow[i], PROBA_EVAL_GMP_PREC);
+    mpf_init2(one_pow[i], PROBA_EVAL_GMP_PREC);
+  }
+  mpf_t mpf_x, mpf_one_minus_x;
+  mpf_init2(mpf_x, PROBA_EVAL_GMP_PREC);
+  mpf_init2(mpf_one_minus_x, PROBA_EVAL_GMP_PREC);
+  mpf_set_d(mpf_x, x);
+  mpf_set_d(mpf_one_minus_x, 1.0-x);
+  if (len > 0) {
+    mpf_set_ui(x_pow[0], 1);
+    mpf_set_ui(one_pow[0], 1);
+  }
+  for (int i = 1; i < len; i++) {
+    mpf_mul(x_pow[i], x_pow[i-1], mpf_x);
+    mpf_mul(one_pow[i], one_pow[i-1], mpf_one_minus_x);
+  }
+  mpf_clears(mpf_x, mpf_one_minus_x, NULL);
+
+  for (int i = 0; i < len; i++) {
+    mpf_mul(weights->gmp[i], x_pow[i], one_pow[len-1-i]);
+  }
+
+  mpz_t binom;
+  mpz_init(binom);
+  mpf_t t;
+  mpf_init2(t, PROBA_EVAL_GMP_PREC);
+  mpf_set_ui(tail->gmp[len], 0);
+  for (int i = len-1; i >= 0; i--) {
+    mpz_bin_uiui(binom, len-1, i);
+    mpf_set_z(t, binom);
+    mpf_mul(t, t, weights->gmp[i]);
+    mpf_add(tail->gmp[i], tail->gmp[i+1], t);
+  }
+  mpf_clear(t);
+  mpz_clear(binom);
+
+  for (int i = 0; i < len; i++) {
+    mpf_clear(x_pow[i]);
+    mpf_clear(one_pow[i]);
+  }
+  free(x_pow);
+  free(one_pow);
+
+  finish_proba_table(weights);
+  finish_proba_table(tail);
+}
+
+
+/***********************************************************
+                   Leakage and fault probabilities
+************************************************************/
+
+struct _proba_eval {
+  int n, total;
+  bool use_gmp; // True if the double-double error bound is too loose
+  ProbaTable leak;       // p^i (1-p)^(n-1-i)
+  ProbaTable leak_tail;  // \sum_{j>=i} (n-1 choose j) p^j (1-p)^(n-1-j)
+  ProbaTable fault;      // f^k (1-f)^(total-k)
+  ProbaTable fault_tail; // \sum_{j>=k} (total choose j) f^j (1-f)^(total-j)
+};
+
+ProbaEval* make_proba_eval(int n, double p, int total, double f) {
+  ProbaEval* e = malloc(sizeof(*e));
+  e->n = n;
+  e->total = total;
+  e->use_gmp = (3.0 * n + 3.0 * PROBA_SUM_FLUSH_PERIOD + 19) * DD_EPS2 > PROBA_EVAL_MAX_REL_ERROR;
+
+  init_proba_table(&e->leak, n);
+  init_proba_table(&e->leak_tail, n+1);
+  fill_binomial_tables(&e->leak, &e->leak_tail, p, n);
+
+  init_proba_table(&e->fault, total+1);
+  init_proba_table(&e->fault_tail, total+2);
+  fill_binomial_tables(&e->fault, &e->fault_tail, f, total+1);
+
+  return e;
+}
+
+void free_proba_eval(ProbaEval* e) {
+  clear_proba_table(&e->leak);
+  clear_proba_table(&e->leak_tail);
+  clear_proba_table(&e->fault);
+  clear_proba_table(&e->fault_tail);
+  free(e);
+}
+
+// Same as proba_eval_add_leakage, but entirely with GMP.
+static void add_leakage_gmp(const ProbaEval* e, const uint64_t* coeffs_lo, const uint64_t* coeffs_hi,
+                            uint64_t count, int k, int split,
+                            ProbaSum* res_min, ProbaSum* res_max) {
+  mpf_t prefix, rest, t;
+  mpf_init2(prefix, PROBA_EVAL_GMP_PREC);
+  mpf_init2(rest, PROBA_EVAL_GMP_PREC);
+  mpf_init2(t, PROBA_EVAL_GMP_PREC);
+
+  for (int i = 0; i < e->n; i++) {
+    uint64_t hi = coeffs_hi ? coeffs_hi[i] : 0;
+    if (!coeffs_lo[i] && !hi) continue;
+    mpf_set_u128(t, hi, coeffs_lo[i]);
+    mpf_mul(t, t, e->leak.gmp[i]);
+    if (i < split) {
+      mpf_add(prefix, prefix, t);
+    } else {
+      mpf_add(rest, rest, t);
+    }
+  }
+
+  if (res_min) {
+    mpf_add(t, prefix, rest);
+    mpf_mul(t, t, e->fault.gmp[k]);
+    mpf_add(res_min->gmp, res_min->gmp, t);
+  }
+  if (res_max) {
+    mpf_set_ui(t, count);
+    mpf_mul(t, t, e->leak_tail.gmp[split]);
+    mpf_add(t, t, prefix);
+    mpf_mul(t, t, e->fault.gmp[k]);
+    mpf_add(res_max->gmp, res_max->gmp, t);
+  }
+
+  mpf_clears(prefix, rest, t, NULL);
+}
+
+void proba_eval_add_leakage(const ProbaEval* e, const uint64_t* coeffs_lo, const uint64_t* coeffs_hi,
+                            uint64_t count, int k, int c_max,
+                            ProbaSum* res_min, ProbaSum* res_max) {
+  assert(k >= 0 && k <= e->total);
+  // Coefficients below |split| are precise.
+  int split = c_max < 0 || c_max >= e->n ? e->n : c_max + 1;
+
+  if (e->use_gmp || !e->fault.ok[k] || (res_max && !e->leak_tail.ok[split])) {
+    add_leakage_gmp(e, coeffs_lo, coeffs_hi, count, k, split, res_min, res_max);
+    return;
+  }
+
+  // Each term has a relative error of at most 7 * 2^-106 (3 for the
+  // conversion of a 128-bit coefficient, and 4 for the product), and
+  // each of the (at most n+1) additions adds at most 3 * 2^-106, which,
+  // with the final multiplication and the addition to the ProbaSums, is
+  // within the bound given in proba_eval.h.
+  DoubleDouble prefix = { 0, 0 }, rest = { 0, 0 };
+  for (int i = 0; i < e->n; i++) {
+    uint64_t hi = coeffs_hi ? coeffs_hi[i] : 0;
+    if (!coeffs_lo[i] && !hi) continue;
+    if (!e->leak.ok[i]) {
+      add_leakage_gmp(e, coeffs_lo, coeffs_hi, count, k, split, res_min, res_max);
+      return;
+    }
+    DoubleDouble t = dd_mul(dd_from_u128(hi, coeffs_lo[i]), e->leak.dd[i]);
+    if (i < split) {
+      prefix = dd_add(prefix, t);
+    } else {
+      rest = dd_add(rest, t);
+    }
+  }
+
+  if (res_min) {
+    proba_sum_add_dd(res_min, dd_mul(dd_add(prefix, rest), e->fault.dd[k]));
+  }
+  if (res_max) {
+    DoubleDouble tail = dd_mul(dd_from_u64(count), e->leak_tail.dd[split]);
+    proba_sum_add_dd(res_max, dd_mul(dd_add(prefix, tail), e->fault.dd[k]));
+  }
+}
+
+void proba_eval_add_mu(const ProbaEval* e, int k, uint64_t count, ProbaSum* res) {
+  assert(k >= 0 && k <= e->total);
+  if (e->use_gmp || !e->fault.ok[k]) {
+    mpf_t t;
+    mpf_init2(t, PROBA_EVAL_GMP_PREC);
+    mpf_set_ui(t, count);
+    mpf_mul(t, t, e->fault.gmp[k]);
+    mpf_add(res->gmp, res->gmp, t);
+    mpf_clear(t);
+  } else {
+    proba_sum_add_dd(res, dd_mul(dd_from_u64(count), e->fault.dd[k]));
+  }
+}
+
+void proba_eval_add_mu_tail(const ProbaEval* e, int k, ProbaSum* res) {
+  assert(k >= 0 && k <= e->total);
+  if (e->use_gmp || !e->fault_tail.ok[k+1]) {
+    mpf_add(res->gmp, res->gmp, e->fault_tail.gmp[k+1]);
+  } else {
+    proba_sum_add_dd(res, e->fault_tail.dd[k+1]);
+  }
+}
+
+
+/***********************************************************
+                 Aggregated fault scenarios
+************************************************************/
+
+ScenarioSums* make_scenario_sums(int k, int n) {
+  ScenarioSums* s = malloc(sizeof(*s));
+  s->k = k;
+  s->n = n;
+  s->verified  = calloc(k+1, sizeof(*s->verified));
+  s->ignored   = calloc(k+1, sizeof(*s->ignored));
+  s->coeffs_lo = calloc((k+1) * n, sizeof(*s->coeffs_lo));
+  s->coeffs_hi = calloc((k+1) * n, sizeof(*s->coeffs_hi));
+  return s;
+}
+
+void free_scenario_sums(ScenarioSums* s) {
+  free(s->verified);
+  free(s->ignored);
+  free(s->coeffs_lo);
+  free(s->coeffs_hi);
+  free(s);
+}
+
+void scenario_sums_add(ScenarioSums* s, int faults, const uint64_t* coeffs) {
+  assert(faults >= 0 && faults <= s->k);
+  s->verified[faults]++;
+  uint64_t* lo = &s->coeffs_lo[faults * s->n];
+  uint64_t* hi = &s->coeffs_hi[faults * s->n];
+  for (int i = 0; i < s->n; i++) {
+    lo[i] += coeffs[i];
+    hi[i] += lo[i] < coeffs[i];
+  }
+}
+
+void scenario_sums_add_ignored(ScenarioSums* s, int faults) {
+  assert(faults >= 0 && faults <= s->k);
+  s->ignored[faults]++;
+}
+
+void init_combined_proba(CombinedProba* r) {
+  mpf_init2(r->epsilon, PROBA_EVAL_GMP_PREC);
+  mpf_init2(r->mu, PROBA_EVAL_GMP_PREC);
+  mpf_init2(r->gamma, PROBA_EVAL_GMP_PREC);
+  mpf_init2(r->epsilon_max, PROBA_EVAL_GMP_PREC);
+  mpf_init2(r->mu_max, PROBA_EVAL_GMP_PREC);
+  mpf_init2(r->gamma_max, PROBA_EVAL_GMP_PREC);
+}
+
+void clear_combined_proba(CombinedProba* r) {
+  mpf_clears(r->epsilon, r->mu, r->gamma, r->epsilon_max, r->mu_max, r->gamma_max, NULL);
+}
+
+// Sets |gamma| to |mu| + |epsilon|, and divides |epsilon| by 1 - |mu|.
+static void finish_combined_proba(mpf_t epsilon, mpf_t mu, mpf_t gamma) {
+  mpf_add(gamma, mu, epsilon);
+
+  mpf_t t;
+  mpf_init2(t, PROBA_EVAL_GMP_PREC);
+  mpf_ui_sub(t, 1, mu);
+  mpf_div(epsilon, epsilon, t);
+  mpf_clear(t);
+}
+
+void proba_eval_scenarios(const ProbaEval* e, const ScenarioSums* s, int c_max,
+                          CombinedProba* res) {
+  assert(s->n == e->n && s->k <= e->total);
+
+  ProbaSum sum_epsilon, sum_mu, sum_epsilon_max, sum_mu_max;
+  proba_sum_init(&sum_epsilon);
+  proba_sum_init(&sum_mu);
+  proba_sum_init(&sum_epsilon_max);
+  proba_sum_init(&sum_mu_max);
+
+  for (int k = 0; k <= s->k; k++) {
+    if (s->ignored[k]) {
+      proba_eval_add_mu(e, k, s->ignored[k], &sum_mu);
+      proba_eval_add_mu(e, k, s->ignored[k], &sum_mu_max);
+    }
+    if (s->verified[k]) {
+      proba_eval_add_leakage(e, &s->coeffs_lo[k * s->n], &s->coeffs_hi[k * s->n],
+                             s->verified[k], k, c_max, &sum_epsilon, &sum_epsilon_max);
+    }
+  }
+  proba_eval_add_mu_tail(e, s->k, &sum_mu_max);
+
+  proba_sum_get(&sum_epsilon, res->epsilon);
+  proba_sum_get(&sum_mu, res->mu);
+  proba_sum_get(&sum_epsilon_max, res->epsilon_max);
+  proba_sum_get(&sum_mu_max, res->mu_max);
+  proba_sum_clear(&sum_epsilon);
+  proba_sum_clear(&sum_mu);
+  proba_sum_clear(&sum_epsilon_max);
+  proba_sum_clear(&sum_mu_max);
+
+  finish_combined_proba(res->epsilon, res->mu, res->gamma);
+  finish_combined_proba(res->epsilon_max, res->mu_max, res->gamma_max);
+}
+
+/***********************************************************
+                 Polynomials of compute_leakage_proba
+************************************************************/
+
+struct _proba_poly {
+  int len;
+  bool use_gmp; // True if some coefficients are out of the double-double range
+  ProbaTable coeffs;
+};
+
+ProbaPoly* make_proba_poly(const uint64_t* coeffs, int last_precise_coeff, int len, int min_max) {
+  ProbaPoly* poly = malloc(sizeof(*poly));
+  poly->len = len;
+  init_proba_table(&poly->coeffs, len);
+
+  mpz_t binom;
+  mpz_init(binom);
+  for (int i = 0; i < len; i++) {
+    if (i <= last_precise_coeff) {
+      mpf_set_ui(poly->coeffs.gmp[i], coeffs[i]);
+    } else if (min_max == 1) {
+      mpz_bin_uiui(binom, len, i);
+      mpf_set_z(poly->coeffs.gmp[i], binom);
+    } else {
+      mpf_set_ui(poly->coeffs.gmp[i], 0);
+    }
+  }
+  mpz_clear(binom);
+  finish_proba_table(&poly->coeffs);
+
+  poly->use_gmp = false;
+  for (int i = 0; i < len; i++) {
+    poly->use_gmp |= !poly->coeffs.ok[i];
+  }
+
+  return poly;
+}
+
+void free_proba_poly(ProbaPoly* poly) {
+  clear_proba_table(&poly->coeffs);
+  free(poly);
+}
+
+static int proba_poly_cmp_gmp(const ProbaPoly* poly, double x, bool square_root) {
+  mpf_t fx, mpf_x;
+  mpf_init2(fx, PROBA_EVAL_GMP_PREC);
+  mpf_init2(mpf_x, PROBA_EVAL_GMP_PREC);
+  mpf_set_d(mpf_x, x);
+
+  for (int i = poly->len-1; i >= 1; i--) {
+    mpf_add(fx, fx, poly->coeffs.gmp[i]);
+    mpf_mul(fx, fx, mpf_x);
+  }
+  if (square_root) {
+    mpf_sqrt(fx, fx);
+  }
+
+  int cmp = mpf_cmp_d(fx, x);
+  mpf_clears(fx, mpf_x, NULL);
+  return cmp > 0 ? 1 : cmp < 0 ? -1 : 0;
+}
+
+int proba_poly_cmp(const ProbaPoly* poly, double x, bool square_root) {
+  if (poly->use_gmp) {
+    return proba_poly_cmp_gmp(poly, x, square_root);
+  }
+
+  // Horner's scheme. Since the coefficients and |x| are non-negative,
+  // each step adds a relative error of at most 7 * 2^-106 (plus an
+  // absolute error below 2^-1000 if some intermediate values
+  // underflow).
+  DoubleDouble dd_x = { x, 0 };
+  DoubleDouble fx = { 0, 0 };
+  for (int i = poly->len-1; i >= 1; i--) {
+    fx = dd_mul(dd_add(fx, poly->coeffs.dd[i]), dd_x);
+  }
+
+  // Comparing fx with x^2 rather than sqrt(fx) with x when
+  // |square_root| is true (x^2 is computed exactly).
+  DoubleDouble target = { x, 0 };
+  if (square_root) {
+    double sq = x * x;
+    target = (DoubleDouble) { sq, fma(x, x, -sq) };
+  }
+
+  double bound = 8.0 * poly->len * DD_EPS2 * fx.hi + poly->len * 0x1p-1000;
+  double diff = (fx.hi - target.hi) + (fx.lo - target.lo);
+  double margin = 2 * bound + 0x1p-100 * fmax(fx.hi, target.hi);
+  if (diff > margin) return 1;
+  if (diff < -margin) return -1;
+
+  // Too close to decide with double-doubles.
+  return proba_poly_cmp_gmp(poly, x, square_root);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+// Evaluation of the polynomials giving leakage and fault probabilities
+// from coefficients (as used by CRP/CRPC, and by compute_leakage_proba
+// and get_failure_proba in coeffs.c).
+//
+// CRP/CRPC first aggregate their scenarios by number of faults (see
+// ScenarioSums), and then evaluate these sums once per probability.
+//
+// Everything that only depends on the probabilities and on the sizes
+// (powers of p and 1-p, binomial coefficients and their tails) is
+// precomputed once with GMP, and the per-scenario evaluations are then
+// done in double-double arithmetic (pairs of doubles, about 106 bits
+// of precision). The relative error of the double-double results is
+// bounded by (3n + 3*PROBA_SUM_FLUSH_PERIOD + 19) * 2^-106 (where n is
+// the number of coefficients), which is checked to be below
+// PROBA_EVAL_MAX_REL_ERROR: the results are then at least as precise
+// as the ones of the default-precision mpf computations. Values that
+// are too small or too large for double-doubles (for which this bound
+// does not hold) and evaluations for which this bound is too loose
+// are done with GMP (at PROBA_EVAL_GMP_PREC bits of precision)
+// instead.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <gmp.h>
+
+typedef struct _double_double {
+  double hi, lo;
+} DoubleDouble;
+
+// A sum of non-negative probabilities. Its double-double part is added
+// to its GMP part every PROBA_SUM_FLUSH_PERIOD additions, so that the
+// rounding errors of the additions do not accumulate indefinitely.
+typedef struct _proba_sum {
+  DoubleDouble dd;
+  int adds;   // Number of additions to |dd| since the last flush
+  mpf_t gmp;
+} ProbaSum;
+
+void proba_sum_init(ProbaSum* s);
+// Sets |res| (which should be initialized) to the value of |s|.
+void proba_sum_get(ProbaSum* s, mpf_t res);
+void proba_sum_clear(ProbaSum* s);
+
+
+// Precomputed tables for the evaluation, for a leakage probability |p|
+// and coefficients of size |n|, and a fault probability |f| for
+// |total| variables that can be faulted.
+typedef struct _proba_eval ProbaEval;
+
+ProbaEval* make_proba_eval(int n, double p, int total, double f);
+void free_proba_eval(ProbaEval* e);
+
+// Adds to |res_min| and |res_max| the probability of |count|
+// scenarios where |k| variables are faulted and whose leakage
+// coefficients sum to |coeffs| (coeffs[i] being coeffs_hi[i] * 2^64 +
+// coeffs_lo[i], |coeffs_hi| being NULL if it is all 0), that is:
+//
+//    f^k (1-f)^(total-k) * \sum_{i=0}^{n-1} c_i p^i (1-p)^(n-1-i)
+//
+// where c_i = coeffs[i] for |res_min|, and, for |res_max|, c_i =
+// coeffs[i] if i <= |c_max| and |count| * (n-1 choose i) otherwise
+// (|c_max| = -1 meaning that all the coefficients are precise). Either
+// of |res_min| and |res_max| can be NULL.
+void proba_eval_add_leakage(const ProbaEval* e, const uint64_t* coeffs_lo, const uint64_t* coeffs_hi,
+                            uint64_t count, int k, int c_max,
+                            ProbaSum* res_min, ProbaSum* res_max);
+
+// Adds |count| * f^k (1-f)^(total-k) to |res|.
+void proba_eval_add_mu(const ProbaEval* e, int k, uint64_t count, ProbaSum* res);
+
+// Adds \sum_{i=k+1}^{total} (total choose i) f^i (1-f)^(total-i) to
+// |res| (the probability that more than |k| variables are faulted).
+void proba_eval_add_mu_tail(const ProbaEval* e, int k, ProbaSum* res);
+
+
+// The fault scenarios of a group (all the scenarios for CRP, or those
+// of a combination of faults on inputs for CRPC), aggregated by number
+// of faults: since the probabilities are linear in the coefficients,
+// it is enough to know, for each number of faults, the sum of the
+// coefficients of the scenarios that were verified, and the number of
+// scenarios that were ignored (because they cannot be corrected).
+// Sums are kept exactly on 128 bits (|coeffs_hi| counting the
+// overflows of |coeffs_lo|).
+typedef struct _scenario_sums {
+  int k;               // Maximal number of faults
+  int n;               // Number of coefficients of each scenario
+  uint64_t* verified;  // verified[i]: number of verified scenarios with i faults
+  uint64_t* ignored;   // ignored[i]: number of ignored scenarios with i faults
+  uint64_t* coeffs_lo; // coeffs_*[i*n+j]: sum of the coefficients j of the
+  uint64_t* coeffs_hi; //   verified scenarios with i faults
+} ScenarioSums;
+
+ScenarioSums* make_scenario_sums(int k, int n);
+void free_scenario_sums(ScenarioSums* s);
+// Adds a verified scenario with |faults| faults and coefficients |coeffs|.
+void scenario_sums_add(ScenarioSums* s, int faults, const uint64_t* coeffs);
+// Adds a scenario with |faults| faults that was ignored.
+void scenario_sums_add_ignored(ScenarioSums* s, int faults);
+
+// The results of CRP/CRPC for a leakage and a fault probability:
+// |gamma| = |mu| + |epsilon| and |epsilon| is then divided by 1-|mu|.
+// The *_max values use binomial coefficients instead of the
+// coefficients that were not computed, and count all the scenarios with
+// more faults than verified in |mu_max|.
+typedef struct _combined_proba {
+  mpf_t epsilon, mu, gamma;
+  mpf_t epsilon_max, mu_max, gamma_max;
+} CombinedProba;
+
+void init_combined_proba(CombinedProba* r);
+void clear_combined_proba(CombinedProba* r);
+
+// Sets |res| to the probabilities of the scenarios of |s|, where the
+// coefficients after |c_max| (-1 if they are all precise) are not
+// precise (the scenarios being aggregated, this takes O(s->k * s->n)
+// operations).
+void proba_eval_scenarios(const ProbaEval* e, const ScenarioSums* s, int c_max,
+                          CombinedProba* res);
+
+
+// The polynomial f(x) = \sum_{i=1}^{len-1} a_i x^i, whose coefficients
+// are non-negative. See compute_leakage_proba.
+typedef struct _proba_poly ProbaPoly;
+
+// a_i = coeffs[i] for i <= |last_precise_coeff|, and (len choose i)
+// (if |min_max| == 1) or 0 (if |min_max| == -1) otherwise.
+ProbaPoly* make_proba_poly(const uint64_t* coeffs, int last_precise_coeff, int len, int min_max);
+void free_proba_poly(ProbaPoly* poly);
+
+// Returns 1 if f(x) > x (or if sqrt(f(x)) > x when |square_root| is
+// true), -1 if f(x) < x, and 0 if they are equal.
+int proba_poly_cmp(const ProbaPoly* poly, double x, bool square_root);
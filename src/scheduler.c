@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "scheduler.h"
+
+
+/***********************************************************
+                   Persistent thread pool
+************************************************************/
+
+struct _work_pool {
+  int size;
+  pthread_t* threads;
+  pthread_mutex_t lock;
+  pthread_cond_t start_cond; // Signaled when a new job is available
+  pthread_cond_t done_cond;  // Signaled when the last worker is done
+  uint64_t generation;       // Incremented for each new job
+  int running;               // Number of workers still on the current job
+  bool shutdown;
+  void (*fn)(void*, int);
+  void* job;
+};
+
+struct worker_args {
+  WorkPool* pool;
+  int id;
+};
+
+static WorkPool* shared_pool = NULL;
+
+static void* work_pool_worker(void* void_args) {
+  struct worker_args* args = (struct worker_args*) void_args;
+  WorkPool* pool = args->pool;
+  int id = args->id;
+  free(args);
+
+  uint64_t seen_generation = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->generation == seen_generation && !pool->shutdown) {
+      pthread_cond_wait(&pool->start_cond, &pool->lock);
+    }
+    if (pool->shutdown) break;
+    seen_generation = pool->generation;
+    void (*fn)(void*, int) = pool->fn;
+    void* job = pool->job;
+    pthread_mutex_unlock(&pool->lock);
+
+    fn(job, id);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->running == 0) {
+      pthread_cond_signal(&pool->done_cond);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static WorkPool* make_work_pool(int size) {
+  WorkPool* pool = malloc(sizeof(*pool));
+  pool->size = size;
+  pool->threads = malloc(size * sizeof(*pool->threads));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+  pool->generation = 0;
+  pool->running = 0;
+  pool->shutdown = false;
+  pool->fn = NULL;
+  pool->job = NULL;
+
+  for (int i = 0; i < size; i++) {
+    struct worker_args* args = malloc(sizeof(*args));
+    args->pool = pool;
+    args->id = i;
+    if (pthread_create(&pool->threads[i], NULL, work_pool_worker, args)) {
+      fprintf(stderr, "Failed to create thread %d of the work pool. Exiting.\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return pool;
+}
+
+static void stop_work_pool(WorkPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start_cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->size; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start_cond);
+  pthread_cond_destroy(&pool->done_cond);
+  free(pool->threads);
+  free(pool);
+}
+
+WorkPool* get_work_pool(int cores) {
+  if (shared_pool && shared_pool->size != cores) {
+    stop_work_pool(shared_pool);
+    shared_pool = NULL;
+  }
+  if (!shared_pool) {
+    shared_pool = make_work_pool(cores);
+  }
+  return shared_pool;
+}
+
+void work_pool_run(WorkPool* pool, void (*fn)(void* job, int worker_id), void* job) {
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->job = job;
+  pool->running = pool->size;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start_cond);
+  while (pool->running) {
+    pthread_cond_wait(&pool->done_cond, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int work_pool_size(WorkPool* pool) {
+  return pool->size;
+}
+
+void free_work_pool() {
+  if (shared_pool) {
+    stop_work_pool(shared_pool);
+    shared_pool = NULL;
+  }
+}
+
+
+struct work_pool_for_job {
+  void (*fn)(void*, int, int);
+  void* data;
+  int count;
+  int next; // Next index not yet taken (updated atomically)
+};
+
+static void work_pool_for_worker(void* void_job, int worker_id) {
+  struct work_pool_for_job* job = (struct work_pool_for_job*) void_job;
+  while (1) {
+    int idx = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+    if (idx >= job->count) return;
+    job->fn(job->data, idx, worker_id);
+  }
+}
+
+void work_pool_for(WorkPool* pool, int count,
+                   void (*fn)(void* data, int idx, int worker_id), void* data) {
+  struct work_pool_for_job job = {
+    .fn = fn, .data = data, .count = count, .next = 0
+  };
+  work_pool_run(pool, work_pool_for_worker, &job);
+}
+
+
+/***********************************************************
+                 Work-stealing rank scheduler
+************************************************************/
+
+void init_rank_scheduler(RankScheduler* sched, int workers,
+                         uint64_t total, uint64_t chunk_size) {
+  sched->workers = workers;
+  sched->total = total;
+  sched->chunk_size = chunk_size ? chunk_size : 1;
+  sched->deques = malloc(workers * sizeof(*sched->deques));
+
+  // Each worker initially gets a contiguous range of chunks
+  uint64_t chunk_count = (total + sched->chunk_size - 1) / sched->chunk_size;
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&sched->deques[i].lock, NULL);
+    sched->deques[i].head = chunk_count * i / workers;
+    sched->deques[i].tail = chunk_count * (i+1) / workers;
+  }
+}
+
+void free_rank_scheduler(RankScheduler* sched) {
+  for (int i = 0; i < sched->workers; i++) {
+    pthread_mutex_destroy(&sched->deques[i].lock);
+  }
+  free(sched->deques);
+}
+
+// Takes the chunk at the front of |deque|. Returns false if |deque| is empty.
+static bool pop_front(RankDeque* deque, uint64_t* chunk) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->head < deque->tail) {
+    *chunk = deque->head++;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// Moves (the back) half of the chunks of |victim| to |thief|, which
+// is expected to be empty. Returns false if |victim| was empty.
+static bool steal_half(RankDeque* victim, RankDeque* thief) {
+  uint64_t first, last;
+  pthread_mutex_lock(&victim->lock);
+  uint64_t available = victim->tail - victim->head;
+  if (available == 0) {
+    pthread_mutex_unlock(&victim->lock);
+    return false;
+  }
+  uint64_t stolen = (available + 1) / 2;
+  last  = victim->tail;
+  first = last - stolen;
+  victim->tail = first;
+  pthread_mutex_unlock(&victim->lock);
+
+  pthread_mutex_lock(&thief->lock);
+  thief->head = first;
+  thief->tail = last;
+  pthread_mutex_unlock(&thief->lock);
+  return true;
+}
+
+bool rank_scheduler_next(RankScheduler* sched, int worker,
+                         uint64_t* start, uint64_t* count) {
+  RankDeque* own = &sched->deques[worker];
+  uint64_t chunk;
+
+  while (!pop_front(own, &chunk)) {
+    // Own deque is empty: trying to steal from the others, starting
+    // with the next worker so that thieves don't all target the same
+    // victim.
+    bool stole = false;
+    for (int i = 1; i < sched->workers && !stole; i++) {
+      stole = steal_half(&sched->deques[(worker + i) % sched->workers], own);
+    }
+    if (!stole) return false;
+  }
+
+  *start = chunk * sched->chunk_size;
+  *count = sched->total - *start < sched->chunk_size ?
+    sched->total - *start : sched->chunk_size;
+  return true;
+}
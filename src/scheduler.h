@@ -0,0 +1,71 @@
+#pragma once
+
+// This file offers the two building blocks used to parallelize the
+// enumeration of tuples:
+//
+//  - WorkPool, a pool of persistent threads. Creating threads for
+//    each call to find_all_failures is fairly expensive when
+//    find_all_failures is called in a loop (once per size in RP, once
+//    per size and per output combination in RPC...). Instead, a
+//    single pool is created the first time it is needed (see
+//    get_work_pool), and its threads wait for jobs in between calls.
+//
+//  - RankScheduler, a work-stealing scheduler over the ranks of the
+//    tuples to verify. The ranks [0, total) are cut into small chunks,
+//    and each worker initially owns a contiguous range of chunks (its
+//    "deque"). A worker takes chunks from the front of its own deque
+//    (so that consecutive chunks share as much as possible of their
+//    Gaussian elimination), and once its deque is empty, steals half
+//    of the remaining chunks from the back of another worker's deque.
+//    This way, a worker that got the "expensive" tuples does not end
+//    up running alone long after the others are done.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct _work_pool WorkPool;
+
+// Returns the shared pool with |cores| workers, creating it if
+// needed. If the shared pool exists but has a different number of
+// workers, it is replaced. This function is not thread-safe: it must
+// not be called from a worker.
+WorkPool* get_work_pool(int cores);
+
+// Calls |fn(job, worker_id)| on each worker of |pool|, with |worker_id|
+// ranging from 0 to |pool->size-1|, and returns once all of them have
+// returned.
+void work_pool_run(WorkPool* pool, void (*fn)(void* job, int worker_id), void* job);
+int work_pool_size(WorkPool* pool);
+
+// Calls |fn(data, idx, worker_id)| for each |idx| in [0, count), on the
+// workers of |pool|: each worker repeatedly takes the smallest index
+// that no worker has taken yet. Returns once all indices are done.
+void work_pool_for(WorkPool* pool, int count,
+                   void (*fn)(void* data, int idx, int worker_id), void* data);
+
+// Stops and frees the shared pool (if any).
+void free_work_pool();
+
+
+typedef struct _rank_deque {
+  pthread_mutex_t lock;
+  uint64_t head; // First chunk not yet taken
+  uint64_t tail; // One past the last chunk not yet taken
+} RankDeque;
+
+typedef struct _rank_scheduler {
+  int workers;
+  uint64_t total;      // Number of ranks to schedule
+  uint64_t chunk_size; // Number of ranks per chunk
+  RankDeque* deques;   // One deque per worker
+} RankScheduler;
+
+void init_rank_scheduler(RankScheduler* sched, int workers,
+                         uint64_t total, uint64_t chunk_size);
+void free_rank_scheduler(RankScheduler* sched);
+
+// Sets |*start| and |*count| to the next chunk of ranks that |worker|
+// should verify. Returns false when there is nothing left to do.
+bool rank_scheduler_next(RankScheduler* sched, int worker,
+                         uint64_t* start, uint64_t* count);
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "subset_index.h"
+
+
+// The tuples of a bucket are stored in a single array (so that they
+// can be published to the readers with a single pointer), each tuple
+// taking |words|+1 words: its bitmap, followed by a word holding its
+// secret deps.
+typedef struct _subset_bucket {
+  uint64_t* entries;
+  int len;  // Number of tuples of |entries| visible to the readers
+  int size; // Number of tuples that |entries| can hold
+} SubsetBucket;
+
+// The tuples (of 2 elements or more) whose smallest variable is a
+// given variable |a|: |buckets[b]| contains those whose second
+// smallest variable is |b|.
+typedef struct _subset_row {
+  uint64_t* non_empty;   // Bitmap of the non-empty buckets
+  SubsetBucket* buckets; // One per variable
+} SubsetRow;
+
+// Arrays of entries that were outgrown. Readers might still be
+// looking at them, so they are only freed with the index.
+typedef struct _retired_entries {
+  uint64_t* entries;
+  struct _retired_entries* next;
+} RetiredEntries;
+
+struct _subset_index {
+  int var_count;
+  int words;                // Number of 64-bit words of a bitmap
+  int count;                // Number of tuples in the index
+  uint64_t* singles;        // Bitmap of the tuples of a single variable
+  SecretDep* singles_deps;  // Secret deps of those tuples (2 per variable)
+  SubsetRow** rows;         // One per variable (NULL if empty)
+  uint64_t* non_empty_rows; // Bitmap of the non-NULL rows
+  pthread_mutex_t insert_mutex;
+  RetiredEntries* retired;
+};
+
+
+SubsetIndex* make_subset_index(int var_count) {
+  SubsetIndex* index = malloc(sizeof(*index));
+  index->var_count      = var_count;
+  index->words          = (var_count + 63) / 64;
+  index->count          = 0;
+  index->singles        = calloc(index->words, sizeof(*index->singles));
+  index->singles_deps   = calloc(2 * var_count, sizeof(*index->singles_deps));
+  index->rows           = calloc(var_count, sizeof(*index->rows));
+  index->non_empty_rows = calloc(index->words, sizeof(*index->non_empty_rows));
+  index->retired        = NULL;
+  pthread_mutex_init(&index->insert_mutex, NULL);
+  return index;
+}
+
+void free_subset_index(SubsetIndex* index) {
+  if (!index) return;
+  for (int a = 0; a < index->var_count; a++) {
+    SubsetRow* row = index->rows[a];
+    if (!row) continue;
+    for (int b = 0; b < index->var_count; b++) {
+      free(row->buckets[b].entries);
+    }
+    free(row->buckets);
+    free(row->non_empty);
+    free(row);
+  }
+  while (index->retired) {
+    RetiredEntries* next = index->retired->next;
+    free(index->retired->entries);
+    free(index->retired);
+    index->retired = next;
+  }
+  pthread_mutex_destroy(&index->insert_mutex);
+  free(index->singles);
+  free(index->singles_deps);
+  free(index->rows);
+  free(index->non_empty_rows);
+  free(index);
+}
+
+int subset_index_size(const SubsetIndex* index) {
+  return __atomic_load_n(&index->count, __ATOMIC_RELAXED);
+}
+
+static inline void set_bit(uint64_t* bitmap, int i) {
+  __atomic_fetch_or(&bitmap[i / 64], 1ULL << (i % 64), __ATOMIC_RELEASE);
+}
+
+// Adds the tuple |entry| (made of |stride| words) to |bucket|. Should
+// be called with |insert_mutex| held.
+static void add_to_bucket(SubsetIndex* index, SubsetBucket* bucket,
+                          const uint64_t* entry, int stride) {
+  uint64_t* entries = bucket->entries;
+  if (bucket->len == bucket->size) {
+    bucket->size = bucket->size ? bucket->size * 2 : 4;
+    entries = malloc(bucket->size * stride * sizeof(*entries));
+    if (bucket->entries) {
+      memcpy(entries, bucket->entries, bucket->len * stride * sizeof(*entries));
+      RetiredEntries* retired = malloc(sizeof(*retired));
+      retired->entries = bucket->entries;
+      retired->next = index->retired;
+      index->retired = retired;
+    }
+  }
+  memcpy(&entries[bucket->len * stride], entry, stride * sizeof(*entry));
+
+  // Readers load |len| before |entries|: the new entries must be
+  // visible before the new length.
+  __atomic_store_n(&bucket->entries, entries, __ATOMIC_RELEASE);
+  __atomic_store_n(&bucket->len, bucket->len + 1, __ATOMIC_RELEASE);
+}
+
+void subset_index_insert(SubsetIndex* index, const Comb* comb, int comb_len,
+                         const SecretDep* secret_deps) {
+  if (comb_len == 0) return;
+  int words = index->words;
+  uint64_t entry[words+1];
+  memset(entry, 0, sizeof(entry));
+  for (int i = 0; i < comb_len; i++) {
+    entry[comb[i] / 64] |= 1ULL << (comb[i] % 64);
+  }
+  memcpy(&entry[words], secret_deps, 2 * sizeof(*secret_deps));
+
+  // The two smallest variables of |comb|
+  int a = -1, b = -1;
+  for (int w = 0; w < words && b == -1; w++) {
+    uint64_t elem = entry[w];
+    while (elem && b == -1) {
+      int var = w * 64 + __builtin_ctzll(elem);
+      elem &= elem - 1;
+      if (a == -1) a = var;
+      else b = var;
+    }
+  }
+
+  pthread_mutex_lock(&index->insert_mutex);
+  if (b == -1) {
+    index->singles_deps[2*a]   = secret_deps[0];
+    index->singles_deps[2*a+1] = secret_deps[1];
+    set_bit(index->singles, a);
+  } else {
+    SubsetRow* row = index->rows[a];
+    if (!row) {
+      row = malloc(sizeof(*row));
+      row->non_empty = calloc(words, sizeof(*row->non_empty));
+      row->buckets   = calloc(index->var_count, sizeof(*row->buckets));
+      __atomic_store_n(&index->rows[a], row, __ATOMIC_RELEASE);
+      set_bit(index->non_empty_rows, a);
+    }
+    add_to_bucket(index, &row->buckets[b], entry, words+1);
+    set_bit(row->non_empty, b);
+  }
+  __atomic_fetch_add(&index->count, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&index->insert_mutex);
+}
+
+const SecretDep* subset_index_find_subset(const SubsetIndex* index,
+                                          const Comb* comb, int comb_len) {
+  if (__atomic_load_n(&index->count, __ATOMIC_RELAXED) == 0) return NULL;
+  int words = index->words;
+  int stride = words + 1;
+  uint64_t comb_bitmap[words];
+  memset(comb_bitmap, 0, sizeof(comb_bitmap));
+  for (int i = 0; i < comb_len; i++) {
+    comb_bitmap[comb[i] / 64] |= 1ULL << (comb[i] % 64);
+  }
+
+  for (int w = 0; w < words; w++) {
+    uint64_t singles = comb_bitmap[w] & __atomic_load_n(&index->singles[w], __ATOMIC_ACQUIRE);
+    if (singles) {
+      return &index->singles_deps[2 * (w * 64 + __builtin_ctzll(singles))];
+    }
+  }
+
+  // Only the buckets of the pairs of variables of |comb| can contain
+  // subtuples of |comb|.
+  for (int aw = 0; aw < words; aw++) {
+    uint64_t rows = comb_bitmap[aw] & __atomic_load_n(&index->non_empty_rows[aw], __ATOMIC_ACQUIRE);
+    while (rows) {
+      int a = aw * 64 + __builtin_ctzll(rows);
+      rows &= rows - 1;
+      const SubsetRow* row = __atomic_load_n(&index->rows[a], __ATOMIC_ACQUIRE);
+      for (int bw = a / 64; bw < words; bw++) {
+        uint64_t buckets = comb_bitmap[bw] & __atomic_load_n(&row->non_empty[bw], __ATOMIC_ACQUIRE);
+        while (buckets) {
+          int b = bw * 64 + __builtin_ctzll(buckets);
+          buckets &= buckets - 1;
+          const SubsetBucket* bucket = &row->buckets[b];
+          int len = __atomic_load_n(&bucket->len, __ATOMIC_ACQUIRE);
+          const uint64_t* entry = __atomic_load_n(&bucket->entries, __ATOMIC_ACQUIRE);
+          for (int j = 0; j < len; j++, entry += stride) {
+            int w = 0;
+            while (w < words && !(entry[w] & ~comb_bitmap[w])) w++;
+            if (w == words) {
+              return (const SecretDep*)&entry[words];
+            }
+          }
+        }
+      }
+    }
+  }
+  return NULL;
+}
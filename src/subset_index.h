@@ -0,0 +1,50 @@
+#pragma once
+
+// This file offers SubsetIndex, a set of tuples (in practice,
+// incompressible failures) built to answer efficiently the question
+// "does the index contain a subtuple of this tuple?", which is what
+// the incompressible tuples optimization (-i) of _verify_tuples asks
+// for every tuple it considers.
+//
+// Each tuple of the index is stored as a bitmap of the variables it
+// contains. Tuples of a single variable are kept in a bitmap of their
+// own; the other ones are stored in the row of their smallest
+// variable, in the bucket of their second smallest variable. To find
+// a subtuple of a tuple t, we thus only need to look at the buckets
+// of the pairs of variables of t (skipping empty rows and buckets
+// thanks to bitmaps of the non-empty ones), and a tuple u of those
+// buckets is a subtuple of t iff (u & ~t) is 0, which is checked one
+// 64-bit word at a time (ie, with a single word for circuits of up to
+// 64 variables). Unlike with the Trie, tuples do not need to be
+// sorted.
+//
+// An index can be shared by the threads of _verify_tuples_parallel:
+// insertions are serialized by a mutex (they are rare: only
+// incompressible failures are inserted), while lookups take no lock.
+// The arrays of tuples are never modified once visible to the
+// readers: when a bucket grows, its tuples are copied to a new array,
+// and the old one is only freed with the index.
+
+#include "combinations.h"
+#include "list_tuples.h"
+
+typedef struct _subset_index SubsetIndex;
+
+// Allocates an empty index for tuples whose variables are between 0
+// and |var_count|-1.
+SubsetIndex* make_subset_index(int var_count);
+void free_subset_index(SubsetIndex* index);
+
+// Returns the number of tuples of |index|.
+int subset_index_size(const SubsetIndex* index);
+
+// Adds |comb| to |index|, along with a copy of |secret_deps| (which
+// should contain 2 elements; see leaky_inputs in _verify_tuples).
+void subset_index_insert(SubsetIndex* index, const Comb* comb, int comb_len,
+                         const SecretDep* secret_deps);
+
+// Returns the secret deps of a tuple of |index| that is a subtuple of
+// |comb| (or is |comb| itself), or NULL if there are none. The
+// returned pointer remains valid until |index| is freed.
+const SecretDep* subset_index_find_subset(const SubsetIndex* index,
+                                          const Comb* comb, int comb_len);
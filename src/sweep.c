@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <locale.h>
+#include <gmp.h>
+
+#include "sweep.h"
+#include "config.h"
+#include "scheduler.h"
+
+
+/***********************************************************
+                      Parsing of the grid
+************************************************************/
+
+bool parse_proba(const char* s, double* v) {
+  char* end;
+  *v = strtod(s, &end);
+  return *s && !*end && *v >= 0 && *v <= 1;
+}
+
+static bool parse_count(const char* s, int* v) {
+  char* end;
+  long l = strtol(s, &end, 10);
+  *v = (int)l;
+  return *s && !*end && l >= 1 && l <= 1000000;
+}
+
+bool parse_proba_list(const char* spec, double** values, int* count) {
+  char* str = strdup(spec);
+  int tokens_count = 1;
+  for (char* c = str; *c; c++) {
+    tokens_count += *c == ':';
+  }
+  char** tokens = malloc(tokens_count * sizeof(*tokens));
+  char* saveptr = NULL;
+  int n = 0;
+  for (char* tok = strtok_r(str, ":", &saveptr); tok; tok = strtok_r(NULL, ":", &saveptr)) {
+    tokens[n++] = tok;
+  }
+
+  bool ok = n > 0;
+  *values = NULL;
+  *count = 0;
+  if (ok && (strcmp(tokens[0], "lin") == 0 || strcmp(tokens[0], "log") == 0)) {
+    bool log_scale = tokens[0][1] == 'o';
+    double from, to;
+    int c;
+    ok = n == 4 && parse_proba(tokens[1], &from) && parse_proba(tokens[2], &to) &&
+      parse_count(tokens[3], &c) && (!log_scale || (from > 0 && to > 0));
+    if (ok) {
+      *values = malloc(c * sizeof(**values));
+      *count = c;
+      for (int i = 0; i < c; i++) {
+        double r = c == 1 ? 0 : (double)i / (c-1);
+        (*values)[i] = log_scale ? from * pow(to / from, r) : from + (to - from) * r;
+      }
+      // Making sure that the bounds are exact despite rounding errors
+      (*values)[c-1] = c == 1 ? from : to;
+    }
+  } else if (ok) {
+    *values = malloc(n * sizeof(**values));
+    *count = n;
+    for (int i = 0; i < n && ok; i++) {
+      ok = parse_proba(tokens[i], &(*values)[i]);
+    }
+  }
+
+  if (!ok) {
+    free(*values);
+    *values = NULL;
+    *count = 0;
+  }
+  free(tokens);
+  free(str);
+  return ok;
+}
+
+void free_proba_grid(ProbaGrid* grid) {
+  free(grid->pleak);
+  free(grid->pfault);
+}
+
+
+/***********************************************************
+                    Evaluation of the grid
+************************************************************/
+
+struct sweep_job {
+  const ProbaGrid* grid;
+  SweepEvalFn eval_point;
+  const void* data;
+  CombinedProba* res; // One per point of the grid
+  int* groups;        // One per point of the grid
+};
+
+static void sweep_worker(void* data, int idx, int worker_id) {
+  (void)worker_id;
+  struct sweep_job* job = data;
+  const ProbaGrid* grid = job->grid;
+  double pleak  = grid->pleak[idx / grid->pfault_count];
+  double pfault = grid->pfault[idx % grid->pfault_count];
+  job->groups[idx] = -1;
+  job->eval_point(job->data, pleak, pfault, &job->res[idx], &job->groups[idx]);
+}
+
+static bool ends_with(const char* s, const char* suffix) {
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+// Writes in |buf| the shortest representation of |v| that reads back
+// as |v| (so that 0.003 is not printed as 0.0030000000000000001).
+static void format_proba(char* buf, size_t size, double v) {
+  for (int digits = 15; digits <= 17; digits++) {
+    snprintf(buf, size, "%.*g", digits, v);
+    if (strtod(buf, NULL) == v) return;
+  }
+}
+
+static void write_csv(FILE* f, const struct sweep_job* job, const char* const* group_labels) {
+  const ProbaGrid* grid = job->grid;
+  fprintf(f, "pleak,pfault,epsilon_min,mu_min,gamma_min,epsilon_max,mu_max,gamma_max%s\n",
+          group_labels ? ",input_faults" : "");
+  for (int i = 0; i < grid->pleak_count * grid->pfault_count; i++) {
+    const CombinedProba* r = &job->res[i];
+    char pleak[32], pfault[32];
+    format_proba(pleak, sizeof(pleak), grid->pleak[i / grid->pfault_count]);
+    format_proba(pfault, sizeof(pfault), grid->pfault[i % grid->pfault_count]);
+    gmp_fprintf(f, "%s,%s,%.15Fe,%.15Fe,%.15Fe,%.15Fe,%.15Fe,%.15Fe", pleak, pfault,
+                r->epsilon, r->mu, r->gamma, r->epsilon_max, r->mu_max, r->gamma_max);
+    if (group_labels) {
+      // Labels contain commas (but no quotes)
+      const char* label = job->groups[i] >= 0 ? group_labels[job->groups[i]] : NULL;
+      fprintf(f, ",\"%s\"", label ? label : "");
+    }
+    fprintf(f, "\n");
+  }
+}
+
+static void write_json(FILE* f, const struct sweep_job* job, const char* const* group_labels) {
+  const ProbaGrid* grid = job->grid;
+  int points = grid->pleak_count * grid->pfault_count;
+  fprintf(f, "[\n");
+  for (int i = 0; i < points; i++) {
+    const CombinedProba* r = &job->res[i];
+    char pleak[32], pfault[32];
+    format_proba(pleak, sizeof(pleak), grid->pleak[i / grid->pfault_count]);
+    format_proba(pfault, sizeof(pfault), grid->pfault[i % grid->pfault_count]);
+    gmp_fprintf(f, "  { \"pleak\": %s, \"pfault\": %s,\n"
+                "    \"epsilon_min\": %.15Fe, \"mu_min\": %.15Fe, \"gamma_min\": %.15Fe,\n"
+                "    \"epsilon_max\": %.15Fe, \"mu_max\": %.15Fe, \"gamma_max\": %.15Fe",
+                pleak, pfault, r->epsilon, r->mu, r->gamma, r->epsilon_max, r->mu_max, r->gamma_max);
+    if (group_labels) {
+      const char* label = job->groups[i] >= 0 ? group_labels[job->groups[i]] : NULL;
+      if (label) {
+        fprintf(f, ",\n    \"input_faults\": \"%s\"", label);
+      } else {
+        fprintf(f, ",\n    \"input_faults\": null");
+      }
+    }
+    fprintf(f, " }%s\n", i == points-1 ? "" : ",");
+  }
+  fprintf(f, "]\n");
+}
+
+void sweep_proba_grid(const ProbaGrid* grid, int cores, SweepEvalFn eval_point,
+                      const void* data, const char* const* group_labels,
+                      const char* output) {
+  int points = grid->pleak_count * grid->pfault_count;
+  struct sweep_job job = {
+    .grid       = grid,
+    .eval_point = eval_point,
+    .data       = data,
+    .res        = malloc(points * sizeof(*job.res)),
+    .groups     = malloc(points * sizeof(*job.groups))
+  };
+  for (int i = 0; i < points; i++) {
+    init_combined_proba(&job.res[i]);
+  }
+
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
+  if (cores <= 1 || points == 1) {
+    for (int i = 0; i < points; i++) {
+      sweep_worker(&job, i, 0);
+    }
+  } else {
+    work_pool_for(get_work_pool(cores), points, sweep_worker, &job);
+  }
+
+  FILE* f = stdout;
+  if (output) {
+    f = fopen(output, "w");
+    if (!f) {
+      fprintf(stderr, "Cannot open file '%s' for writing. Exiting.\n", output);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // CSV and JSON need '.' as decimal separator, whatever the locale
+  // used to parse the probabilities.
+  char* locale = strdup(setlocale(LC_NUMERIC, NULL));
+  setlocale(LC_NUMERIC, "C");
+  if (output && ends_with(output, ".json")) {
+    write_json(f, &job, group_labels);
+  } else {
+    write_csv(f, &job, group_labels);
+  }
+  setlocale(LC_NUMERIC, locale);
+  free(locale);
+
+  if (output) {
+    fclose(f);
+    printf("Results of the %d points written to %s\n", points, output);
+  }
+
+  for (int i = 0; i < points; i++) {
+    clear_combined_proba(&job.res[i]);
+  }
+  free(job.res);
+  free(job.groups);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// Evaluation of CRP/CRPC on a grid of leakage and fault probabilities
+// (--sweep-l and --sweep-f options), in order to draw security curves
+// with a single run of ironmask: the coefficients are loaded once, and
+// the points of the grid are evaluated in parallel.
+
+#include <stdbool.h>
+
+#include "proba_eval.h"
+
+typedef struct _proba_grid {
+  int pleak_count;
+  double* pleak;
+  int pfault_count;
+  double* pfault;
+} ProbaGrid;
+
+// Parses the probability |s| (a number between 0 and 1, in the format
+// of the current locale, as the -l and -f options). Returns false if
+// |s| is not such a number.
+bool parse_proba(const char* s, double* v);
+
+// Parses the list of probabilities |spec|, which is either a list of
+// values separated by ':' (eg, "0.001:0.002:0.005"), or a range
+// "lin:FROM:TO:COUNT" or "log:FROM:TO:COUNT" of COUNT values between
+// FROM and TO (included), evenly spaced on a linear or logarithmic
+// scale. Values are parsed with the current locale, like -l and -f.
+// Returns false if |spec| is invalid.
+bool parse_proba_list(const char* spec, double** values, int* count);
+
+void free_proba_grid(ProbaGrid* grid);
+
+// Computes the probabilities of a point of the grid. When the results
+// are the ones of a group of scenarios among several (for CRPC: the
+// combination of faults on inputs with the highest gamma), |group| is
+// set to the index of this group.
+typedef void (*SweepEvalFn)(const void* data, double pleak, double pfault,
+                            CombinedProba* res, int* group);
+
+// Calls |eval_point| on each point of |grid|, using |cores| threads, and
+// writes the results to |output| (in JSON if its name ends with
+// ".json", and in CSV otherwise), or as CSV on stdout if |output| is
+// NULL. If |group_labels| is not NULL, the results contain the label
+// |group_labels[group]| of the group of each point.
+void sweep_proba_grid(const ProbaGrid* grid, int cores, SweepEvalFn eval_point,
+                      const void* data, const char* const* group_labels,
+                      const char* output);
@@ -0,0 +1,606 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "symmetry.h"
+#include "config.h"
+#include "vectors.h"
+
+#define max(_a,_b) ((_a) >= (_b) ? (_a) : (_b))
+
+
+/***********************************************************
+                   Supported circuits
+************************************************************/
+
+// Symmetries are only computed for circuits whose variables all have
+// a single dependency (no glitches nor transitions), without faults
+// nor correction outputs, and that do not require factorizations
+// (multiplications whose inputs are refreshed): the verdict of such
+// tuples only depends on the span of their dependencies (see the
+// comment on _verify_tuples_prefixes in verification_rules.c), and
+// is thus not changed by renaming the shares, randoms and
+// multiplications.
+static bool can_use_symmetries(const Circuit* c) {
+  const DependencyList* deps = c->deps;
+  if (c->share_count < 2 || c->faults_on_inputs || c->nb_duplications > 1 ||
+      deps->correction_outputs->length != 0 ||
+      deps->first_rand_idx != c->secret_count ||
+      deps->first_mult_idx != deps->first_rand_idx + c->random_count ||
+      deps->deps_size != deps->first_mult_idx +
+                         (c->contains_mults ? deps->mult_deps->length : 0) + 1 ||
+      (c->contains_mults && c->has_input_rands)) {
+    return false;
+  }
+  for (int i = 0; i < deps->length; i++) {
+    if (deps->deps[i]->length != 1) return false;
+  }
+  return true;
+}
+
+
+/***********************************************************
+                   Share permutations
+************************************************************/
+
+// Applies the permutation |perm| to the shares of |mask|.
+static Dependency permute_shares(Dependency mask, const int* perm, int share_count) {
+  Dependency res = 0;
+  for (int s = 0; s < share_count; s++) {
+    if (mask & (1 << s)) res |= 1 << perm[s];
+  }
+  return res;
+}
+
+// The objects that a symmetry permutes: the variables (|var_count|
+// first objects), then the randoms, then the multiplications.
+struct sym_graph {
+  const Circuit* c;
+  const DimRedData* dim_red_data;
+  int var_count, rand_count, mult_count;
+  int obj_count;
+  // Adjacency lists (in CSR format) between variables and the randoms
+  // and multiplications that they contain, in both directions.
+  int* adj_start; // Of size |obj_count|+1
+  int* adj;
+};
+
+static void make_sym_graph(struct sym_graph* g, const Circuit* c,
+                           const DimRedData* dim_red_data) {
+  const DependencyList* deps = c->deps;
+  g->c = c;
+  g->dim_red_data = dim_red_data;
+  g->var_count = deps->length;
+  g->rand_count = c->random_count;
+  g->mult_count = c->contains_mults ? deps->mult_deps->length : 0;
+  g->obj_count = g->var_count + g->rand_count + g->mult_count;
+
+  int col_count = g->rand_count + g->mult_count;
+  int* degree = calloc(g->obj_count, sizeof(*degree));
+  for (int v = 0; v < g->var_count; v++) {
+    Dependency* dep = deps->deps[v]->content[0];
+    for (int j = 0; j < col_count; j++) {
+      if (dep[deps->first_rand_idx + j]) {
+        degree[v]++;
+        degree[g->var_count + j]++;
+      }
+    }
+  }
+  g->adj_start = malloc((g->obj_count + 1) * sizeof(*g->adj_start));
+  g->adj_start[0] = 0;
+  for (int i = 0; i < g->obj_count; i++) {
+    g->adj_start[i+1] = g->adj_start[i] + degree[i];
+  }
+  g->adj = malloc(g->adj_start[g->obj_count] * sizeof(*g->adj));
+  memset(degree, 0, g->obj_count * sizeof(*degree));
+  for (int v = 0; v < g->var_count; v++) {
+    Dependency* dep = deps->deps[v]->content[0];
+    for (int j = 0; j < col_count; j++) {
+      if (dep[deps->first_rand_idx + j]) {
+        int col = g->var_count + j;
+        g->adj[g->adj_start[v] + degree[v]++] = col;
+        g->adj[g->adj_start[col] + degree[col]++] = v;
+      }
+    }
+  }
+  free(degree);
+}
+
+static void free_sym_graph(struct sym_graph* g) {
+  free(g->adj_start);
+  free(g->adj);
+}
+
+// Returns the weight of the variable |v| (which is not an output). The
+// weights of a circuit reduced by remove_elementary_wires are still
+// indexed by the variables of the original circuit.
+static int var_weight(const struct sym_graph* g, int v) {
+  if (g->dim_red_data) {
+    const DimRedData* dim_red_data = g->dim_red_data;
+    return dim_red_data->old_circuit->weights[dim_red_data->new_to_old_mapping[v]];
+  }
+  return g->c->weights[v];
+}
+
+
+/***********************************************************
+                     Color refinement
+************************************************************/
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb93e40a2ad53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static inline uint64_t combine(uint64_t h, uint64_t x) {
+  return mix64(h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+// Sets |colors| to the initial colors of the objects of |g|, where
+// the shares are renamed by |relabel|: everything that a symmetry
+// must preserve (kind of object, weight, being an output, secret
+// shares after renaming...).
+static void init_colors(const struct sym_graph* g, const int* relabel, uint64_t* colors) {
+  const Circuit* c = g->c;
+  const DependencyList* deps = c->deps;
+  int share_count = c->share_count;
+  for (int v = 0; v < g->var_count; v++) {
+    Dependency* dep = deps->deps[v]->content[0];
+    uint64_t h = combine(0, v < c->length ? var_weight(g, v) : -1);
+    for (int k = 0; k < c->secret_count; k++) {
+      h = combine(h, permute_shares(dep[k], relabel, share_count));
+    }
+    colors[v] = combine(h, dep[deps->deps_size-1]);
+  }
+  for (int r = 0; r < g->rand_count; r++) {
+    uint64_t h = combine(1, 0);
+    if (c->i1_rands) {
+      h = combine(h, c->i1_rands[r] | c->i2_rands[r] << 1 | c->out_rands[r] << 2);
+    }
+    colors[g->var_count + r] = h;
+  }
+  for (int m = 0; m < g->mult_count; m++) {
+    Dependency* secrets = deps->mult_deps->deps[m]->contained_secrets;
+    uint64_t h = combine(2, 0);
+    for (int k = 0; k < c->secret_count; k++) {
+      h = combine(h, permute_shares(secrets[k], relabel, share_count));
+    }
+    colors[g->var_count + g->rand_count + m] = h;
+  }
+}
+
+// Refines |colors| once: the new color of an object depends on its
+// color and on the multiset of the colors of its neighbors.
+static void refine_colors(const struct sym_graph* g, uint64_t* colors, uint64_t* tmp) {
+  for (int i = 0; i < g->obj_count; i++) {
+    uint64_t sum = 0;
+    for (int j = g->adj_start[i]; j < g->adj_start[i+1]; j++) {
+      sum += mix64(colors[g->adj[j]]);
+    }
+    tmp[i] = combine(colors[i], sum);
+  }
+  memcpy(colors, tmp, g->obj_count * sizeof(*colors));
+}
+
+static int cmp_uint64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+// The secret shares (of each input, on 32 bits each) and weight of
+// an elementary wire.
+struct wire_key {
+  uint64_t secrets;
+  int weight;
+};
+
+static int cmp_wire_key(const void* a, const void* b) {
+  const struct wire_key* x = a;
+  const struct wire_key* y = b;
+  if (x->secrets != y->secrets) return x->secrets < y->secrets ? -1 : 1;
+  return x->weight - y->weight;
+}
+
+static int count_colors(const uint64_t* colors, uint64_t* sorted, int n) {
+  memcpy(sorted, colors, n * sizeof(*sorted));
+  qsort(sorted, n, sizeof(*sorted), cmp_uint64);
+  int count = n > 0;
+  for (int i = 1; i < n; i++) count += sorted[i] != sorted[i-1];
+  return count;
+}
+
+// Objects sorted by color (and then by index).
+static const uint64_t* sort_colors;
+static int cmp_by_color(const void* a, const void* b) {
+  int x = *(const int*)a, y = *(const int*)b;
+  if (sort_colors[x] != sort_colors[y]) return sort_colors[x] < sort_colors[y] ? -1 : 1;
+  return x - y;
+}
+
+static void sort_by_color(const uint64_t* colors, int* objs, int n) {
+  for (int i = 0; i < n; i++) objs[i] = i;
+  sort_colors = colors;
+  qsort(objs, n, sizeof(*objs), cmp_by_color);
+}
+
+
+/***********************************************************
+                        Symmetries
+************************************************************/
+
+// Checks that |perm| (which maps each object of |g| to another
+// object) is a symmetry of the circuit for the share permutation
+// |share_perm|.
+static bool is_symmetry(const struct sym_graph* g, const int* perm, const int* share_perm) {
+  const Circuit* c = g->c;
+  const DependencyList* deps = c->deps;
+  int share_count = c->share_count;
+  int first_rand_idx = deps->first_rand_idx;
+  int rand_base = g->var_count, mult_base = g->var_count + g->rand_count;
+
+  for (int i = 0; i < g->obj_count; i++) {
+    int kind_i = i < rand_base ? 0 : i < mult_base ? 1 : 2;
+    int kind_p = perm[i] < rand_base ? 0 : perm[i] < mult_base ? 1 : 2;
+    if (kind_i != kind_p) return false;
+  }
+
+  for (int v = 0; v < g->var_count; v++) {
+    int w = perm[v];
+    if ((v < c->length) != (w < c->length)) return false;
+    if (v < c->length && var_weight(g, v) != var_weight(g, w)) return false;
+    Dependency* dep_v = deps->deps[v]->content[0];
+    Dependency* dep_w = deps->deps[w]->content[0];
+    for (int k = 0; k < c->secret_count; k++) {
+      if (dep_w[k] != permute_shares(dep_v[k], share_perm, share_count)) return false;
+      if (deps->contained_secrets[w][k] !=
+          permute_shares(deps->contained_secrets[v][k], share_perm, share_count)) {
+        return false;
+      }
+    }
+    for (int j = 0; j < g->rand_count + g->mult_count; j++) {
+      int j_img = perm[rand_base + j] - rand_base;
+      if (dep_w[first_rand_idx + j_img] != dep_v[first_rand_idx + j]) return false;
+    }
+    if (dep_w[deps->deps_size-1] != dep_v[deps->deps_size-1]) return false;
+  }
+
+  if (c->i1_rands) {
+    for (int r = 0; r < g->rand_count; r++) {
+      int r_img = perm[rand_base + r] - rand_base;
+      if (c->i1_rands[r] != c->i1_rands[r_img] || c->i2_rands[r] != c->i2_rands[r_img] ||
+          c->out_rands[r] != c->out_rands[r_img]) {
+        return false;
+      }
+    }
+  }
+
+  for (int m = 0; m < g->mult_count; m++) {
+    int m_img = perm[mult_base + m] - mult_base;
+    Dependency* secrets = deps->mult_deps->deps[m]->contained_secrets;
+    Dependency* secrets_img = deps->mult_deps->deps[m_img]->contained_secrets;
+    for (int k = 0; k < c->secret_count; k++) {
+      if (secrets_img[k] != permute_shares(secrets[k], share_perm, share_count)) return false;
+    }
+  }
+
+  // The elementary wires that were removed (and are added back to
+  // the tuples that need them) must be symmetric as well.
+  const DimRedData* dim_red_data = g->dim_red_data;
+  if (dim_red_data) {
+    const VarVector* removed = dim_red_data->removed_wires;
+    const Circuit* old_circuit = dim_red_data->old_circuit;
+    struct wire_key orig[removed->length+1], img[removed->length+1];
+    for (int i = 0; i < removed->length; i++) {
+      Dependency* secrets = old_circuit->deps->contained_secrets[removed->content[i]];
+      orig[i].secrets = img[i].secrets = 0;
+      for (int k = 0; k < c->secret_count; k++) {
+        orig[i].secrets = orig[i].secrets << 32 | (uint32_t)secrets[k];
+        img[i].secrets = img[i].secrets << 32 |
+          (uint32_t)permute_shares(secrets[k], share_perm, share_count);
+      }
+      orig[i].weight = img[i].weight = old_circuit->weights[removed->content[i]];
+    }
+    qsort(orig, removed->length, sizeof(*orig), cmp_wire_key);
+    qsort(img, removed->length, sizeof(*img), cmp_wire_key);
+    for (int i = 0; i < removed->length; i++) {
+      if (cmp_wire_key(&orig[i], &img[i])) return false;
+    }
+  }
+
+  return true;
+}
+
+// Tries to extend the share permutation |share_perm| into a symmetry
+// of the circuit. Returns true and sets |perm| if it succeeds.
+//
+// The objects are colored twice: once as they are (A), and once with
+// the shares renamed by the inverse of |share_perm| (B), so that an
+// object x and its image by a symmetry have the same color in A and B
+// respectively. After refinement, the objects of each color of A are
+// mapped to the objects of the same color of B (in ascending order
+// when there are several of them), and the resulting permutation is
+// then checked. Symmetries that would require to choose between
+// objects with the same color in another way are thus missed, but the
+// symmetries returned are always correct.
+static bool extend_share_permutation(const struct sym_graph* g, const int* share_perm,
+                                     int* perm) {
+  int n = g->obj_count;
+  int share_count = g->c->share_count;
+  int identity[share_count], inverse[share_count];
+  for (int s = 0; s < share_count; s++) {
+    identity[s] = s;
+    inverse[share_perm[s]] = s;
+  }
+
+  uint64_t* colors_a = malloc(n * sizeof(*colors_a));
+  uint64_t* colors_b = malloc(n * sizeof(*colors_b));
+  uint64_t* tmp = malloc(n * sizeof(*tmp));
+  uint64_t* sorted_a = malloc(n * sizeof(*sorted_a));
+  uint64_t* sorted_b = malloc(n * sizeof(*sorted_b));
+  int* objs_a = malloc(n * sizeof(*objs_a));
+  int* objs_b = malloc(n * sizeof(*objs_b));
+  bool found = false;
+
+  init_colors(g, identity, colors_a);
+  init_colors(g, inverse, colors_b);
+  int color_count = count_colors(colors_a, sorted_a, n);
+  for (int round = 0; round < n; round++) {
+    refine_colors(g, colors_a, tmp);
+    refine_colors(g, colors_b, tmp);
+    int new_color_count = count_colors(colors_a, sorted_a, n);
+    if (new_color_count == color_count) break;
+    color_count = new_color_count;
+  }
+  count_colors(colors_b, sorted_b, n);
+  if (memcmp(sorted_a, sorted_b, n * sizeof(*sorted_a))) goto end;
+
+  sort_by_color(colors_a, objs_a, n);
+  sort_by_color(colors_b, objs_b, n);
+  for (int i = 0; i < n; i++) {
+    perm[objs_a[i]] = objs_b[i];
+  }
+  found = is_symmetry(g, perm, share_perm);
+
+ end:
+  free(colors_a);
+  free(colors_b);
+  free(tmp);
+  free(sorted_a);
+  free(sorted_b);
+  free(objs_a);
+  free(objs_b);
+  return found;
+}
+
+static int find_root(int* parent, int x) {
+  while (parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+// Sets |share_perms| to the share permutations to try: the
+// transpositions (i j), the rotation of all shares (if there are more
+// than 2 shares), and the translations s -> s ^ 2^b (if the number of
+// shares is a power of 2 larger than 2). Returns their number.
+static int candidate_share_perms(int share_count, int (*share_perms)[share_count]) {
+  int count = 0;
+  for (int i = 0; i < share_count; i++) {
+    for (int j = i+1; j < share_count; j++) {
+      for (int s = 0; s < share_count; s++) share_perms[count][s] = s;
+      share_perms[count][i] = j;
+      share_perms[count][j] = i;
+      count++;
+    }
+  }
+  if (share_count > 2) {
+    for (int s = 0; s < share_count; s++) share_perms[count][s] = (s + 1) % share_count;
+    count++;
+    if ((share_count & (share_count - 1)) == 0) {
+      for (int b = 1; b < share_count; b <<= 1) {
+        for (int s = 0; s < share_count; s++) share_perms[count][s] = s ^ b;
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+CircuitSymmetries* find_circuit_symmetries(const Circuit* circuit,
+                                           const DimRedData* dim_red_data) {
+  if (!can_use_symmetries(circuit)) return NULL;
+
+  struct sym_graph g;
+  make_sym_graph(&g, circuit, dim_red_data);
+  int share_count = circuit->share_count;
+  int var_count = g.var_count;
+
+  // Union-find of the orbits of the variables
+  int* parent = malloc(var_count * sizeof(*parent));
+  for (int v = 0; v < var_count; v++) parent[v] = v;
+
+  int (*share_perms)[share_count] =
+    malloc((share_count * share_count + 1) * sizeof(*share_perms));
+  int candidate_count = candidate_share_perms(share_count, share_perms);
+  int** generators = malloc(candidate_count * sizeof(*generators));
+  int generator_count = 0;
+  int* perm = malloc(g.obj_count * sizeof(*perm));
+  for (int cand = 0; cand < candidate_count; cand++) {
+    if (!extend_share_permutation(&g, share_perms[cand], perm)) continue;
+    generators[generator_count] = malloc(var_count * sizeof(**generators));
+    memcpy(generators[generator_count], perm, var_count * sizeof(**generators));
+    generator_count++;
+    for (int v = 0; v < var_count; v++) {
+      int root_v = find_root(parent, v), root_w = find_root(parent, perm[v]);
+      if (root_v != root_w) parent[root_v] = root_w;
+    }
+  }
+  free(perm);
+  free(share_perms);
+  free_sym_graph(&g);
+
+  CircuitSymmetries* sym = malloc(sizeof(*sym));
+  sym->var_count = var_count;
+  sym->generator_count = generator_count;
+  sym->generators = generators;
+  sym->orbit_min = malloc(var_count * sizeof(*sym->orbit_min));
+  sym->orbit_of = malloc(var_count * sizeof(*sym->orbit_of));
+  sym->index_in_orbit = malloc(var_count * sizeof(*sym->index_in_orbit));
+  sym->orbit_vars = malloc(var_count * sizeof(*sym->orbit_vars));
+  sym->orbit_start = malloc((var_count + 1) * sizeof(*sym->orbit_start));
+  sym->orbit_count = 0;
+  // Variables are visited in ascending order: the first variable of
+  // each orbit is its minimum, and orbits are numbered by their
+  // minimum.
+  int* root_orbit = malloc(var_count * sizeof(*root_orbit));
+  int* orbit_size = calloc(var_count, sizeof(*orbit_size));
+  for (int v = 0; v < var_count; v++) root_orbit[v] = -1;
+  for (int v = 0; v < var_count; v++) {
+    int root = find_root(parent, v);
+    if (root_orbit[root] == -1) {
+      root_orbit[root] = sym->orbit_count++;
+      sym->orbit_min[root] = v;
+    }
+    int orbit = root_orbit[root];
+    sym->orbit_of[v] = orbit;
+    sym->orbit_min[v] = sym->orbit_min[root];
+    sym->index_in_orbit[v] = orbit_size[orbit]++;
+  }
+  sym->orbit_start[0] = 0;
+  for (int i = 0; i < sym->orbit_count; i++) {
+    sym->orbit_start[i+1] = sym->orbit_start[i] + orbit_size[i];
+  }
+  int max_orbit_size = 0;
+  for (int v = 0; v < var_count; v++) {
+    int orbit = sym->orbit_of[v];
+    sym->orbit_vars[sym->orbit_start[orbit] + sym->index_in_orbit[v]] = v;
+    max_orbit_size = max(max_orbit_size, orbit_size[orbit]);
+  }
+  free(orbit_size);
+  free(root_orbit);
+  free(parent);
+
+  // Sets of variables of an orbit are represented as 64-bit bitmaps
+  // (see subset_orbit_size).
+  if (generator_count == 0 || max_orbit_size > 64) {
+    free_circuit_symmetries(sym);
+    return NULL;
+  }
+  return sym;
+}
+
+
+/***********************************************************
+                   Orbits of sets of variables
+************************************************************/
+
+// Set of 64-bit bitmaps (open addressing, linear probing). 0 is used
+// for empty slots, and is never added (the sets considered are never
+// empty).
+struct mask_set {
+  uint64_t* slots;
+  int capacity; // Power of 2
+  int count;
+};
+
+static bool mask_set_add(struct mask_set* set, uint64_t mask) {
+  if (2 * (set->count + 1) > set->capacity) {
+    struct mask_set old = *set;
+    set->capacity *= 2;
+    set->slots = calloc(set->capacity, sizeof(*set->slots));
+    set->count = 0;
+    for (int i = 0; i < old.capacity; i++) {
+      if (old.slots[i]) mask_set_add(set, old.slots[i]);
+    }
+    free(old.slots);
+  }
+  int i = mix64(mask) & (set->capacity - 1);
+  while (set->slots[i]) {
+    if (set->slots[i] == mask) return false;
+    i = (i + 1) & (set->capacity - 1);
+  }
+  set->slots[i] = mask;
+  set->count++;
+  return true;
+}
+
+// The orbit of a set is computed by a breadth-first search of the
+// images of the set by the generators. Since |vars| are usually
+// small sets, their orbits are small as well.
+int subset_orbit_size(const CircuitSymmetries* sym, const Comb* vars, int len) {
+  int orbit = sym->orbit_of[vars[0]];
+  const int* orbit_vars = &sym->orbit_vars[sym->orbit_start[orbit]];
+  uint64_t mask = 0;
+  for (int i = 0; i < len; i++) mask |= 1ULL << sym->index_in_orbit[vars[i]];
+
+  struct mask_set set = { .slots = calloc(16, sizeof(uint64_t)), .capacity = 16, .count = 0 };
+  uint64_t* queue = malloc(16 * sizeof(*queue));
+  int queue_capacity = 16, queue_len = 0;
+  mask_set_add(&set, mask);
+  queue[queue_len++] = mask;
+  bool is_min = true;
+  for (int q = 0; q < queue_len && is_min; q++) {
+    for (int g = 0; g < sym->generator_count; g++) {
+      const int* perm = sym->generators[g];
+      uint64_t img = 0;
+      for (uint64_t m = queue[q]; m; m &= m - 1) {
+        img |= 1ULL << sym->index_in_orbit[perm[orbit_vars[__builtin_ctzll(m)]]];
+      }
+      if (img < mask) {
+        is_min = false;
+        break;
+      }
+      if (mask_set_add(&set, img)) {
+        if (queue_len == queue_capacity) {
+          queue_capacity *= 2;
+          queue = realloc(queue, queue_capacity * sizeof(*queue));
+        }
+        queue[queue_len++] = img;
+      }
+    }
+  }
+  int size = is_min ? set.count : 0;
+  free(set.slots);
+  free(queue);
+  return size;
+}
+
+void print_circuit_symmetries(const Circuit* circuit, const CircuitSymmetries* sym) {
+  if (!sym) {
+    printf("No symmetry found.\n");
+    return;
+  }
+  int tuple_orbits = 0;
+  for (int i = 0; i < sym->orbit_count; i++) {
+    tuple_orbits += sym->orbit_vars[sym->orbit_start[i]] < circuit->length;
+  }
+  printf("Found %d share permutation(s) that are symmetries of the circuit: "
+         "its %d variables form %d orbits:\n",
+         sym->generator_count, circuit->length, tuple_orbits);
+  for (int i = 0; i < sym->orbit_count; i++) {
+    if (sym->orbit_vars[sym->orbit_start[i]] >= circuit->length) continue;
+    printf("  {");
+    for (int j = sym->orbit_start[i]; j < sym->orbit_start[i+1]; j++) {
+      printf(" %s", circuit->deps->names[sym->orbit_vars[j]]);
+    }
+    printf(" }\n");
+  }
+}
+
+void free_circuit_symmetries(CircuitSymmetries* sym) {
+  if (!sym) return;
+  for (int g = 0; g < sym->generator_count; g++) free(sym->generators[g]);
+  free(sym->generators);
+  free(sym->orbit_min);
+  free(sym->orbit_of);
+  free(sym->index_in_orbit);
+  free(sym->orbit_vars);
+  free(sym->orbit_start);
+  free(sym);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// This file detects the symmetries of a gadget: permutations of the
+// variables of a circuit that are induced by a permutation of the
+// shares (the same for all inputs and outputs), along with a
+// consistent permutation of its randoms and multiplications.
+//
+// For instance, in a circular refresh (c_i = a_i + r_i + r_{i+1}),
+// rotating the shares (a_i -> a_{i+1}, r_i -> r_{i+1}) maps every
+// variable of the gadget to another variable of the gadget. Such a
+// permutation maps every tuple to a tuple with the same dependencies
+// up to a renaming of the shares and randoms, and thus to a tuple
+// that is a failure if and only if the original one is (when the
+// verification only depends on the span of the dependencies of the
+// tuple, see can_use_symmetries).
+//
+// Symmetries are searched for on the circuit actually verified (ie,
+// after the dimension reductions), by trying each transposition of
+// two shares, the rotation of all shares, and (when the number of
+// shares is a power of 2) the translations s -> s ^ 2^b: for each of
+// them, a candidate permutation of the variables, randoms and
+// multiplications is computed by color refinement, and then checked
+// exactly. The orbits of the variables under the group generated by
+// the symmetries found are then computed.
+//
+// find_all_failures_monotone (RP) uses them to only visit one tuple
+// per orbit of tuples (see subset_orbit_size).
+
+#include <stdbool.h>
+
+#include "circuit.h"
+#include "dimensions.h"
+#include "combinations.h"
+
+typedef struct _circuit_symmetries {
+  int var_count;       // Number of variables (deps->length, ie including outputs)
+  int* orbit_min;      // For each variable, the smallest variable of its orbit
+  int orbit_count;
+  // The variables, sorted by orbit (orbits being sorted by their
+  // smallest variable), and then in ascending order: the variables of
+  // the i-th orbit are orbit_vars[orbit_start[i]..orbit_start[i+1]-1].
+  int* orbit_vars;
+  int* orbit_start;    // Of size |orbit_count|+1
+  int* orbit_of;       // For each variable, the index of its orbit
+  int* index_in_orbit; // For each variable, its index in |orbit_vars| of its orbit
+  int generator_count; // Number of share permutations found
+  int** generators;    // For each of them, the corresponding permutation of the variables
+} CircuitSymmetries;
+
+// Returns the symmetries of |circuit| (whose elementary wires removed
+// by remove_elementary_wires are in |dim_red_data|, which can be
+// NULL), or NULL if none were found or if |circuit| is not supported
+// (see can_use_symmetries).
+CircuitSymmetries* find_circuit_symmetries(const Circuit* circuit,
+                                           const DimRedData* dim_red_data);
+
+// Returns true if |var| is the smallest variable of its orbit.
+static inline bool is_orbit_min(const CircuitSymmetries* sym, int var) {
+  return sym->orbit_min[var] == var;
+}
+
+// Returns the number of sets of variables that are images of the set
+// |vars| (of length |len|, whose variables must all belong to the same
+// orbit) by a symmetry, if |vars| is the smallest of them (comparing
+// them as bitmaps of their indices in their orbit), or 0 otherwise.
+int subset_orbit_size(const CircuitSymmetries* sym, const Comb* vars, int len);
+
+// Prints the orbits of the variables of |circuit| (if |sym| is not NULL).
+void print_circuit_symmetries(const Circuit* circuit, const CircuitSymmetries* sym);
+
+void free_circuit_symmetries(CircuitSymmetries* sym);
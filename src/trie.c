@@ -8,130 +8,212 @@
 
 
 
-Trie* make_trie(int childs_len) {
-  Trie* trie = malloc(sizeof(*trie));
-  trie->childs_len = childs_len;
-  TrieNode* head = malloc(sizeof(*head));
-  // Mallocing the head's childs so that |trie_contains| does not
-  // return true as soon as it visits the head. (Since nodes with an
-  // empty childs array are leafs)
-  head->childs = calloc(childs_len, sizeof(*head->childs));
-  head->secret_deps = NULL;
-  trie->head = head;
-  return trie;
+static uint32_t edges_capacity(uint32_t edges_len) {
+  return edges_len <= 1 ? 1 : 1u << (32 - __builtin_clz(edges_len - 1));
 }
 
-void free_trie_node(TrieNode* trie, int childs_len) {
-    free(trie->secret_deps);
-    if (!trie->childs) {
-    free(trie);
-    return;
+static uint32_t alloc_edges(Trie* trie, uint32_t capacity) {
+  int size_class = __builtin_ctz(capacity);
+  uint32_t block = trie->free_edges[size_class];
+  if (block != TRIE_NO_EDGES) {
+    trie->free_edges[size_class] = trie->edges[block].child;
+    return block;
   }
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      free_trie_node(trie->childs[i], childs_len);
-    }
+  if (trie->edges_len + capacity > trie->edges_size) {
+    while (trie->edges_len + capacity > trie->edges_size) trie->edges_size *= 2;
+    trie->edges = realloc(trie->edges, trie->edges_size * sizeof(*trie->edges));
   }
-  free(trie->childs);
-  free(trie);
+  block = trie->edges_len;
+  trie->edges_len += capacity;
+  return block;
+}
+
+static void release_edges(Trie* trie, uint32_t block, uint32_t capacity) {
+  int size_class = __builtin_ctz(capacity);
+  trie->edges[block].child = trie->free_edges[size_class];
+  trie->free_edges[size_class] = block;
+}
+
+static uint32_t alloc_node(Trie* trie) {
+  if (trie->nodes_len == trie->nodes_size) {
+    trie->nodes_size *= 2;
+    trie->nodes = realloc(trie->nodes, trie->nodes_size * sizeof(*trie->nodes));
+  }
+  TrieNode* node = &trie->nodes[trie->nodes_len];
+  node->secret_deps = NULL;
+  node->edges       = TRIE_NO_EDGES;
+  node->edges_len   = 0;
+  return trie->nodes_len++;
+}
+
+static inline int is_leaf(const TrieNode* node) {
+  return node->edges == TRIE_NO_EDGES;
+}
+
+// Returns the position of the first edge of |node| whose variable is
+// not less than |var| (or |node->edges_len| if there are none).
+static inline uint32_t lower_bound_edge(const Trie* trie, const TrieNode* node, Var var) {
+  const TrieEdge* edges = &trie->edges[node->edges];
+  uint32_t lo = 0, hi = node->edges_len;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (edges[mid].var < var) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// Returns the child of |node| through the edge |var|, or NULL if
+// there is no such child. |node| should not be a leaf.
+static inline TrieNode* get_child(const Trie* trie, const TrieNode* node, Var var) {
+  uint32_t pos = lower_bound_edge(trie, node, var);
+  if (pos == node->edges_len) return NULL;
+  const TrieEdge* edge = &trie->edges[node->edges + pos];
+  return edge->var == var ? &trie->nodes[edge->child] : NULL;
+}
+
+// Returns the index of the child of the node |node_idx| through the
+// edge |var|, creating it (as well as the edge array of the node) if
+// needed.
+static uint32_t get_or_add_child(Trie* trie, uint32_t node_idx, Var var) {
+  TrieNode* node = &trie->nodes[node_idx];
+  if (is_leaf(node)) {
+    node->edges = alloc_edges(trie, 1);
+  }
+  uint32_t pos = lower_bound_edge(trie, node, var);
+  if (pos < node->edges_len && trie->edges[node->edges + pos].var == var) {
+    return trie->edges[node->edges + pos].child;
+  }
+
+  uint32_t child = alloc_node(trie);
+  node = &trie->nodes[node_idx]; // |trie->nodes| may have been reallocated
+  uint32_t capacity = edges_capacity(node->edges_len);
+  if (node->edges_len == capacity) {
+    uint32_t block = alloc_edges(trie, capacity * 2);
+    memcpy(&trie->edges[block], &trie->edges[node->edges],
+           node->edges_len * sizeof(*trie->edges));
+    release_edges(trie, node->edges, capacity);
+    node->edges = block;
+  }
+  TrieEdge* edges = &trie->edges[node->edges];
+  memmove(&edges[pos+1], &edges[pos], (node->edges_len - pos) * sizeof(*edges));
+  edges[pos].var   = var;
+  edges[pos].child = child;
+  node->edges_len++;
+  return child;
+}
+
+
+Trie* make_trie(int childs_len) {
+  Trie* trie = malloc(sizeof(*trie));
+  trie->childs_len = childs_len;
+  trie->nodes_size = 64;
+  trie->nodes_len  = 0;
+  trie->nodes      = malloc(trie->nodes_size * sizeof(*trie->nodes));
+  trie->edges_size = 64;
+  trie->edges_len  = 0;
+  trie->edges      = malloc(trie->edges_size * sizeof(*trie->edges));
+  for (int i = 0; i < TRIE_EDGE_CLASSES; i++) {
+    trie->free_edges[i] = TRIE_NO_EDGES;
+  }
+  uint32_t head = alloc_node(trie);
+  // Allocating the head's edges so that |trie_contains| does not
+  // return true as soon as it visits the head. (Since nodes without
+  // edge array are leafs)
+  trie->nodes[head].edges = alloc_edges(trie, 1);
+  return trie;
 }
 
 void free_trie(Trie* trie) {
-  free_trie_node(trie->head, trie->childs_len);
+  for (uint32_t i = 0; i < trie->nodes_len; i++) {
+    free(trie->nodes[i].secret_deps);
+  }
+  free(trie->nodes);
+  free(trie->edges);
   free(trie);
 }
 
-int trie_node_size(TrieNode* trie, int childs_len) {
-  if (!trie->childs) return 1; // a leaf
+int trie_node_size(const Trie* trie, const TrieNode* node) {
+  if (is_leaf(node)) return 1;
   int total = 0;
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      total += trie_node_size(trie->childs[i], childs_len);
-    }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    total += trie_node_size(trie, &trie->nodes[trie->edges[node->edges+i].child]);
   }
   return total;
 }
 
 int trie_size(Trie* trie) {
-  return trie_node_size(trie->head, trie->childs_len);
+  return trie_node_size(trie, &trie->nodes[0]);
 }
 
-int trie_node_tuples_size(TrieNode* trie, int childs_len, int size) {
-  if (!trie->childs) return size == 0;
+int trie_node_tuples_size(const Trie* trie, const TrieNode* node, int size) {
+  if (is_leaf(node)) return size == 0;
   int total = 0;
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      total += trie_node_tuples_size(trie->childs[i], childs_len, size-1);
-    }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    total += trie_node_tuples_size(trie, &trie->nodes[trie->edges[node->edges+i].child],
+                                   size-1);
   }
   return total;
 }
 
 int trie_tuples_size(Trie* trie, int size) {
-  return trie_node_tuples_size(trie->head, trie->childs_len, size);
+  return trie_node_tuples_size(trie, &trie->nodes[0], size);
 }
 
-void _insert_in_trie(TrieNode* trie, int childs_len,
-                     Comb* comb, int comb_len,
+void _insert_in_trie(Trie* trie, Comb* comb, int comb_len,
                      SecretDep* secret_deps, int secret_deps_len) {
-  if (comb_len == 0) {
-    if (secret_deps_len && trie->secret_deps) {
-      for (int i = 0; i < secret_deps_len; i++) {
-        trie->secret_deps[i] |= secret_deps[i];
-      }
-      free(secret_deps);
-    } else {
-      trie->secret_deps = secret_deps;
-    }
-    return;
+  uint32_t node_idx = 0;
+  for (int i = 0; i < comb_len; i++) {
+    node_idx = get_or_add_child(trie, node_idx, comb[i]);
   }
-  if (! trie->childs) {
-    trie->childs = calloc(childs_len, sizeof(*trie->childs));
-  }
-  if (!trie->childs[*comb]) {
-    trie->childs[*comb] = calloc(1, sizeof(*trie->childs[*comb]));
+  TrieNode* node = &trie->nodes[node_idx];
+  if (secret_deps_len && node->secret_deps) {
+    for (int i = 0; i < secret_deps_len; i++) {
+      node->secret_deps[i] |= secret_deps[i];
+    }
+    free(secret_deps);
+  } else {
+    node->secret_deps = secret_deps;
   }
-  _insert_in_trie(trie->childs[*comb], childs_len, comb+1, comb_len-1,
-                  secret_deps, secret_deps_len);
-  return;
 }
 
 void insert_in_trie(Trie* trie, Comb* comb, int comb_len, SecretDep* secret_deps) {
-  _insert_in_trie(trie->head, trie->childs_len, comb, comb_len,
-                  secret_deps, 0);
+  _insert_in_trie(trie, comb, comb_len, secret_deps, 0);
 }
 
 void insert_in_trie_merge(Trie* trie, Comb* comb, int comb_len,
                           SecretDep* secret_deps, int secret_deps_len) {
-  _insert_in_trie(trie->head, trie->childs_len, comb, comb_len,
-                  secret_deps, secret_deps_len);
+  _insert_in_trie(trie, comb, comb_len, secret_deps, secret_deps_len);
 }
 
 
-int _trie_contains(TrieNode* trie, Comb* comb, int comb_len) {
-    if (!trie->childs) return 1;
-    if (comb_len == 0) return 0;
-    if (!trie->childs[*comb]) return 0;
-    return _trie_contains(trie->childs[*comb], comb+1, comb_len-1);
+int _trie_contains(const Trie* trie, const TrieNode* node, Comb* comb, int comb_len) {
+  if (is_leaf(node)) return 1;
+  if (comb_len == 0) return 0;
+  const TrieNode* child = get_child(trie, node, *comb);
+  if (!child) return 0;
+  return _trie_contains(trie, child, comb+1, comb_len-1);
 }
 
 int trie_contains(Trie* trie, Comb* comb, int comb_len) {
-  return _trie_contains(trie->head, comb, comb_len);
+  return _trie_contains(trie, &trie->nodes[0], comb, comb_len);
 }
 
-SecretDep* _trie_contains_subset(TrieNode* trie, Comb* comb, int comb_len) {
-  if (!trie->childs) {
-    return trie->secret_deps;
+SecretDep* _trie_contains_subset(const Trie* trie, const TrieNode* node,
+                                 Comb* comb, int comb_len) {
+  if (is_leaf(node)) {
+    return node->secret_deps;
   }
   if (comb_len == 0) return NULL;
-  char* secret_deps = _trie_contains_subset(trie, comb+1, comb_len-1);
+  char* secret_deps = _trie_contains_subset(trie, node, comb+1, comb_len-1);
   if (secret_deps) return secret_deps;
-  if (!trie->childs[*comb]) return NULL;
-  return _trie_contains_subset(trie->childs[*comb], comb+1, comb_len-1);
+  const TrieNode* child = get_child(trie, node, *comb);
+  if (!child) return NULL;
+  return _trie_contains_subset(trie, child, comb+1, comb_len-1);
 }
 
 SecretDep* trie_contains_subset(Trie* trie, Comb* comb, int comb_len) {
-  return _trie_contains_subset(trie->head, comb, comb_len);
+  return _trie_contains_subset(trie, &trie->nodes[0], comb, comb_len);
 }
 
 // This function generates all combinations of |comb| of size 1 to
@@ -161,9 +243,9 @@ int trie_contains_subset_slow(Trie* trie, Comb* comb, int comb_len) {
   return 0;
 }
 
-void _get_all_tuples(VarVecVector* all_tuples, TrieNode* trie, int childs_len,
+void _get_all_tuples(VarVecVector* all_tuples, const Trie* trie, const TrieNode* node,
                      Comb* work_comb, int work_comb_idx) {
-  if (!trie->childs) {
+  if (is_leaf(node)) {
     VarVector* tuple = VarVector_make_size(work_comb_idx+1);
     for (int i = 0; i < work_comb_idx; i++) {
       VarVector_push(tuple, work_comb[i]);
@@ -172,12 +254,11 @@ void _get_all_tuples(VarVecVector* all_tuples, TrieNode* trie, int childs_len,
     return;
   }
 
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      work_comb[work_comb_idx] = i;
-      _get_all_tuples(all_tuples, trie->childs[i], childs_len,
-                      work_comb, work_comb_idx+1);
-    }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    const TrieEdge* edge = &trie->edges[node->edges+i];
+    work_comb[work_comb_idx] = edge->var;
+    _get_all_tuples(all_tuples, trie, &trie->nodes[edge->child],
+                    work_comb, work_comb_idx+1);
   }
 }
 
@@ -185,7 +266,7 @@ VarVecVector* get_all_tuples(Trie* trie) {
   VarVecVector* all_tuples = VarVecVector_make();
   // Assumes that no incompressible tuple is more than 100 elements long
   Comb work_comb[100] = { 0 };
-  _get_all_tuples(all_tuples, trie->head, trie->childs_len, work_comb, 0);
+  _get_all_tuples(all_tuples, trie, &trie->nodes[0], work_comb, 0);
   return all_tuples;
 }
 
@@ -199,83 +280,78 @@ void print_comb(Comb* comb, int comb_len) {
   printf(" ]\n");
 }
 
-void _print_all_tuples(TrieNode* trie, int childs_len,
+void _print_all_tuples(const Trie* trie, const TrieNode* node,
                        Comb* work_comb, int work_comb_idx) {
-  if (!trie->childs) {
+  if (is_leaf(node)) {
     print_comb(work_comb, work_comb_idx);
     return;
   }
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      work_comb[work_comb_idx] = i;
-      _print_all_tuples(trie->childs[i], childs_len, work_comb, work_comb_idx+1);
-    }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    const TrieEdge* edge = &trie->edges[node->edges+i];
+    work_comb[work_comb_idx] = edge->var;
+    _print_all_tuples(trie, &trie->nodes[edge->child], work_comb, work_comb_idx+1);
   }
 }
 
 void print_all_tuples(Trie* trie) {
   // Assumes that no incompressible tuple is more than 100 elements long
   Comb work_comb[100] = { 0 };
-  _print_all_tuples(trie->head, trie->childs_len, work_comb, 0);
+  _print_all_tuples(trie, &trie->nodes[0], work_comb, 0);
 }
 
-void _print_all_tuples_size(TrieNode* trie, int childs_len,
+void _print_all_tuples_size(const Trie* trie, const TrieNode* node,
                             Comb* work_comb, int work_comb_idx, int size) {
-  if (!trie->childs) {
+  if (is_leaf(node)) {
     if (size == 0) {
       print_comb(work_comb, work_comb_idx);
     }
     return;
   }
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      work_comb[work_comb_idx] = i;
-      _print_all_tuples_size(trie->childs[i], childs_len, work_comb, work_comb_idx+1, size-1);
-    }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    const TrieEdge* edge = &trie->edges[node->edges+i];
+    work_comb[work_comb_idx] = edge->var;
+    _print_all_tuples_size(trie, &trie->nodes[edge->child], work_comb, work_comb_idx+1, size-1);
   }
 }
 
 void print_all_tuples_size(Trie* trie, int size) {
   // Assumes that no incompressible tuple is more than 100 elements long
   Comb work_comb[100] = { 0 };
-  _print_all_tuples_size(trie->head, trie->childs_len, work_comb, 0, size);
+  _print_all_tuples_size(trie, &trie->nodes[0], work_comb, 0, size);
 }
-void _list_from_trie(TrieNode* trie, int childs_len,
+
+void _list_from_trie(const Trie* trie, const TrieNode* node,
                      ListComb* list,
                      Comb* comb, int idx, int comb_len) {
-  if (!trie->childs && idx == comb_len) {
-    add_with_deps(list, comb, trie->secret_deps);
+  if (is_leaf(node) && idx == comb_len) {
+    add_with_deps(list, comb, node->secret_deps);
     return;
   }
-  if (idx == comb_len || !trie->childs) {
+  if (idx == comb_len || is_leaf(node)) {
     return;
   }
-  int used = 0;
-  for (int i = 0; i < childs_len; i++) {
-    if (trie->childs[i]) {
-      if (used) {
-        Comb* comb_copy = malloc(comb_len * sizeof(*comb_copy));
-        memcpy(comb_copy, comb, idx * sizeof(*comb));
-        comb_copy[idx] = i;
-        _list_from_trie(trie->childs[i], childs_len, list, comb_copy, idx+1, comb_len);
-      } else {
-        used = 1;
-        comb[idx] = i;
-        _list_from_trie(trie->childs[i], childs_len, list, comb, idx+1, comb_len);
-      }
+  for (uint32_t i = 0; i < node->edges_len; i++) {
+    const TrieEdge* edge = &trie->edges[node->edges+i];
+    if (i) {
+      Comb* comb_copy = malloc(comb_len * sizeof(*comb_copy));
+      memcpy(comb_copy, comb, idx * sizeof(*comb));
+      comb_copy[idx] = edge->var;
+      _list_from_trie(trie, &trie->nodes[edge->child], list, comb_copy, idx+1, comb_len);
+    } else {
+      comb[idx] = edge->var;
+      _list_from_trie(trie, &trie->nodes[edge->child], list, comb, idx+1, comb_len);
     }
   }
 }
 
 ListComb* list_from_trie(Trie* trie, int comb_len) {
   ListComb* list = make_empty_list();
-  TrieNode* head = trie->head;
-  for (int i = 0; i < trie->childs_len; i++) {
-    if (head->childs[i]) {
-      Comb* comb = malloc(comb_len * sizeof(*comb));
-      comb[0] = i;
-      _list_from_trie(head->childs[i], trie->childs_len, list, comb, 1, comb_len);
-    }
+  const TrieNode* head = &trie->nodes[0];
+  for (uint32_t i = 0; i < head->edges_len; i++) {
+    const TrieEdge* edge = &trie->edges[head->edges+i];
+    Comb* comb = malloc(comb_len * sizeof(*comb));
+    comb[0] = edge->var;
+    _list_from_trie(trie, &trie->nodes[edge->child], list, comb, 1, comb_len);
   }
   return list;
 }
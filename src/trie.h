@@ -6,22 +6,51 @@
 //
 // Because this trie only stores incompressible tuples, it cannot
 // contain a tuple t and a tuple t' that is a subtuple of t. Thus, the
-// criteria we use to know where to stop in the sub-tries is: if
-// |childs| is NULL, then we are on a leaf.
+// criteria we use to know where to stop in the sub-tries is: if a
+// node has no edge array (|edges| is TRIE_NO_EDGES), then we are on a
+// leaf.
+//
+// Circuits can have hundreds of variables, while most nodes of the
+// trie only have a handful of children. Rather than an array of
+// |childs_len| pointers, each node thus has a sorted array of edges
+// (variable, child), searched by dichotomy. Nodes are allocated in a
+// single array (|nodes|) and referred to by their index, and edge
+// arrays are blocks of |edges| whose sizes are powers of 2; blocks
+// that are outgrown are kept in per-size free lists for later reuse.
+
+#include <stdint.h>
 
 #include "combinations.h"
 #include "list_tuples.h"
 #include "vectors.h"
 
 
+typedef struct _trie_edge {
+  Var var;
+  uint32_t child; // Index of the child in |trie->nodes|
+} TrieEdge;
+
+// The capacity of the block of edges of a node is not stored: it is
+// the smallest power of 2 that is at least |edges_len| (and at least 1).
 typedef struct _trie_node {
-  struct _trie_node** childs;
   SecretDep* secret_deps;
+  uint32_t edges;     // Index of the first edge of the node in |trie->edges|
+  uint32_t edges_len; // Number of edges of the node
 } TrieNode;
 
+#define TRIE_NO_EDGES UINT32_MAX
+
+// Number of size classes of blocks of edges
+#define TRIE_EDGE_CLASSES 32
+
 typedef struct _trie {
   int childs_len;
-  TrieNode* head;
+  TrieNode* nodes; // The root is nodes[0]
+  uint32_t nodes_len, nodes_size;
+  TrieEdge* edges;
+  uint32_t edges_len, edges_size;
+  uint32_t free_edges[TRIE_EDGE_CLASSES]; // Free lists of blocks of
+                                          // edges (TRIE_NO_EDGES if empty)
 } Trie;
 
 void free_trie(Trie* trie);
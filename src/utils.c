@@ -24,6 +24,151 @@ int is_eol(char c) {
   return c == '\0' || c == '#';
 }
 
+/* ***************************************************** */
+/*              String hash index                        */
+/* ***************************************************** */
+
+#define STR_INDEX_INITIAL_BUCKETS 16
+
+typedef struct _StrIndexEntry {
+  const char* key;
+  void* elem;
+  uint64_t hash;
+  int next; // Next entry of the same bucket (or of the free list), or -1
+} StrIndexEntry;
+
+struct _StrIndex {
+  int* buckets; // First entry of each bucket, or -1
+  int bucket_count; // Always a power of 2
+  StrIndexEntry* entries;
+  int entries_size;
+  int entries_capacity;
+  int free_entries; // Entries that were removed, reused by str_index_add
+  int count;
+};
+
+// FNV-1a
+static uint64_t hash_str(const char* str) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (; *str; str++) {
+    hash ^= (unsigned char)*str;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+StrIndex* make_str_index() {
+  StrIndex* index = malloc(sizeof(*index));
+  index->bucket_count = STR_INDEX_INITIAL_BUCKETS;
+  index->buckets = malloc(index->bucket_count * sizeof(*index->buckets));
+  memset(index->buckets, -1, index->bucket_count * sizeof(*index->buckets));
+  index->entries_capacity = STR_INDEX_INITIAL_BUCKETS;
+  index->entries = malloc(index->entries_capacity * sizeof(*index->entries));
+  index->entries_size = 0;
+  index->free_entries = -1;
+  index->count = 0;
+  return index;
+}
+
+// Doubles the number of buckets of |index|. The entries of each bucket
+// keep their relative order (which matters when a key was added
+// several times): the entries of bucket |b| are split between buckets
+// |b| and |b + bucket_count|, and appended in order to these buckets.
+static void grow_str_index(StrIndex* index) {
+  int old_count = index->bucket_count;
+  int new_count = old_count * 2;
+  int* buckets = malloc(new_count * sizeof(*buckets));
+  int* tails = malloc(new_count * sizeof(*tails));
+  memset(buckets, -1, new_count * sizeof(*buckets));
+  memset(tails, -1, new_count * sizeof(*tails));
+  for (int b = 0; b < old_count; b++) {
+    int i = index->buckets[b];
+    while (i != -1) {
+      int next = index->entries[i].next;
+      int new_b = index->entries[i].hash & (new_count - 1);
+      index->entries[i].next = -1;
+      if (tails[new_b] == -1) {
+        buckets[new_b] = i;
+      } else {
+        index->entries[tails[new_b]].next = i;
+      }
+      tails[new_b] = i;
+      i = next;
+    }
+  }
+  free(tails);
+  free(index->buckets);
+  index->buckets = buckets;
+  index->bucket_count = new_count;
+}
+
+void str_index_add(StrIndex* index, const char* key, void* elem) {
+  if (index->count >= index->bucket_count) {
+    grow_str_index(index);
+  }
+  int i;
+  if (index->free_entries != -1) {
+    i = index->free_entries;
+    index->free_entries = index->entries[i].next;
+  } else {
+    if (index->entries_size == index->entries_capacity) {
+      index->entries_capacity *= 2;
+      index->entries = realloc(index->entries,
+                               index->entries_capacity * sizeof(*index->entries));
+    }
+    i = index->entries_size++;
+  }
+  StrIndexEntry* entry = &index->entries[i];
+  entry->key = key;
+  entry->elem = elem;
+  entry->hash = hash_str(key);
+  int b = entry->hash & (index->bucket_count - 1);
+  entry->next = index->buckets[b];
+  index->buckets[b] = i;
+  index->count++;
+}
+
+void* str_index_get(const StrIndex* index, const char* key) {
+  uint64_t hash = hash_str(key);
+  for (int i = index->buckets[hash & (index->bucket_count - 1)]; i != -1;
+       i = index->entries[i].next) {
+    const StrIndexEntry* entry = &index->entries[i];
+    if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+      return entry->elem;
+    }
+  }
+  return NULL;
+}
+
+void str_index_remove(StrIndex* index, const char* key, const void* elem) {
+  int* prev = &index->buckets[hash_str(key) & (index->bucket_count - 1)];
+  while (*prev != -1) {
+    int i = *prev;
+    if (index->entries[i].elem == elem) {
+      *prev = index->entries[i].next;
+      index->entries[i].next = index->free_entries;
+      index->free_entries = i;
+      index->count--;
+      return;
+    }
+    prev = &index->entries[i].next;
+  }
+}
+
+void str_index_clear(StrIndex* index) {
+  memset(index->buckets, -1, index->bucket_count * sizeof(*index->buckets));
+  index->entries_size = 0;
+  index->free_entries = -1;
+  index->count = 0;
+}
+
+void free_str_index(StrIndex* index) {
+  free(index->buckets);
+  free(index->entries);
+  free(index);
+}
+
+
 /* ***************************************************** */
 /*              String/Int map utilities                 */
 /* ***************************************************** */
@@ -33,6 +178,7 @@ StrMap* make_str_map(char* name) {
   map->name = strdup(name);
   map->head = NULL;
   map->next_val = 0;
+  map->index = make_str_index();
   return map;
 }
 
@@ -43,6 +189,7 @@ void str_map_add_with_val(StrMap* map, char* str, int val) {
   e->val = val;
   e->next = map->head;
   map->head = e;
+  str_index_add(map->index, e->key, e);
 }
 
 void str_map_add(StrMap* map, char* str) {
@@ -50,52 +197,32 @@ void str_map_add(StrMap* map, char* str) {
 }
 
 void str_map_remove(StrMap* map, char* str) {
-  StrMapElem* e = map->head;
+  StrMapElem* e = str_index_get(map->index, str);
   if (!e) return;
+  str_index_remove(map->index, e->key, e);
 
-  if (strcmp(e->key, str) == 0) {
+  if (map->head == e) {
     map->head = e->next;
-    free(e->key);
-    free(e);
-    return;
-  }
-  StrMapElem* prev = e;
-  e = e->next;
-  while (e) {
-    if (strcmp(e->key, str) == 0) {
-      prev->next = e->next;
-      free(e->key);
-      free(e);
-      return;
-    }
-    prev = e;
-    e = e->next;
+  } else {
+    StrMapElem* prev = map->head;
+    while (prev->next != e) prev = prev->next;
+    prev->next = e->next;
   }
+  free(e->key);
+  free(e);
 }
 
 int str_map_get(StrMap* map, char* str) {
-  StrMapElem* curr = map->head;
-
-  while (curr) {
-    if (strcmp(curr->key, str) == 0) {
-      return curr->val;
-    }
-    curr = curr->next;
+  StrMapElem* e = str_index_get(map->index, str);
+  if (e) {
+    return e->val;
   }
   fprintf(stderr, "Elem '%s' not found in map '%s'.\n", str, map->name);
   exit(EXIT_FAILURE);
 }
 
 int str_map_contains(StrMap* map, char* str) {
-  StrMapElem* curr = map->head;
-
-  while (curr) {
-    if (strcmp(curr->key, str) == 0) {
-      return 1;
-    }
-    curr = curr->next;
-  }
-  return 0;
+  return str_index_get(map->index, str) != NULL;
 }
 
 void free_str_map(StrMap* map) {
@@ -106,6 +233,7 @@ void free_str_map(StrMap* map) {
     free(e);
     e = next;
   }
+  free_str_index(map->index);
   free(map->name);
   free(map);
 }
@@ -131,6 +259,13 @@ StrMapElem* _reverse_str_map(StrMapElem* e, StrMapElem* prev) {
 }
 
 void reverse_str_map(StrMap* map) {
+  // Re-indexing the elements, from the last one of the reversed list to
+  // its head, so that the index keeps returning the first element of
+  // the list with a given key.
+  str_index_clear(map->index);
+  for (StrMapElem* e = map->head; e != NULL; e = e->next) {
+    str_index_add(map->index, e->key, e);
+  }
   StrMapElem* e = map->head;
   map->head = _reverse_str_map(e, NULL);
 }
@@ -145,18 +280,15 @@ StrVecMap* make_str_vec_map(char* name) {
   map->name = strdup(name);
   map->head = NULL;
   map->length = 0;
+  map->index = make_str_index();
   return map;
 }
 
 void str_vec_map_add(StrVecMap* map, char* key, char* var) {
-  StrVecMapElem* curr = map->head;
-
-  while (curr) {
-    if (strcmp(curr->key, key) == 0) {
-      StringVector_push(curr->vec, strdup(var));
-      return;
-    }
-    curr = curr->next;
+  StrVecMapElem* curr = str_index_get(map->index, key);
+  if (curr) {
+    StringVector_push(curr->vec, strdup(var));
+    return;
   }
 
   StrVecMapElem* e = malloc(sizeof(*e));
@@ -166,7 +298,7 @@ void str_vec_map_add(StrVecMap* map, char* key, char* var) {
   e->next = map->head;
   map->head = e;
   map->length++;
-  
+  str_index_add(map->index, e->key, e);
 }
 
 void free_str_vec_map(StrVecMap* map) {
@@ -178,6 +310,7 @@ void free_str_vec_map(StrVecMap* map) {
     free(e);
     e = next;
   }
+  free_str_index(map->index);
   free(map->name);
   free(map);
 }
@@ -207,6 +340,7 @@ EqList* make_eq_list() {
   EqList* l = malloc(sizeof(*l));
   l->size = 0;
   l->head = NULL;
+  l->index = make_str_index();
   return l;
 }
 
@@ -220,6 +354,7 @@ void add_eq_list(EqList* l, char* dst, Expr* e, bool anti_glitch, bool correctio
   el->next = l->head;
   l->head = el;
   l->size++;
+  str_index_add(l->index, el->dst, el);
 }
 
 void free_eq_list(EqList* l) {
@@ -235,6 +370,7 @@ void free_eq_list(EqList* l) {
     free(el);
     el = next;
   }
+  free_str_index(l->index);
   free(l);
 }
 
@@ -250,14 +386,7 @@ void print_eq_list(EqList* l) {
 }
 
 EqListElem * get_eq_list(EqList* l, char* dst) {
-  EqListElem * h = l->head;
-  while(h){
-    if(strcmp(h->dst, dst) == 0){
-      return h;
-    }
-    h = h->next;
-  }
-  return NULL;
+  return str_index_get(l->index, dst);
 }
 
 void print_eq_full_expr(EqList* l, char* dst){
@@ -298,6 +427,11 @@ EqListElem* _reverse_eq_list(EqListElem* el, EqListElem* prev) {
 }
 
 void reverse_eq_list(EqList* l) {
+  // Cf reverse_str_map
+  str_index_clear(l->index);
+  for (EqListElem* el = l->head; el != NULL; el = el->next) {
+    str_index_add(l->index, el->dst, el);
+  }
   EqListElem* el = l->head;
   l->head = _reverse_eq_list(el, NULL);
 }
@@ -313,6 +447,7 @@ DepMap* make_dep_map(char* name) {
   DepMap* map = malloc(sizeof(*map));
   map->name = strdup(name);
   map->head = NULL;
+  map->index = make_str_index();
   return map;
 }
 
@@ -325,16 +460,13 @@ void dep_map_add(DepMap* map, char* str, Dependency* std_dep, DepArrVector* glit
   e->original_dep = original_dep;
   e->next = map->head;
   map->head = e;
+  str_index_add(map->index, e->key, e);
 }
 
 DepMapElem* dep_map_get(DepMap* map, char* dep) {
-  DepMapElem* curr = map->head;
-
-  while (curr) {
-    if (strcmp(curr->key, dep) == 0) {
-      return curr;
-    }
-    curr = curr->next;
+  DepMapElem* e = str_index_get(map->index, dep);
+  if (e) {
+    return e;
   }
   fprintf(stderr, "Elem '%s' not found in map '%s'.\n", dep, map->name);
   exit(EXIT_FAILURE);
@@ -343,14 +475,7 @@ DepMapElem* dep_map_get(DepMap* map, char* dep) {
 // Same as dep_map_get, but if |dep| is not found in |map|, returns
 // NULL instead of crashing.
 DepMapElem* dep_map_get_nofail(DepMap* map, char* dep) {
-  DepMapElem* curr = map->head;
-  while (curr) {
-    if (strcmp(curr->key, dep) == 0) {
-      return curr;
-    }
-    curr = curr->next;
-  }
-  return NULL;
+  return str_index_get(map->index, dep);
 }
 
 char* dep_get_from_expr_nofail(DependencyList* deps, int length, Dependency* dep, DepArrVector* dep_arr, int deps_size) {
@@ -383,6 +508,7 @@ void free_dep_map(DepMap* map) {
     free(e);
     e = next;
   }
+  free_str_index(map->index);
   free(map->name);
   free(map);
 }
@@ -409,6 +535,7 @@ void free_faults_combs(FaultsCombs * fc){
     for(int j=0; j<f->length; j++){
       free(f->names[j]);
     }
+    free(f->names);
     free(f);
   }
   free(fc->fc);
@@ -12,6 +12,7 @@
 
 typedef struct _StrMap StrMap;
 typedef struct _EqList EqList;
+typedef struct _StrIndex StrIndex;
 
 
 
@@ -31,11 +32,38 @@ int is_eol(char c);
 
 
 /* ***************************************************** */
-/*              String/Int map utilities                 */
+/*              String hash index                        */
 /* ***************************************************** */
 
-// For simplicity, a map is implemented using a linked-list. This is
-// far from efficient, but parsing is hardly the bottleneck of IronMask.
+// The maps below (StrMap, StrVecMap, EqList and DepMap) are
+// linked-lists, which the parser and its callers iterate over (their
+// order is the order of the variables in the circuit). A StrIndex is
+// attached to each of them, so that looking up an element by name
+// does not require a linear scan of the list: with large gadgets
+// (generated multiplications at order 10+, nlogn at 16 shares), and
+// since gen_circuit is called again for each fault scenario in
+// CRP/CRPC, these scans made the construction of circuits quadratic.
+//
+// A StrIndex maps strings to elements with separate chaining. It does
+// not copy keys: they must remain valid as long as their element is
+// in the index (they are typically the key of the element). When a
+// key is added several times, str_index_get returns the element that
+// was added last (like the linear scans of the lists, which add
+// elements at their head).
+
+StrIndex* make_str_index();
+void str_index_add(StrIndex* index, const char* key, void* elem);
+// Returns the last element added with key |key|, or NULL if there is
+// none.
+void* str_index_get(const StrIndex* index, const char* key);
+void str_index_remove(StrIndex* index, const char* key, const void* elem);
+void str_index_clear(StrIndex* index);
+void free_str_index(StrIndex* index);
+
+
+/* ***************************************************** */
+/*              String/Int map utilities                 */
+/* ***************************************************** */
 
 typedef struct _StrMapElem {
   char* key;
@@ -47,6 +75,7 @@ typedef struct _StrMap {
   char* name;
   StrMapElem* head;
   int next_val;
+  StrIndex* index;
 } StrMap;
 
 StrMap* make_str_map(char* name);
@@ -76,6 +105,7 @@ typedef struct _StrVecMap {
   char* name;
   StrVecMapElem* head;
   int length;
+  StrIndex* index;
 } StrVecMap;
 
 StrVecMap* make_str_vec_map(char* name);
@@ -110,6 +140,7 @@ typedef struct _EqListElem {
 typedef struct _EqList {
   int size;
   EqListElem* head;
+  StrIndex* index; // Indexed by |dst|
 } EqList;
 
 EqList* make_eq_list();
@@ -137,6 +168,7 @@ typedef struct _DepMapElem {
 typedef struct _DepMap {
   char* name;
   DepMapElem* head;
+  StrIndex* index;
 } DepMap;
 
 DepMap* make_dep_map(char* name);
@@ -12,6 +12,10 @@
 #include "combinations.h"
 #include "trie.h"
 #include "vectors.h"
+#include "scheduler.h"
+#include "coeffs.h"
+#include "bitdep_kernels.h"
+#include "coeffs.h"
 
 /**********************************************************************
               Very high level description
@@ -248,24 +252,31 @@ int expand_tuple_to_failure(const Circuit* c,
 }
 #endif
 
+// Returns the maximum number of secret shares among |secret_dep_1|
+// and |secret_dep_2|, ignoring |shares_to_ignore| (used for PINI).
+static inline int count_shares(const Circuit* c, Dependency secret_dep_1, Dependency secret_dep_2,
+                               Dependency shares_to_ignore, bool PINI) {
+  int secret_count = c->secret_count;
+  if (PINI) {
+    return hamming_weight((secret_dep_1 | secret_dep_2) & ~shares_to_ignore);
+  }
+  int count_1 = hamming_weight(secret_dep_1 & ~shares_to_ignore);
+  int count_2 = secret_count == 2 ? hamming_weight(secret_dep_2 & ~shares_to_ignore) : 0;
+  return count_1 > count_2 ? count_1 : count_2;
+}
+
 // Returns the maximum number of secret shares of the same input in
 // |comb|, ignoring |shares_to_ignore| (used for PINI).
 int get_number_of_shares(const Circuit* c, const Comb* comb, int comb_len,
                          Dependency shares_to_ignore, bool PINI) {
   DependencyList* deps = c->deps;
-  int secret_count = c->secret_count;
   Dependency secret_dep_1 = 0, secret_dep_2 = 0;
   for (int i = 0; i < comb_len; i++) {
     int idx = comb[i];
     secret_dep_1 |= deps->contained_secrets[idx][0];
     secret_dep_2 |= deps->contained_secrets[idx][1];
   }
-  if (PINI) {
-    return hamming_weight((secret_dep_1 | secret_dep_2) & ~shares_to_ignore);
-  }
-  int count_1 = hamming_weight(secret_dep_1 & ~shares_to_ignore);
-  int count_2 = secret_count == 2 ? hamming_weight(secret_dep_2 & ~shares_to_ignore) : 0;
-  return count_1 > count_2 ? count_1 : count_2;
+  return count_shares(c, secret_dep_1, secret_dep_2, shares_to_ignore, PINI);
 }
 
 #define Is_leaky(_v, _t_in, _comb_free_space) (hamming_weight(_v)+_comb_free_space > (_t_in))
@@ -433,6 +444,7 @@ static void set_gauss_rand(BitDep** deps, GaussRand* gauss_rands,
 // (that were removed from the circuit by the function
 // |remove_randoms| of dimensions.c).
 static int is_failure_with_randoms(const Circuit* circuit,
+                            const BitDepKernels* kernels,
                             BitDep** local_deps, GaussRand* gauss_rands, BitDep** local_deps_copy, GaussRand* gauss_rands_copy,
                             int local_deps_len, int t_in,
                             int comb_free_space, Dependency shares_to_ignore, bool PINI) {
@@ -451,15 +463,9 @@ static int is_failure_with_randoms(const Circuit* circuit,
 
   DependencyList* deps = circuit->deps;
   int secret_count = circuit->secret_count;
-  int random_count = circuit->random_count;
   int share_count = circuit->share_count;
-  int mult_count = deps->mult_deps->length;
   int non_mult_deps_count = circuit->deps->first_mult_idx;
-  int bit_rand_len = 1 + random_count / 64;
-  int corr_outputs_count = deps->correction_outputs->length;
-
-  int bit_mult_len = (mult_count == 0) ? 0 :  1 + mult_count / 64;
-  int bit_correction_outputs_len = (corr_outputs_count == 0) ? 0 : 1 + corr_outputs_count / 64;
+  int bit_rand_len = kernels->bit_rand_len;
 
   // Collecting all randoms of |local_deps| in the binary array |randoms|.
   uint64_t randoms[bit_rand_len];
@@ -559,9 +565,8 @@ static int is_failure_with_randoms(const Circuit* circuit,
       }
 
       for (int i = 0; i < copy_size; i++) {
-          gauss_step(circuit, local_deps_copy[i], local_deps_copy, gauss_rands_copy,
-                    bit_rand_len, bit_mult_len, bit_correction_outputs_len, i);
-          set_gauss_rand(local_deps_copy, gauss_rands_copy, i, bit_rand_len, circuit->deps->correction_outputs, bit_correction_outputs_len);
+          kernels->gauss_step(kernels, circuit, local_deps_copy[i], local_deps_copy, gauss_rands_copy, i);
+          kernels->set_gauss_rand(kernels, local_deps_copy, gauss_rands_copy, i, deps->correction_outputs);
       }
 
       for (int i = 0; i < copy_size; i++) {
@@ -943,16 +948,22 @@ void factorize_mults(const Circuit* c, BitDep** local_deps,
 
 }
 
-static void replace_correction_outputs_in_dep(const Circuit * c, BitDep** local_deps, int idx, GaussRand* gauss_rands,
-                                                   int * local_deps_len, int bit_correction_outputs_len,
-                                                   int bit_rand_len, int bit_mult_len,
-                                                   CorrectionOutputs * correction_outputs){
+static void local_deps_overflow() {
+  fprintf(stderr, "Too many dependencies in the Gaussian elimination (the workspace "
+          "of _verify_tuples is too small). Exiting.\n");
+  exit(EXIT_FAILURE);
+}
+
+static void replace_correction_outputs_in_dep(const Circuit * c, const BitDepKernels* kernels,
+                                              BitDep** local_deps, int idx, GaussRand* gauss_rands,
+                                              int * local_deps_len, int local_deps_max_len,
+                                              CorrectionOutputs * correction_outputs){
 
   if(gauss_rands[idx].is_set) return;
 
   BitDep * bit_dep = local_deps[idx];
 
-  for(int i=0; i< bit_correction_outputs_len; i++){
+  for(int i=0; i< kernels->bit_correction_outputs_len; i++){
     //printf("Entering %d\n", idx);
     uint64_t corr_out_elem = bit_dep->correction_outputs[i];
 
@@ -966,17 +977,16 @@ static void replace_correction_outputs_in_dep(const Circuit * c, BitDep** local_
       //printf("i = %d of length %d\n", corr_out_idx, bit_dep_arr->length);
 
       for(int dep_idx=0; dep_idx< bit_dep_arr->length; dep_idx++){
+        if (*local_deps_len >= local_deps_max_len) local_deps_overflow();
 
-        gauss_step(c, bit_dep_arr->content[dep_idx], local_deps, gauss_rands,
-                bit_rand_len, bit_mult_len, bit_correction_outputs_len, *local_deps_len);
-        set_gauss_rand(local_deps, gauss_rands, *local_deps_len, bit_rand_len, correction_outputs, bit_correction_outputs_len);
+        kernels->gauss_step(kernels, c, bit_dep_arr->content[dep_idx], local_deps, gauss_rands,
+                            *local_deps_len);
+        kernels->set_gauss_rand(kernels, local_deps, gauss_rands, *local_deps_len, correction_outputs);
 
         (*local_deps_len)++;
 
-        replace_correction_outputs_in_dep(c, local_deps, *local_deps_len - 1, gauss_rands,
-                                               local_deps_len, bit_correction_outputs_len,
-                                               bit_rand_len, bit_mult_len,
-                                               correction_outputs);
+        replace_correction_outputs_in_dep(c, kernels, local_deps, *local_deps_len - 1, gauss_rands,
+                                          local_deps_len, local_deps_max_len, correction_outputs);
       }
     }
   }
@@ -1026,10 +1036,13 @@ int incr_comb_in_place_get_index(Comb* comb, int k, int max) {
 // Generates the tuple/comb right after |curr_comb|. The parameter
 // |sub_comb_len| is the length of |curr_comb| without the length of
 // |prefix|. Put otherwise, the full length of |curr_comb| is
-// |prefix->length + sub_comb_len|.
+// |prefix->length + sub_comb_len|. The index returned is the index
+// of the first element that changed in the full |curr_comb| (ie,
+// including the prefix), or -1 if there are no more tuples.
 int next_comb(Comb* curr_comb, int sub_comb_len, int last_var, VarVector* prefix) {
   if (!prefix) return incr_comb_in_place_get_index(curr_comb, sub_comb_len, last_var);
-  return incr_comb_in_place_get_index(&curr_comb[prefix->length], sub_comb_len, last_var);
+  int idx = incr_comb_in_place_get_index(&curr_comb[prefix->length], sub_comb_len, last_var);
+  return idx < 0 ? idx : idx + prefix->length;
 }
 
 // Generates the first tuple/comb.
@@ -1054,6 +1067,646 @@ Comb* init_comb(Comb* first_comb, int sub_comb_len, VarVector* prefix, int max_c
   return comb;
 }
 
+// The arrays used by _verify_tuples to perform the Gaussian
+// eliminations. They used to be alloca'd (and zeroed) on each call,
+// with a size of 10 times the number of variables of the circuit,
+// which was both slow (_verify_tuples is called once per size and
+// per output combination in RPC & co) and could overflow the stack on
+// large gadgets. Instead, each thread has its own workspaces, which
+// are allocated the first time they are needed, and only reallocated
+// when larger ones are needed. Since _verify_tuples can be called
+// from a failure callback (as done by RPE), each thread has a stack
+// of workspaces, with one workspace per level of nesting.
+//
+// The BitDeps of the workspace are not reset between calls: every
+// field read by the elimination is written beforehand (which was
+// already the case from one tuple to the next within a call).
+struct verify_workspace {
+  int local_deps_max_len; // Capacity of |local_deps|, |local_deps_copy| & co
+  int deps_fact_max_len;  // Capacity of |deps_fact| and |deps_rands_fact|
+  BitDep** local_deps;
+  BitDep** local_deps_copy;
+  GaussRand* gauss_rands;
+  GaussRand* gauss_rands_copy;
+  int* local_deps_to_mult_map_fact;
+  BitDep** deps_fact;
+  GaussRand* deps_rands_fact;
+  BitDep* bit_deps_storage; // Content of |local_deps|, |local_deps_copy| and |deps_fact|
+};
+
+struct verify_workspace_stack {
+  int depth;  // Number of workspaces in use
+  int length; // Number of workspaces allocated
+  struct verify_workspace** workspaces;
+};
+
+static pthread_key_t verify_workspace_key;
+static pthread_once_t verify_workspace_key_once = PTHREAD_ONCE_INIT;
+
+static void free_verify_workspace(struct verify_workspace* ws) {
+  if (!ws) return;
+  free(ws->local_deps);
+  free(ws->local_deps_copy);
+  free(ws->gauss_rands);
+  free(ws->gauss_rands_copy);
+  free(ws->local_deps_to_mult_map_fact);
+  free(ws->deps_fact);
+  free(ws->deps_rands_fact);
+  free(ws->bit_deps_storage);
+  free(ws);
+}
+
+static void free_verify_workspace_stack(void* void_stack) {
+  struct verify_workspace_stack* stack = (struct verify_workspace_stack*) void_stack;
+  for (int i = 0; i < stack->length; i++) {
+    free_verify_workspace(stack->workspaces[i]);
+  }
+  free(stack->workspaces);
+  free(stack);
+}
+
+static void make_verify_workspace_key() {
+  pthread_key_create(&verify_workspace_key, free_verify_workspace_stack);
+}
+
+static struct verify_workspace* make_verify_workspace(int local_deps_max_len,
+                                                      int deps_fact_max_len) {
+  struct verify_workspace* ws = malloc(sizeof(*ws));
+  ws->local_deps_max_len = local_deps_max_len;
+  ws->deps_fact_max_len  = deps_fact_max_len;
+  ws->local_deps       = malloc(local_deps_max_len * sizeof(*ws->local_deps));
+  ws->local_deps_copy  = malloc(local_deps_max_len * sizeof(*ws->local_deps_copy));
+  ws->gauss_rands      = malloc(local_deps_max_len * sizeof(*ws->gauss_rands));
+  ws->gauss_rands_copy = malloc(local_deps_max_len * sizeof(*ws->gauss_rands_copy));
+  ws->local_deps_to_mult_map_fact =
+    malloc((local_deps_max_len + 1) * sizeof(*ws->local_deps_to_mult_map_fact));
+  ws->deps_fact        = malloc((deps_fact_max_len + 1) * sizeof(*ws->deps_fact));
+  ws->deps_rands_fact  = malloc((deps_fact_max_len + 1) * sizeof(*ws->deps_rands_fact));
+
+  // calloc rather than malloc+memset: large workspaces are mapped
+  // lazily, and the parts that are never used cost nothing.
+  ws->bit_deps_storage = calloc(2 * local_deps_max_len + deps_fact_max_len,
+                                sizeof(*ws->bit_deps_storage));
+  BitDep* next = ws->bit_deps_storage;
+  for (int i = 0; i < local_deps_max_len; i++) ws->local_deps[i] = next++;
+  for (int i = 0; i < local_deps_max_len; i++) ws->local_deps_copy[i] = next++;
+  for (int i = 0; i < deps_fact_max_len; i++) ws->deps_fact[i] = next++;
+  return ws;
+}
+
+// Returns a workspace of the current thread with room for at least
+// |local_deps_max_len| dependencies in |local_deps| (and
+// |local_deps_copy|), and |deps_fact_max_len| in |deps_fact|. It must
+// be given back with release_verify_workspace.
+static struct verify_workspace* acquire_verify_workspace(int local_deps_max_len,
+                                                         int deps_fact_max_len) {
+  pthread_once(&verify_workspace_key_once, make_verify_workspace_key);
+  struct verify_workspace_stack* stack = pthread_getspecific(verify_workspace_key);
+  if (!stack) {
+    stack = calloc(1, sizeof(*stack));
+    pthread_setspecific(verify_workspace_key, stack);
+  }
+  if (stack->depth == stack->length) {
+    stack->length++;
+    stack->workspaces = realloc(stack->workspaces, stack->length * sizeof(*stack->workspaces));
+    stack->workspaces[stack->depth] = NULL;
+  }
+
+  struct verify_workspace* ws = stack->workspaces[stack->depth];
+  if (!ws || ws->local_deps_max_len < local_deps_max_len ||
+      ws->deps_fact_max_len < deps_fact_max_len) {
+    if (ws) {
+      local_deps_max_len = max(local_deps_max_len, ws->local_deps_max_len);
+      deps_fact_max_len  = max(deps_fact_max_len, ws->deps_fact_max_len);
+      free_verify_workspace(ws);
+    }
+    ws = make_verify_workspace(local_deps_max_len, deps_fact_max_len);
+    stack->workspaces[stack->depth] = ws;
+  }
+  stack->depth++;
+  return ws;
+}
+
+static void release_verify_workspace() {
+  struct verify_workspace_stack* stack = pthread_getspecific(verify_workspace_key);
+  stack->depth--;
+}
+
+// Computes the maximal number of dependencies that the Gaussian
+// eliminations of _verify_tuples can produce for a tuple of
+// |comb_len| variables among the first |last_var| ones of |c|:
+//
+//   - each variable has up to |max_var_deps| dependencies;
+//
+//   - each dependency can be expanded with the dependencies of the
+//     correction outputs it contains (see
+//     replace_correction_outputs_in_dep), which can themselves
+//     contain (previous) correction outputs. |expansion[i]| is the
+//     number of dependencies that the i-th correction output expands
+//     to, and a single dependency expands to at most the sum of all
+//     of them;
+//
+//   - when factorizing multiplications, each dependency produces at
+//     most one dependency per input share, random, correction output
+//     and constant term (see factorize_mults), each of which can be
+//     expanded as above.
+static void get_verify_workspace_size(const Circuit* c, int comb_len, int last_var,
+                                      int* local_deps_max_len, int* deps_fact_max_len) {
+  DependencyList* deps = c->deps;
+  CorrectionOutputs* correction_outputs = deps->correction_outputs;
+  int corr_outputs_count = correction_outputs->length;
+
+  int max_var_deps = 1;
+  for (int var = 0; var < last_var; var++) {
+    max_var_deps = max(max_var_deps, deps->bit_deps[var]->length);
+  }
+
+  int64_t total_expansion = 0;
+  if (corr_outputs_count) {
+    int64_t expansion[corr_outputs_count];
+    for (int i = 0; i < corr_outputs_count; i++) {
+      BitDepVector* bit_dep_arr = correction_outputs->correction_outputs_deps_bits[i];
+      expansion[i] = 0;
+      for (int j = 0; j < bit_dep_arr->length; j++) {
+        expansion[i]++;
+        for (int k = 0; k < i; k++) {
+          if ((bit_dep_arr->content[j]->correction_outputs[k/64] >> (k%64)) & 1) {
+            expansion[i] += expansion[k];
+          }
+        }
+      }
+      total_expansion += expansion[i];
+    }
+  }
+
+  int64_t local_len = (int64_t)comb_len * max_var_deps * (1 + total_expansion);
+  int64_t fact_len = 0;
+  if (c->contains_mults && c->has_input_rands) {
+    int inputs_real_count = c->secret_count * c->share_count;
+    if (c->faults_on_inputs) {
+      inputs_real_count += c->secret_count * c->share_count * c->nb_duplications;
+    }
+    int factorized_deps_length = inputs_real_count + c->random_count + corr_outputs_count + 2;
+    fact_len = local_len * factorized_deps_length * (1 + total_expansion);
+  }
+  if (local_len > INT32_MAX || fact_len > INT32_MAX) local_deps_overflow();
+  *local_deps_max_len = local_len;
+  *deps_fact_max_len  = fact_len;
+}
+
+// Adds the dependencies |bit_dep_arr| of a variable to |local_deps|
+// (whose length is |*local_deps_len|), performing the Gaussian
+// elimination on the fly.
+static void add_var_to_local_deps(const Circuit* circuit, const BitDepKernels* kernels,
+                                  BitDepVector* bit_dep_arr,
+                                  BitDep** local_deps, GaussRand* gauss_rands,
+                                  int* local_deps_len, int local_deps_max_len) {
+  CorrectionOutputs* correction_outputs = circuit->deps->correction_outputs;
+  for (int dep_idx = 0; dep_idx < bit_dep_arr->length; dep_idx++) {
+    if (*local_deps_len >= local_deps_max_len) local_deps_overflow();
+    kernels->gauss_step(kernels, circuit, bit_dep_arr->content[dep_idx], local_deps, gauss_rands,
+                        *local_deps_len);
+    kernels->set_gauss_rand(kernels, local_deps, gauss_rands, *local_deps_len, correction_outputs);
+    (*local_deps_len)++;
+    replace_correction_outputs_in_dep(circuit, kernels, local_deps, *local_deps_len - 1, gauss_rands,
+                                      local_deps_len, local_deps_max_len, correction_outputs);
+  }
+}
+
+// Checks if the tuple |local_deps| (after Gaussian elimination) is a
+// failure, in the cases where no factorization is needed: linear
+// gadgets, and multiplications without input randoms. Sets
+// |leaky_inputs| and |secret_deps| like set_contained_shares.
+static int is_failure_without_factorization(const Circuit* circuit,
+                                            const BitDepKernels* kernels,
+                                            BitDep** local_deps, GaussRand* gauss_rands,
+                                            int local_deps_len, int t_in,
+                                            int comb_free_space, Dependency shares_to_ignore,
+                                            bool PINI, SecretDep* leaky_inputs,
+                                            Dependency* secret_deps) {
+  DependencyList* deps = circuit->deps;
+  int bit_mult_len = kernels->bit_mult_len;
+
+  if (! circuit->contains_mults) {
+    return kernels->set_contained_shares(circuit, leaky_inputs, secret_deps, local_deps, gauss_rands,
+                                         local_deps_len, circuit->secret_count, t_in,
+                                         comb_free_space, shares_to_ignore, PINI);
+  }
+
+  // Special case for multiplications without input randoms: no
+  // factorization is required, nor any Gaussian elimination on
+  // input randoms.
+  Dependency secret_share_0 = 0, secret_share_1 = 0;
+  uint64_t all_mults[BITMULT_MAX_LEN] = { 0 };
+  for (int i = 0; i < local_deps_len; i++) {
+    if (! gauss_rands[i].is_set) {
+      secret_share_0 |= local_deps[i]->secrets[0];
+      secret_share_1 |= local_deps[i]->secrets[1];
+      if(circuit->faults_on_inputs){
+        for(int j=0; j<circuit->share_count;j++){
+          if(local_deps[i]->duplicate_secrets[j]){
+            secret_share_0 |= (1ULL << j);
+          }
+          if(local_deps[i]->duplicate_secrets[circuit->share_count + j]){
+            secret_share_1 |= (1ULL << j);
+          }
+        }
+      }
+      for (int j = 0; j < bit_mult_len; j++) {
+        all_mults[j] |= local_deps[i]->mults[j];
+      }
+    }
+  }
+  for (int i = 0; i < bit_mult_len; i++) {
+    uint64_t mult_elem = all_mults[i];
+    while (mult_elem != 0) {
+      int mult_idx_in_elem = __builtin_ia32_lzcnt_u64(mult_elem);
+      mult_elem &= ~(1ULL << (63-mult_idx_in_elem));
+      int mult_idx = i * 64 + (63-mult_idx_in_elem);
+      //printf("--- %d\n\n", mult_idx);
+      Dependency* this_secret_shares = deps->mult_deps->deps[mult_idx]->contained_secrets; //dim_red_data->old_circuit->deps->mult_deps->deps[mult_idx]->contained_secrets;
+      secret_share_0 |= this_secret_shares[0];
+      secret_share_1 |= this_secret_shares[1];
+    }
+  }
+  if (PINI) {
+    secret_share_0 |= secret_share_1;
+  }
+  secret_deps[0] = secret_share_0;
+  secret_deps[1] = secret_share_1;
+  leaky_inputs[0] = Is_leaky(secret_share_0, t_in, 0);
+  leaky_inputs[1] = Is_leaky(secret_share_1, t_in, 0);
+  return Is_leaky(secret_share_0, t_in, comb_free_space) ||
+    Is_leaky(secret_share_1, t_in, comb_free_space);
+}
+
+
+// Bitsliced evaluation of the last position of the tuples.
+//
+// Consecutive tuples (in lexicographic order) only differ by their
+// last element, and thus share the Gaussian elimination of their
+// prefix (ie, all elements but the last one). In the cases where no
+// factorization is needed (see is_failure_without_factorization),
+// the verdict for a tuple whose last element is fully masked by the
+// randoms of the prefix (ie, whose dependency still contains a
+// random after elimination) is the verdict of the prefix alone. The
+// last position sweep thus:
+//
+//   - stores the randoms of the variables as bit planes: for each
+//     block of 64 consecutive variables and each random |r|, a word
+//     whose j-th bit is set if the j-th variable of the block
+//     contains |r|.
+//
+//   - eliminates the prefix from the planes of a whole block at once
+//     (one xor per random of each pivot, for the 64 variables of the
+//     block), which tells which variables of the block are masked.
+//
+//   - computes the verdict of the prefix (only once per prefix), and
+//     reuses it for all masked last elements. Only the tuples whose
+//     last element is not masked go through the regular elimination.
+//
+// Similarly, the secret shares contained in the prefix are computed
+// once per prefix, so that the initial check on the number of shares
+// of the tuple (which discards most tuples of linear gadgets) only
+// costs a single "or" per tuple.
+//
+// The sweep is used only when each variable has a single dependency,
+// and when there are no correction outputs (since those affect the
+// choice of the pivots).
+struct last_position_sweep {
+  bool enabled;
+  int plane_count;       // Number of planes per block (1 + the highest random used)
+  uint64_t* raw_planes;  // |plane_count| planes for each block of variables
+  uint64_t* planes;      // Planes of |block| after elimination of the prefix
+  int block;             // Block for which |masked| was computed (-1 if none)
+  uint64_t masked;       // Masked variables of |block| (given the current prefix)
+  int prefix_verdict;    // Verdict of the prefix (-1 if not computed yet)
+  SecretDep prefix_leaky_inputs[2];
+  Dependency prefix_secret_deps[2];
+  Dependency prefix_contained_secrets[2]; // Secret shares contained in the prefix
+};
+
+// |extra_vars| (of length |extra_var_count|) are variables that are
+// not part of the planes, but whose randoms can appear in the rows
+// eliminated from the planes.
+static void init_last_position_sweep(struct last_position_sweep* sweep,
+                                     const Circuit* circuit, const BitDepKernels* kernels,
+                                     int last_var, const Var* extra_vars, int extra_var_count,
+                                     bool enabled) {
+  BitDepVector** bit_deps = circuit->deps->bit_deps;
+  sweep->enabled = false;
+  sweep->raw_planes = sweep->planes = NULL;
+  sweep->block = -1;
+  sweep->prefix_verdict = -1;
+  sweep->prefix_contained_secrets[0] = sweep->prefix_contained_secrets[1] = 0;
+  if (!enabled || kernels->bit_correction_outputs_len != 0) return;
+
+  int plane_count = 0;
+  for (int i = 0; i < last_var + extra_var_count; i++) {
+    int var = i < last_var ? i : extra_vars[i - last_var];
+    if (bit_deps[var]->length != 1) return;
+    const uint64_t* randoms = bit_deps[var]->content[0]->randoms;
+    for (int w = kernels->bit_rand_len-1; w >= 0; w--) {
+      if (randoms[w]) {
+        plane_count = max(plane_count, w * 64 + 64 - (int)__builtin_ia32_lzcnt_u64(randoms[w]));
+        break;
+      }
+    }
+  }
+
+  int block_count = (last_var + 63) / 64;
+  sweep->enabled = true;
+  sweep->plane_count = plane_count;
+  sweep->raw_planes = calloc(block_count * plane_count + 1, sizeof(*sweep->raw_planes));
+  sweep->planes = malloc((plane_count + 1) * sizeof(*sweep->planes));
+  for (int var = 0; var < last_var; var++) {
+    const uint64_t* randoms = bit_deps[var]->content[0]->randoms;
+    uint64_t* block_planes = &sweep->raw_planes[(var / 64) * plane_count];
+    for (int w = 0; w < kernels->bit_rand_len; w++) {
+      uint64_t rand_elem = randoms[w];
+      while (rand_elem != 0) {
+        int r = __builtin_ctzll(rand_elem);
+        rand_elem &= rand_elem - 1;
+        block_planes[w * 64 + r] |= 1ULL << (var % 64);
+      }
+    }
+  }
+}
+
+static void free_last_position_sweep(struct last_position_sweep* sweep) {
+  free(sweep->raw_planes);
+  free(sweep->planes);
+}
+
+// Same elimination as gauss_step, for the 64 variables of a block
+// at once: eliminates the |row_count| rows |rows| from |planes|.
+static void eliminate_from_planes(const BitDepKernels* kernels, uint64_t* planes,
+                                  BitDep** rows, const GaussRand* gauss_rands,
+                                  int row_count) {
+  for (int i = 0; i < row_count; i++) {
+    if (!gauss_rands[i].is_set) continue;
+    int pivot = gauss_rands[i].idx * 64 + __builtin_ctzll(gauss_rands[i].mask);
+    uint64_t hit = planes[pivot];
+    if (!hit) continue;
+    for (int w = 0; w < kernels->bit_rand_len; w++) {
+      uint64_t rand_elem = rows[i]->randoms[w];
+      while (rand_elem != 0) {
+        int r = __builtin_ctzll(rand_elem);
+        rand_elem &= rand_elem - 1;
+        planes[w * 64 + r] ^= hit;
+      }
+    }
+  }
+}
+
+// Returns true if the dependency of |var| is masked after
+// elimination of the prefix |local_deps| (of length |prefix_len|).
+static bool last_position_is_masked(struct last_position_sweep* sweep,
+                                    const BitDepKernels* kernels, int var,
+                                    BitDep** local_deps, GaussRand* gauss_rands,
+                                    int prefix_len) {
+  int block = var / 64;
+  if (block != sweep->block) {
+    int plane_count = sweep->plane_count;
+    uint64_t* planes = sweep->planes;
+    memcpy(planes, &sweep->raw_planes[block * plane_count], plane_count * sizeof(*planes));
+    eliminate_from_planes(kernels, planes, local_deps, gauss_rands, prefix_len);
+
+    uint64_t masked = 0;
+    for (int r = 0; r < plane_count; r++) masked |= planes[r];
+    sweep->masked = masked;
+    sweep->block  = block;
+  }
+  return (sweep->masked >> (var % 64)) & 1;
+}
+
+// Bounds on the number of secret shares that the end of a tuple can
+// add to its beginning, to skip whole ranges of tuples at once.
+//
+// The tuples that follow the current tuple and share its first |i|
+// elements take their elements |i| to |comb_len|-1 among the
+// variables |curr_comb[i]| to |last_var|-1. They thus can't contain
+// more shares (of each input) than:
+//
+//   - the shares of their first |i| elements, plus all the shares
+//     contained in those variables (|suffix_secrets|).
+//
+//   - the shares of their first |i| elements, plus the sum of the
+//     numbers of shares of the |comb_len|-|i| of those variables that
+//     contain the most shares (|best_shares|).
+//
+// When this is not enough for a failure (with the same test as the
+// initial check of _verify_tuples on the number of shares), all of
+// those tuples are skipped, and the enumeration resumes by
+// incrementing the |i|-1-th element. Since these bounds can only
+// decrease when |curr_comb[i]| increases, the first value of
+// |curr_comb[i]| from which the tuples are skipped (|cutoffs[i]|) is
+// computed (by dichotomy) only when the first |i| elements change:
+// in the common case where only the last element changes, checking
+// a tuple costs a single comparison.
+struct share_bounds {
+  bool enabled;
+  bool PINI;
+  int last_var;
+  int max_count;                   // Maximal number of elements to add (= comb_len)
+  Dependency shares_to_ignore;
+  Dependency (*suffix_secrets)[2]; // Shares of the variables |v| to |last_var|-1
+  int* best_shares;                // [(v * (max_count+1) + count) * 2 + input]
+  Dependency (*prefix_secrets)[2]; // Shares of the first |i| elements of the tuple
+  int* cutoffs;                    // First hopeless value of each element
+};
+
+// Returns the shares of |var| that are counted by count_shares (for
+// PINI, the shares of both inputs are merged into the first one).
+static inline void counted_shares(const Circuit* circuit, Dependency shares_to_ignore,
+                                  bool PINI, int var, Dependency* shares) {
+  Dependency* contained_secrets = circuit->deps->contained_secrets[var];
+  if (PINI) {
+    shares[0] = (contained_secrets[0] | contained_secrets[1]) & ~shares_to_ignore;
+    shares[1] = 0;
+  } else {
+    shares[0] = contained_secrets[0] & ~shares_to_ignore;
+    shares[1] = circuit->secret_count == 2 ? contained_secrets[1] & ~shares_to_ignore : 0;
+  }
+}
+
+static void init_share_bounds(struct share_bounds* bounds, const Circuit* circuit,
+                              int last_var, int comb_len, Dependency shares_to_ignore,
+                              bool PINI, bool enabled) {
+  bounds->enabled = enabled && comb_len > 0;
+  bounds->PINI = PINI;
+  bounds->last_var = last_var;
+  bounds->max_count = comb_len;
+  bounds->shares_to_ignore = shares_to_ignore;
+  bounds->suffix_secrets = NULL;
+  bounds->best_shares = NULL;
+  bounds->prefix_secrets = NULL;
+  bounds->cutoffs = NULL;
+  if (!bounds->enabled) return;
+
+  bounds->suffix_secrets = malloc((last_var+1) * sizeof(*bounds->suffix_secrets));
+  bounds->best_shares = malloc((last_var+1) * (comb_len+1) * 2 * sizeof(*bounds->best_shares));
+  bounds->prefix_secrets = malloc((comb_len+1) * sizeof(*bounds->prefix_secrets));
+  bounds->cutoffs = malloc(comb_len * sizeof(*bounds->cutoffs));
+
+  // Going from the last variable to the first one, while maintaining
+  // the (sorted) numbers of shares of the |comb_len| variables with
+  // the most shares.
+  int top[2][comb_len];
+  int top_len = 0;
+  bounds->suffix_secrets[last_var][0] = bounds->suffix_secrets[last_var][1] = 0;
+  for (int v = last_var; v >= 0; v--) {
+    if (v < last_var) {
+      Dependency shares[2];
+      counted_shares(circuit, shares_to_ignore, PINI, v, shares);
+      for (int k = 0; k < 2; k++) {
+        bounds->suffix_secrets[v][k] = bounds->suffix_secrets[v+1][k] | shares[k];
+        int count = hamming_weight(shares[k]);
+        int j = top_len < comb_len ? top_len : comb_len - 1;
+        if (top_len < comb_len || count > top[k][j]) {
+          while (j > 0 && top[k][j-1] < count) {
+            top[k][j] = top[k][j-1];
+            j--;
+          }
+          top[k][j] = count;
+        }
+      }
+      if (top_len < comb_len) top_len++;
+    }
+    int* best = &bounds->best_shares[v * (comb_len+1) * 2];
+    best[0] = best[1] = 0;
+    for (int count = 1; count <= comb_len; count++) {
+      for (int k = 0; k < 2; k++) {
+        best[count*2+k] = best[(count-1)*2+k] + (count <= top_len ? top[k][count-1] : 0);
+      }
+    }
+  }
+}
+
+static void free_share_bounds(struct share_bounds* bounds) {
+  free(bounds->suffix_secrets);
+  free(bounds->best_shares);
+  free(bounds->prefix_secrets);
+  free(bounds->cutoffs);
+}
+
+// Returns an upper bound on the number of shares (as computed by
+// count_shares) of the tuples made of |prefix_secrets| and of |count|
+// variables among |first_var| to |last_var|-1.
+static inline int share_bound(const struct share_bounds* bounds,
+                              const Dependency* prefix_secrets, int first_var, int count) {
+  const int* best = &bounds->best_shares[(first_var * (bounds->max_count+1) + count) * 2];
+  int bound = 0;
+  for (int k = 0; k < 2; k++) {
+    int with_all = hamming_weight(prefix_secrets[k] | bounds->suffix_secrets[first_var][k]);
+    int with_best = hamming_weight(prefix_secrets[k]) + best[k];
+    int bound_k = with_all < with_best ? with_all : with_best;
+    if (bound_k > bound) bound = bound_k;
+  }
+  return bound;
+}
+
+// Returns the smallest value (at least |min_var|) of the |i|-th
+// element of the tuples from which they can't be failures, given
+// their first |i| elements (|last_var| if there is none).
+static int share_bounds_cutoff(const struct share_bounds* bounds, int i, int comb_len,
+                               int min_var, int t_in, int comb_free_space) {
+  const Dependency* prefix_secrets = bounds->prefix_secrets[i];
+  int count = comb_len - i;
+  int lo = min_var, hi = bounds->last_var;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (share_bound(bounds, prefix_secrets, mid, count) + comb_free_space <= t_in) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+// Advances |curr_comb| to the first tuple (starting from |curr_comb|
+// itself) whose elements can still contain enough shares to be a
+// failure. |first_changed| is the index of the first element of
+// |curr_comb| that changed since the last call (the elements before
+// are assumed to be unchanged). Returns the index of the first
+// element that changed since the last call (which can thus be lower
+// than |first_changed|), or -1 if there are no tuples left. The
+// number of tuples skipped is added to |skipped|.
+static int skip_hopeless_tuples(struct share_bounds* bounds, const Circuit* circuit,
+                                Comb* curr_comb, int comb_len, VarVector* prefix,
+                                int t_in, int comb_free_space, int first_changed,
+                                uint64_t* skipped) {
+  int last_var = bounds->last_var;
+  int prefix_len = prefix->length;
+  Dependency (*prefix_secrets)[2] = bounds->prefix_secrets;
+  int* cutoffs = bounds->cutoffs;
+  if (first_changed == 0) {
+    prefix_secrets[0][0] = prefix_secrets[0][1] = 0;
+    if (prefix_len == 0) {
+      cutoffs[0] = share_bounds_cutoff(bounds, 0, comb_len, 0, t_in, comb_free_space);
+    }
+  }
+  for (int i = first_changed; i < comb_len; i++) {
+    if (i >= prefix_len && curr_comb[i] >= cutoffs[i]) {
+      // Skipping all the tuples that start with the first |i|
+      // elements of |curr_comb|, from |curr_comb| itself to the last
+      // one. The elements after |i| are not necessarily the smallest
+      // ones (e.g., when a chunk of _verify_tuples_parallel starts in
+      // the middle of this subtree): for each |j| >= |i|, this counts
+      // the tuples that start with the first |j| elements of
+      // |curr_comb| and whose |j|-th element is larger than
+      // |curr_comb[j]|.
+      *skipped += 1;
+      for (int j = i; j < comb_len; j++) {
+        *skipped += n_choose_k(comb_len - j, last_var - curr_comb[j] - 1);
+      }
+      for (int j = i; j < comb_len; j++) {
+        curr_comb[j] = last_var - (comb_len - j);
+      }
+      int changed = next_comb(curr_comb, comb_len - prefix_len, last_var, prefix);
+      if (changed < 0) return -1;
+      first_changed = min(first_changed, changed);
+      i = changed - 1;
+      continue;
+    }
+    if (i == comb_len - 1) break;
+    Dependency shares[2];
+    counted_shares(circuit, bounds->shares_to_ignore, bounds->PINI, curr_comb[i], shares);
+    prefix_secrets[i+1][0] = prefix_secrets[i][0] | shares[0];
+    prefix_secrets[i+1][1] = prefix_secrets[i][1] | shares[1];
+    // The first element after |prefix| does not have to be larger
+    // than the elements of |prefix|.
+    if (i+1 >= prefix_len) {
+      cutoffs[i+1] = share_bounds_cutoff(bounds, i+1, comb_len,
+                                         i+1 == prefix_len ? 0 : curr_comb[i]+1,
+                                         t_in, comb_free_space);
+    }
+  }
+  return first_changed;
+}
+
+// When searching for the first failure on multiple threads, all
+// threads share |lowest_failure_rank|, the rank of the lowest failure
+// found so far (UINT64_MAX if none). A thread gives up as soon as it
+// only has tuples with higher ranks left to verify.
+struct cancel_token {
+  uint64_t first_rank; // Rank of the first tuple verified by this thread
+  uint64_t* lowest_failure_rank; // Shared between all threads
+};
+
+// Records that the tuple of rank |rank| is a failure.
+static void cancel_token_set_failure(struct cancel_token* cancel, uint64_t rank) {
+  uint64_t lowest = __atomic_load_n(cancel->lowest_failure_rank, __ATOMIC_RELAXED);
+  while (rank < lowest &&
+         !__atomic_compare_exchange_n(cancel->lowest_failure_rank, &lowest, rank,
+                                      true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static bool cancel_token_is_set(const struct cancel_token* cancel, uint64_t rank) {
+  return rank > __atomic_load_n(cancel->lowest_failure_rank, __ATOMIC_RELAXED);
+}
+
 // verify_tuples is our generic verification function. Depending on
 // its parameters, it can:
 //
@@ -1100,42 +1753,46 @@ Comb* init_comb(Comb* first_comb, int sub_comb_len, VarVector* prefix, int max_c
 //      dependencies on each inputs are factorized, after which a new
 //      gauss elimination is done on each.
 //
-int _verify_tuples(const Circuit* circuit, // The circuit
-                   int t_in, // The number of shares that must be
-                             // leaked for a tuple to be a failure
-                   VarVector* prefix, // Prefix to add to all the tuples
-                   int comb_len, // The length of the tuples (includes prefix->length)
-                   int max_len, // Maximum length allowed
-                   const DimRedData* dim_red_data, // Data to generate the actual tuples
-                                                   // after the dimension reduction
-                   bool has_random, // Should be false if randoms have been removed
-                   Comb* first_tuple, // The first tuple
-                   uint64_t tuple_count, // How many tuples to consider (-1 to consider all)
-                   bool include_outputs, // If true, include outputs in the tuples
-                   Dependency shares_to_ignore, // Shares that do not count in failures
-                                                // (used only for PINI)
-                   bool PINI, // If true, we are checking PINI
-                   bool stop_at_first_failure, // If true, stops after the first failure
-                   bool only_one_tuple, // If true, stops after checking a single tuple
-                   SecretDep* secret_deps_out, // The secret deps to set as output
-                   Trie* incompr_tuples, // The trie of incompressible tuples
-                                         // (set to NULL to disable this optim)
-                   void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
-                   //    ^^^^^^^^^^^^^^^^
-                   // The function to call when a failure is found
-                   void* data // additional data to pass to |failure_callback|
-                   ) {
+// If |cancel| is not NULL, then the tuples are part of a parallel
+// search for the first failure (see _verify_tuples_parallel): the
+// rank of the failure found (if any) is recorded in |cancel|, and the
+// verification stops early when another thread already found a
+// failure with a lower rank.
+static int _verify_tuples_cancellable(const Circuit* circuit, // The circuit
+                              int t_in, // The number of shares that must be
+                                        // leaked for a tuple to be a failure
+                              VarVector* prefix, // Prefix to add to all the tuples
+                              int comb_len, // The length of the tuples (includes prefix->length)
+                              int max_len, // Maximum length allowed
+                              const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                              // after the dimension reduction
+                              bool has_random, // Should be false if randoms have been removed
+                              Comb* first_tuple, // The first tuple
+                              uint64_t tuple_count, // How many tuples to consider (-1 to consider all)
+                              bool include_outputs, // If true, include outputs in the tuples
+                              Dependency shares_to_ignore, // Shares that do not count in failures
+                                                           // (used only for PINI)
+                              bool PINI, // If true, we are checking PINI
+                              bool stop_at_first_failure, // If true, stops after the first failure
+                              bool only_one_tuple, // If true, stops after checking a single tuple
+                              SecretDep* secret_deps_out, // The secret deps to set as output
+                              SubsetIndex* incompr_tuples, // The index of incompressible tuples
+                                                    // (set to NULL to disable this optim)
+                              void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
+                              //    ^^^^^^^^^^^^^^^^
+                              // The function to call when a failure is found
+                              void* data, // additional data to pass to |failure_callback|
+                              struct cancel_token* cancel // Shared state of the threads of
+                                                          // find_first_failure (or NULL)
+                              ) {
 
   DependencyList* deps    = circuit->deps;
   int secret_count        = circuit->secret_count;
-  int random_count        = circuit->random_count;
-  int mult_count          = deps->mult_deps->length;
   int contains_mults      = circuit->contains_mults;
-  int corr_outputs_count = deps->correction_outputs->length;
 
-  int bit_rand_len = 1 + (random_count / 64);
-  int bit_mult_len = (mult_count == 0) ? 0 :  1 + mult_count / 64;
-  int bit_correction_outputs_len = (corr_outputs_count == 0) ? 0 : 1 + corr_outputs_count / 64;
+  // Specialized versions of gauss_step & co for the shape of |circuit|
+  BitDepKernels kernels;
+  init_bitdep_kernels(&kernels, circuit);
 
 
   prefix = prefix ? prefix : &empty_VarVector;
@@ -1159,30 +1816,6 @@ int _verify_tuples(const Circuit* circuit, // The circuit
   /* printf("max_len = %d -- comb_len = %d ==> comb_free_space = %d\n", */
   /*        max_len, comb_len, comb_free_space); */
 
-  // Local dependencies
-  int local_deps_max_size = deps->length * 10; // sounds reasonable?
-  BitDep* local_deps[local_deps_max_size];
-  BitDep* local_deps_copy[local_deps_max_size];
-  for (int i = 0; i < local_deps_max_size; i++) {
-    local_deps[i] = alloca(sizeof(**local_deps));
-    set_bit_dep_zero(local_deps[i]);
-
-    local_deps_copy[i] = alloca(sizeof(**local_deps_copy));
-    set_bit_dep_zero(local_deps_copy[i]);
-  }
-  GaussRand gauss_rands[local_deps_max_size];
-  GaussRand gauss_rands_copy[local_deps_max_size];
-  
-  // Used when factorizing multiplications
-  BitDep* deps_fact[local_deps_max_size];
-  for (int i = 0; i < local_deps_max_size; i++) {
-    deps_fact[i] = alloca(sizeof(**deps_fact));
-    set_bit_dep_zero(deps_fact[i]);
-  }
-  int deps_length_fact = 0;
-  GaussRand deps_rands_fact[local_deps_max_size];
-
-
   SecretDep leaky_inputs[2] = { 0 }; // We could use |secret_count| instead of 2. However,
                                      // using 2 by default makes the code a bit simpler
                                      // (no need to add "if (secret_count == 2)" everywhere)
@@ -1216,13 +1849,61 @@ int _verify_tuples(const Circuit* circuit, // The circuit
   tuple_to_local_deps_map[0] = 0;
   int local_deps_len = 0;
 
+  // Local dependencies (see struct verify_workspace)
+  int local_deps_max_len, deps_fact_max_len;
+  get_verify_workspace_size(circuit, comb_len, last_var,
+                            &local_deps_max_len, &deps_fact_max_len);
+  struct verify_workspace* ws = acquire_verify_workspace(local_deps_max_len, deps_fact_max_len);
+  BitDep** local_deps            = ws->local_deps;
+  BitDep** local_deps_copy       = ws->local_deps_copy;
+  GaussRand* gauss_rands         = ws->gauss_rands;
+  GaussRand* gauss_rands_copy    = ws->gauss_rands_copy;
+
+  // Used when factorizing multiplications
+  BitDep** deps_fact             = ws->deps_fact;
+  GaussRand* deps_rands_fact     = ws->deps_rands_fact;
+  int deps_length_fact = 0;
+
   int first_invalid_mult_index_fact = 0;
-  int local_deps_to_mult_map_fact[local_deps_max_size];
+  int* local_deps_to_mult_map_fact = ws->local_deps_to_mult_map_fact;
   local_deps_to_mult_map_fact[0] = 0;
 
+  // Since the bitsliced sweep reuses the verdict of the prefix, it
+  // can't be used when randoms were removed. (Tuples skipped thanks
+  // to |incompr_tuples| leave |first_invalid_local_deps_index| as is,
+  // which resets the sweep if their prefix differs from the next one)
+  struct last_position_sweep sweep;
+  init_last_position_sweep(&sweep, circuit, &kernels, last_var, NULL, 0,
+                           has_random && !only_one_tuple &&
+                           sub_comb_len >= 1 &&
+                           (!contains_mults || !circuit->has_input_rands));
+
+  struct share_bounds bounds;
+  init_share_bounds(&bounds, circuit, last_var, comb_len, shares_to_ignore, PINI,
+                    !only_one_tuple && sub_comb_len >= 1 && sub_comb_len <= last_var);
+
   Comb* curr_comb = init_comb(first_tuple, sub_comb_len, prefix, max_len);
   do {
+    bool known_failure = false; // True if |curr_comb| contains a tuple of |incompr_tuples|
+    if (bounds.enabled) {
+      uint64_t skipped = 0;
+      int changed = skip_hopeless_tuples(&bounds, circuit, curr_comb, comb_len, prefix,
+                                         t_in, comb_free_space,
+                                         new_first_invalid_local_deps_index, &skipped);
+      if (skipped) {
+        // The skipped tuples count as checked (for |tuple_count| and
+        // for the ranks of |cancel|).
+        if (changed < 0 || (tuple_count != -1ULL && skipped >= tuple_count)) break;
+        if (tuple_count != -1ULL) tuple_count -= skipped;
+        tuples_checked += skipped;
+        new_first_invalid_local_deps_index = changed;
+      }
+    }
     tuples_checked++;
+    if (cancel && (tuples_checked % CANCEL_CHECK_PERIOD) == 0 &&
+        cancel_token_is_set(cancel, cancel->first_rank + tuples_checked - 1)) {
+      break;
+    }
     first_invalid_local_deps_index = min(new_first_invalid_local_deps_index,
                                          first_invalid_local_deps_index);
 
@@ -1230,8 +1911,24 @@ int _verify_tuples(const Circuit* circuit, // The circuit
     /* for (int i = 0; i < comb_len; i++) printf("%d ", curr_comb[i]); */
     /* printf("]  -- first_invalid_local_deps_index = %d\n", first_invalid_local_deps_index); */
 
-    int number_of_shares = get_number_of_shares(circuit, curr_comb, comb_len,
-                                                shares_to_ignore, PINI);
+    int number_of_shares;
+    if (sweep.enabled) {
+      if (new_first_invalid_local_deps_index < comb_len - 1) {
+        sweep.prefix_contained_secrets[0] = sweep.prefix_contained_secrets[1] = 0;
+        for (int i = 0; i < comb_len - 1; i++) {
+          sweep.prefix_contained_secrets[0] |= deps->contained_secrets[curr_comb[i]][0];
+          sweep.prefix_contained_secrets[1] |= deps->contained_secrets[curr_comb[i]][1];
+        }
+      }
+      Var last = curr_comb[comb_len-1];
+      number_of_shares = count_shares(circuit,
+                                      sweep.prefix_contained_secrets[0] | deps->contained_secrets[last][0],
+                                      sweep.prefix_contained_secrets[1] | deps->contained_secrets[last][1],
+                                      shares_to_ignore, PINI);
+    } else {
+      number_of_shares = get_number_of_shares(circuit, curr_comb, comb_len,
+                                              shares_to_ignore, PINI);
+    }
     /* printf("number_of_shares+comb_len = %d + %d = %d <= %d = t_in\n", */
     /*        number_of_shares, comb_free_space, number_of_shares + comb_free_space, t_in); */
     if (number_of_shares+comb_free_space <= t_in) {
@@ -1241,15 +1938,21 @@ int _verify_tuples(const Circuit* circuit, // The circuit
     /* printf(" --> Enough shares\n"); */
 
     if (incompr_tuples) {
-      // TODO: this will not work if |prefix| is used, since in that
-      // case, |curr_comb| will not be sorted. Anyways, we don't use
-      // this optimization in practice, so let's not bother about that
-      // just right now.
-      SecretDep* trie_secret_deps = trie_contains_subset(incompr_tuples, curr_comb, comb_len);
-      if (trie_secret_deps) {
-        leaky_inputs[0] = trie_secret_deps[0];
-        if (secret_count == 2) leaky_inputs[1] = trie_secret_deps[1];
-        goto process_success;
+      const SecretDep* incompr_secret_deps =
+        subset_index_find_subset(incompr_tuples, curr_comb, comb_len);
+      if (incompr_secret_deps) {
+        // |curr_comb| contains a failure, and is thus a failure as
+        // well, which the elimination would only confirm. Its secret
+        // deps include those of this failure, which already contain
+        // more than |t_in| shares of the leaky inputs: using all the
+        // shares of those inputs instead gives the same result in
+        // expand_tuple_to_failure.
+        leaky_inputs[0] = incompr_secret_deps[0];
+        leaky_inputs[1] = secret_count == 2 ? incompr_secret_deps[1] : 0;
+        secret_deps[0] = leaky_inputs[0] ? circuit->all_shares_mask : 0;
+        secret_deps[1] = leaky_inputs[1] ? circuit->all_shares_mask : 0;
+        known_failure = true;
+        goto process_failure;
       }
     }
 
@@ -1261,30 +1964,52 @@ int _verify_tuples(const Circuit* circuit, // The circuit
     local_deps_len = tuple_to_local_deps_map[first_invalid_local_deps_index];
 
     // 1- Updating |local_deps| while applying a simple Gaussian elimination
-    for (int i = first_invalid_local_deps_index; i < comb_len; i++) {
+    for (int i = first_invalid_local_deps_index; i < comb_len - sweep.enabled; i++) {
       tuple_to_local_deps_map[i] = local_deps_len;
-      BitDepVector* bit_dep_arr = bit_deps[curr_comb[i]];
-      for (int dep_idx = 0; dep_idx < bit_dep_arr->length; dep_idx++) {
-        gauss_step(circuit, bit_dep_arr->content[dep_idx], local_deps, gauss_rands,
-                   bit_rand_len, bit_mult_len, bit_correction_outputs_len, local_deps_len);
-        set_gauss_rand(local_deps, gauss_rands, local_deps_len, bit_rand_len, deps->correction_outputs, bit_correction_outputs_len);
-        local_deps_len++;
-        replace_correction_outputs_in_dep(circuit, local_deps, local_deps_len - 1, gauss_rands, &local_deps_len, 
-                                               bit_correction_outputs_len, bit_rand_len,
-                                               bit_mult_len, deps->correction_outputs);
+      add_var_to_local_deps(circuit, &kernels, bit_deps[curr_comb[i]], local_deps, gauss_rands,
+                            &local_deps_len, local_deps_max_len);
+    }
+    if (sweep.enabled) {
+      // The last element is added only if it is not masked by the prefix
+      if (first_invalid_local_deps_index < comb_len - 1) {
+        sweep.block = -1;
+        sweep.prefix_verdict = -1;
+      }
+      tuple_to_local_deps_map[comb_len-1] = local_deps_len;
+      if (last_position_is_masked(&sweep, &kernels, curr_comb[comb_len-1],
+                                  local_deps, gauss_rands, local_deps_len)) {
+        first_invalid_local_deps_index = comb_len - 1;
+        if (sweep.prefix_verdict == -1) {
+          sweep.prefix_leaky_inputs[0] = sweep.prefix_leaky_inputs[1] = 0;
+          sweep.prefix_secret_deps[0] = sweep.prefix_secret_deps[1] = 0;
+          sweep.prefix_verdict =
+            is_failure_without_factorization(circuit, &kernels, local_deps, gauss_rands,
+                                             local_deps_len, t_in, comb_free_space,
+                                             shares_to_ignore, PINI,
+                                             sweep.prefix_leaky_inputs,
+                                             sweep.prefix_secret_deps);
+        }
+        leaky_inputs[0] = sweep.prefix_leaky_inputs[0];
+        leaky_inputs[1] = sweep.prefix_leaky_inputs[1];
+        secret_deps[0]  = sweep.prefix_secret_deps[0];
+        secret_deps[1]  = sweep.prefix_secret_deps[1];
+        if (sweep.prefix_verdict) goto process_failure;
+        else goto process_success;
       }
+      add_var_to_local_deps(circuit, &kernels, bit_deps[curr_comb[comb_len-1]], local_deps,
+                            gauss_rands, &local_deps_len, local_deps_max_len);
     }
     first_invalid_mult_index_fact = min(first_invalid_mult_index_fact,
                                         first_invalid_local_deps_index);
     first_invalid_local_deps_index = comb_len;
 
-    if (! contains_mults) {
-      if (set_contained_shares(circuit, leaky_inputs, secret_deps, local_deps, gauss_rands,
-                               local_deps_len, secret_count, t_in,
-                               comb_free_space, shares_to_ignore, PINI)) {
+    if (! contains_mults || !circuit->has_input_rands) {
+      if (is_failure_without_factorization(circuit, &kernels, local_deps, gauss_rands,
+                                           local_deps_len, t_in, comb_free_space,
+                                           shares_to_ignore, PINI, leaky_inputs, secret_deps)) {
         goto process_failure;
       } else if (!has_random &&
-                 is_failure_with_randoms(circuit, local_deps, gauss_rands, local_deps_copy, gauss_rands_copy,
+                 is_failure_with_randoms(circuit, &kernels, local_deps, gauss_rands, local_deps_copy, gauss_rands_copy,
                                          local_deps_len, t_in,
                                          comb_free_space, shares_to_ignore, PINI)) {
         goto process_failure;
@@ -1295,63 +2020,6 @@ int _verify_tuples(const Circuit* circuit, // The circuit
       secret_deps[0] = secret_deps[1] = 0;
       leaky_inputs[0] = leaky_inputs[1] = 0;
 
-      if (!circuit->has_input_rands) {
-        // Special case for multiplications without input randoms: no
-        // factorization is required, nor any Gaussian elimination on
-        // input randoms.
-        Dependency secret_share_0 = 0, secret_share_1 = 0;
-        uint64_t all_mults[BITMULT_MAX_LEN] = { 0 };
-        for (int i = 0; i < local_deps_len; i++) {
-          if (! gauss_rands[i].is_set) {
-            secret_share_0 |= local_deps[i]->secrets[0];
-            secret_share_1 |= local_deps[i]->secrets[1];
-            if(circuit->faults_on_inputs){
-              for(int j=0; j<circuit->share_count;j++){
-                if(local_deps[i]->duplicate_secrets[j]){
-                  secret_share_0 |= (1ULL << j);
-                }
-                if(local_deps[i]->duplicate_secrets[circuit->share_count + j]){
-                  secret_share_1 |= (1ULL << j);
-                }
-              }
-            }
-            for (int j = 0; j < bit_mult_len; j++) {
-              all_mults[j] |= local_deps[i]->mults[j];
-            }
-          }
-        }
-        for (int i = 0; i < bit_mult_len; i++) {
-          uint64_t mult_elem = all_mults[i];
-          while (mult_elem != 0) {
-            int mult_idx_in_elem = __builtin_ia32_lzcnt_u64(mult_elem);
-            mult_elem &= ~(1ULL << (63-mult_idx_in_elem));
-            int mult_idx = i * 64 + (63-mult_idx_in_elem);
-            //printf("--- %d\n\n", mult_idx);
-            Dependency* this_secret_shares = deps->mult_deps->deps[mult_idx]->contained_secrets; //dim_red_data->old_circuit->deps->mult_deps->deps[mult_idx]->contained_secrets;
-            secret_share_0 |= this_secret_shares[0];
-            secret_share_1 |= this_secret_shares[1];
-          }
-        }
-        if (PINI) {
-          secret_share_0 |= secret_share_1;
-        }
-        secret_deps[0] = secret_share_0;
-        secret_deps[1] = secret_share_1;
-        leaky_inputs[0] = Is_leaky(secret_share_0, t_in, 0);
-        leaky_inputs[1] = Is_leaky(secret_share_1, t_in, 0);
-        if (Is_leaky(secret_share_0, t_in, comb_free_space) ||
-            Is_leaky(secret_share_1, t_in, comb_free_space)) {
-          goto process_failure;
-        } else if (!has_random &&
-                   is_failure_with_randoms(circuit, local_deps, gauss_rands, local_deps_copy, gauss_rands_copy,
-                                           local_deps_len, t_in,
-                                           comb_free_space, shares_to_ignore, PINI)) {
-          goto process_failure;
-        } else {
-          goto process_success;
-        }
-      }
-
       // Factorizing tuple
 
       // for (int h = 0; h < local_deps_len; h++) {
@@ -1422,13 +2090,13 @@ int _verify_tuples(const Circuit* circuit, // The circuit
 
         // Apply Gauss on both tuples
         for (int l = up_to_date_deps_length_fact; l < deps_length_fact; l++) {
-          gauss_step(circuit, deps_fact[l], deps_fact, deps_rands_fact, bit_rand_len, bit_mult_len, bit_correction_outputs_len, l);
-          set_gauss_rand(deps_fact, deps_rands_fact, i, bit_rand_len, deps->correction_outputs, bit_correction_outputs_len);
+          kernels.gauss_step(&kernels, circuit, deps_fact[l], deps_fact, deps_rands_fact, l);
+          kernels.set_gauss_rand(&kernels, deps_fact, deps_rands_fact, l, deps->correction_outputs);
 
           //printf("%d\n",l);
-          replace_correction_outputs_in_dep(circuit, deps_fact, l, deps_rands_fact, &deps_length_fact, 
-                                                bit_correction_outputs_len, bit_rand_len,
-                                                bit_mult_len, deps->correction_outputs);
+          replace_correction_outputs_in_dep(circuit, &kernels, deps_fact, l, deps_rands_fact,
+                                            &deps_length_fact, deps_fact_max_len,
+                                            deps->correction_outputs);
 
           //printf("next\n");
         }
@@ -1484,10 +2152,10 @@ int _verify_tuples(const Circuit* circuit, // The circuit
       secret_deps[0] = secret_deps[1] = 0;
       leaky_inputs[0] = leaky_inputs[1] = 0;
 
-      int is_failure = set_contained_shares(circuit, leaky_inputs, secret_deps,
-                                        deps_fact, deps_rands_fact,
-                                        deps_length_fact, secret_count, t_in,
-                                        comb_free_space, shares_to_ignore, PINI);
+      int is_failure = kernels.set_contained_shares(circuit, leaky_inputs, secret_deps,
+                                                    deps_fact, deps_rands_fact,
+                                                    deps_length_fact, secret_count, t_in,
+                                                    comb_free_space, shares_to_ignore, PINI);
 
       if (!is_failure) goto process_success;
     }
@@ -1511,8 +2179,14 @@ int _verify_tuples(const Circuit* circuit, // The circuit
         // failure_callback(circuit, curr_comb, comb_len, leaky_inputs, data);
       }
     }
-    if (incompr_tuples) {
-      insert_in_trie(incompr_tuples, curr_comb, comb_len, leaky_inputs);
+    // Only the failures that leak by themselves (rather than thanks
+    // to the |comb_free_space| elementary shares that might be added
+    // to them) are failures whatever the variables added to them.
+    if (incompr_tuples && !known_failure && (leaky_inputs[0] || leaky_inputs[1])) {
+      subset_index_insert(incompr_tuples, curr_comb, comb_len, leaky_inputs);
+    }
+    if (cancel) {
+      cancel_token_set_failure(cancel, cancel->first_rank + tuples_checked - 1);
     }
     failure_count++;
     if (stop_at_first_failure) {
@@ -1535,98 +2209,159 @@ int _verify_tuples(const Circuit* circuit, // The circuit
   // the begining that are never used. Thus, the actual malloc'd
   // pointer is at index |curr_comb-2|.
   free(curr_comb-2);
+  free_last_position_sweep(&sweep);
+  free_share_bounds(&bounds);
+  release_verify_workspace();
 
   return failure_count;
 }
 
-
-struct verify_tuples_args {
-  const Circuit* circuit; // The circuit
-  int t_in; // The number of shares that must be
-            // leaked for a tuple to be a failure
+int _verify_tuples(const Circuit* circuit, // The circuit
+                   int t_in, // The number of shares that must be
+                             // leaked for a tuple to be a failure
+                   VarVector* prefix, // Prefix to add to all the tuples
+                   int comb_len, // The length of the tuples (includes prefix->length)
+                   int max_len, // Maximum length allowed
+                   const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                   // after the dimension reduction
+                   bool has_random, // Should be false if randoms have been removed
+                   Comb* first_tuple, // The first tuple
+                   uint64_t tuple_count, // How many tuples to consider (-1 to consider all)
+                   bool include_outputs, // If true, include outputs in the tuples
+                   Dependency shares_to_ignore, // Shares that do not count in failures
+                                                // (used only for PINI)
+                   bool PINI, // If true, we are checking PINI
+                   bool stop_at_first_failure, // If true, stops after the first failure
+                   bool only_one_tuple, // If true, stops after checking a single tuple
+                   SecretDep* secret_deps_out, // The secret deps to set as output
+                   SubsetIndex* incompr_tuples, // The index of incompressible tuples
+                                         // (set to NULL to disable this optim)
+                   void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
+                   //    ^^^^^^^^^^^^^^^^
+                   // The function to call when a failure is found
+                   void* data // additional data to pass to |failure_callback|
+                   ) {
+  return _verify_tuples_cancellable(circuit, t_in, prefix, comb_len, max_len,
+                                    dim_red_data, has_random, first_tuple, tuple_count,
+                                    include_outputs, shares_to_ignore, PINI,
+                                    stop_at_first_failure, only_one_tuple,
+                                    secret_deps_out, incompr_tuples,
+                                    failure_callback, data,
+                                    NULL); // cancel
+}
+
+
+// Each thread gets its own thread_callback_data, so that counting
+// failures never requires synchronization. If the caller provided
+// LocalDataOps, then |data| is a per-thread copy of the caller's data,
+// and |failure_callback| is called without taking any lock. Otherwise,
+// |data| is shared by all threads, and |mutex| serializes the calls to
+// |failure_callback|.
+//
+// Note that failures do not need to be deduplicated: the chunks of
+// the RankScheduler are disjoint, and a tuple can only be expanded
+// (by expand_tuple_to_failure) into failures that start with this
+// very tuple. Each failure is thus reported exactly once.
+struct thread_callback_data {
+  void* data; // The original data, or a per-thread copy of it
+  void (*failure_callback)(const Circuit*,Comb*,
+                           int, SecretDep*, void*); // The original callback function
+  pthread_mutex_t* mutex; // To avoid concurrence issues in |failure_callback|
+                          // (NULL when |data| is a per-thread copy)
+  int failure_count; // Number of failures found by this thread
+} __attribute__((aligned(64))); // Avoids false sharing of |failure_count|
+
+static void thread_failure_callback(const Circuit* circuit, Comb* comb, int comb_len,
+                                    SecretDep* secret_deps, void* data) {
+  struct thread_callback_data* thread_data = (struct thread_callback_data*) data;
+
+  thread_data->failure_count++;
+  if (thread_data->mutex) {
+    pthread_mutex_lock(thread_data->mutex);
+    thread_data->failure_callback(circuit, comb, comb_len, secret_deps, thread_data->data);
+    pthread_mutex_unlock(thread_data->mutex);
+  } else {
+    thread_data->failure_callback(circuit, comb, comb_len, secret_deps, thread_data->data);
+  }
+}
+
+struct verify_tuples_job {
+  const Circuit* circuit; // The circuit
+  int t_in; // The number of shares that must be
+            // leaked for a tuple to be a failure
   VarVector* prefix; // Prefix to add to all the tuples
   int comb_len; // The length of the tuples (includes prefix->length)
   int max_len; // Maximum length allowed
   const DimRedData* dim_red_data; // Data to generate the actual tuples
                                   // after the dimension reduction
   bool has_random; // Should be false if randoms have been removed
-  Comb* first_tuple; // The first tuple
-  uint64_t tuple_count; // How many tuples to consider (-1 to consider all)
   bool include_outputs; // If true, include outputs in the tuples
   Dependency shares_to_ignore; // Shares that do not count in failures
                                // (used only for PINI)
   bool PINI; // If true, we are checking PINI
   bool stop_at_first_failure; // If true, stops after the first failure
-  Trie* incompr_tuples; // The trie of incompressible tuples
-                        // (set to NULL to disable this optim)
-  void (*failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*);
-  //     ^^^^^^^^^^^^^^^^
-  // The function to call when a failure is found
-  void* data; // additional data to pass to |failure_callback|
-};
+  SubsetIndex* incompr_tuples; // The index of incompressible tuples
+                               // (set to NULL to disable this optim)
+  struct thread_callback_data* thread_data; // Data of each thread, passed to
+                                            // thread_failure_callback
 
-void* _verify_tuples_thread_start(void* void_args) {
-  struct verify_tuples_args* args = (struct verify_tuples_args*) void_args;
-
-  _verify_tuples(args->circuit,
-                 args->t_in,
-                 args->prefix,
-                 args->comb_len,
-                 args->max_len,
-                 args->dim_red_data,
-                 args->has_random,
-                 args->first_tuple,
-                 args->tuple_count,
-                 args->include_outputs,
-                 args->shares_to_ignore,
-                 args->PINI,
-                 args->stop_at_first_failure,
-                 false, // only_one_tuple
-                 NULL, // secret_deps
-                 args->incompr_tuples,
-                 args->failure_callback,
-                 args->data
-                 );
-  free(args);
-
-  // Note: The return value here doesn't matter, since
-  // thread_failure_callback increments a counter of failures.
-  return 0;
-}
+  uint64_t lowest_failure_rank; // When |stop_at_first_failure| is true: the rank of
+                                // the lowest failure found so far (see cancel_token)
 
-struct thread_callback_data {
-  void* data; // The original data
-  void (*failure_callback)(const Circuit*,Comb*,
-                           int, SecretDep*, void*); // The original callback function
-  Trie* seen_tuples; // Failures that have already been seen
-  pthread_mutex_t* mutex; // To avoid concurrence issues in |failure_callback|
-  int* failure_count; // Total number of failures
-  VarVector* prefix; // Prefix, to skip this part of the tuples in |seen_tuples|
+  int max_vars_in_tuples; // The |n| of "n choose k" (used to unrank chunks)
+  int real_comb_len;      // The |k| of "n choose k" (ie, without the prefix)
+  RankScheduler* sched;   // Distributes chunks of tuples to the workers
 };
 
-void thread_failure_callback(const Circuit* circuit, Comb* comb, int comb_len,
-                             SecretDep* secret_deps, void* data) {
-  struct thread_callback_data* thread_data = (struct thread_callback_data*) data;
+// Entry point of the workers of the WorkPool: verifies chunks of
+// tuples until the scheduler runs out of chunks.
+static void _verify_tuples_worker(void* void_job, int worker_id) {
+  struct verify_tuples_job* job = (struct verify_tuples_job*) void_job;
+
+  uint64_t start, count;
+  while (rank_scheduler_next(job->sched, worker_id, &start, &count)) {
+    struct cancel_token cancel = {
+      .first_rank = start,
+      .lowest_failure_rank = &job->lowest_failure_rank
+    };
+    if (job->stop_at_first_failure && cancel_token_is_set(&cancel, start)) {
+      // A failure with a lower rank than this whole chunk was already
+      // found. Chunks are not necessarily taken in ascending order
+      // (because of stealing), so the next one could still be useful.
+      continue;
+    }
 
-  Comb* comb_no_prefix = comb;
-  int comb_len_no_prefix = comb_len;
-  if (thread_data->prefix && thread_data->prefix->length) {
-    comb_no_prefix = &comb_no_prefix[thread_data->prefix->length];
-    comb_len_no_prefix -= thread_data->prefix->length;
+    // Note: ranks of combinations.c start at 1, while the ranks of
+    // the scheduler start at 0.
+    Comb* first_tuple = unrank(job->max_vars_in_tuples, job->real_comb_len, start+1);
+    _verify_tuples_cancellable(job->circuit,
+                               job->t_in,
+                               job->prefix,
+                               job->comb_len,
+                               job->max_len,
+                               job->dim_red_data,
+                               job->has_random,
+                               first_tuple,
+                               count,
+                               job->include_outputs,
+                               job->shares_to_ignore,
+                               job->PINI,
+                               job->stop_at_first_failure,
+                               false, // only_one_tuple
+                               NULL, // secret_deps
+                               job->incompr_tuples,
+                               // When looking for the first failure, the
+                               // callback is only called once all threads
+                               // are done, on the failure of lowest rank.
+                               job->stop_at_first_failure ? NULL : thread_failure_callback,
+                               &job->thread_data[worker_id],
+                               job->stop_at_first_failure ? &cancel : NULL);
+    free(first_tuple);
   }
 
-  pthread_mutex_lock(thread_data->mutex);
-
-  if (trie_contains(thread_data->seen_tuples, comb_no_prefix, comb_len_no_prefix)) {
-    pthread_mutex_unlock(thread_data->mutex);
-    return;
-  }
-
-  (*(thread_data->failure_count))++;
-  insert_in_trie(thread_data->seen_tuples, comb_no_prefix, comb_len_no_prefix, NULL);
-  thread_data->failure_callback(circuit, comb, comb_len, secret_deps, thread_data->data);
-
-  pthread_mutex_unlock(thread_data->mutex);
+  // Note: there is nothing to return here, since
+  // thread_failure_callback increments a counter of failures (and
+  // the first failure is recorded in |job->lowest_failure_rank|).
 }
 
 // A wrapper for _verify_tuples that will automatically parallelize the computation.
@@ -1648,14 +2383,20 @@ int _verify_tuples_parallel(const Circuit* circuit, // The circuit
                             bool PINI, // If true, we are checking PINI
                             bool stop_at_first_failure, // If true, stops after the first failure
                             bool only_one_tuple, // If true, stops after checking a single tuple
-                            Trie* incompr_tuples, // The trie of incompressible tuples
+                            SubsetIndex* incompr_tuples, // The index of incompressible tuples
                             // (set to NULL to disable this optim)
                             void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
                             //     ^^^^^^^^^^^^^^^^
                             // The function to call when a failure is found
-                            void* data // additional data to pass to |failure_callback|
+                            void* data, // additional data to pass to |failure_callback|
+                            const LocalDataOps* local_ops // To create per-thread copies of |data|
+                                                          // (NULL to share |data| between threads)
                             ) {
-  if (cores == 1 || first_tuple != NULL) {
+  // The empty tuple is verified on this thread: there is nothing to
+  // split, and the threads of find_first_failure run without
+  // |failure_callback|, which is the only way failures of size 0 are
+  // reported (see the |comb_len| == 0 case of _verify_tuples).
+  if (cores == 1 || first_tuple != NULL || comb_len == 0) {
     return _verify_tuples(circuit, t_in, prefix, comb_len, max_len,
                           dim_red_data, has_random, first_tuple, tuple_count,
                           include_outputs, shares_to_ignore, PINI,
@@ -1663,75 +2404,442 @@ int _verify_tuples_parallel(const Circuit* circuit, // The circuit
                           NULL, incompr_tuples, failure_callback, data);
   }
 
-  int max_in_prefix = 0;
-  if (prefix) {
-    for (int i = 0; i < prefix->length; i++) {
-      max_in_prefix = max(max_in_prefix, prefix->content[i]);
-    }
-  }
-
   if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
   int real_comb_len = comb_len - (prefix ? prefix->length : 0);
+  // Same range of variables as |last_var| in _verify_tuples: the
+  // prefix is not part of the enumerated tuples.
   int max_vars_in_tuples = include_outputs ? circuit->deps->length : circuit->length;
-  max_vars_in_tuples = max(max_in_prefix+1, max_vars_in_tuples);
-  int trie_size;
-  if (dim_red_data) {
-    trie_size = include_outputs ? dim_red_data->old_circuit->deps->length :
-      dim_red_data->old_circuit->length;
-    trie_size = max(max_vars_in_tuples, trie_size);
-  } else {
-    trie_size = max_vars_in_tuples;
-  }
   uint64_t total_tuples = n_choose_k(real_comb_len, max_vars_in_tuples);
-  uint64_t tuples_per_core = total_tuples / cores;
 
   // Initializing threads data
   pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-  Trie* seen_tuples = make_trie(trie_size);
-  int failure_count = 0;
+  struct thread_callback_data* thread_data = aligned_alloc(64, cores * sizeof(*thread_data));
+  for (int i = 0; i < cores; i++) {
+    thread_data[i].failure_callback = failure_callback;
+    thread_data[i].failure_count = 0;
+    if (local_ops) {
+      thread_data[i].data  = local_ops->make(data);
+      thread_data[i].mutex = NULL;
+    } else {
+      thread_data[i].data  = data;
+      thread_data[i].mutex = &mutex;
+    }
+  }
 
-  struct thread_callback_data thread_data = {
-    .data = data,
-    .failure_callback = failure_callback,
-    .seen_tuples = seen_tuples,
-    .mutex = &mutex,
-    .failure_count = &failure_count,
-    .prefix = prefix
+  // Chunks are small enough for the work to be balanced between
+  // threads, but large enough for the incremental Gaussian
+  // elimination of _verify_tuples to be worth it.
+  uint64_t chunk_size = total_tuples / ((uint64_t)cores * PARALLEL_CHUNKS_PER_CORE);
+  chunk_size = max(chunk_size, PARALLEL_MIN_CHUNK_SIZE);
+  RankScheduler sched;
+  init_rank_scheduler(&sched, cores, total_tuples, chunk_size);
+
+  struct verify_tuples_job job = {
+    .circuit = circuit,
+    .t_in = t_in,
+    .prefix = prefix,
+    .comb_len = comb_len,
+    .max_len = max_len,
+    .dim_red_data = dim_red_data,
+    .has_random = has_random,
+    .include_outputs = include_outputs,
+    .shares_to_ignore = shares_to_ignore,
+    .PINI = PINI,
+    .stop_at_first_failure = stop_at_first_failure,
+    .incompr_tuples = incompr_tuples,
+    .thread_data = thread_data,
+    .lowest_failure_rank = UINT64_MAX,
+    .max_vars_in_tuples = max_vars_in_tuples,
+    .real_comb_len = real_comb_len,
+    .sched = &sched
   };
 
-  pthread_t threads[cores];
+  work_pool_run(get_work_pool(cores), _verify_tuples_worker, &job);
 
-  for (int i = 0; i < cores; i++) {
-    first_tuple = unrank(max_vars_in_tuples, real_comb_len, tuples_per_core * i);
-    struct verify_tuples_args* args = malloc(sizeof(*args));
-    args->circuit = circuit;
-    args->t_in = t_in;
-    args->prefix = prefix;
-    args->comb_len = comb_len;
-    args->max_len = max_len;
-    args->dim_red_data = dim_red_data;
-    args->has_random = has_random;
-    args->first_tuple = first_tuple;
-    args->tuple_count = tuples_per_core + 1; // +1 needed to not forget any tuples
-    args->include_outputs = include_outputs;
-    args->shares_to_ignore = shares_to_ignore;
-    args->PINI = PINI;
-    args->stop_at_first_failure = stop_at_first_failure;
-    args->incompr_tuples = incompr_tuples;
-    args->failure_callback = thread_failure_callback;
-    args->data = (void*)&thread_data;
-
-    pthread_create(&threads[i], NULL, _verify_tuples_thread_start, (void*) args);
-  }
+  free_rank_scheduler(&sched);
 
+  int failure_count = 0;
   for (int i = 0; i < cores; i++) {
-    void* unused;
-    pthread_join(threads[i], &unused);
+    failure_count += thread_data[i].failure_count;
+    if (local_ops) {
+      local_ops->merge(data, thread_data[i].data);
+    }
+  }
+  free(thread_data);
+
+  if (stop_at_first_failure && job.lowest_failure_rank != UINT64_MAX) {
+    // Verifying again the failure of lowest rank, this time with the
+    // actual callback, so that the failure reported does not depend
+    // on the scheduling of the threads.
+    Comb* failure = unrank(max_vars_in_tuples, real_comb_len, job.lowest_failure_rank+1);
+    failure_count = _verify_tuples(circuit, t_in, prefix, comb_len, max_len,
+                                   dim_red_data, has_random, failure,
+                                   1, // tuple_count
+                                   include_outputs, shares_to_ignore, PINI,
+                                   stop_at_first_failure, only_one_tuple,
+                                   NULL, incompr_tuples, failure_callback, data);
+    free(failure);
   }
 
   return failure_count;
 }
 
+/**********************************************************************
+              Depth-first enumeration for monotone properties
+
+  For RP-like properties, a tuple that leaks by itself (ie, without
+  the elementary shares that expand_tuple_to_failure adds) remains a
+  failure whatever the variables added after its last one: the
+  Gaussian elimination of the extended tuple starts with the one of
+  the tuple, whose rows are never modified afterwards. Rather than
+  verifying each size separately, find_all_failures_monotone thus
+  walks the tree of tuples (each tuple being the parent of the tuples
+  that extend it with a larger variable), extending the elimination
+  of the parent by one variable at each node, and adds the
+  coefficients of the whole subtree of a tuple that leaks by itself
+  in closed form (see SubtreeSums in coeffs.h).
+
+  When the circuit has symmetries (see symmetry.h), only one tuple
+  per orbit of tuples is visited, and its coefficients are counted
+  as many times as there are tuples in its orbit: the verdict of a
+  tuple, and the elementary shares that it needs, are the same as
+  the ones of its images (up to a renaming of the shares), and the
+  images of a tuple have the same weights.
+
+************************************************************************/
+
+struct monotone_job {
+  const Circuit* circuit;
+  const DimRedData* dim_red_data;
+  int t_in;
+  int max_len;
+  int max_depth; // Maximal length of the tuples of |circuit|
+  int local_deps_max_len, deps_fact_max_len;
+  const SubtreeSums* sums;
+  int coeffs_len;
+  uint64_t** coeffs;       // One array per worker
+  WeightHistogram** hists; // One per worker
+  // Order in which the variables are enumerated: |order| maps
+  // positions to variables, and |position| variables to positions
+  // (the identity without symmetries).
+  const int* order;
+  const int* position;
+  // With symmetries (see below), |block_end| is, for each position,
+  // the end of the positions of its orbit. NULL otherwise.
+  const CircuitSymmetries* sym;
+  const int* block_end;
+  uint64_t** scratch_coeffs;       // One array per worker (with symmetries)
+  WeightHistogram** scratch_hists; // One per worker (with symmetries)
+};
+
+struct monotone_dfs {
+  const struct monotone_job* job;
+  BitDepKernels kernels;
+  BitDep** local_deps;
+  GaussRand* gauss_rands;
+  BitDep** deps_fact;
+  GaussRand* deps_rands_fact;
+  Comb* comb;
+  uint64_t* coeffs;
+  WeightHistogram* hist;
+  uint64_t* scratch_coeffs;
+  WeightHistogram* scratch_hist;
+};
+
+static void add_failure_to_hist(const Circuit* c, Comb* comb, int comb_len,
+                                SecretDep* secret_deps, void* data) {
+  (void) secret_deps;
+  weight_histogram_add((WeightHistogram*) data, c, comb, comb_len);
+}
+
+static void monotone_dfs_visit(struct monotone_dfs* dfs, int comb_len,
+                               int local_deps_len, int deps_fact_len,
+                               Dependency secrets_0, Dependency secrets_1);
+
+// Visits the children of the tuple |dfs->comb| of length |comb_len|
+// whose last variable is at a position in [|from|, |to|).
+static void monotone_dfs_visit_children(struct monotone_dfs* dfs, int comb_len,
+                                        int from, int to,
+                                        int local_deps_len, int deps_fact_len,
+                                        Dependency secrets_0, Dependency secrets_1) {
+  const struct monotone_job* job = dfs->job;
+  const Circuit* circuit = job->circuit;
+  DependencyList* deps = circuit->deps;
+  int comb_free_space = job->max_len - comb_len;
+  bool leaf_children = comb_len+1 == job->max_depth;
+  for (int next_pos = from; next_pos < to; next_pos++) {
+    Var next = job->order[next_pos];
+    // Most of the nodes are leaves: those that do not contain enough
+    // shares to be failures are skipped without extending the
+    // elimination (nor even calling monotone_dfs_visit).
+    if ((leaf_children || next_pos+1 == circuit->length) &&
+        count_shares(circuit, secrets_0 | deps->contained_secrets[next][0],
+                     secrets_1 | deps->contained_secrets[next][1], 0, false)
+        + comb_free_space-1 <= job->t_in) {
+      continue;
+    }
+    dfs->comb[comb_len] = next;
+    monotone_dfs_visit(dfs, comb_len+1, local_deps_len, deps_fact_len,
+                       secrets_0, secrets_1);
+  }
+}
+
+// Visits the tuple |dfs->comb| of length |comb_len|, and its
+// subtree. The first |local_deps_len| elements of |local_deps| (and
+// |deps_fact_len| of |deps_fact|) hold the elimination of the
+// parent of the tuple, which contains the shares |secrets_0| and
+// |secrets_1|.
+static void monotone_dfs_visit(struct monotone_dfs* dfs, int comb_len,
+                               int local_deps_len, int deps_fact_len,
+                               Dependency secrets_0, Dependency secrets_1) {
+  const struct monotone_job* job = dfs->job;
+  const Circuit* circuit = job->circuit;
+  DependencyList* deps = circuit->deps;
+  const BitDepKernels* kernels = &dfs->kernels;
+  Var var = dfs->comb[comb_len-1];
+  int pos = job->position[var];
+  int comb_free_space = job->max_len - comb_len;
+  bool factorize = circuit->contains_mults && circuit->has_input_rands;
+  bool has_children = comb_len < job->max_depth && pos+1 < circuit->length;
+
+  secrets_0 |= deps->contained_secrets[var][0];
+  secrets_1 |= deps->contained_secrets[var][1];
+  bool may_fail =
+    count_shares(circuit, secrets_0, secrets_1, 0, false) + comb_free_space > job->t_in;
+
+  // Extending the elimination of the parent (same steps as
+  // _verify_tuples_cancellable)
+  int first_new_dep = local_deps_len;
+  add_var_to_local_deps(circuit, kernels, deps->bit_deps[var], dfs->local_deps,
+                        dfs->gauss_rands, &local_deps_len, job->local_deps_max_len);
+  if (factorize) {
+    for (int i = first_new_dep; i < local_deps_len; i++) {
+      int first_new_fact = deps_fact_len;
+      factorize_mults(circuit, &dfs->local_deps[i], dfs->deps_fact, &deps_fact_len, 1);
+      for (int l = first_new_fact; l < deps_fact_len; l++) {
+        kernels->gauss_step(kernels, circuit, dfs->deps_fact[l], dfs->deps_fact,
+                            dfs->deps_rands_fact, l);
+        kernels->set_gauss_rand(kernels, dfs->deps_fact, dfs->deps_rands_fact, l,
+                                deps->correction_outputs);
+        replace_correction_outputs_in_dep(circuit, kernels, dfs->deps_fact, l,
+                                          dfs->deps_rands_fact, &deps_fact_len,
+                                          job->deps_fact_max_len, deps->correction_outputs);
+      }
+    }
+  }
+  SecretDep leaky_inputs[2] = { 0 };
+  Dependency secret_deps[2] = { 0 };
+  int failure = 0;
+  if (may_fail) {
+    if (factorize) {
+      failure = kernels->set_contained_shares(circuit, leaky_inputs, secret_deps,
+                                              dfs->deps_fact, dfs->deps_rands_fact,
+                                              deps_fact_len, circuit->secret_count, job->t_in,
+                                              comb_free_space, 0, false);
+    } else {
+      failure = is_failure_without_factorization(circuit, kernels, dfs->local_deps,
+                                                 dfs->gauss_rands, local_deps_len, job->t_in,
+                                                 comb_free_space, 0, false,
+                                                 leaky_inputs, secret_deps);
+    }
+  }
+
+  // With symmetries, the variables of the orbit of the first variable
+  // of the tuple occupy the positions [first position, |block_end|).
+  // A tuple S made only of such variables stands for the |weight|
+  // tuples of its orbit (0 if it is not the smallest of its orbit), and
+  // so does each of its extensions by variables of the next orbits: S
+  // and these extensions are counted in |dfs->scratch_coeffs|, which
+  // are then added |weight| times to the coefficients. The extensions
+  // of S by variables of its own orbit are visited independently.
+  bool in_first_orbit = job->sym && pos < job->block_end[job->position[dfs->comb[0]]];
+  int ext_start = in_first_orbit ? job->block_end[pos] : pos+1;
+  int weight = 1;
+  uint64_t* coeffs = dfs->coeffs;
+  WeightHistogram* hist = dfs->hist;
+  if (in_first_orbit) {
+    weight = (failure || has_children) ? subset_orbit_size(job->sym, dfs->comb, comb_len) : 0;
+    dfs->coeffs = dfs->scratch_coeffs;
+    dfs->hist = dfs->scratch_hist;
+  }
+
+  bool leaks = false;
+  if (failure && weight) {
+    if (leaky_inputs[0] || leaky_inputs[1]) {
+      // All the tuples of the subtree are failures, whatever the
+      // elementary shares added to them.
+      const Circuit* old_circuit = job->dim_red_data->old_circuit;
+      Comb old_comb[comb_len];
+      for (int i = 0; i < comb_len; i++) {
+        old_comb[i] = job->dim_red_data->new_to_old_mapping[dfs->comb[i]];
+      }
+      if (comb_free_space == 0) {
+        weight_histogram_add(dfs->hist, old_circuit, old_comb, comb_len);
+      } else {
+        subtree_sums_add(job->sums, old_circuit, old_comb, comb_len,
+                         ext_start, comb_free_space, dfs->coeffs);
+      }
+      leaks = true;
+    } else {
+      expand_tuple_to_failure(circuit, job->t_in, 0, dfs->comb, comb_len,
+                              leaky_inputs, secret_deps, job->max_len, job->dim_red_data,
+                              add_failure_to_hist, dfs->hist);
+    }
+  }
+
+  if (has_children && weight && !leaks) {
+    monotone_dfs_visit_children(dfs, comb_len, ext_start, circuit->length,
+                                local_deps_len, deps_fact_len, secrets_0, secrets_1);
+  }
+
+  if (in_first_orbit) {
+    dfs->coeffs = coeffs;
+    dfs->hist = hist;
+    if (weight) {
+      weight_histogram_flush(dfs->scratch_hist, dfs->scratch_coeffs);
+      for (int i = 0; i < job->coeffs_len; i++) {
+        coeffs[i] += weight * dfs->scratch_coeffs[i];
+        dfs->scratch_coeffs[i] = 0;
+      }
+    }
+    if (has_children) {
+      monotone_dfs_visit_children(dfs, comb_len, pos+1, ext_start,
+                                  local_deps_len, deps_fact_len, secrets_0, secrets_1);
+    }
+  }
+}
+
+// Visits the subtree of the tuple [ |job->order[first_pos]| ].
+static void monotone_worker(void* job_void, int first_pos, int worker_id) {
+  const struct monotone_job* job = (const struct monotone_job*) job_void;
+  struct verify_workspace* ws = acquire_verify_workspace(job->local_deps_max_len,
+                                                         job->deps_fact_max_len);
+  Comb comb[job->max_depth];
+  comb[0] = job->order[first_pos];
+  struct monotone_dfs dfs = {
+    .job             = job,
+    .local_deps      = ws->local_deps,
+    .gauss_rands     = ws->gauss_rands,
+    .deps_fact       = ws->deps_fact,
+    .deps_rands_fact = ws->deps_rands_fact,
+    .comb            = comb,
+    .coeffs          = job->coeffs[worker_id],
+    .hist            = job->hists[worker_id],
+    .scratch_coeffs  = job->sym ? job->scratch_coeffs[worker_id] : NULL,
+    .scratch_hist    = job->sym ? job->scratch_hists[worker_id] : NULL
+  };
+  init_bitdep_kernels(&dfs.kernels, job->circuit);
+  monotone_dfs_visit(&dfs, 1, 0, 0, 0, 0);
+  release_verify_workspace();
+}
+
+void find_all_failures_monotone(const Circuit* circuit, int cores, int max_len,
+                                const DimRedData* dim_red_data,
+                                const CircuitSymmetries* sym, uint64_t* coeffs) {
+  const Circuit* old_circuit = dim_red_data->old_circuit;
+  int coeffs_len = old_circuit->total_wires+1;
+  int t_in = hamming_weight(circuit->all_shares_mask) - 1;
+  int last_var = circuit->length;
+
+  // Tuples made only of elementary shares
+  WeightHistogram* hist = make_weight_histogram();
+  if (max_len > 0) {
+    Comb comb[max_len];
+    SecretDep leaky_inputs[2] = { 0 };
+    Dependency secret_deps[2] = { 0 };
+    expand_tuple_to_failure(circuit, t_in, 0, comb, 0, leaky_inputs, secret_deps,
+                            max_len, dim_red_data, add_failure_to_hist, hist);
+  }
+  weight_histogram_flush(hist, coeffs);
+  free_weight_histogram(hist);
+
+  int max_depth = min(max_len, last_var);
+  if (max_depth <= 0) return;
+
+  // With symmetries, the variables are enumerated orbit by orbit (the
+  // variables that are not outputs come first, see CircuitSymmetries).
+  int order[last_var], block_end[last_var];
+  int position[circuit->deps->length];
+  for (int i = 0; i < last_var; i++) {
+    order[i] = sym ? sym->orbit_vars[i] : i;
+    position[order[i]] = i;
+    if (sym) block_end[i] = sym->orbit_start[sym->orbit_of[order[i]]+1];
+  }
+
+  int var_weights[last_var];
+  for (int i = 0; i < last_var; i++) {
+    var_weights[i] = old_circuit->weights[dim_red_data->new_to_old_mapping[order[i]]];
+  }
+  VarVector* removed_wires = dim_red_data->removed_wires;
+  int extra_weights[removed_wires->length+1];
+  for (int i = 0; i < removed_wires->length; i++) {
+    extra_weights[i] = old_circuit->weights[removed_wires->content[i]];
+  }
+  SubtreeSums* sums = make_subtree_sums(var_weights, last_var,
+                                        extra_weights, removed_wires->length,
+                                        max_len-1, coeffs_len);
+
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
+  WorkPool* pool = cores > 1 ? get_work_pool(cores) : NULL;
+  int workers = pool ? work_pool_size(pool) : 1;
+
+  struct monotone_job job = {
+    .circuit        = circuit,
+    .dim_red_data   = dim_red_data,
+    .t_in           = t_in,
+    .max_len        = max_len,
+    .max_depth      = max_depth,
+    .sums           = sums,
+    .coeffs_len     = coeffs_len,
+    .coeffs         = malloc(workers * sizeof(*job.coeffs)),
+    .hists          = malloc(workers * sizeof(*job.hists)),
+    .order          = order,
+    .position       = position,
+    .sym            = sym,
+    .block_end      = sym ? block_end : NULL,
+    .scratch_coeffs = sym ? malloc(workers * sizeof(*job.scratch_coeffs)) : NULL,
+    .scratch_hists  = sym ? malloc(workers * sizeof(*job.scratch_hists)) : NULL
+  };
+  get_verify_workspace_size(circuit, max_depth, last_var,
+                            &job.local_deps_max_len, &job.deps_fact_max_len);
+  for (int w = 0; w < workers; w++) {
+    job.coeffs[w] = calloc(coeffs_len, sizeof(*job.coeffs[w]));
+    job.hists[w]  = make_weight_histogram();
+    if (sym) {
+      job.scratch_coeffs[w] = calloc(coeffs_len, sizeof(*job.scratch_coeffs[w]));
+      job.scratch_hists[w]  = make_weight_histogram();
+    }
+  }
+
+  // The subtrees of the first variables are the largest ones: taking
+  // them first balances the work between the workers.
+  if (pool) {
+    work_pool_for(pool, last_var, monotone_worker, &job);
+  } else {
+    for (int first_pos = 0; first_pos < last_var; first_pos++) {
+      monotone_worker(&job, first_pos, 0);
+    }
+  }
+
+  for (int w = 0; w < workers; w++) {
+    weight_histogram_flush(job.hists[w], coeffs);
+    for (int i = 0; i < coeffs_len; i++) {
+      coeffs[i] += job.coeffs[w][i];
+    }
+    free_weight_histogram(job.hists[w]);
+    free(job.coeffs[w]);
+    if (sym) {
+      free_weight_histogram(job.scratch_hists[w]);
+      free(job.scratch_coeffs[w]);
+    }
+  }
+  free(job.coeffs);
+  free(job.hists);
+  free(job.scratch_coeffs);
+  free(job.scratch_hists);
+  free_subtree_sums(sums);
+}
+
 int is_failure(const Circuit* circuit, // The circuit
                int t_in, // The number of shares that must be
                          // leaked for a tuple to be a failure
@@ -1739,7 +2847,7 @@ int is_failure(const Circuit* circuit, // The circuit
                Comb* tuple, // The tuple to check
                bool has_random, // Should be false if randoms have been removed
                SecretDep* secret_deps, // The secret deps to set as output
-               Trie* incompr_tuples // The trie of incompressible tuples
+               SubsetIndex* incompr_tuples // The index of incompressible tuples
                                     // (set to NULL to disable this optim)
                ) {
   return _verify_tuples(circuit, t_in,
@@ -1779,20 +2887,130 @@ int find_all_failures(const Circuit* circuit, // The circuit
                       Dependency shares_to_ignore,  // Shares that do not count in failures
                                                     // (used only for PINI)
                       bool PINI, // If true, we are checking PINI
-                      Trie* incompr_tuples, // The trie of incompressible tuples
+                      SubsetIndex* incompr_tuples, // The index of incompressible tuples
                                             // (set to NULL to disable this optim)
                       void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
                       //     ^^^^^^^^^^^^^^^^
                       // The function to call when a failure is found
                       void* data // additional data to pass to |failure_callback|
                       ) {
+  return find_all_failures_local(circuit, cores, t_in, prefix, comb_len,
+                                 max_len, dim_red_data, has_random, first_tuple,
+                                 include_outputs, shares_to_ignore, PINI,
+                                 incompr_tuples, failure_callback, data,
+                                 NULL); // local_ops
+}
+
+// Same as find_all_failures, but each thread accumulates failures in
+// its own copy of |data| (see LocalDataOps).
+int find_all_failures_local(const Circuit* circuit, // The circuit
+                      int cores, // How many threads to use
+                      int t_in, // The number of shares that must be
+                                // leaked for a tuple to be a failure
+                      VarVector* prefix, // Prefix to add to all the tuples
+                      int comb_len, // The length of the tuples (includes prefix->length)
+                      int max_len, // Maximum length allowed
+                      const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                      // after the dimension reduction
+                      bool has_random, // Should be false if randoms have been removed
+                      Comb* first_tuple, // The first tuple
+                      bool include_outputs, // If true, include outputs in the tuples
+                      Dependency shares_to_ignore,  // Shares that do not count in failures
+                                                    // (used only for PINI)
+                      bool PINI, // If true, we are checking PINI
+                      SubsetIndex* incompr_tuples, // The index of incompressible tuples
+                                            // (set to NULL to disable this optim)
+                      void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
+                      //     ^^^^^^^^^^^^^^^^
+                      // The function to call when a failure is found
+                      void* data, // additional data to pass to |failure_callback|
+                      const LocalDataOps* local_ops // To create/merge per-thread copies of |data|
+                      ) {
   return _verify_tuples_parallel(circuit, cores, t_in, prefix, comb_len,
                                  max_len, dim_red_data, has_random, first_tuple,
                                  -1, // tuple_count
                                  include_outputs, shares_to_ignore, PINI,
                                  false, // stop at first failure
                                  false, // only_one_tuple
-                                 incompr_tuples, failure_callback, data);
+                                 incompr_tuples, failure_callback, data, local_ops);
+}
+
+void coeffs_failure_callback(const Circuit* c, Comb* comb, int comb_len,
+                             SecretDep* secret_deps, void* data_void) {
+  (void) secret_deps;
+  CoeffsData* data = (CoeffsData*) data_void;
+  int prefix_len = data->prefix_len;
+  weight_histogram_add(data->hist, c, &comb[prefix_len], comb_len-prefix_len);
+}
+
+// Each thread accumulates failures in its own histogram, which is
+// then added to the shared coefficients (see LocalDataOps).
+static void* make_local_coeffs_data(void* data_void) {
+  CoeffsData* data = (CoeffsData*) data_void;
+  CoeffsData* local_data = malloc(sizeof(*local_data));
+  *local_data = *data;
+  local_data->hist = make_weight_histogram();
+  return local_data;
+}
+
+static void merge_local_coeffs_data(void* data_void, void* local_data_void) {
+  CoeffsData* data = (CoeffsData*) data_void;
+  CoeffsData* local_data = (CoeffsData*) local_data_void;
+  weight_histogram_flush(local_data->hist, data->coeffs);
+  free_weight_histogram(local_data->hist);
+  free(local_data);
+}
+
+const LocalDataOps coeffs_local_data_ops = {
+  .make  = make_local_coeffs_data,
+  .merge = merge_local_coeffs_data
+};
+
+
+void init_scenario_batch(ScenarioBatch* batch, size_t scenario_size, int cores,
+                         bool parallel_scenarios,
+                         void (*verify)(const void* params, void* scenario, int cores),
+                         const void* params) {
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
+  if (cores < 1) cores = 1;
+  batch->cores = cores;
+  batch->parallel_scenarios = parallel_scenarios && cores > 1;
+  batch->max_length = batch->parallel_scenarios ? cores * SCENARIO_BATCH_PER_CORE : 1;
+  batch->scenario_size = scenario_size;
+  batch->scenarios = malloc(batch->max_length * scenario_size);
+  batch->length = 0;
+  batch->verify = verify;
+  batch->params = params;
+}
+
+void free_scenario_batch(ScenarioBatch* batch) {
+  free(batch->scenarios);
+}
+
+void* scenario_batch_get(const ScenarioBatch* batch, int idx) {
+  return (char*)batch->scenarios + idx * batch->scenario_size;
+}
+
+void* scenario_batch_add(ScenarioBatch* batch) {
+  assert(batch->length < batch->max_length);
+  return scenario_batch_get(batch, batch->length++);
+}
+
+static void verify_scenario_worker(void* batch_void, int idx, int worker_id) {
+  (void) worker_id;
+  ScenarioBatch* batch = (ScenarioBatch*) batch_void;
+  batch->verify(batch->params, scenario_batch_get(batch, idx), 1);
+}
+
+void verify_scenario_batch(ScenarioBatch* batch) {
+  if (batch->parallel_scenarios) {
+    work_pool_for(get_work_pool(batch->cores), batch->length,
+                  verify_scenario_worker, batch);
+  } else {
+    for (int i = 0; i < batch->length; i++) {
+      batch->verify(batch->params, scenario_batch_get(batch, i), batch->cores);
+    }
+  }
 }
 
 // Finds the first failure of size |comb_len|, and calls
@@ -1812,7 +3030,7 @@ int find_first_failure(const Circuit* circuit, // The circuit
                        Dependency shares_to_ignore,  // Shares that do not count in failures
                                                      // (used only for PINI)
                        bool PINI, // If true, we are checking PINI
-                       Trie* incompr_tuples, // The trie of incompressible tuples
+                       SubsetIndex* incompr_tuples, // The index of incompressible tuples
                        // (set to NULL to disable this optim)
                        void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
                        //     ^^^^^^^^^^^^^^^^
@@ -1825,7 +3043,553 @@ int find_first_failure(const Circuit* circuit, // The circuit
                                  include_outputs, shares_to_ignore, PINI,
                                  true, // stop at first failure
                                  false, // only_one_tuple
-                                 incompr_tuples, failure_callback, data);
+                                 incompr_tuples, failure_callback, data,
+                                 NULL); // local_ops
+}
+
+
+/**********************************************************************
+                Sharing the tuples between output prefixes
+
+  RPC, RPE1, CRPC and SNI verify the same tuples once for each
+  combination of output shares (the "prefix" of the tuples). When no
+  factorization is needed, whether a tuple is a failure only depends
+  on the span of its dependencies: the unmasked rows of the
+  elimination span the vectors of this span that contain no random,
+  and the shares (or multiplications) leaked are the union of the
+  supports of those vectors, which does not depend on the basis, and
+  thus not on the order in which the variables are eliminated.
+
+  _verify_tuples_prefixes thus enumerates the tuples without prefix
+  once, and eliminates their variables in the order: all elements of
+  the tuple but the last one (the "head" of the tuple), the output
+  shares of the prefix, and the last element of the tuple. This way:
+
+    - the head is eliminated incrementally (as in
+      _verify_tuples_cancellable), once for all the prefixes;
+
+    - each output share is reduced by the rows of the head one
+      position at a time (|out_levels|), and the rows of each prefix
+      are computed once per head (and not once per tuple);
+
+    - as in the last position sweep, the verdict of the head and a
+      prefix is reused for all the last elements that they mask, and
+      the masked last elements of a whole block of variables are
+      computed at once for each prefix, from the planes of the block
+      after elimination of the head (which are also shared by all the
+      prefixes);
+
+    - the unmasked rows of the head are or'ed together once per head
+      (|acc|), and each prefix only adds its own unmasked rows (and the
+      one of the last element).
+
+  This is not possible with factorizations, correction outputs (which
+  affect the choice of the pivots), removed randoms (see
+  is_failure_with_randoms), incompressible tuples (whose index is
+  filled in the order of the prefixes) or variables with several
+  dependencies: in those cases, the prefixes are verified one after
+  the other, as before.
+
+************************************************************************/
+
+// Union of the unmasked rows of an elimination (see
+// is_failure_without_factorization).
+struct unmasked_union {
+  Dependency secrets[2];
+  uint64_t mults[BITMULT_MAX_LEN];
+};
+
+static inline void add_unmasked_row(const Circuit* circuit, const BitDepKernels* kernels,
+                                    struct unmasked_union* acc, BitDep* row) {
+  update_secret_deps(acc->secrets, row, circuit->faults_on_inputs, circuit->secret_count,
+                     circuit->share_count);
+  for (int j = 0; j < kernels->bit_mult_len; j++) {
+    acc->mults[j] |= row->mults[j];
+  }
+}
+
+// Same verdict as is_failure_without_factorization (without ignored
+// shares), for an elimination whose unmasked rows are |acc|.
+static int unmasked_union_is_failure(const Circuit* circuit, const BitDepKernels* kernels,
+                                     const struct unmasked_union* acc, int t_in,
+                                     int comb_free_space, SecretDep* leaky_inputs,
+                                     Dependency* secret_deps) {
+  Dependency secret_share_0 = acc->secrets[0], secret_share_1 = acc->secrets[1];
+  if (circuit->contains_mults) {
+    for (int i = 0; i < kernels->bit_mult_len; i++) {
+      uint64_t mult_elem = acc->mults[i];
+      while (mult_elem != 0) {
+        int mult_idx = i * 64 + __builtin_ctzll(mult_elem);
+        mult_elem &= mult_elem - 1;
+        Dependency* this_secret_shares = circuit->deps->mult_deps->deps[mult_idx]->contained_secrets;
+        secret_share_0 |= this_secret_shares[0];
+        secret_share_1 |= this_secret_shares[1];
+      }
+    }
+  }
+  secret_deps[0] = secret_share_0;
+  secret_deps[1] = secret_share_1;
+  leaky_inputs[0] = Is_leaky(secret_share_0, t_in, 0);
+  leaky_inputs[1] = circuit->secret_count == 2 && Is_leaky(secret_share_1, t_in, 0);
+  return Is_leaky(secret_share_0, t_in, comb_free_space) ||
+    (circuit->secret_count == 2 && Is_leaky(secret_share_1, t_in, comb_free_space));
+}
+
+struct prefixes_job {
+  const Circuit* circuit;
+  int t_in;
+  Comb** prefixes;
+  int prefix_count;
+  int prefix_len;
+  int comb_len; // Includes |prefix_len|
+  int max_len;
+  const DimRedData* dim_red_data;
+  void (*failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*);
+  void** data; // One per prefix
+  // The data of thread |w| for prefix |p| is
+  // |thread_data[w * prefix_count + p]| (see thread_callback_data).
+  struct thread_callback_data* thread_data;
+
+  // If true, only looks for the first prefix that has a failure (the
+  // callback is not called).
+  bool first_prefix_only;
+  int first_failing_prefix; // Lowest prefix with a failure found so far
+
+  int last_var;
+  RankScheduler* sched;
+};
+
+static bool can_share_prefixes(const Circuit* circuit, Comb** prefixes, int prefix_count,
+                               int prefix_len, int comb_len, bool has_random,
+                               SubsetIndex* incompr_tuples) {
+  int sub_comb_len = comb_len - prefix_len;
+  if (prefix_count < 2 || sub_comb_len < 1 || sub_comb_len > circuit->length ||
+      !has_random || incompr_tuples ||
+      (circuit->contains_mults && circuit->has_input_rands) ||
+      circuit->deps->correction_outputs->length != 0) {
+    return false;
+  }
+  BitDepVector** bit_deps = circuit->deps->bit_deps;
+  for (int var = 0; var < circuit->length; var++) {
+    if (bit_deps[var]->length != 1) return false;
+  }
+  for (int p = 0; p < prefix_count; p++) {
+    for (int i = 0; i < prefix_len; i++) {
+      if (bit_deps[prefixes[p][i]]->length != 1) return false;
+    }
+  }
+  return true;
+}
+
+// Verifies the |tuple_count| tuples (without prefix) starting at
+// |first_tuple| (or all of them if |first_tuple| is NULL) for all the
+// prefixes of |job|.
+static void _verify_tuples_prefixes(struct prefixes_job* job, Comb* first_tuple,
+                                    uint64_t tuple_count, int worker_id) {
+  const Circuit* circuit = job->circuit;
+  DependencyList* deps = circuit->deps;
+  BitDepVector** bit_deps = deps->bit_deps;
+  int t_in = job->t_in;
+  int prefix_count = job->prefix_count;
+  int prefix_len = job->prefix_len;
+  int comb_len = job->comb_len;
+  int sub_comb_len = comb_len - prefix_len;
+  int head_len = sub_comb_len - 1;
+  int comb_free_space = job->max_len - comb_len;
+  int last_var = job->last_var;
+
+  BitDepKernels kernels;
+  init_bitdep_kernels(&kernels, circuit);
+
+  // The output shares used by the prefixes, and the secret shares that
+  // each prefix contains.
+  int out_count = 0;
+  Var* out_vars = calloc(prefix_count * prefix_len, sizeof(*out_vars));
+  int prefix_outs[prefix_count][prefix_len]; // Index in |out_vars|
+  Dependency prefix_secrets[prefix_count][2];
+  for (int p = 0; p < prefix_count; p++) {
+    prefix_secrets[p][0] = prefix_secrets[p][1] = 0;
+    for (int i = 0; i < prefix_len; i++) {
+      Var var = job->prefixes[p][i];
+      int o = 0;
+      while (o < out_count && out_vars[o] != var) o++;
+      if (o == out_count) out_vars[out_count++] = var;
+      prefix_outs[p][i] = o;
+      prefix_secrets[p][0] |= deps->contained_secrets[var][0];
+      prefix_secrets[p][1] |= deps->contained_secrets[var][1];
+    }
+  }
+
+  // The planes of the variables (see last_position_sweep), and the
+  // planes of |head_block| after elimination of the head.
+  struct last_position_sweep sweep;
+  init_last_position_sweep(&sweep, circuit, &kernels, last_var, out_vars, out_count, true);
+  int plane_count = sweep.plane_count;
+  uint64_t* head_planes = malloc((plane_count + 1) * sizeof(*head_planes));
+  int head_block = -1;
+
+  // |out_levels[l * out_count + o]|: the o-th output share, reduced by
+  // the rows of the first |l| elements of the tuple. Levels up to
+  // |out_valid[o]| are up to date.
+  BitDep* out_levels = malloc((head_len+1) * out_count * sizeof(*out_levels));
+  int out_valid[out_count];
+  for (int o = 0; o < out_count; o++) {
+    memcpy(&out_levels[o], bit_deps[out_vars[o]]->content[0], sizeof(*out_levels));
+    out_valid[o] = 0;
+  }
+
+  // The state of each prefix for the current head (valid if
+  // |prefix_head[p]| is |head_id|): the rows of its output shares
+  // after elimination of the head, the union of the unmasked rows of
+  // the head and of those rows, its verdict (-1 if not computed yet),
+  // and the last elements of |prefix_block[p]| that it masks.
+  BitDep* prefix_rows_storage = malloc(prefix_count * prefix_len * sizeof(*prefix_rows_storage));
+  BitDep* prefix_rows[prefix_count][prefix_len+1];
+  GaussRand prefix_rands[prefix_count][prefix_len];
+  struct unmasked_union* prefix_acc = malloc(prefix_count * sizeof(*prefix_acc));
+  int prefix_head[prefix_count];
+  int prefix_verdict[prefix_count];
+  SecretDep prefix_leaky_inputs[prefix_count][2];
+  Dependency prefix_secret_deps[prefix_count][2];
+  int prefix_block[prefix_count];
+  uint64_t prefix_masked[prefix_count];
+  BitDep last_row; // The last element, reduced by the head and a prefix
+  for (int p = 0; p < prefix_count; p++) {
+    for (int i = 0; i < prefix_len; i++) {
+      prefix_rows[p][i] = &prefix_rows_storage[p * prefix_len + i];
+    }
+    prefix_rows[p][prefix_len] = &last_row;
+    prefix_head[p] = -1;
+  }
+  int head_id = 0;
+
+  int local_deps_max_len, deps_fact_max_len;
+  get_verify_workspace_size(circuit, sub_comb_len, last_var,
+                            &local_deps_max_len, &deps_fact_max_len);
+  struct verify_workspace* ws = acquire_verify_workspace(local_deps_max_len, deps_fact_max_len);
+  BitDep** local_deps = ws->local_deps;
+  GaussRand* gauss_rands = ws->gauss_rands;
+  BitDep* window[local_deps_max_len+1];
+
+  // For the first |i| elements of the tuple: the index of their first
+  // row in |local_deps|, the union of their unmasked rows, and the
+  // secret shares they contain. Only the first |rows_valid| elements
+  // have up to date rows.
+  int tuple_to_local_deps_map[sub_comb_len+1];
+  struct unmasked_union acc[sub_comb_len+1];
+  Dependency tuple_secrets[sub_comb_len+1][2];
+  tuple_to_local_deps_map[0] = 0;
+  memset(&acc[0], 0, sizeof(acc[0]));
+  tuple_secrets[0][0] = tuple_secrets[0][1] = 0;
+  int rows_valid = 0;
+
+  // The tuples passed to the callback: a prefix followed by the tuple
+  // (with room for expand_tuple_to_failure).
+  Comb full_comb[job->max_len];
+
+  VarVector no_prefix = { .length = 0, .max_size = 0, .content = NULL };
+  Comb* curr_comb = init_comb(first_tuple, sub_comb_len, &no_prefix, sub_comb_len);
+  int first_changed = 0;
+  do {
+    for (int i = first_changed; i < sub_comb_len; i++) {
+      tuple_secrets[i+1][0] = tuple_secrets[i][0] | deps->contained_secrets[curr_comb[i]][0];
+      tuple_secrets[i+1][1] = tuple_secrets[i][1] | deps->contained_secrets[curr_comb[i]][1];
+    }
+    if (first_changed < head_len) {
+      rows_valid = min(rows_valid, first_changed);
+      head_block = -1;
+      head_id++;
+    }
+    Dependency secrets_0 = tuple_secrets[sub_comb_len][0];
+    Dependency secrets_1 = tuple_secrets[sub_comb_len][1];
+    Var last = curr_comb[head_len];
+    int block = last / 64;
+    bool last_reduced = false; // True if |local_deps[head_rows]| is |last| reduced by the head
+
+    int prefix_end = prefix_count;
+    if (job->first_prefix_only) {
+      prefix_end = __atomic_load_n(&job->first_failing_prefix, __ATOMIC_RELAXED);
+      if (prefix_end == 0) break;
+    }
+    for (int p = 0; p < prefix_end; p++) {
+      if (count_shares(circuit, secrets_0 | prefix_secrets[p][0],
+                       secrets_1 | prefix_secrets[p][1], 0, false)
+          + comb_free_space <= t_in) {
+        continue;
+      }
+
+      // Eliminating the head (if not done yet)
+      if (rows_valid < head_len) {
+        for (int o = 0; o < out_count; o++) out_valid[o] = min(out_valid[o], rows_valid);
+        int local_deps_len = tuple_to_local_deps_map[rows_valid];
+        for (int i = rows_valid; i < head_len; i++) {
+          add_var_to_local_deps(circuit, &kernels, bit_deps[curr_comb[i]], local_deps,
+                                gauss_rands, &local_deps_len, local_deps_max_len);
+          acc[i+1] = acc[i];
+          for (int r = tuple_to_local_deps_map[i]; r < local_deps_len; r++) {
+            if (!gauss_rands[r].is_set) add_unmasked_row(circuit, &kernels, &acc[i+1], local_deps[r]);
+          }
+          tuple_to_local_deps_map[i+1] = local_deps_len;
+        }
+        rows_valid = head_len;
+      }
+      int head_rows = tuple_to_local_deps_map[head_len];
+
+      // Eliminating the output shares of the prefix (if not done yet
+      // for this head)
+      if (prefix_head[p] != head_id) {
+        for (int i = 0; i < prefix_len; i++) {
+          int o = prefix_outs[p][i];
+          for (int l = out_valid[o]+1; l <= head_len; l++) {
+            int first_row = tuple_to_local_deps_map[l-1];
+            int row_count = tuple_to_local_deps_map[l] - first_row;
+            for (int r = 0; r < row_count; r++) window[r] = local_deps[first_row + r];
+            window[row_count] = &out_levels[l * out_count + o];
+            kernels.gauss_step(&kernels, circuit, &out_levels[(l-1) * out_count + o],
+                               window, &gauss_rands[first_row], row_count);
+          }
+          out_valid[o] = head_len;
+          kernels.gauss_step(&kernels, circuit, &out_levels[head_len * out_count + o],
+                             prefix_rows[p], prefix_rands[p], i);
+          kernels.set_gauss_rand(&kernels, prefix_rows[p], prefix_rands[p], i,
+                                 deps->correction_outputs);
+        }
+        prefix_acc[p] = acc[head_len];
+        for (int i = 0; i < prefix_len; i++) {
+          if (!prefix_rands[p][i].is_set) {
+            add_unmasked_row(circuit, &kernels, &prefix_acc[p], prefix_rows[p][i]);
+          }
+        }
+        prefix_verdict[p] = -1;
+        prefix_block[p] = -1;
+        prefix_head[p] = head_id;
+      }
+
+      // Which elements of |block| are masked by the head and the prefix
+      if (prefix_block[p] != block) {
+        if (head_block != block) {
+          memcpy(head_planes, &sweep.raw_planes[block * plane_count],
+                 plane_count * sizeof(*head_planes));
+          eliminate_from_planes(&kernels, head_planes, local_deps, gauss_rands, head_rows);
+          head_block = block;
+        }
+        uint64_t* planes = sweep.planes;
+        memcpy(planes, head_planes, plane_count * sizeof(*planes));
+        eliminate_from_planes(&kernels, planes, prefix_rows[p], prefix_rands[p], prefix_len);
+        uint64_t masked = 0;
+        for (int r = 0; r < plane_count; r++) masked |= planes[r];
+        prefix_masked[p] = masked;
+        prefix_block[p] = block;
+      }
+
+      SecretDep leaky_inputs[2];
+      Dependency secret_deps[2];
+      if ((prefix_masked[p] >> (last % 64)) & 1) {
+        if (prefix_verdict[p] == -1) {
+          prefix_verdict[p] =
+            unmasked_union_is_failure(circuit, &kernels, &prefix_acc[p], t_in, comb_free_space,
+                                      prefix_leaky_inputs[p], prefix_secret_deps[p]);
+        }
+        if (!prefix_verdict[p]) continue;
+        leaky_inputs[0] = prefix_leaky_inputs[p][0];
+        leaky_inputs[1] = prefix_leaky_inputs[p][1];
+        secret_deps[0] = prefix_secret_deps[p][0];
+        secret_deps[1] = prefix_secret_deps[p][1];
+      } else {
+        // The last element contains no random once reduced, and is thus
+        // an unmasked row.
+        if (!last_reduced) {
+          kernels.gauss_step(&kernels, circuit, bit_deps[last]->content[0], local_deps,
+                             gauss_rands, head_rows);
+          last_reduced = true;
+        }
+        kernels.gauss_step(&kernels, circuit, local_deps[head_rows], prefix_rows[p],
+                           prefix_rands[p], prefix_len);
+        struct unmasked_union tuple_acc = prefix_acc[p];
+        add_unmasked_row(circuit, &kernels, &tuple_acc, &last_row);
+        if (!unmasked_union_is_failure(circuit, &kernels, &tuple_acc, t_in, comb_free_space,
+                                       leaky_inputs, secret_deps)) {
+          continue;
+        }
+      }
+
+      if (job->first_prefix_only) {
+        // Lower prefixes can still have failures in the next tuples
+        int expected = __atomic_load_n(&job->first_failing_prefix, __ATOMIC_RELAXED);
+        while (p < expected &&
+               !__atomic_compare_exchange_n(&job->first_failing_prefix, &expected, p, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        break;
+      }
+
+      memcpy(full_comb, job->prefixes[p], prefix_len * sizeof(*full_comb));
+      memcpy(&full_comb[prefix_len], curr_comb, sub_comb_len * sizeof(*full_comb));
+      struct thread_callback_data* data = &job->thread_data[worker_id * prefix_count + p];
+      if (job->dim_red_data) {
+        expand_tuple_to_failure(circuit, t_in, 0, full_comb, comb_len, leaky_inputs, secret_deps,
+                                job->max_len, job->dim_red_data, thread_failure_callback, data);
+      } else {
+        thread_failure_callback(circuit, full_comb, comb_len, leaky_inputs, data);
+      }
+    }
+  } while ((first_changed = next_comb(curr_comb, sub_comb_len, last_var, NULL)) >= 0 &&
+           (tuple_count == -1ULL || --tuple_count != 0));
+
+  free(curr_comb-2);
+  free(out_vars);
+  free(out_levels);
+  free(prefix_rows_storage);
+  free(prefix_acc);
+  free(head_planes);
+  free_last_position_sweep(&sweep);
+  release_verify_workspace();
+}
+
+static void _verify_tuples_prefixes_worker(void* void_job, int worker_id) {
+  struct prefixes_job* job = (struct prefixes_job*) void_job;
+  uint64_t start, count;
+  while (rank_scheduler_next(job->sched, worker_id, &start, &count)) {
+    if (job->first_prefix_only &&
+        __atomic_load_n(&job->first_failing_prefix, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+    // Note: ranks of combinations.c start at 1, while the ranks of
+    // the scheduler start at 0.
+    Comb* first_tuple = unrank(job->last_var, job->comb_len - job->prefix_len, start+1);
+    _verify_tuples_prefixes(job, first_tuple, count, worker_id);
+    free(first_tuple);
+  }
+}
+
+// Runs |job| on |cores| threads. Returns the number of failures found
+// (when |job->first_prefix_only| is false).
+static int run_prefixes_job(struct prefixes_job* job, int cores, const LocalDataOps* local_ops) {
+  if (cores == -1) cores = CORES_TO_USE_FOR_MULTITHREADING;
+  int prefix_count = job->prefix_count;
+  bool copy_data = local_ops && cores > 1 && !job->first_prefix_only;
+
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  job->thread_data = aligned_alloc(64, cores * prefix_count * sizeof(*job->thread_data));
+  for (int i = 0; i < cores * prefix_count; i++) {
+    struct thread_callback_data* thread_data = &job->thread_data[i];
+    void* data = job->data ? job->data[i % prefix_count] : NULL;
+    thread_data->failure_callback = job->failure_callback;
+    thread_data->failure_count = 0;
+    if (copy_data) {
+      thread_data->data  = local_ops->make(data);
+      thread_data->mutex = NULL;
+    } else {
+      thread_data->data  = data;
+      thread_data->mutex = cores > 1 ? &mutex : NULL;
+    }
+  }
+
+  if (cores == 1) {
+    _verify_tuples_prefixes(job, NULL, -1, 0);
+  } else {
+    uint64_t total_tuples = n_choose_k(job->comb_len - job->prefix_len, job->last_var);
+    uint64_t chunk_size = total_tuples / ((uint64_t)cores * PARALLEL_CHUNKS_PER_CORE);
+    chunk_size = max(chunk_size, PARALLEL_MIN_CHUNK_SIZE);
+    RankScheduler sched;
+    init_rank_scheduler(&sched, cores, total_tuples, chunk_size);
+    job->sched = &sched;
+
+    work_pool_run(get_work_pool(cores), _verify_tuples_prefixes_worker, job);
+
+    free_rank_scheduler(&sched);
+  }
+
+  int failure_count = 0;
+  for (int i = 0; i < cores * prefix_count; i++) {
+    failure_count += job->thread_data[i].failure_count;
+    if (copy_data) {
+      local_ops->merge(job->data[i % prefix_count], job->thread_data[i].data);
+    }
+  }
+  free(job->thread_data);
+  return failure_count;
+}
+
+int find_all_failures_prefixes(const Circuit* circuit, int cores, int t_in,
+                               Comb** prefixes, int prefix_count, int prefix_len,
+                               int comb_len, int max_len, const DimRedData* dim_red_data,
+                               bool has_random, SubsetIndex* incompr_tuples,
+                               void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
+                               void** data, const LocalDataOps* local_ops) {
+  if (!can_share_prefixes(circuit, prefixes, prefix_count, prefix_len, comb_len,
+                          has_random, incompr_tuples)) {
+    int failure_count = 0;
+    for (int p = 0; p < prefix_count; p++) {
+      VarVector prefix = { .length = prefix_len, .max_size = prefix_len,
+                           .content = prefixes[p] };
+      failure_count += find_all_failures_local(circuit, cores, t_in, &prefix, comb_len,
+                                               max_len, dim_red_data, has_random,
+                                               NULL,  // first_tuple
+                                               false, // include_outputs
+                                               0,     // shares_to_ignore
+                                               false, // PINI
+                                               incompr_tuples, failure_callback, data[p],
+                                               local_ops);
+    }
+    return failure_count;
+  }
+
+  struct prefixes_job job = {
+    .circuit           = circuit,
+    .t_in              = t_in > 0 ? t_in : hamming_weight(circuit->all_shares_mask) - 1,
+    .prefixes          = prefixes,
+    .prefix_count      = prefix_count,
+    .prefix_len        = prefix_len,
+    .comb_len          = comb_len,
+    .max_len           = max_len,
+    .dim_red_data      = dim_red_data,
+    .failure_callback  = failure_callback,
+    .data              = data,
+    .first_prefix_only = false,
+    .last_var          = circuit->length
+  };
+  return run_prefixes_job(&job, cores, local_ops);
+}
+
+int find_first_failing_prefix(const Circuit* circuit, int cores, int t_in,
+                              Comb** prefixes, int prefix_count, int prefix_len,
+                              int comb_len, int max_len, const DimRedData* dim_red_data,
+                              bool has_random) {
+  if (!can_share_prefixes(circuit, prefixes, prefix_count, prefix_len, comb_len,
+                          has_random, NULL)) {
+    for (int p = 0; p < prefix_count; p++) {
+      VarVector prefix = { .length = prefix_len, .max_size = prefix_len,
+                           .content = prefixes[p] };
+      if (find_first_failure(circuit, cores, t_in, &prefix, comb_len, max_len,
+                             dim_red_data, has_random,
+                             NULL,  // first_tuple
+                             false, // include_outputs
+                             0,     // shares_to_ignore
+                             false, // PINI
+                             NULL,  // incompr_tuples
+                             NULL,  // failure_callback
+                             NULL)) {
+        return p;
+      }
+    }
+    return -1;
+  }
+
+  struct prefixes_job job = {
+    .circuit              = circuit,
+    .t_in                 = t_in > 0 ? t_in : hamming_weight(circuit->all_shares_mask) - 1,
+    .prefixes             = prefixes,
+    .prefix_count         = prefix_count,
+    .prefix_len           = prefix_len,
+    .comb_len             = comb_len,
+    .max_len              = max_len,
+    .dim_red_data         = dim_red_data,
+    .first_prefix_only    = true,
+    .first_failing_prefix = prefix_count,
+    .last_var             = circuit->length
+  };
+  run_prefixes_job(&job, cores, NULL);
+  return job.first_failing_prefix < prefix_count ? job.first_failing_prefix : -1;
 }
 
 
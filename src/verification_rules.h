@@ -6,8 +6,10 @@
 #include "vectors.h"
 #include "list_tuples.h"
 #include "parser.h"
-#include "trie.h"
+#include "subset_index.h"
 #include "dimensions.h"
+#include "coeffs.h"
+#include "symmetry.h"
 
 #define hamming_weight(x) __builtin_popcount(x)
 #define make_t_in_from_mask(mask) (hamming_weight(mask) - 1)
@@ -27,7 +29,7 @@ typedef struct _gauss_rand {
 
 
 int is_failure(const Circuit* c, int t_in, int comb_len, Comb* tuple,
-               bool has_random, SecretDep* secret_deps, Trie* incompr_tuples);
+               bool has_random, SecretDep* secret_deps, SubsetIndex* incompr_tuples);
 
 // Finds all failures of size |comb_len|, and calls |failure_callback|
 // for each of them.
@@ -46,7 +48,7 @@ int find_all_failures(const Circuit* c,             // The circuit
                       Dependency shares_to_ignore,  // Shares that do not count in failures
                                                     // (used only for PINI)
                       bool PINI,                    // If true, we are checking PINI
-                      Trie* incompr_tuples,         // The trie of incompressible tuples
+                      SubsetIndex* incompr_tuples,         // The index of incompressible tuples
                                                     // (set to NULL to disable this optim)
                       void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void* data),
                       //     ^^^^^^^^^^^^^^^^
@@ -54,6 +56,117 @@ int find_all_failures(const Circuit* c,             // The circuit
                       void* data // additional data to pass to |failure_callback|
                       );
 
+// Per-thread copies of the |data| of find_all_failures_local. When
+// several threads are used, each of them calls the failure callback
+// on its own copy (created with |make|), which removes the need to
+// serialize the callbacks. Once all threads are done, each copy is
+// merged back into the original |data| (with |merge|, which should
+// also free the copy).
+typedef struct _local_data_ops {
+  void* (*make)(void* data);
+  void (*merge)(void* data, void* local_data);
+} LocalDataOps;
+
+// Same as find_all_failures, but with per-thread copies of |data|
+// (see LocalDataOps).
+int find_all_failures_local(const Circuit* c,             // The circuit
+                            int cores,                    // How many threads to use
+                            int t_in,                     // The number of shares that must be
+                                                          // leaked for a tuple to be a failure
+                            VarVector* prefix,            // Prefix to add to all the tuples
+                            int comb_len,                 // The length of the tuples
+                            int max_len,                  // Maximum length allowed
+                            const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                            // after the dimension reduction
+                            bool has_random, // Should be false if randoms have been removed
+                            Comb* first_tuple,            // The first tuple
+                            bool include_outputs,         // If true, include outputs in the tuples
+                            Dependency shares_to_ignore,  // Shares that do not count in failures
+                                                          // (used only for PINI)
+                            bool PINI,                    // If true, we are checking PINI
+                            SubsetIndex* incompr_tuples,         // The index of incompressible tuples
+                                                          // (set to NULL to disable this optim)
+                            void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void* data),
+                            //     ^^^^^^^^^^^^^^^^
+                            // The function to call when a failure is found
+                            void* data, // additional data to pass to |failure_callback|
+                            const LocalDataOps* local_ops // How to copy and merge |data|
+                            );
+
+// Finds all the failures of up to |max_len| variables of an RP-like
+// property (a tuple is a failure if it leaks all the shares of an
+// input), and adds their coefficients (with the weights of
+// |dim_red_data->old_circuit|) to |coeffs|. Instead of verifying each
+// size separately, the tuples are enumerated depth-first, and the
+// coefficients of all the extensions of a tuple that leaks by itself
+// are computed in closed form (see verification_rules.c).
+// |dim_red_data| must be the result of remove_elementary_wires on
+// |c|, and |sym| (which can be NULL) the symmetries of |c|, in which
+// case only one tuple per orbit of tuples is verified.
+void find_all_failures_monotone(const Circuit* c,   // The circuit
+                                int cores,          // How many threads to use
+                                int max_len,        // Maximum length allowed
+                                const DimRedData* dim_red_data,
+                                const CircuitSymmetries* sym, // Symmetries of |c|
+                                uint64_t* coeffs    // The coefficients to update
+                                );
+// Coefficients of an RP-like property (RP, RPC, CRP, CRPC), for
+// find_all_failures_local: use coeffs_failure_callback as the failure
+// callback, and &coeffs_local_data_ops as |local_ops|. The first
+// |prefix_len| elements of the failures (the output shares of RPC and
+// CRPC) do not count in the coefficients. Failures are accumulated in
+// |hist| (see WeightHistogram): the ones found by worker threads are
+// added to |coeffs| when their local data is merged, and callers should
+// flush |hist| into |coeffs| after each find_all_failures_local call
+// (for the failures found on the calling thread).
+typedef struct _coeffs_data {
+  uint64_t* coeffs;
+  WeightHistogram* hist; // Failures not yet added to |coeffs|
+  int prefix_len;
+} CoeffsData;
+
+void coeffs_failure_callback(const Circuit* c, Comb* comb, int comb_len,
+                             SecretDep* secret_deps, void* data);
+extern const LocalDataOps coeffs_local_data_ops;
+
+// Fault scenarios of CNI, CRP and CRPC. The faulted circuits are built
+// in order (on the main thread), and accumulated in a ScenarioBatch
+// (see scenario_batch_add). Once the batch is full, all of its
+// scenarios are verified (see verify_scenario_batch), and the caller
+// reports their results in the order in which they were added.
+typedef struct _scenario_batch {
+  void* scenarios;      // |max_length| scenarios, of |scenario_size| bytes each
+  size_t scenario_size;
+  int length;
+  int max_length;
+  int cores;
+  bool parallel_scenarios; // If true, each scenario is verified on a
+                           // single core, but scenarios are verified
+                           // in parallel
+  // Verifies |scenario| using |cores| threads.
+  void (*verify)(const void* params, void* scenario, int cores);
+  const void* params;   // Passed to |verify|
+} ScenarioBatch;
+
+// Initializes |batch|. If |parallel_scenarios| is false (or if a single
+// core is used), batches contain a single scenario, verified on
+// |cores| threads.
+void init_scenario_batch(ScenarioBatch* batch, size_t scenario_size, int cores,
+                         bool parallel_scenarios,
+                         void (*verify)(const void* params, void* scenario, int cores),
+                         const void* params);
+void free_scenario_batch(ScenarioBatch* batch);
+
+// Returns the slot of the next scenario of |batch|, to be filled by the
+// caller. |batch| must not be full.
+void* scenario_batch_add(ScenarioBatch* batch);
+void* scenario_batch_get(const ScenarioBatch* batch, int idx);
+
+// Verifies all the scenarios of |batch|. This does not empty |batch|:
+// the caller should set its |length| to 0 once the results have been
+// reported.
+void verify_scenario_batch(ScenarioBatch* batch);
+
 // Finds the first failure of size |comb_len|, and calls
 // |failure_callback| with this failure.
 int find_first_failure(const Circuit* c,             // The circuit
@@ -71,7 +184,7 @@ int find_first_failure(const Circuit* c,             // The circuit
                        Dependency shares_to_ignore,  // Shares that do not count in failures
                                                      // (used only for PINI)
                        bool PINI,                    // If true, we are checking PINI
-                       Trie* incompr_tuples,         // The trie of incompressible tuples
+                       SubsetIndex* incompr_tuples,         // The index of incompressible tuples
                                                      // (set to NULL to disable this optim)
                        void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void* data),
                        //     ^^^^^^^^^^^^^^^^
@@ -80,6 +193,56 @@ int find_first_failure(const Circuit* c,             // The circuit
                        );
 
 
+// Same as find_all_failures_local, for each of the |prefix_count|
+// prefixes of |prefixes| (which all have |prefix_len| elements): the
+// failures that start with |prefixes[i]| are passed to
+// |failure_callback| along with |data[i]|. When possible, the tuples
+// are enumerated and eliminated once for all the prefixes (see
+// verification_rules.c); otherwise, this is the same as calling
+// find_all_failures_local for each prefix. Outputs are not included
+// in the tuples, and no shares are ignored.
+int find_all_failures_prefixes(const Circuit* c,             // The circuit
+                               int cores,                    // How many threads to use
+                               int t_in,                     // The number of shares that must be
+                                                             // leaked for a tuple to be a failure
+                               Comb** prefixes,              // The prefixes to add to the tuples
+                               int prefix_count,             // The number of prefixes
+                               int prefix_len,               // The length of each prefix
+                               int comb_len,                 // The length of the tuples
+                                                             // (includes |prefix_len|)
+                               int max_len,                  // Maximum length allowed
+                               const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                               // after the dimension reduction
+                               bool has_random, // Should be false if randoms have been removed
+                               SubsetIndex* incompr_tuples,  // The index of incompressible tuples
+                                                             // (set to NULL to disable this optim)
+                               void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void* data),
+                               //     ^^^^^^^^^^^^^^^^
+                               // The function to call when a failure is found
+                               void** data, // additional data to pass to |failure_callback|
+                                            // (one per prefix)
+                               const LocalDataOps* local_ops // How to copy and merge |data|
+                               );
+
+// Returns the index of the first prefix of |prefixes| for which there
+// is a failure of size |comb_len|, or -1 if there are none (see
+// find_all_failures_prefixes). No callback is called: use
+// find_first_failure on this prefix to get its first failure.
+int find_first_failing_prefix(const Circuit* c,             // The circuit
+                              int cores,                    // How many threads to use
+                              int t_in,                     // The number of shares that must be
+                                                            // leaked for a tuple to be a failure
+                              Comb** prefixes,              // The prefixes to add to the tuples
+                              int prefix_count,             // The number of prefixes
+                              int prefix_len,               // The length of each prefix
+                              int comb_len,                 // The length of the tuples
+                                                            // (includes |prefix_len|)
+                              int max_len,                  // Maximum length allowed
+                              const DimRedData* dim_red_data, // Data to generate the actual tuples
+                                                              // after the dimension reduction
+                              bool has_random // Should be false if randoms have been removed
+                              );
+
 // This is the actual primitive. You probably don't want to call it
 // yourself, but rather call find_all_failures or
 // find_first_failure. Still, if you know what you are doing, go
@@ -102,7 +265,7 @@ int _verify_tuples(const Circuit* circuit, // The circuit
                    bool stop_at_first_failure, // If true, stops after the first failure
                    bool only_one_tuple, // If true, stops after checking a single tuple
                    SecretDep* secret_deps_out, // The secret deps to set as output
-                   Trie* incompr_tuples, // The trie of incompressible tuples
+                   SubsetIndex* incompr_tuples, // The index of incompressible tuples
                                          // (set to NULL to disable this optim)
                    void (failure_callback)(const Circuit*,Comb*, int, SecretDep*, void*),
                    //    ^^^^^^^^^^^^^^^^
@@ -0,0 +1,123 @@
+#!/bin/bash
+# Runs IronMask on a few gadgets and checks its outputs: either against
+# known results, or between runs that must give the same results (e.g.,
+# sequential (-j1) and parallel (-j4) runs).
+#
+# Usage: tests/run_tests.sh [path to ironmask]
+#
+# The gadgets are copied to a temporary directory first, so that the
+# files written next to them (.circuit_cache, coefficients) do not end
+# up in gadgets/.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+IRONMASK=$(realpath "${1:-$ROOT/src/ironmask}")
+GADGETS=$(mktemp -d)
+trap 'rm -rf "$GADGETS"' EXIT
+# Probabilities (-l, -f, --sweep-l, --sweep-f) are written with a '.'
+export LC_ALL=C
+
+passed=0
+failed=0
+
+# Prints the path of a copy of the gadget |$1| (relative to gadgets/).
+gadget() {
+  local dst="$GADGETS/$(echo "$1" | tr '/' '_')"
+  [ -f "$dst" ] || cp "$ROOT/gadgets/$1" "$dst"
+  echo "$dst"
+}
+
+# Prints the result of IronMask on the arguments |$@| on a single line:
+# the coefficients of RP-like properties, or the verdict and the
+# failure of probing properties.
+result() {
+  "$IRONMASK" "$@" 2>&1 | grep "f(p) = \|with ids\|is [0-9]*-[A-Z]*\|is not [0-9]*-[A-Z]*" | tr -s ' \n' ' '
+}
+
+# Prints the coefficients computed by IronMask on the arguments |$@|
+# (for RP-like properties), without the trailing zeros.
+coeffs() {
+  "$IRONMASK" "$@" 2>&1 | grep "f(p) = " | sed 's/f(p) = \[ //; s/ \]$//; s/\(, 0\)*$//'
+}
+
+check() {
+  local name=$1 expected=$2 actual=$3
+  if [ "$expected" == "$actual" ]; then
+    passed=$((passed+1))
+  else
+    failed=$((failed+1))
+    echo "FAIL: $name"
+    echo "  expected: $expected"
+    echo "  actual:   $actual"
+  fi
+}
+
+# Checks that -j1 and -j4 give the same result with the arguments |$@|.
+check_parallel() {
+  check "$* (-j1 vs -j4)" "$(result -j1 "$@")" "$(result -j4 "$@")"
+}
+
+
+# Factorized Gaussian elimination of multiplication gadgets (the pivots
+# of the factorized dependencies used to be recorded at the wrong index).
+check "RP mult_1_o2" "0, 0, 1091, 3929, 8723, 13560, 15992, 14760, 10760, 6180, 2748, 910, 210, 30, 2" \
+      "$(coeffs -c 3 RP "$(gadget Crypto2020_Gadgets/gadget_mult_1_o2.sage)")"
+check "RPC mult_1_o2" "0, 0, 6" \
+      "$(coeffs -c 2 -t 1 RPC "$(gadget Crypto2020_Gadgets/gadget_mult_1_o2.sage)")"
+
+# First failure of probing properties: the threads stop as soon as one
+# of them finds a failure, and the failure with the lowest rank is then
+# verified again (and reported) sequentially.
+check_parallel -t 3 NI "$(gadget RP-Eurocrypt2021/mult_3_shares_test3.sage)"
+check_parallel -t 3 SNI "$(gadget RP-Eurocrypt2021/mult_3_shares_test3.sage)"
+check_parallel -t 3 SNI "$(gadget ISW/mult/gadget_mult_3_shares.sage)"
+
+
+# Fault scenarios verified in parallel (--parallel-scenarios): the
+# coefficient files of CRP/CRPC and the log of CNI must be the same as
+# without the option. The files of faulty scenarios (normally generated
+# by test_correction.py) only contain the fault-free scenario.
+g=$(gadget correction/and-cini-flawed-d1-k1.sage)
+printf '0\n' > "${g}_faulty_scenarios_k1_f1_CRP"
+printf '0\n0\n 0\n' > "${g}_faulty_scenarios_k1_f1_CRPC"
+crp_coeffs() {
+  "$IRONMASK" "$@" -k 1 -c 2 CRP "$g" > /dev/null 2>&1 && md5sum < "${g}_k1_c2_f1.CRP_coeffs"
+}
+crpc_coeffs() {
+  "$IRONMASK" "$@" -k 1 -c 1 -t 1 CRPC "$g" > /dev/null 2>&1 && md5sum < "${g}_t1_k1_c1_f1.CRPC_coeffs"
+}
+cni_log() {
+  "$IRONMASK" "$@" -t 1 -k 1 CNI "$g" 2>&1 | grep -v "completed in"
+}
+check "CRP --parallel-scenarios" "$(crp_coeffs)" "$(crp_coeffs -j 4 --parallel-scenarios)"
+check "CRPC --parallel-scenarios" "$(crpc_coeffs)" "$(crpc_coeffs -j 4 --parallel-scenarios)"
+check "CNI --parallel-scenarios" "$(cni_log)" "$(cni_log -j 4 --parallel-scenarios)"
+
+# Sweeps of CRP/CRPC on a single point (--sweep-l/--sweep-f) must give
+# the same probabilities as -l/-f (with the coefficient files computed
+# above).
+val() {
+  "$IRONMASK" -l 0.01 -f 0.01 "$@" "$g" 2>&1 | grep "min = \|max = " | sed 's/.* = //' | tr '\n' ' '
+}
+sweep() {
+  "$IRONMASK" --sweep-l 0.01 --sweep-f 0.01 "$@" "$g" 2>&1 | grep "^0.01,0.01," |
+    awk -F, '{ for (i = 3; i <= 8; i++) printf "%.10f ", $i }'
+}
+check "CRP --sweep-l/--sweep-f" "$(val -k 1 -c 2 CRP)" "$(sweep -k 1 -c 2 CRP)"
+check "CRPC --sweep-l/--sweep-f" "$(val -k 1 -c 1 -t 1 CRPC)" "$(sweep -k 1 -c 1 -t 1 CRPC)"
+
+# Incompressible tuples optimization: the tuples skipped by the threads
+# (whose chunks can start anywhere) must be counted exactly.
+check_parallel -c 4 -i RP "$(gadget nlogn/gadget_refresh_4_shares.sage)"
+check_parallel -c 3 -i RP "$(gadget Crypto2020_Gadgets/gadget_mult_1_o2.sage)"
+check_parallel -c 2 -t 1 -i RPC "$(gadget Crypto2020_Gadgets/gadget_mult_1_o2.sage)"
+
+# Share symmetries (--symmetries): the failures counted once per orbit
+# must give the same coefficients as the plain enumeration (add_4 has
+# symmetries, copy_3 has none).
+for g in nlogn/gadget_add_4_shares.sage ISW/copy/gadget_copy_3_shares.sage; do
+  check "RP -c 6 --symmetries $g" "$(coeffs -c 6 RP "$(gadget $g)")" \
+        "$(coeffs -c 6 --symmetries RP "$(gadget $g)")"
+done
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]